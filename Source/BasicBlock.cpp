@@ -1,7 +1,9 @@
 #include "BasicBlock.h"
+#include "InterpretedBlock.h"
 #include "MemStream.h"
 #include "offsetof_def.h"
 #include "MipsJitter.h"
+#include "MIPSAnalysis.h"
 #include "Jitter_CodeGenFactory.h"
 
 #if defined(AOT_BUILD_CACHE) || defined(AOT_USE_CACHE)
@@ -78,11 +80,8 @@ void CBasicBlock::Compile()
 
 	Framework::CMemStream stream;
 	{
-		static
-#ifdef AOT_BUILD_CACHE
-		    __declspec(thread)
-#endif
-		        CMipsJitter* jitter = nullptr;
+		//Blocks can be compiled from several threads (IOP thread, precompile worker)
+		static thread_local CMipsJitter* jitter = nullptr;
 		if(jitter == nullptr)
 		{
 			Jitter::CCodeGen* codeGen = Jitter::CreateCodeGen();
@@ -197,6 +196,8 @@ void CBasicBlock::CompileRange(CMipsJitter* jitter)
 		return;
 	}
 
+	m_isIdleLoop = CMIPSAnalysis::IsIdleLoop(&m_context, m_begin, m_end);
+
 	CompileProlog(jitter);
 
 	for(uint32 address = m_begin; address <= m_end; address += 4)
@@ -261,6 +262,13 @@ void CBasicBlock::CompileEpilog(CMipsJitter* jitter)
 		jitter->PushCst(MIPS_INVALID_PC);
 		jitter->PullRel(offsetof(CMIPS, m_State.nDelayedJumpAddr));
 
+		if(m_isIdleLoop)
+		{
+			//Only branch in an idle loop goes back to the beginning of the block
+			jitter->PushCtx();
+			jitter->Call(reinterpret_cast<void*>(&IdleLoopHandler), 1, Jitter::CJitter::RETURN_VALUE_NONE);
+		}
+
 #ifndef AOT_BUILD_CACHE
 		jitter->PushRel(offsetof(CMIPS, m_State.nHasException));
 		jitter->PushCst(0);
@@ -291,6 +299,13 @@ void CBasicBlock::CompileEpilog(CMipsJitter* jitter)
 
 void CBasicBlock::Execute()
 {
+	//Dispatch on block type instead of using a virtual call, compiled blocks are the common case
+	if(m_type == BLOCK_TYPE_INTERPRETED)
+	{
+		static_cast<CInterpretedBlock*>(this)->Interpret();
+		return;
+	}
+
 	m_function(&m_context);
 
 	assert(m_context.m_State.nGPR[0].nV0 == 0);
@@ -305,6 +320,11 @@ void CBasicBlock::Execute()
 	assert(m_context.m_State.nCOP2VI[0] == 0);
 }
 
+CBasicBlock::BLOCK_TYPE CBasicBlock::GetType() const
+{
+	return m_type;
+}
+
 uint32 CBasicBlock::GetBeginAddress() const
 {
 	return m_begin;
@@ -330,6 +350,11 @@ bool CBasicBlock::IsEmpty() const
 	       (m_end == MIPS_INVALID_PC);
 }
 
+bool CBasicBlock::IsIdleLoop() const
+{
+	return m_isIdleLoop;
+}
+
 uint32 CBasicBlock::GetRecycleCount() const
 {
 	return m_recycleCount;
@@ -405,6 +430,11 @@ void CBasicBlock::HandleExternalFunctionReference(uintptr_t symbol, uint32 offse
 	}
 }
 
+void CBasicBlock::IdleLoopHandler(CMIPS* context)
+{
+	context->m_executor->NotifyIdleLoop();
+}
+
 #ifdef DEBUGGER_INCLUDED
 
 bool CBasicBlock::HasBreakpoint() const
@@ -72,16 +72,24 @@ typedef BlockOutLinkMap::iterator BlockOutLinkPointer;
 class CBasicBlock
 {
 public:
+	enum BLOCK_TYPE
+	{
+		BLOCK_TYPE_COMPILED,
+		BLOCK_TYPE_INTERPRETED,
+	};
+
 	CBasicBlock(CMIPS&, uint32 = MIPS_INVALID_PC, uint32 = MIPS_INVALID_PC);
 	virtual ~CBasicBlock() = default;
 	void Execute();
 	void Compile();
 	virtual void CompileRange(CMipsJitter*);
 
+	BLOCK_TYPE GetType() const;
 	uint32 GetBeginAddress() const;
 	uint32 GetEndAddress() const;
 	bool IsCompiled() const;
 	bool IsEmpty() const;
+	bool IsIdleLoop() const;
 
 	uint32 GetRecycleCount() const;
 	void SetRecycleCount(uint32);
@@ -100,6 +108,8 @@ protected:
 	uint32 m_begin;
 	uint32 m_end;
 	CMIPS& m_context;
+	BLOCK_TYPE m_type = BLOCK_TYPE_COMPILED;
+	bool m_isIdleLoop = false;
 
 	void CompileProlog(CMipsJitter*);
 	void CompileEpilog(CMipsJitter*);
@@ -107,6 +117,8 @@ protected:
 private:
 	void HandleExternalFunctionReference(uintptr_t, uint32, Jitter::CCodeGen::SYMBOL_REF_TYPE);
 
+	static void IdleLoopHandler(CMIPS*);
+
 #ifdef DEBUGGER_INCLUDED
 	bool HasBreakpoint() const;
 	static uint32 BreakpointFilter(CMIPS*);
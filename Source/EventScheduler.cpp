@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cassert>
+#include "EventScheduler.h"
+
+CEventScheduler::EventId CEventScheduler::RegisterEvent(EventHandler handler)
+{
+	EVENT event;
+	event.handler = std::move(handler);
+	m_events.push_back(std::move(event));
+	return static_cast<EventId>(m_events.size() - 1);
+}
+
+void CEventScheduler::Reset()
+{
+	for(auto& event : m_events)
+	{
+		event.time = 0;
+		event.scheduled = false;
+		event.generation++;
+	}
+	m_queue.clear();
+	m_currentTime = 0;
+}
+
+//Schedules an event to occur 'delay' ticks from now. Replaces any previous occurence of the same event.
+void CEventScheduler::Schedule(EventId id, uint64 delay)
+{
+	Enqueue(id, m_currentTime + delay);
+}
+
+//Schedules an event to occur 'period' ticks after the time it was last due. Used by periodic
+//events, time slices overshooting the due time don't accumulate into drift this way.
+void CEventScheduler::ScheduleNext(EventId id, uint64 period)
+{
+	assert(id < m_events.size());
+	Enqueue(id, m_events[id].time + period);
+}
+
+void CEventScheduler::Cancel(EventId id)
+{
+	assert(id < m_events.size());
+	auto& event = m_events[id];
+	//Entry stays in the queue, but will be ignored since its generation doesn't match anymore
+	event.generation++;
+	event.scheduled = false;
+	DiscardStaleEntries();
+}
+
+bool CEventScheduler::IsScheduled(EventId id) const
+{
+	assert(id < m_events.size());
+	return m_events[id].scheduled;
+}
+
+uint64 CEventScheduler::GetCurrentTime() const
+{
+	return m_currentTime;
+}
+
+uint64 CEventScheduler::GetTicksUntilNextEvent() const
+{
+	if(m_queue.empty()) return NO_EVENT;
+	const auto& entry = m_queue.front();
+	return (entry.time > m_currentTime) ? (entry.time - m_currentTime) : 0;
+}
+
+void CEventScheduler::AdvanceTime(uint64 ticks)
+{
+	m_currentTime += ticks;
+}
+
+void CEventScheduler::ProcessEvents()
+{
+	while(!m_queue.empty())
+	{
+		auto entry = m_queue.front();
+		if(entry.time > m_currentTime) break;
+		std::pop_heap(m_queue.begin(), m_queue.end());
+		m_queue.pop_back();
+
+		auto& event = m_events[entry.id];
+		if(event.generation != entry.generation) continue;
+		event.scheduled = false;
+		//Handler is allowed to schedule the event again
+		event.handler();
+	}
+	DiscardStaleEntries();
+}
+
+void CEventScheduler::Enqueue(EventId id, uint64 time)
+{
+	assert(id < m_events.size());
+	auto& event = m_events[id];
+	event.generation++;
+	event.time = time;
+	event.scheduled = true;
+
+	QUEUE_ENTRY entry;
+	entry.time = event.time;
+	entry.id = id;
+	entry.generation = event.generation;
+	m_queue.push_back(entry);
+	std::push_heap(m_queue.begin(), m_queue.end());
+}
+
+void CEventScheduler::DiscardStaleEntries()
+{
+	while(!m_queue.empty())
+	{
+		const auto& entry = m_queue.front();
+		if(m_events[entry.id].generation == entry.generation) break;
+		std::pop_heap(m_queue.begin(), m_queue.end());
+		m_queue.pop_back();
+	}
+}
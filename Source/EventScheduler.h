@@ -0,0 +1,67 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "Types.h"
+
+//Keeps track of timed events on a single time base (ie.: EE clock ticks).
+//
+//Owner advances time as the machine executes and calls ProcessEvents to fire everything
+//that is due. GetTicksUntilNextEvent tells how far execution can go before something needs
+//to happen, allowing the owner to adapt its time slices instead of polling at fixed intervals.
+
+class CEventScheduler
+{
+public:
+	typedef std::function<void()> EventHandler;
+	typedef uint32 EventId;
+
+	enum : uint64
+	{
+		NO_EVENT = ~0ULL,
+	};
+
+	EventId RegisterEvent(EventHandler);
+
+	void Reset();
+
+	void Schedule(EventId, uint64);
+	void ScheduleNext(EventId, uint64);
+	void Cancel(EventId);
+	bool IsScheduled(EventId) const;
+
+	uint64 GetCurrentTime() const;
+	uint64 GetTicksUntilNextEvent() const;
+
+	void AdvanceTime(uint64);
+	void ProcessEvents();
+
+private:
+	struct EVENT
+	{
+		EventHandler handler;
+		uint64 time = 0;
+		uint32 generation = 0;
+		bool scheduled = false;
+	};
+
+	struct QUEUE_ENTRY
+	{
+		uint64 time;
+		EventId id;
+		uint32 generation;
+
+		//std::push_heap builds a max heap, reverse order to get the earliest event on top
+		bool operator<(const QUEUE_ENTRY& rhs) const
+		{
+			return time > rhs.time;
+		}
+	};
+
+	void Enqueue(EventId, uint64);
+	void DiscardStaleEntries();
+
+	std::vector<EVENT> m_events;
+	std::vector<QUEUE_ENTRY> m_queue;
+	uint64 m_currentTime = 0;
+};
@@ -0,0 +1,122 @@
+#include "FastMemWindow.h"
+#include <cassert>
+#include <cstdio>
+#include <atomic>
+#include <stdexcept>
+#include "Log.h"
+
+#if defined(__APPLE__)
+#include <TargetConditionals.h>
+#endif
+
+#if !defined(_WIN32) && !defined(__ANDROID__) && !(defined(__APPLE__) && TARGET_OS_IPHONE)
+#define HAS_FASTMEM_WINDOW
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define LOG_NAME ("fastmem")
+
+CFastMemWindow::~CFastMemWindow()
+{
+#ifdef HAS_FASTMEM_WINDOW
+	if(m_base)
+	{
+		munmap(m_base, WINDOW_SIZE);
+	}
+	if(m_backing)
+	{
+		munmap(m_backing, m_backingSize);
+	}
+	if(m_fd != -1)
+	{
+		close(m_fd);
+	}
+#endif
+}
+
+std::unique_ptr<CFastMemWindow> CFastMemWindow::Create(uint32 backingSize)
+{
+	if(sizeof(void*) != 8) return std::unique_ptr<CFastMemWindow>();
+
+	auto window = std::unique_ptr<CFastMemWindow>(new CFastMemWindow());
+	if(!window->Initialize(backingSize))
+	{
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to create fast memory window, falling back to page table.\r\n");
+		return std::unique_ptr<CFastMemWindow>();
+	}
+	return window;
+}
+
+bool CFastMemWindow::Initialize(uint32 backingSize)
+{
+#ifdef HAS_FASTMEM_WINDOW
+	m_pageSize = static_cast<uint32>(sysconf(_SC_PAGESIZE));
+	m_backingSize = (backingSize + m_pageSize - 1) & ~(m_pageSize - 1);
+
+	//Create an anonymous shared memory object, name is removed right away
+	{
+		static std::atomic<uint32> windowIndex(0);
+		char name[64];
+		snprintf(name, sizeof(name), "/play_fastmem_%d_%d", static_cast<int>(getpid()), static_cast<int>(windowIndex++));
+		m_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if(m_fd == -1) return false;
+		shm_unlink(name);
+	}
+
+	if(ftruncate(m_fd, m_backingSize) != 0) return false;
+
+	void* backing = mmap(nullptr, m_backingSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if(backing == MAP_FAILED) return false;
+	m_backing = reinterpret_cast<uint8*>(backing);
+
+	void* base = mmap(nullptr, WINDOW_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(base == MAP_FAILED) return false;
+	m_base = reinterpret_cast<uint8*>(base);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint8* CFastMemWindow::GetBase() const
+{
+	return m_base;
+}
+
+uint8* CFastMemWindow::AllocateBacking(uint32 size)
+{
+	uint32 allocSize = (size + m_pageSize - 1) & ~(m_pageSize - 1);
+	if((m_backingUsed + allocSize) > m_backingSize)
+	{
+		throw std::runtime_error("Fast memory window backing is exhausted.");
+	}
+	auto result = m_backing + m_backingUsed;
+	m_backingUsed += allocSize;
+	return result;
+}
+
+//Maps 'size' bytes of backing memory (must come from AllocateBacking) at the specified guest address.
+bool CFastMemWindow::Map(uint32 guestAddress, const uint8* memory, uint32 size)
+{
+#ifdef HAS_FASTMEM_WINDOW
+	assert((memory >= m_backing) && ((memory + size) <= (m_backing + m_backingSize)));
+	//Host pages might be bigger than the guest's (ie.: 16KB on Apple Silicon)
+	if((guestAddress % m_pageSize) != 0) return false;
+	if((size % m_pageSize) != 0) return false;
+	if((static_cast<uint64>(guestAddress) + size) > WINDOW_SIZE) return false;
+
+	auto offset = static_cast<off_t>(memory - m_backing);
+	void* result = mmap(m_base + guestAddress, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, m_fd, offset);
+	if(result == MAP_FAILED)
+	{
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to map 0x%08X bytes at 0x%08X.\r\n", size, guestAddress);
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
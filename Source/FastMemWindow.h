@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include "Types.h"
+
+//Host address space window mirroring a guest CPU's directly accessible memory.
+//
+//Guest memory (RAM, scratchpad) is allocated from a shared memory object and the same
+//pages are mapped a second time at (window base + guest address). Generated code can then
+//access guest memory with a single base + offset computation. Everything that isn't mapped
+//(hardware registers, unused ranges) stays reserved and inaccessible.
+
+class CFastMemWindow
+{
+public:
+	enum
+	{
+		//Only the lower 2GB of the guest address space is mirrored, upper half
+		//is a mirror of the lower one on both EE (kseg0/kseg1) and IOP
+		WINDOW_SIZE = 0x80000000U,
+		WINDOW_MASK = WINDOW_SIZE - 1,
+	};
+
+	virtual ~CFastMemWindow();
+
+	//Returns nullptr if host doesn't support this or if reservation fails
+	static std::unique_ptr<CFastMemWindow> Create(uint32);
+
+	uint8* GetBase() const;
+
+	uint8* AllocateBacking(uint32);
+	bool Map(uint32, const uint8*, uint32);
+
+private:
+	CFastMemWindow() = default;
+
+	bool Initialize(uint32);
+
+	uint8* m_base = nullptr;
+	uint8* m_backing = nullptr;
+	uint32 m_backingSize = 0;
+	uint32 m_backingUsed = 0;
+	uint32 m_pageSize = 0;
+	int m_fd = -1;
+};
@@ -0,0 +1,625 @@
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <stdexcept>
+#include <zlib.h>
+#include "FrameDumpStream.h"
+#include "Log.h"
+
+#define LOG_NAME ("framedumpstream")
+
+using namespace FrameDumpStream;
+
+static void AppendData(std::vector<uint8>& output, const void* data, size_t size)
+{
+	auto bytes = reinterpret_cast<const uint8*>(data);
+	output.insert(output.end(), bytes, bytes + size);
+}
+
+CFrameDumpStreamWriter::CFrameDumpStreamWriter(std::unique_ptr<Framework::CStream> stream, uint32 keyFrameInterval)
+    : m_stream(std::move(stream))
+    , m_keyFrameInterval(std::max<uint32>(keyFrameInterval, 1))
+{
+	FILEHEADER header = {};
+	header.magic = FILE_MAGIC;
+	header.version = FILE_VERSION;
+	header.keyFrameInterval = m_keyFrameInterval;
+	header.metadataSize = sizeof(CGsPacketMetadata);
+	m_stream->Write(&header, sizeof(FILEHEADER));
+
+	m_packetChunk.reserve(PACKET_CHUNK_FLUSH_SIZE);
+	m_writeThread = std::thread([this]() { WriteThreadProc(); });
+}
+
+CFrameDumpStreamWriter::~CFrameDumpStreamWriter()
+{
+	Finish();
+}
+
+void CFrameDumpStreamWriter::AddRegisterPacket(const CGSHandler::RegisterWrite* registerWrites, uint32 count, const CGsPacketMetadata* metadata)
+{
+	if(!m_frameStarted) return;
+	CGsPacketMetadata packetMetadata;
+	if(metadata)
+	{
+		packetMetadata = *metadata;
+	}
+	WriteRecordHeader(RECORD_TYPE_REGISTERS, count);
+	AppendData(m_packetChunk, &packetMetadata, sizeof(CGsPacketMetadata));
+	AppendData(m_packetChunk, registerWrites, sizeof(CGSHandler::RegisterWrite) * count);
+	{
+		std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+		m_stats.packetCount++;
+	}
+	if(m_packetChunk.size() >= PACKET_CHUNK_FLUSH_SIZE)
+	{
+		FlushPacketChunk();
+	}
+}
+
+void CFrameDumpStreamWriter::AddImagePacket(const uint8* imageData, uint32 size)
+{
+	if(!m_frameStarted) return;
+	{
+		std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+		m_stats.packetCount++;
+		m_stats.imageBytes += size;
+	}
+	if(size < IMAGE_DEDUP_MIN_SIZE)
+	{
+		WriteRecordHeader(RECORD_TYPE_IMAGE, size);
+		AppendData(m_packetChunk, imageData, size);
+	}
+	else
+	{
+		auto crc = static_cast<uint32>(crc32(0, imageData, size));
+		auto adler = static_cast<uint32>(adler32(1, imageData, size));
+		auto imageKey = std::make_tuple(crc, adler, size);
+		uint32 imageId = FindImage(imageKey, imageData, size);
+		if(imageId == ~0U)
+		{
+			imageId = m_nextImageId++;
+			RememberImage(imageKey, imageId, imageData, size);
+			QueueChunk(CHUNK_TYPE_IMAGE, imageId, ChunkData(imageData, imageData + size));
+		}
+		else
+		{
+			std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+			m_stats.dedupedImageBytes += size;
+		}
+		WriteRecordHeader(RECORD_TYPE_IMAGE_REF, imageId);
+	}
+	if(m_packetChunk.size() >= PACKET_CHUNK_FLUSH_SIZE)
+	{
+		FlushPacketChunk();
+	}
+}
+
+bool CFrameDumpStreamWriter::AddVSync()
+{
+	assert(!m_finished);
+	if(m_frameStarted)
+	{
+		WriteRecordHeader(RECORD_TYPE_VSYNC, 0);
+		FlushPacketChunk();
+		m_currentFrame++;
+	}
+	m_frameStarted = true;
+	return (m_currentFrame % m_keyFrameInterval) == 0;
+}
+
+//GS state must be the one obtained after processing every packet added before the last VSync
+void CFrameDumpStreamWriter::AddKeyFrame(const uint8* gsRam, const uint64* gsRegisters, uint64 smode2)
+{
+	assert(m_frameStarted);
+	assert(m_packetChunk.empty());
+	ChunkData keyFrame;
+	keyFrame.reserve(CGSHandler::RAMSIZE + (sizeof(uint64) * CGSHandler::REGISTER_MAX) + sizeof(uint64));
+	AppendData(keyFrame, gsRam, CGSHandler::RAMSIZE);
+	AppendData(keyFrame, gsRegisters, sizeof(uint64) * CGSHandler::REGISTER_MAX);
+	AppendData(keyFrame, &smode2, sizeof(uint64));
+	QueueChunk(CHUNK_TYPE_KEYFRAME, m_currentFrame, std::move(keyFrame));
+}
+
+void CFrameDumpStreamWriter::Finish()
+{
+	if(m_finished) return;
+	m_finished = true;
+
+	if(m_frameStarted)
+	{
+		//Last frame is incomplete, it won't have a VSync record
+		FlushPacketChunk();
+	}
+
+	{
+		std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+		m_writeThreadDone = true;
+	}
+	m_pendingCondition.notify_all();
+	m_writeThread.join();
+
+	if(m_writeFailed)
+	{
+		//Index can be rebuilt from the chunks that made it to the file
+		m_stream.reset();
+		return;
+	}
+
+	ChunkData indexData;
+	uint32 frameCount = static_cast<uint32>(m_index.frameOffsets.size());
+	uint32 keyFrameCount = static_cast<uint32>(m_index.keyFrameOffsets.size());
+	uint32 imageCount = static_cast<uint32>(m_index.imageOffsets.size());
+	AppendData(indexData, &frameCount, sizeof(uint32));
+	AppendData(indexData, &keyFrameCount, sizeof(uint32));
+	AppendData(indexData, &imageCount, sizeof(uint32));
+	AppendData(indexData, m_index.frameOffsets.data(), sizeof(uint64) * frameCount);
+	for(const auto& keyFramePair : m_index.keyFrameOffsets)
+	{
+		uint64 keyFrame = keyFramePair.first;
+		AppendData(indexData, &keyFrame, sizeof(uint64));
+		AppendData(indexData, &keyFramePair.second, sizeof(uint64));
+	}
+	AppendData(indexData, m_index.imageOffsets.data(), sizeof(uint64) * imageCount);
+
+	FOOTER footer = {};
+	footer.indexOffset = m_stream->Tell();
+	footer.magic = FOOTER_MAGIC;
+
+	PENDING_CHUNK indexChunk;
+	indexChunk.type = CHUNK_TYPE_INDEX;
+	indexChunk.id = 0;
+	indexChunk.data = std::move(indexData);
+	try
+	{
+		WriteChunk(indexChunk);
+		m_stream->Write(&footer, sizeof(FOOTER));
+	}
+	catch(const std::exception& exception)
+	{
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to write frame dump stream index: %s\r\n", exception.what());
+	}
+	m_stream.reset();
+}
+
+CFrameDumpStreamWriter::STATS CFrameDumpStreamWriter::GetStats() const
+{
+	std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+	auto stats = m_stats;
+	stats.frameCount = m_currentFrame + (m_frameStarted ? 1 : 0);
+	return stats;
+}
+
+void CFrameDumpStreamWriter::WriteRecordHeader(RECORD_TYPE type, uint32 param)
+{
+	uint32 header[2] = {type, param};
+	AppendData(m_packetChunk, header, sizeof(header));
+}
+
+void CFrameDumpStreamWriter::FlushPacketChunk()
+{
+	if(m_packetChunk.empty()) return;
+	ChunkData packetChunk;
+	packetChunk.reserve(PACKET_CHUNK_FLUSH_SIZE);
+	std::swap(packetChunk, m_packetChunk);
+	QueueChunk(CHUNK_TYPE_PACKETS, m_currentFrame, std::move(packetChunk));
+}
+
+void CFrameDumpStreamWriter::QueueChunk(CHUNK_TYPE type, uint32 id, ChunkData data)
+{
+	std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+	//Apply back pressure if the write thread can't keep up
+	m_pendingCondition.wait(pendingLock, [this]() { return m_pendingBytes < MAX_PENDING_BYTES; });
+	m_pendingBytes += data.size();
+	PENDING_CHUNK chunk;
+	chunk.type = type;
+	chunk.id = id;
+	chunk.data = std::move(data);
+	m_pendingChunks.push_back(std::move(chunk));
+	m_pendingCondition.notify_all();
+}
+
+void CFrameDumpStreamWriter::WriteThreadProc()
+{
+	while(1)
+	{
+		PENDING_CHUNK chunk;
+		{
+			std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+			m_pendingCondition.wait(pendingLock, [this]() { return !m_pendingChunks.empty() || m_writeThreadDone; });
+			if(m_pendingChunks.empty())
+			{
+				assert(m_writeThreadDone);
+				break;
+			}
+			chunk = std::move(m_pendingChunks.front());
+			m_pendingChunks.pop_front();
+		}
+
+		//Once writing failed, chunks are only drained to release the producer
+		if(!m_writeFailed)
+		{
+			try
+			{
+				uint64 chunkOffset = m_stream->Tell();
+				WriteChunk(chunk);
+				switch(chunk.type)
+				{
+				case CHUNK_TYPE_KEYFRAME:
+					m_index.keyFrameOffsets[chunk.id] = chunkOffset;
+					break;
+				case CHUNK_TYPE_PACKETS:
+					if(chunk.id == m_index.frameOffsets.size())
+					{
+						m_index.frameOffsets.push_back(chunkOffset);
+					}
+					break;
+				case CHUNK_TYPE_IMAGE:
+					assert(chunk.id == m_index.imageOffsets.size());
+					m_index.imageOffsets.push_back(chunkOffset);
+					break;
+				default:
+					assert(false);
+					break;
+				}
+			}
+			catch(const std::exception& exception)
+			{
+				CLog::GetInstance().Warn(LOG_NAME, "Failed to write frame dump stream chunk, capture stopped: %s\r\n", exception.what());
+				m_writeFailed = true;
+			}
+		}
+
+		{
+			std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+			m_pendingBytes -= chunk.data.size();
+			if(chunk.type == CHUNK_TYPE_KEYFRAME)
+			{
+				m_stats.keyFrameCount++;
+			}
+		}
+		m_pendingCondition.notify_all();
+	}
+}
+
+void CFrameDumpStreamWriter::WriteChunk(const PENDING_CHUNK& chunk)
+{
+	uLongf compressedSize = compressBound(static_cast<uLong>(chunk.data.size()));
+	ChunkData compressedData(compressedSize);
+	int result = compress2(compressedData.data(), &compressedSize, chunk.data.data(), static_cast<uLong>(chunk.data.size()), Z_BEST_SPEED);
+	if(result != Z_OK)
+	{
+		throw std::runtime_error("Failed to compress frame dump chunk.");
+	}
+
+	CHUNKHEADER header = {};
+	header.type = chunk.type;
+	header.id = chunk.id;
+	header.compressedSize = static_cast<uint32>(compressedSize);
+	header.uncompressedSize = static_cast<uint32>(chunk.data.size());
+	m_stream->Write(&header, sizeof(CHUNKHEADER));
+	m_stream->Write(compressedData.data(), compressedSize);
+
+	std::unique_lock<std::mutex> pendingLock(m_pendingMutex);
+	m_stats.compressedBytes += sizeof(CHUNKHEADER) + compressedSize;
+}
+
+//Returns ~0 if no identical image was stored before
+uint32 CFrameDumpStreamWriter::FindImage(const ImageKey& imageKey, const uint8* imageData, uint32 size) const
+{
+	auto imageIterator = m_images.find(imageKey);
+	if(imageIterator == std::end(m_images)) return ~0U;
+	const auto& image = imageIterator->second;
+	//Hashes can collide
+	if(memcmp(image.data.data(), imageData, size) != 0) return ~0U;
+	return image.id;
+}
+
+void CFrameDumpStreamWriter::RememberImage(const ImageKey& imageKey, uint32 imageId, const uint8* imageData, uint32 size)
+{
+	//If an image with the same key is already there, it's a collision. Keep the first one.
+	if(m_images.find(imageKey) != std::end(m_images)) return;
+	while(!m_imageAges.empty() && ((m_imageBytes + size) > IMAGE_DEDUP_MAX_BYTES))
+	{
+		auto imageIterator = m_images.find(m_imageAges.front());
+		assert(imageIterator != std::end(m_images));
+		m_imageBytes -= imageIterator->second.data.size();
+		m_images.erase(imageIterator);
+		m_imageAges.pop_front();
+	}
+	IMAGE_ENTRY image;
+	image.id = imageId;
+	image.data = ChunkData(imageData, imageData + size);
+	m_images.insert(std::make_pair(imageKey, std::move(image)));
+	m_imageAges.push_back(imageKey);
+	m_imageBytes += size;
+}
+
+CFrameDumpStreamReader::CFrameDumpStreamReader(std::unique_ptr<Framework::CStream> stream)
+    : m_stream(std::move(stream))
+{
+	m_stream->Seek(0, Framework::STREAM_SEEK_SET);
+	if(m_stream->Read(&m_header, sizeof(FILEHEADER)) != sizeof(FILEHEADER))
+	{
+		throw std::runtime_error("Could not read frame dump stream header.");
+	}
+	if(m_header.magic != FILE_MAGIC)
+	{
+		throw std::runtime_error("Not a valid frame dump stream.");
+	}
+	if(m_header.version != FILE_VERSION)
+	{
+		throw std::runtime_error("Unsupported frame dump stream version.");
+	}
+	if(m_header.metadataSize != sizeof(CGsPacketMetadata))
+	{
+		throw std::runtime_error("Frame dump stream packet metadata doesn't match this build.");
+	}
+	ReadIndex();
+}
+
+uint32 CFrameDumpStreamReader::GetFrameCount() const
+{
+	return static_cast<uint32>(m_index.frameOffsets.size());
+}
+
+uint32 CFrameDumpStreamReader::GetKeyFrameForFrame(uint32 frameIndex) const
+{
+	auto keyFrameIterator = m_index.keyFrameOffsets.upper_bound(frameIndex);
+	if(keyFrameIterator == std::begin(m_index.keyFrameOffsets))
+	{
+		throw std::runtime_error("No key frame available for frame.");
+	}
+	keyFrameIterator--;
+	return keyFrameIterator->first;
+}
+
+void CFrameDumpStreamReader::ReadFramePackets(uint32 frameIndex, CFrameDump::PacketArray& packets)
+{
+	if(frameIndex >= GetFrameCount())
+	{
+		throw std::runtime_error("Frame index out of range.");
+	}
+
+	ChunkData chunkData;
+	uint64 chunkOffset = m_index.frameOffsets[frameIndex];
+	uint64 streamLength = m_stream->GetLength();
+	while(chunkOffset < streamLength)
+	{
+		auto chunkHeader = ReadChunk(chunkOffset, chunkData);
+		chunkOffset += sizeof(CHUNKHEADER) + chunkHeader.compressedSize;
+		if(chunkHeader.type == CHUNK_TYPE_INDEX) break;
+		if(chunkHeader.type != CHUNK_TYPE_PACKETS) continue;
+		if(chunkHeader.id != frameIndex) break;
+
+		size_t position = 0;
+		//Returns the next 'size' bytes of the chunk, records must not go past its end
+		auto readRecordData =
+		    [&chunkData, &position](uint64 size) {
+			    if(size > (chunkData.size() - position))
+			    {
+				    throw std::runtime_error("Truncated record in frame dump stream.");
+			    }
+			    auto data = chunkData.data() + position;
+			    position += static_cast<size_t>(size);
+			    return data;
+		    };
+		while(position < chunkData.size())
+		{
+			uint32 recordHeader[2];
+			memcpy(recordHeader, readRecordData(sizeof(recordHeader)), sizeof(recordHeader));
+			uint32 recordParam = recordHeader[1];
+			switch(recordHeader[0])
+			{
+			case RECORD_TYPE_REGISTERS:
+			{
+				CGsPacket packet;
+				memcpy(&packet.metadata, readRecordData(sizeof(CGsPacketMetadata)), sizeof(CGsPacketMetadata));
+				auto registerWrites = reinterpret_cast<const CGSHandler::RegisterWrite*>(readRecordData(static_cast<uint64>(sizeof(CGSHandler::RegisterWrite)) * recordParam));
+				packet.registerWrites = CGsPacket::RegisterWriteArray(registerWrites, registerWrites + recordParam);
+				packets.push_back(std::move(packet));
+			}
+			break;
+			case RECORD_TYPE_IMAGE:
+			{
+				CGsPacket packet;
+				auto imageData = readRecordData(recordParam);
+				packet.imageData = CGsPacket::ImageDataArray(imageData, imageData + recordParam);
+				packets.push_back(std::move(packet));
+			}
+			break;
+			case RECORD_TYPE_IMAGE_REF:
+			{
+				CGsPacket packet;
+				ReadImage(recordParam, packet.imageData);
+				packets.push_back(std::move(packet));
+			}
+			break;
+			case RECORD_TYPE_VSYNC:
+				return;
+			default:
+				throw std::runtime_error("Invalid record in frame dump stream.");
+			}
+		}
+	}
+}
+
+void CFrameDumpStreamReader::ReadFrame(uint32 frameIndex, CFrameDump& frameDump)
+{
+	//Frame dump will contain the state of the closest key frame and all the packets
+	//from that key frame up to the requested frame (inclusive)
+	uint32 keyFrameIndex = GetKeyFrameForFrame(frameIndex);
+	ReadKeyFrame(keyFrameIndex, frameDump);
+	CFrameDump::PacketArray packets;
+	for(uint32 currentFrame = keyFrameIndex; currentFrame <= frameIndex; currentFrame++)
+	{
+		packets.clear();
+		ReadFramePackets(currentFrame, packets);
+		for(const auto& packet : packets)
+		{
+			if(!packet.imageData.empty())
+			{
+				frameDump.AddImagePacket(packet.imageData.data(), static_cast<uint32>(packet.imageData.size()));
+			}
+			else
+			{
+				frameDump.AddRegisterPacket(packet.registerWrites.data(), static_cast<uint32>(packet.registerWrites.size()), &packet.metadata);
+			}
+		}
+	}
+}
+
+void CFrameDumpStreamReader::ReadIndex()
+{
+	uint64 streamLength = m_stream->GetLength();
+	if(streamLength < (sizeof(FILEHEADER) + sizeof(FOOTER)))
+	{
+		RebuildIndex();
+		return;
+	}
+
+	FOOTER footer = {};
+	m_stream->Seek(streamLength - sizeof(FOOTER), Framework::STREAM_SEEK_SET);
+	m_stream->Read(&footer, sizeof(FOOTER));
+	if((footer.magic != FOOTER_MAGIC) || (footer.indexOffset >= streamLength))
+	{
+		RebuildIndex();
+		return;
+	}
+
+	ChunkData indexData;
+	auto indexHeader = ReadChunk(footer.indexOffset, indexData);
+	if((indexHeader.type != CHUNK_TYPE_INDEX) || (indexData.size() < (sizeof(uint32) * 3)))
+	{
+		RebuildIndex();
+		return;
+	}
+
+	uint32 counts[3];
+	memcpy(counts, indexData.data(), sizeof(counts));
+	uint32 frameCount = counts[0];
+	uint32 keyFrameCount = counts[1];
+	uint32 imageCount = counts[2];
+	size_t expectedSize = sizeof(counts) + (sizeof(uint64) * (frameCount + (keyFrameCount * 2) + imageCount));
+	if(indexData.size() != expectedSize)
+	{
+		RebuildIndex();
+		return;
+	}
+
+	auto offsets = reinterpret_cast<const uint64*>(indexData.data() + sizeof(counts));
+	m_index.frameOffsets.assign(offsets, offsets + frameCount);
+	offsets += frameCount;
+	for(uint32 i = 0; i < keyFrameCount; i++)
+	{
+		m_index.keyFrameOffsets[static_cast<uint32>(offsets[0])] = offsets[1];
+		offsets += 2;
+	}
+	m_index.imageOffsets.assign(offsets, offsets + imageCount);
+}
+
+void CFrameDumpStreamReader::RebuildIndex()
+{
+	m_index = INDEX();
+	uint64 streamLength = m_stream->GetLength();
+	uint64 chunkOffset = sizeof(FILEHEADER);
+	while((chunkOffset + sizeof(CHUNKHEADER)) <= streamLength)
+	{
+		CHUNKHEADER header = {};
+		m_stream->Seek(chunkOffset, Framework::STREAM_SEEK_SET);
+		m_stream->Read(&header, sizeof(CHUNKHEADER));
+		uint64 nextChunkOffset = chunkOffset + sizeof(CHUNKHEADER) + header.compressedSize;
+		//Stop at the first truncated chunk
+		if(nextChunkOffset > streamLength) break;
+		switch(header.type)
+		{
+		case CHUNK_TYPE_KEYFRAME:
+			m_index.keyFrameOffsets[header.id] = chunkOffset;
+			break;
+		case CHUNK_TYPE_PACKETS:
+			if(header.id == m_index.frameOffsets.size())
+			{
+				m_index.frameOffsets.push_back(chunkOffset);
+			}
+			break;
+		case CHUNK_TYPE_IMAGE:
+			if(header.id == m_index.imageOffsets.size())
+			{
+				m_index.imageOffsets.push_back(chunkOffset);
+			}
+			break;
+		}
+		if(header.type == CHUNK_TYPE_INDEX) break;
+		chunkOffset = nextChunkOffset;
+	}
+}
+
+CHUNKHEADER CFrameDumpStreamReader::ReadChunk(uint64 offset, ChunkData& data)
+{
+	CHUNKHEADER header = {};
+	m_stream->Seek(offset, Framework::STREAM_SEEK_SET);
+	if(m_stream->Read(&header, sizeof(CHUNKHEADER)) != sizeof(CHUNKHEADER))
+	{
+		throw std::runtime_error("Failed to read frame dump chunk header.");
+	}
+	//Sizes come from the file, make sure they make sense before allocating anything
+	uint64 dataOffset = offset + sizeof(CHUNKHEADER);
+	if((dataOffset > m_stream->GetLength()) || (header.compressedSize > (m_stream->GetLength() - dataOffset)))
+	{
+		throw std::runtime_error("Truncated chunk in frame dump stream.");
+	}
+	if(header.uncompressedSize > (static_cast<uint64>(header.compressedSize) * MAX_COMPRESSION_RATIO))
+	{
+		throw std::runtime_error("Invalid chunk size in frame dump stream.");
+	}
+
+	ChunkData compressedData(header.compressedSize);
+	if(m_stream->Read(compressedData.data(), header.compressedSize) != header.compressedSize)
+	{
+		throw std::runtime_error("Failed to read frame dump chunk.");
+	}
+
+	data.resize(header.uncompressedSize);
+	uLongf uncompressedSize = header.uncompressedSize;
+	int result = uncompress(data.data(), &uncompressedSize, compressedData.data(), header.compressedSize);
+	if((result != Z_OK) || (uncompressedSize != header.uncompressedSize))
+	{
+		throw std::runtime_error("Failed to decompress frame dump chunk.");
+	}
+
+	return header;
+}
+
+void CFrameDumpStreamReader::ReadKeyFrame(uint32 keyFrameIndex, CFrameDump& frameDump)
+{
+	auto keyFrameIterator = m_index.keyFrameOffsets.find(keyFrameIndex);
+	assert(keyFrameIterator != std::end(m_index.keyFrameOffsets));
+
+	ChunkData keyFrameData;
+	auto header = ReadChunk(keyFrameIterator->second, keyFrameData);
+	uint32 registersSize = sizeof(uint64) * CGSHandler::REGISTER_MAX;
+	if((header.type != CHUNK_TYPE_KEYFRAME) || (keyFrameData.size() != (CGSHandler::RAMSIZE + registersSize + sizeof(uint64))))
+	{
+		throw std::runtime_error("Invalid key frame in frame dump stream.");
+	}
+
+	frameDump.Reset();
+	memcpy(frameDump.GetInitialGsRam(), keyFrameData.data(), CGSHandler::RAMSIZE);
+	memcpy(frameDump.GetInitialGsRegisters(), keyFrameData.data() + CGSHandler::RAMSIZE, registersSize);
+	uint64 smode2 = 0;
+	memcpy(&smode2, keyFrameData.data() + CGSHandler::RAMSIZE + registersSize, sizeof(uint64));
+	frameDump.SetInitialSMODE2(smode2);
+}
+
+void CFrameDumpStreamReader::ReadImage(uint32 imageId, CGsPacket::ImageDataArray& imageData)
+{
+	if(imageId >= m_index.imageOffsets.size())
+	{
+		throw std::runtime_error("Invalid image reference in frame dump stream.");
+	}
+	auto header = ReadChunk(m_index.imageOffsets[imageId], imageData);
+	if(header.type != CHUNK_TYPE_IMAGE)
+	{
+		throw std::runtime_error("Invalid image chunk in frame dump stream.");
+	}
+}
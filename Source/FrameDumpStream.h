@@ -0,0 +1,205 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <tuple>
+#include "Types.h"
+#include "Stream.h"
+#include "FrameDump.h"
+
+//Streaming capture format for long GS sequences.
+//
+//The stream is made of compressed chunks. Each frame (delimited by VSync) starts on a chunk
+//boundary and a key frame (GS RAM + registers) is stored every few frames. Image data
+//that is uploaded more than once is only stored once, in its own chunk, and referenced by id.
+//An index is appended when the capture is finished, allowing random access to any frame.
+//If the index is missing (ie.: capture was interrupted), it is rebuilt by scanning chunks.
+
+namespace FrameDumpStream
+{
+	enum
+	{
+		FILE_MAGIC = 0x53444650, //'PFDS'
+		FILE_VERSION = 1,
+		FOOTER_MAGIC = 0x58444950, //'PIDX'
+	};
+
+	enum CHUNK_TYPE : uint32
+	{
+		CHUNK_TYPE_KEYFRAME = 1,
+		CHUNK_TYPE_PACKETS = 2,
+		CHUNK_TYPE_IMAGE = 3,
+		CHUNK_TYPE_INDEX = 4,
+	};
+
+	enum RECORD_TYPE : uint32
+	{
+		RECORD_TYPE_REGISTERS = 1,
+		RECORD_TYPE_IMAGE = 2,
+		RECORD_TYPE_IMAGE_REF = 3,
+		RECORD_TYPE_VSYNC = 4,
+	};
+
+	struct FILEHEADER
+	{
+		uint32 magic;
+		uint32 version;
+		uint32 keyFrameInterval;
+		uint32 metadataSize;
+	};
+	static_assert(sizeof(FILEHEADER) == 0x10, "Size of FILEHEADER must be 16 bytes.");
+
+	struct CHUNKHEADER
+	{
+		uint32 type;
+		uint32 id;
+		uint32 compressedSize;
+		uint32 uncompressedSize;
+	};
+	static_assert(sizeof(CHUNKHEADER) == 0x10, "Size of CHUNKHEADER must be 16 bytes.");
+
+	struct FOOTER
+	{
+		uint64 indexOffset;
+		uint32 magic;
+		uint32 reserved;
+	};
+	static_assert(sizeof(FOOTER) == 0x10, "Size of FOOTER must be 16 bytes.");
+
+	struct INDEX
+	{
+		//Offset of the first chunk of every frame
+		std::vector<uint64> frameOffsets;
+		//Frame index -> Offset of key frame chunk
+		std::map<uint32, uint64> keyFrameOffsets;
+		//Image id -> Offset of image chunk
+		std::vector<uint64> imageOffsets;
+	};
+}
+
+class CFrameDumpStreamWriter
+{
+public:
+	struct STATS
+	{
+		uint32 frameCount = 0;
+		uint32 keyFrameCount = 0;
+		uint32 packetCount = 0;
+		uint64 imageBytes = 0;
+		uint64 dedupedImageBytes = 0;
+		uint64 compressedBytes = 0;
+	};
+
+	enum
+	{
+		DEFAULT_KEYFRAME_INTERVAL = 60,
+	};
+
+	CFrameDumpStreamWriter(std::unique_ptr<Framework::CStream>, uint32 = DEFAULT_KEYFRAME_INTERVAL);
+	virtual ~CFrameDumpStreamWriter();
+
+	//All of these need to be called from the thread that sends packets to the GS (EE thread)
+	void AddRegisterPacket(const CGSHandler::RegisterWrite*, uint32, const CGsPacketMetadata*);
+	void AddImagePacket(const uint8*, uint32);
+	//Ends the current frame and starts a new one. Returns true if the new frame needs a key frame.
+	bool AddVSync();
+	void AddKeyFrame(const uint8*, const uint64*, uint64);
+
+	void Finish();
+
+	STATS GetStats() const;
+
+private:
+	typedef std::vector<uint8> ChunkData;
+	typedef std::tuple<uint32, uint32, uint32> ImageKey;
+
+	struct IMAGE_ENTRY
+	{
+		uint32 id = 0;
+		ChunkData data;
+	};
+	typedef std::map<ImageKey, IMAGE_ENTRY> ImageMap;
+
+	struct PENDING_CHUNK
+	{
+		FrameDumpStream::CHUNK_TYPE type;
+		uint32 id;
+		ChunkData data;
+	};
+
+	enum
+	{
+		PACKET_CHUNK_FLUSH_SIZE = 0x400000,
+		MAX_PENDING_BYTES = 0x4000000,
+		IMAGE_DEDUP_MIN_SIZE = 0x400,
+		//Images kept around to be compared with new ones, oldest ones are forgotten first
+		IMAGE_DEDUP_MAX_BYTES = 0x4000000,
+	};
+
+	void WriteRecordHeader(FrameDumpStream::RECORD_TYPE, uint32);
+	void FlushPacketChunk();
+	void QueueChunk(FrameDumpStream::CHUNK_TYPE, uint32, ChunkData);
+	void WriteThreadProc();
+	void WriteChunk(const PENDING_CHUNK&);
+	uint32 FindImage(const ImageKey&, const uint8*, uint32) const;
+	void RememberImage(const ImageKey&, uint32, const uint8*, uint32);
+
+	std::unique_ptr<Framework::CStream> m_stream;
+	uint32 m_keyFrameInterval = DEFAULT_KEYFRAME_INTERVAL;
+	bool m_finished = false;
+	bool m_frameStarted = false;
+	uint32 m_currentFrame = 0;
+	ChunkData m_packetChunk;
+	ImageMap m_images;
+	std::deque<ImageKey> m_imageAges;
+	uint64 m_imageBytes = 0;
+	uint32 m_nextImageId = 0;
+
+	//Shared with the write thread
+	mutable std::mutex m_pendingMutex;
+	std::condition_variable m_pendingCondition;
+	std::deque<PENDING_CHUNK> m_pendingChunks;
+	uint64 m_pendingBytes = 0;
+	bool m_writeThreadDone = false;
+	bool m_writeFailed = false;
+	FrameDumpStream::INDEX m_index;
+	STATS m_stats;
+
+	std::thread m_writeThread;
+};
+
+class CFrameDumpStreamReader
+{
+public:
+	CFrameDumpStreamReader(std::unique_ptr<Framework::CStream>);
+	virtual ~CFrameDumpStreamReader() = default;
+
+	uint32 GetFrameCount() const;
+	uint32 GetKeyFrameForFrame(uint32) const;
+
+	void ReadFramePackets(uint32, CFrameDump::PacketArray&);
+	void ReadFrame(uint32, CFrameDump&);
+
+private:
+	typedef std::vector<uint8> ChunkData;
+
+	enum
+	{
+		//Best ratio zlib can achieve, chunks claiming more than that are corrupted
+		MAX_COMPRESSION_RATIO = 1032,
+	};
+
+	void ReadIndex();
+	void RebuildIndex();
+	FrameDumpStream::CHUNKHEADER ReadChunk(uint64, ChunkData&);
+	void ReadKeyFrame(uint32, CFrameDump&);
+	void ReadImage(uint32, CGsPacket::ImageDataArray&);
+
+	std::unique_ptr<Framework::CStream> m_stream;
+	FrameDumpStream::FILEHEADER m_header = {};
+	FrameDumpStream::INDEX m_index;
+};
@@ -1,8 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
 #include "MIPS.h"
+#include "MIPSAnalysis.h"
 #include "BasicBlock.h"
+#include "InterpretedBlock.h"
+#include "ThreadPool.h"
 
 #include "BlockLookupOneWay.h"
 #include "BlockLookupTwoWay.h"
@@ -31,6 +39,11 @@ public:
 		RECYCLE_NOLINK_THRESHOLD = 16,
 	};
 
+	enum
+	{
+		PRECOMPILE_MAX_BLOCKS = 0x4000,
+	};
+
 	CGenericMipsExecutor(CMIPS& context, uint32 maxAddress)
 	    : m_emptyBlock(std::make_shared<CBasicBlock>(context, MIPS_INVALID_PC, MIPS_INVALID_PC))
 	    , m_context(context)
@@ -52,7 +65,12 @@ public:
 		    };
 	}
 
-	virtual ~CGenericMipsExecutor() = default;
+	virtual ~CGenericMipsExecutor()
+	{
+		//Pending jobs still hold their blocks, make sure they don't compile anything
+		DiscardPrecompiledBlocks();
+		m_precompileThreadPool.reset();
+	}
 
 	int Execute(int cycles) override
 	{
@@ -86,6 +104,7 @@ public:
 
 	void Reset() override
 	{
+		DiscardPrecompiledBlocks();
 		m_blockLookup.Clear();
 		m_blocks.clear();
 		m_blockOutLinks.clear();
@@ -99,9 +118,108 @@ public:
 			currentBlock = FindBlockStartingAt(m_context.m_State.nPC);
 			assert(!currentBlock->IsEmpty());
 		}
+		DiscardPrecompiledBlocksInRange(start, end);
 		ClearActiveBlocksInRangeInternal(start, end, currentBlock);
 	}
 
+	uint32 GetCompiledBlockCount() const override
+	{
+		return m_compiledBlockCount;
+	}
+
+	void SetExecutionMode(EXECUTION_MODE executionMode) override
+	{
+		//Interpreted blocks only support the MIPS IV instruction set
+		if(instructionSize != 4) return;
+		if(m_executionMode == executionMode) return;
+		m_executionMode = executionMode;
+		Reset();
+	}
+
+	EXECUTION_MODE GetExecutionMode() const override
+	{
+		return m_executionMode;
+	}
+
+	uint32 GetInterpretedBlockCount() const override
+	{
+		return m_interpretedBlockCount;
+	}
+
+	//Called by idle loop blocks when they're about to loop again. Remaining cycles
+	//are skipped since nothing will change until an external event occurs.
+	void NotifyIdleLoop() override
+	{
+		auto& state = m_context.m_State;
+		if((state.nHasException & ~MIPS_EXECUTION_STATUS_QUOTADONE) != MIPS_EXCEPTION_NONE) return;
+		//Loop is about to start over, PC points to its beginning
+		auto block = FindBlockStartingAt(state.nPC);
+		if(CMIPSAnalysis::IsIdleLoopPollingTimer(&m_context, block->GetBeginAddress(), block->GetEndAddress())) return;
+		state.nHasException |= MIPS_EXCEPTION_IDLE;
+		m_idleLoopStats.hitCount++;
+		m_idleLoopStats.skippedCycles += std::max<int>(state.cycleQuota, 0);
+	}
+
+	IDLE_LOOP_STATS GetIdleLoopStats() const override
+	{
+		auto stats = m_idleLoopStats;
+		stats.loopCount = static_cast<uint32>(m_idleLoopAddresses.size());
+		return stats;
+	}
+
+	void ResetIdleLoopStats() override
+	{
+		m_idleLoopStats = IDLE_LOOP_STATS();
+		m_idleLoopAddresses.clear();
+	}
+
+	void SetPrecompileEnabled(bool precompileEnabled) override
+	{
+		m_precompileEnabled = precompileEnabled;
+		if(!m_precompileEnabled)
+		{
+			DiscardPrecompiledBlocks();
+		}
+	}
+
+	//Finds functions in a range of newly loaded code and compiles their blocks on a worker
+	//thread. CreateBasicBlock picks them up when execution first reaches them, provided the
+	//code didn't change in the meantime.
+	void PrecompileRange(uint32 start, uint32 end, uint32 entryPoint) override
+	{
+		if(instructionSize != 4) return;
+		if(!m_precompileEnabled || (m_executionMode != EXECUTION_MODE_JIT)) return;
+
+		start &= m_addressMask;
+		end = std::min<uint32>(end & ~0x3, m_maxAddress - MAX_BLOCK_SIZE);
+		if(start >= end) return;
+
+		uint32 generation = 0;
+		{
+			std::lock_guard<std::mutex> compileLock(m_compileMutex);
+			generation = m_precompileGeneration;
+		}
+
+		if(!m_precompileThreadPool)
+		{
+			//Code generation is serialized by m_compileMutex, more workers wouldn't help
+			m_precompileThreadPool = std::make_unique<Framework::CThreadPool>(1);
+		}
+		m_precompileThreadPool->Enqueue([this, start, end, entryPoint, generation]() { PrecompileRangeJob(start, end, entryPoint, generation); });
+	}
+
+	PRECOMPILE_STATS GetPrecompileStats() const override
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		return m_precompileStats;
+	}
+
+	void ResetPrecompileStats() override
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		m_precompileStats = PRECOMPILE_STATS();
+	}
+
 #ifdef DEBUGGER_INCLUDED
 	bool MustBreak() const override
 	{
@@ -122,6 +240,16 @@ public:
 protected:
 	typedef std::list<BasicBlockPtr> BlockList;
 
+	struct PRECOMPILED_BLOCK
+	{
+		BasicBlockPtr block;
+		std::vector<uint32> opcodes;
+		bool compiled = false;
+		bool cancelled = false;
+	};
+	typedef std::shared_ptr<PRECOMPILED_BLOCK> PrecompiledBlockPtr;
+	typedef std::map<uint32, PrecompiledBlockPtr> PrecompiledBlockMap;
+
 	bool HasBlockAt(uint32 address) const
 	{
 		auto block = m_blockLookup.FindBlockAt(address);
@@ -147,11 +275,41 @@ protected:
 
 	virtual BasicBlockPtr BlockFactory(CMIPS& context, uint32 start, uint32 end)
 	{
+		return CreateBasicBlock(context, start, end);
+	}
+
+	//Creates a block according to the execution mode. Blocks that can't be interpreted
+	//(unsupported instructions, breakpoints) are compiled instead.
+	BasicBlockPtr CreateBasicBlock(CMIPS& context, uint32 start, uint32 end)
+	{
+		if((m_executionMode == EXECUTION_MODE_MIXED) && !context.HasBreakpointInRange(start, end))
+		{
+			auto block = std::make_shared<CInterpretedBlock>(context, start, end);
+			if(block->Predecode())
+			{
+				m_interpretedBlockCount++;
+				return block;
+			}
+		}
+		if(auto block = TakePrecompiledBlock(start, end))
+		{
+			m_compiledBlockCount++;
+			return block;
+		}
 		auto result = std::make_shared<CBasicBlock>(context, start, end);
 		result->Compile();
+		m_compiledBlockCount++;
 		return result;
 	}
 
+	//Links only patch generated code, they can only be used between compiled blocks
+	static bool CanLinkToBlock(CBasicBlock* block)
+	{
+		return !block->IsEmpty() && (block->GetType() == CBasicBlock::BLOCK_TYPE_COMPILED);
+	}
+
+	//Must only be called for compiled blocks. Links to interpreted blocks stay pending,
+	//execution goes back to the block lookup when they're reached.
 	void SetupBlockLinks(uint32 startAddress, uint32 endAddress, uint32 branchAddress)
 	{
 		auto block = m_blockLookup.FindBlockAt(startAddress);
@@ -163,7 +321,7 @@ protected:
 			block->SetOutLink(linkSlot, link);
 
 			auto nextBlock = m_blockLookup.FindBlockAt(nextBlockAddress);
-			if(!nextBlock->IsEmpty())
+			if(CanLinkToBlock(nextBlock))
 			{
 				block->LinkBlock(linkSlot, nextBlock);
 				link->second.live = true;
@@ -178,7 +336,7 @@ protected:
 			block->SetOutLink(linkSlot, link);
 
 			auto branchBlock = m_blockLookup.FindBlockAt(branchAddress);
-			if(!branchBlock->IsEmpty())
+			if(CanLinkToBlock(branchBlock))
 			{
 				block->LinkBlock(linkSlot, branchBlock);
 				link->second.live = true;
@@ -205,10 +363,11 @@ protected:
 		}
 	}
 
-	virtual void PartitionFunction(uint32 startAddress)
+	//Returns the address of the last instruction of the block starting at the specified address
+	uint32 FindBlockEnd(uint32 startAddress, uint32& branchAddress) const
 	{
 		uint32 endAddress = startAddress + MAX_BLOCK_SIZE;
-		uint32 branchAddress = 0;
+		branchAddress = 0;
 		for(uint32 address = startAddress; address < endAddress; address += 4)
 		{
 			uint32 opcode = m_context.m_pMemoryMap->GetInstruction(address);
@@ -225,11 +384,24 @@ protected:
 				break;
 			}
 		}
+		return endAddress;
+	}
+
+	virtual void PartitionFunction(uint32 startAddress)
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		uint32 branchAddress = 0;
+		uint32 endAddress = FindBlockEnd(startAddress, branchAddress);
 		assert((endAddress - startAddress) <= MAX_BLOCK_SIZE);
 		assert(endAddress <= m_maxAddress);
 		CreateBlock(startAddress, endAddress);
 		auto block = FindBlockStartingAt(startAddress);
-		if(block->GetRecycleCount() < RECYCLE_NOLINK_THRESHOLD)
+		if(block->IsIdleLoop())
+		{
+			m_idleLoopAddresses.insert(startAddress);
+		}
+		//Interpreted blocks don't have generated code to patch, they always return to the lookup
+		if((block->GetType() == CBasicBlock::BLOCK_TYPE_COMPILED) && (block->GetRecycleCount() < RECYCLE_NOLINK_THRESHOLD))
 		{
 			SetupBlockLinks(startAddress, endAddress, branchAddress);
 		}
@@ -255,6 +427,162 @@ protected:
 		orphanBlockLinkSlot(LINK_SLOT_BRANCH);
 	}
 
+	//Splits a subroutine in blocks the same way PartitionFunction would when execution reaches them.
+	//Runs on the precompile worker thread with m_compileMutex held. The block lookup belongs to the
+	//emulation thread, blocks that already exist there are never taken and get discarded on reset.
+	void PartitionSubroutine(uint32 start, uint32 end, std::vector<PrecompiledBlockPtr>& blocks)
+	{
+		std::set<uint32> visitedAddresses;
+		std::vector<uint32> pendingAddresses;
+		pendingAddresses.push_back(start);
+		while(!pendingAddresses.empty() && (blocks.size() < PRECOMPILE_MAX_BLOCKS))
+		{
+			uint32 blockStart = pendingAddresses.back();
+			pendingAddresses.pop_back();
+			if((blockStart < start) || (blockStart > end) || (blockStart & 3)) continue;
+			if(!visitedAddresses.insert(blockStart).second) continue;
+			if(m_precompiledBlocks.find(blockStart) != std::end(m_precompiledBlocks)) continue;
+
+			uint32 branchAddress = 0;
+			uint32 blockEnd = FindBlockEnd(blockStart, branchAddress);
+			pendingAddresses.push_back(blockEnd + 4);
+			if(branchAddress != 0)
+			{
+				pendingAddresses.push_back(branchAddress & m_addressMask);
+			}
+
+			//Breakpoints are checked by TakePrecompiledBlock
+			auto block = std::make_shared<PRECOMPILED_BLOCK>();
+			block->block = std::make_shared<CBasicBlock>(m_context, blockStart, blockEnd);
+			block->opcodes = ReadBlockOpcodes(blockStart, blockEnd);
+			blocks.push_back(std::move(block));
+		}
+	}
+
+	std::vector<uint32> ReadBlockOpcodes(uint32 start, uint32 end) const
+	{
+		std::vector<uint32> opcodes;
+		opcodes.reserve(((end - start) / 4) + 1);
+		for(uint32 address = start; address <= end; address += 4)
+		{
+			opcodes.push_back(m_context.m_pMemoryMap->GetInstruction(address));
+		}
+		return opcodes;
+	}
+
+	bool IsPrecompiledBlockCurrent(const PRECOMPILED_BLOCK& block) const
+	{
+		return ReadBlockOpcodes(block.block->GetBeginAddress(), block.block->GetEndAddress()) == block.opcodes;
+	}
+
+	bool IsPrecompileGenerationCurrent(uint32 generation) const
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		return m_precompileGeneration == generation;
+	}
+
+	//Runs on the precompile worker thread. Jobs queued before blocks were discarded (reset,
+	//execution mode change) are dropped.
+	void PrecompileRangeJob(uint32 start, uint32 end, uint32 entryPoint, uint32 generation)
+	{
+		if(!IsPrecompileGenerationCurrent(generation)) return;
+
+		//Function discovery only reads guest memory, it doesn't need to hold m_compileMutex
+		CMIPSAnalysis analysis(&m_context);
+		analysis.AnalyseSubroutines(start, end, entryPoint);
+
+		//Start with the entry point's function since it will be needed first
+		auto subroutines = analysis.GetSubroutines();
+		std::stable_partition(subroutines.begin(), subroutines.end(),
+		                      [entryPoint](const CMIPSAnalysis::SUBROUTINE& subroutine) { return (entryPoint >= subroutine.start) && (entryPoint <= subroutine.end); });
+
+		std::vector<PrecompiledBlockPtr> blocks;
+		{
+			std::lock_guard<std::mutex> compileLock(m_compileMutex);
+			if(m_precompileGeneration != generation) return;
+			for(const auto& subroutine : subroutines)
+			{
+				if(blocks.size() >= PRECOMPILE_MAX_BLOCKS) break;
+				PartitionSubroutine(subroutine.start, std::min<uint32>(subroutine.end, end), blocks);
+			}
+			for(const auto& block : blocks)
+			{
+				m_precompiledBlocks[block->block->GetBeginAddress()] = block;
+			}
+			m_precompileStats.queuedCount += static_cast<uint32>(blocks.size());
+		}
+
+		for(const auto& block : blocks)
+		{
+			CompilePrecompiledBlock(block);
+		}
+	}
+
+	//Runs on the precompile worker thread
+	void CompilePrecompiledBlock(const PrecompiledBlockPtr& block)
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		if(block->cancelled) return;
+		//Guest might have overwritten the code since the block was queued
+		if(!IsPrecompiledBlockCurrent(*block))
+		{
+			block->cancelled = true;
+			return;
+		}
+		block->block->Compile();
+		block->compiled = true;
+		m_precompileStats.compiledCount++;
+	}
+
+	//Must be called with m_compileMutex held. Returns nullptr if no valid precompiled block exists.
+	BasicBlockPtr TakePrecompiledBlock(uint32 start, uint32 end)
+	{
+		auto blockIterator = m_precompiledBlocks.find(start);
+		if(blockIterator == std::end(m_precompiledBlocks)) return BasicBlockPtr();
+		auto block = blockIterator->second;
+		m_precompiledBlocks.erase(blockIterator);
+		//Prevents the worker from compiling the block if it didn't get to it yet
+		block->cancelled = true;
+		if(!block->compiled) return BasicBlockPtr();
+		if(block->block->GetEndAddress() != end) return BasicBlockPtr();
+		if(m_context.HasBreakpointInRange(start, end)) return BasicBlockPtr();
+		if(!IsPrecompiledBlockCurrent(*block)) return BasicBlockPtr();
+		m_precompileStats.usedCount++;
+		return block->block;
+	}
+
+	void DiscardPrecompiledBlocks()
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		m_precompileGeneration++;
+		for(auto& blockPair : m_precompiledBlocks)
+		{
+			blockPair.second->cancelled = true;
+		}
+		m_precompiledBlocks.clear();
+	}
+
+	void DiscardPrecompiledBlocksInRange(uint32 start, uint32 end)
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		if(m_precompiledBlocks.empty()) return;
+		uint32 scanStart = static_cast<uint32>(std::max<int64>(0, static_cast<int64>(start) - MAX_BLOCK_SIZE));
+		auto blockIterator = m_precompiledBlocks.lower_bound(scanStart);
+		while((blockIterator != std::end(m_precompiledBlocks)) && (blockIterator->first <= end))
+		{
+			auto& block = blockIterator->second->block;
+			if(RangesOverlap(block->GetBeginAddress(), block->GetEndAddress(), start, end))
+			{
+				blockIterator->second->cancelled = true;
+				blockIterator = m_precompiledBlocks.erase(blockIterator);
+			}
+			else
+			{
+				blockIterator++;
+			}
+		}
+	}
+
 	void ClearActiveBlocksInRangeInternal(uint32 start, uint32 end, CBasicBlock* protectedBlock)
 	{
 		//Widen scan range since blocks starting before the range can end in the range
@@ -310,9 +638,26 @@ protected:
 
 	BlockLookupType m_blockLookup;
 
+	EXECUTION_MODE m_executionMode = EXECUTION_MODE_JIT;
+	uint32 m_compiledBlockCount = 0;
+	uint32 m_interpretedBlockCount = 0;
+
+	IDLE_LOOP_STATS m_idleLoopStats;
+	std::set<uint32> m_idleLoopAddresses;
+
+	//Guards the architecture objects used by block compilation and the precompiled blocks
+	mutable std::mutex m_compileMutex;
+	bool m_precompileEnabled = false;
+	PrecompiledBlockMap m_precompiledBlocks;
+	PRECOMPILE_STATS m_precompileStats;
+	uint32 m_precompileGeneration = 0;
+
 #ifdef DEBUGGER_INCLUDED
 	bool m_mustBreak = false;
 	bool m_breakpointsDisabledOnce = false;
 	int m_initQuota = 0;
 #endif
+
+	//Declared last so that it's destroyed before the state its jobs use
+	std::unique_ptr<Framework::CThreadPool> m_precompileThreadPool;
 };
@@ -1,12 +1,20 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include "Types.h"
 #include "Stream.h"
 
 namespace ISO9660
 {
+	//Block providers can be used from more than one thread (ex.: asynchronous
+	//ioman reads), accesses to the underlying stream need to be serialized.
+	//Providers reading from the same stream (ex.: both layers of a DVD) must
+	//share the same mutex.
 	class CBlockProvider
 	{
 	public:
@@ -15,11 +23,37 @@ namespace ISO9660
 			BLOCKSIZE = 0x800ULL
 		};
 
+		typedef std::shared_ptr<std::mutex> MutexPtr;
+
+		CBlockProvider(const MutexPtr& streamMutex)
+		    : m_streamMutex(streamMutex ? streamMutex : std::make_shared<std::mutex>())
+		{
+		}
+
 		virtual ~CBlockProvider() = default;
 		virtual void ReadBlock(uint32, void*) = 0;
 		virtual void ReadRawBlock(uint32, void*) = 0;
 		virtual uint32 GetBlockCount() = 0;
 		virtual uint32 GetRawBlockSize() const = 0;
+
+		//Reads consecutive blocks, providers should override this if they can
+		//do better than one read per block
+		virtual void ReadBlocks(uint32 address, uint32 count, void* blocks)
+		{
+			auto output = reinterpret_cast<uint8*>(blocks);
+			for(uint32 i = 0; i < count; i++)
+			{
+				ReadBlock(address + i, output + (i * BLOCKSIZE));
+			}
+		}
+
+		const MutexPtr& GetStreamMutex() const
+		{
+			return m_streamMutex;
+		}
+
+	protected:
+		MutexPtr m_streamMutex;
 	};
 
 	class CBlockProvider2048 : public CBlockProvider
@@ -27,18 +61,27 @@ namespace ISO9660
 	public:
 		typedef std::shared_ptr<Framework::CStream> StreamPtr;
 
-		CBlockProvider2048(const StreamPtr& stream, uint32 offset = 0)
-		    : m_stream(stream)
+		CBlockProvider2048(const StreamPtr& stream, uint32 offset = 0, const MutexPtr& streamMutex = MutexPtr())
+		    : CBlockProvider(streamMutex)
+		    , m_stream(stream)
 		    , m_offset(offset)
 		{
 		}
 
 		void ReadBlock(uint32 address, void* block) override
 		{
+			std::lock_guard<std::mutex> streamLock(*m_streamMutex);
 			m_stream->Seek(static_cast<uint64>(address + m_offset) * BLOCKSIZE, Framework::STREAM_SEEK_SET);
 			m_stream->Read(block, BLOCKSIZE);
 		}
 
+		void ReadBlocks(uint32 address, uint32 count, void* blocks) override
+		{
+			std::lock_guard<std::mutex> streamLock(*m_streamMutex);
+			m_stream->Seek(static_cast<uint64>(address + m_offset) * BLOCKSIZE, Framework::STREAM_SEEK_SET);
+			m_stream->Read(blocks, static_cast<uint64>(count) * BLOCKSIZE);
+		}
+
 		void ReadRawBlock(uint32 address, void* block) override
 		{
 			ReadBlock(address, block);
@@ -46,6 +89,7 @@ namespace ISO9660
 
 		uint32 GetBlockCount() override
 		{
+			std::lock_guard<std::mutex> streamLock(*m_streamMutex);
 			uint64 imageSize = m_stream->GetLength();
 			assert((imageSize % BLOCKSIZE) == 0);
 			return static_cast<uint32>(imageSize / BLOCKSIZE);
@@ -66,25 +110,49 @@ namespace ISO9660
 	public:
 		typedef std::shared_ptr<Framework::CStream> StreamPtr;
 
-		CBlockProviderCDROMXA(const StreamPtr& stream)
-		    : m_stream(stream)
+		CBlockProviderCDROMXA(const StreamPtr& stream, const MutexPtr& streamMutex = MutexPtr())
+		    : CBlockProvider(streamMutex)
+		    , m_stream(stream)
 		{
 		}
 
 		void ReadBlock(uint32 address, void* block) override
 		{
+			std::lock_guard<std::mutex> streamLock(*m_streamMutex);
 			m_stream->Seek((static_cast<uint64>(address) * INTERNAL_BLOCKSIZE) + BLOCKHEADER_SIZE, Framework::STREAM_SEEK_SET);
 			m_stream->Read(block, BLOCKSIZE);
 		}
 
+		//Raw blocks are read in batches and their user data is extracted from them
+		void ReadBlocks(uint32 address, uint32 count, void* blocks) override
+		{
+			std::lock_guard<std::mutex> streamLock(*m_streamMutex);
+			auto output = reinterpret_cast<uint8*>(blocks);
+			m_rawBlocks.resize(RAW_BATCH_BLOCKCOUNT * INTERNAL_BLOCKSIZE);
+			m_stream->Seek(static_cast<uint64>(address) * INTERNAL_BLOCKSIZE, Framework::STREAM_SEEK_SET);
+			while(count != 0)
+			{
+				uint32 batchCount = std::min<uint32>(count, RAW_BATCH_BLOCKCOUNT);
+				m_stream->Read(m_rawBlocks.data(), batchCount * INTERNAL_BLOCKSIZE);
+				for(uint32 i = 0; i < batchCount; i++)
+				{
+					memcpy(output, m_rawBlocks.data() + (i * INTERNAL_BLOCKSIZE) + BLOCKHEADER_SIZE, BLOCKSIZE);
+					output += BLOCKSIZE;
+				}
+				count -= batchCount;
+			}
+		}
+
 		void ReadRawBlock(uint32 address, void* block) override
 		{
+			std::lock_guard<std::mutex> streamLock(*m_streamMutex);
 			m_stream->Seek(static_cast<uint64>(address) * INTERNAL_BLOCKSIZE, Framework::STREAM_SEEK_SET);
 			m_stream->Read(block, INTERNAL_BLOCKSIZE);
 		}
 
 		uint32 GetBlockCount() override
 		{
+			std::lock_guard<std::mutex> streamLock(*m_streamMutex);
 			uint64 imageSize = m_stream->GetLength();
 			assert((imageSize % INTERNAL_BLOCKSIZE) == 0);
 			return static_cast<uint32>(imageSize / INTERNAL_BLOCKSIZE);
@@ -102,6 +170,12 @@ namespace ISO9660
 			BLOCKHEADER_SIZE = 0x18ULL
 		};
 
+		enum
+		{
+			RAW_BATCH_BLOCKCOUNT = 0x20,
+		};
+
 		StreamPtr m_stream;
+		std::vector<uint8> m_rawBlocks;
 	};
 }
@@ -60,21 +60,42 @@ uint64 CFile::Read(void* data, uint64 length)
 	length = std::min<uint64>(length, remainFileSize);
 
 	uint64 total = length;
-	//Read what's remaining of this block
-	while(1)
+	auto output = reinterpret_cast<uint8*>(data);
+
+	//Read what's remaining of the current block
+	uint64 blockPosition = (m_start + m_position) % CBlockProvider::BLOCKSIZE;
+	if(blockPosition != 0)
 	{
 		SyncBlock();
-		uint64 blockPosition = (m_start + m_position) % CBlockProvider::BLOCKSIZE;
 		uint64 blockRemain = CBlockProvider::BLOCKSIZE - blockPosition;
-		uint64 toRead = (length > blockRemain) ? (blockRemain) : (length);
+		uint64 toRead = std::min<uint64>(length, blockRemain);
+
+		memcpy(output, m_block + blockPosition, static_cast<uint32>(toRead));
+
+		m_position += toRead;
+		length -= toRead;
+		output += toRead;
+	}
 
-		memcpy(data, m_block + blockPosition, static_cast<uint32>(toRead));
+	//Whole blocks go straight to the destination
+	uint64 blockCount = length / CBlockProvider::BLOCKSIZE;
+	if(blockCount != 0)
+	{
+		uint32 firstBlock = static_cast<uint32>((m_start + m_position) / CBlockProvider::BLOCKSIZE);
+		m_blockProvider->ReadBlocks(firstBlock, static_cast<uint32>(blockCount), output);
 
+		uint64 toRead = blockCount * CBlockProvider::BLOCKSIZE;
 		m_position += toRead;
 		length -= toRead;
-		data = reinterpret_cast<uint8*>(data) + toRead;
+		output += toRead;
+	}
 
-		if(length == 0) break;
+	//Read the beginning of the last block
+	if(length != 0)
+	{
+		SyncBlock();
+		memcpy(output, m_block, static_cast<uint32>(length));
+		m_position += length;
 	}
 
 	return total;
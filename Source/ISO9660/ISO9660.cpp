@@ -1,10 +1,14 @@
 #include <string.h>
 #include <limits.h>
+#include <ctype.h>
 #include "ISO9660.h"
 #include "StdStream.h"
 #include "File.h"
 #include "DirectoryRecord.h"
 #include "stricmp.h"
+#include "../Log.h"
+
+#define LOG_NAME ("iso9660")
 
 using namespace ISO9660;
 
@@ -17,6 +21,11 @@ CISO9660::CISO9660(const BlockProviderPtr& blockProvider)
 
 CISO9660::~CISO9660()
 {
+	if(m_stats.lookupCount != 0)
+	{
+		CLog::GetInstance().Print(LOG_NAME, "%d lookups, %d served by path cache, %d served by directory index, %d served by prefix match, %d directories indexed.\r\n",
+		                          m_stats.lookupCount, m_stats.pathCacheHitCount, m_stats.directoryIndexHitCount, m_stats.prefixMatchCount, m_stats.indexedDirectoryCount);
+	}
 }
 
 void CISO9660::ReadBlock(uint32 address, void* data)
@@ -31,9 +40,56 @@ void CISO9660::ReadBlock(uint32 address, void* data)
 
 bool CISO9660::GetFileRecord(CDirectoryRecord* record, const char* filename)
 {
+	m_stats.lookupCount++;
+
 	//Remove the first '/'
 	if(filename[0] == '/' || filename[0] == '\\') filename++;
 
+	auto pathKey = MakeIndexKey(filename, strlen(filename));
+	auto pathIterator = m_pathCache.find(pathKey);
+	if(pathIterator != std::end(m_pathCache))
+	{
+		m_stats.pathCacheHitCount++;
+		(*record) = pathIterator->second;
+		return true;
+	}
+	if(m_missingPaths.find(pathKey) != std::end(m_missingPaths))
+	{
+		m_stats.pathCacheHitCount++;
+		return false;
+	}
+
+	if(!FindFileRecord(record, filename))
+	{
+		if(m_missingPaths.size() >= MAX_MISSING_PATHS)
+		{
+			m_missingPaths.clear();
+		}
+		m_missingPaths.insert(std::move(pathKey));
+		return false;
+	}
+
+	m_pathCache.emplace(std::move(pathKey), *record);
+	return true;
+}
+
+CISO9660::STATS CISO9660::GetStats() const
+{
+	return m_stats;
+}
+
+std::string CISO9660::MakeIndexKey(const char* name, size_t length)
+{
+	std::string key(name, length);
+	for(auto& character : key)
+	{
+		character = static_cast<char>(toupper(static_cast<unsigned char>(character)));
+	}
+	return key;
+}
+
+bool CISO9660::FindFileRecord(CDirectoryRecord* record, const char* filename)
+{
 	unsigned int recordIndex = m_pathTable.FindRoot();
 
 	while(1)
@@ -59,15 +115,23 @@ bool CISO9660::GetFileRecord(CDirectoryRecord* record, const char* filename)
 
 bool CISO9660::GetFileRecordFromDirectory(CDirectoryRecord* record, uint32 address, const char* filename)
 {
-	CFile directory(m_blockProvider.get(), address * CBlockProvider::BLOCKSIZE);
+	const auto& directory = GetDirectoryIndex(address);
+	size_t filenameLength = strlen(filename);
 
-	while(1)
+	auto recordIterator = directory.recordIndices.find(MakeIndexKey(filename, filenameLength));
+	if(recordIterator != std::end(directory.recordIndices))
 	{
-		CDirectoryRecord entry(&directory);
+		m_stats.directoryIndexHitCount++;
+		(*record) = directory.records[recordIterator->second];
+		return true;
+	}
 
-		if(entry.GetLength() == 0) break;
-		if(strnicmp(entry.GetName(), filename, strlen(filename))) continue;
+	//Not an exact name, use the first record matching by prefix in disc order like lookups did before indexing
+	for(const auto& entry : directory.records)
+	{
+		if(strnicmp(entry.GetName(), filename, filenameLength)) continue;
 
+		m_stats.prefixMatchCount++;
 		(*record) = entry;
 		return true;
 	}
@@ -75,6 +139,38 @@ bool CISO9660::GetFileRecordFromDirectory(CDirectoryRecord* record, uint32 addre
 	return false;
 }
 
+const CISO9660::DIRECTORY_INDEX& CISO9660::GetDirectoryIndex(uint32 address)
+{
+	auto directoryIterator = m_directoryIndices.find(address);
+	if(directoryIterator != std::end(m_directoryIndices))
+	{
+		return directoryIterator->second;
+	}
+
+	auto& directory = m_directoryIndices[address];
+	m_stats.indexedDirectoryCount++;
+
+	CFile directoryStream(m_blockProvider.get(), static_cast<uint64>(address) * CBlockProvider::BLOCKSIZE);
+	while(1)
+	{
+		CDirectoryRecord entry(&directoryStream);
+		if(entry.GetLength() == 0) break;
+
+		//First record wins if names collide, like it did with a linear search
+		size_t recordIndex = directory.records.size();
+		const char* name = entry.GetName();
+		size_t nameLength = strlen(name);
+		directory.recordIndices.emplace(MakeIndexKey(name, nameLength), recordIndex);
+		if(const char* versionSeparator = strchr(name, ';'))
+		{
+			directory.recordIndices.emplace(MakeIndexKey(name, versionSeparator - name), recordIndex);
+		}
+		directory.records.push_back(entry);
+	}
+
+	return directory;
+}
+
 Framework::CStream* CISO9660::Open(const char* filename)
 {
 	CDirectoryRecord record;
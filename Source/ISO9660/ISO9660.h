@@ -1,6 +1,10 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "BlockProvider.h"
 #include "VolumeDescriptor.h"
 #include "PathTable.h"
@@ -11,6 +15,15 @@ class CISO9660
 public:
 	typedef std::shared_ptr<ISO9660::CBlockProvider> BlockProviderPtr;
 
+	struct STATS
+	{
+		uint32 lookupCount = 0;
+		uint32 pathCacheHitCount = 0;
+		uint32 directoryIndexHitCount = 0;
+		uint32 prefixMatchCount = 0;
+		uint32 indexedDirectoryCount = 0;
+	};
+
 	CISO9660(const BlockProviderPtr&);
 	~CISO9660();
 
@@ -19,12 +32,41 @@ public:
 	Framework::CStream* Open(const char*);
 	bool GetFileRecord(ISO9660::CDirectoryRecord*, const char*);
 
+	STATS GetStats() const;
+
 private:
+	//Records of a directory extent, indexed by upper case name, with and without version suffix
+	struct DIRECTORY_INDEX
+	{
+		std::vector<ISO9660::CDirectoryRecord> records;
+		std::unordered_map<std::string, size_t> recordIndices;
+	};
+	typedef std::unordered_map<uint32, DIRECTORY_INDEX> DirectoryIndexMap;
+
+	enum
+	{
+		//Failed lookups can be made with any name, a game probing many of them must not grow the cache forever
+		MAX_MISSING_PATHS = 0x100,
+	};
+
+	typedef std::unordered_map<std::string, ISO9660::CDirectoryRecord> PathCacheMap;
+	typedef std::unordered_set<std::string> MissingPathSet;
+
+	static std::string MakeIndexKey(const char*, size_t);
+
+	bool FindFileRecord(ISO9660::CDirectoryRecord*, const char*);
 	bool GetFileRecordFromDirectory(ISO9660::CDirectoryRecord*, uint32, const char*);
+	const DIRECTORY_INDEX& GetDirectoryIndex(uint32);
 
 	BlockProviderPtr m_blockProvider;
 	ISO9660::CVolumeDescriptor m_volumeDescriptor;
 	ISO9660::CPathTable m_pathTable;
 
+	//Disc contents never change while mounted, successful lookups are kept forever
+	DirectoryIndexMap m_directoryIndices;
+	PathCacheMap m_pathCache;
+	MissingPathSet m_missingPaths;
+	STATS m_stats;
+
 	uint8 m_blockBuffer[ISO9660::CBlockProvider::BLOCKSIZE];
 };
@@ -0,0 +1,1070 @@
+#include <cassert>
+#include "InterpretedBlock.h"
+#include "MIPS.h"
+#include "MIPSAnalysis.h"
+#include "MemoryUtils.h"
+#include "COP_SCU.h"
+
+//Defined in MA_MIPSIV.cpp
+extern "C" uint32 LWL_Proxy(uint32, uint32, CMIPS*);
+extern "C" uint32 LWR_Proxy(uint32, uint32, CMIPS*);
+extern "C" uint64 LDL_Proxy(uint32, uint64, CMIPS*);
+extern "C" uint64 LDR_Proxy(uint32, uint64, CMIPS*);
+extern "C" void SWL_Proxy(uint32, uint32, CMIPS*);
+extern "C" void SWR_Proxy(uint32, uint32, CMIPS*);
+extern "C" void SDL_Proxy(uint32, uint64, CMIPS*);
+extern "C" void SDR_Proxy(uint32, uint64, CMIPS*);
+
+typedef CInterpretedBlock::INSTRUCTION INSTRUCTION;
+
+static uint128& Gpr(CMIPS* context, uint32 reg)
+{
+	return context->m_State.nGPR[reg];
+}
+
+template <bool is64>
+static void WriteGpr32(CMIPS* context, uint32 reg, uint32 value)
+{
+	auto& gpr = Gpr(context, reg);
+	gpr.nV0 = value;
+	if(is64)
+	{
+		gpr.nV1 = static_cast<int32>(value) >> 31;
+	}
+}
+
+static uint8* GetPagePointer(CMIPS* context, uint32 address, uint32 accessSize)
+{
+	if(context->m_pageLookup == nullptr) return nullptr;
+	auto page = reinterpret_cast<uint8*>(context->m_pageLookup[address / MIPS_PAGE_SIZE]);
+	if(page == nullptr) return nullptr;
+	return page + (address & (MIPS_PAGE_SIZE - accessSize));
+}
+
+static uint32 GetEffectiveAddress(CMIPS* context, const INSTRUCTION& instruction)
+{
+	return Gpr(context, instruction.rs).nV0 + instruction.immediate;
+}
+
+//////////////////////////////////////////////////
+//Misc
+//////////////////////////////////////////////////
+
+static bool Nop(CMIPS*, const INSTRUCTION&)
+{
+	return true;
+}
+
+static bool Syscall(CMIPS* context, const INSTRUCTION& instruction)
+{
+	context->m_State.nCOP0[CCOP_SCU::EPC] = instruction.address;
+	context->m_State.nHasException = MIPS_EXCEPTION_SYSCALL;
+	return true;
+}
+
+template <bool is64>
+static bool Mfc0(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rt, context->m_State.nCOP0[instruction.rd]);
+	return true;
+}
+
+static bool Mtc0(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 value = Gpr(context, instruction.rt).nV0;
+	if(instruction.rd == CCOP_SCU::STATUS)
+	{
+		//Keep the EXL bit (see CCOP_SCU::MTC0)
+		value |= context->m_State.nCOP0[CCOP_SCU::STATUS] & CMIPS::STATUS_EXL;
+	}
+	context->m_State.nCOP0[instruction.rd] = value;
+	return true;
+}
+
+//////////////////////////////////////////////////
+//Immediate operations
+//////////////////////////////////////////////////
+
+template <bool is64>
+static bool Addiu(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rt, Gpr(context, instruction.rs).nV0 + instruction.immediate);
+	return true;
+}
+
+static bool Daddiu(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rt).nD0 = Gpr(context, instruction.rs).nD0 + static_cast<int64>(static_cast<int32>(instruction.immediate));
+	return true;
+}
+
+template <bool is64, bool isSigned>
+static bool Slti(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& rs = Gpr(context, instruction.rs);
+	uint32 result = 0;
+	if(is64)
+	{
+		uint64 immediate = static_cast<int64>(static_cast<int32>(instruction.immediate));
+		result = isSigned ? (static_cast<int64>(rs.nD0) < static_cast<int64>(immediate)) : (rs.nD0 < immediate);
+	}
+	else
+	{
+		result = isSigned ? (static_cast<int32>(rs.nV0) < static_cast<int32>(instruction.immediate)) : (rs.nV0 < instruction.immediate);
+	}
+	auto& rt = Gpr(context, instruction.rt);
+	rt.nV0 = result;
+	if(is64) rt.nV1 = 0;
+	return true;
+}
+
+template <bool is64>
+static bool Andi(CMIPS* context, const INSTRUCTION& instruction)
+{
+	auto& rt = Gpr(context, instruction.rt);
+	rt.nV0 = Gpr(context, instruction.rs).nV0 & instruction.immediate;
+	if(is64) rt.nV1 = 0;
+	return true;
+}
+
+template <bool is64>
+static bool Ori(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& rs = Gpr(context, instruction.rs);
+	uint32 upper = rs.nV1;
+	auto& rt = Gpr(context, instruction.rt);
+	rt.nV0 = rs.nV0 | instruction.immediate;
+	if(is64) rt.nV1 = upper;
+	return true;
+}
+
+static bool Xori(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& rs = Gpr(context, instruction.rs);
+	uint32 upper = rs.nV1;
+	auto& rt = Gpr(context, instruction.rt);
+	rt.nV0 = rs.nV0 ^ instruction.immediate;
+	rt.nV1 = upper;
+	return true;
+}
+
+template <bool is64>
+static bool Lui(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rt, instruction.immediate << 16);
+	return true;
+}
+
+//////////////////////////////////////////////////
+//Register operations
+//////////////////////////////////////////////////
+
+template <bool is64>
+static bool Sll(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rd, Gpr(context, instruction.rt).nV0 << instruction.sa);
+	return true;
+}
+
+template <bool is64>
+static bool Srl(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rd, Gpr(context, instruction.rt).nV0 >> instruction.sa);
+	return true;
+}
+
+template <bool is64>
+static bool Sra(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rd, static_cast<int32>(Gpr(context, instruction.rt).nV0) >> instruction.sa);
+	return true;
+}
+
+template <bool is64>
+static bool Sllv(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rd, Gpr(context, instruction.rt).nV0 << (Gpr(context, instruction.rs).nV0 & 0x1F));
+	return true;
+}
+
+template <bool is64>
+static bool Srlv(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rd, Gpr(context, instruction.rt).nV0 >> (Gpr(context, instruction.rs).nV0 & 0x1F));
+	return true;
+}
+
+template <bool is64>
+static bool Srav(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rd, static_cast<int32>(Gpr(context, instruction.rt).nV0) >> (Gpr(context, instruction.rs).nV0 & 0x1F));
+	return true;
+}
+
+//Shift amount already includes the +32 of the DSxx32 variants
+static bool Dsll(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rd).nD0 = Gpr(context, instruction.rt).nD0 << instruction.sa;
+	return true;
+}
+
+static bool Dsrl(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rd).nD0 = Gpr(context, instruction.rt).nD0 >> instruction.sa;
+	return true;
+}
+
+static bool Dsra(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rd).nD0 = static_cast<int64>(Gpr(context, instruction.rt).nD0) >> instruction.sa;
+	return true;
+}
+
+static bool Dsllv(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rd).nD0 = Gpr(context, instruction.rt).nD0 << (Gpr(context, instruction.rs).nV0 & 0x3F);
+	return true;
+}
+
+static bool Dsrlv(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rd).nD0 = Gpr(context, instruction.rt).nD0 >> (Gpr(context, instruction.rs).nV0 & 0x3F);
+	return true;
+}
+
+static bool Dsrav(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rd).nD0 = static_cast<int64>(Gpr(context, instruction.rt).nD0) >> (Gpr(context, instruction.rs).nV0 & 0x3F);
+	return true;
+}
+
+template <bool is64, bool isZero>
+static bool Movz(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& rt = Gpr(context, instruction.rt);
+	bool rtIsZero = is64 ? (rt.nD0 == 0) : (rt.nV0 == 0);
+	if(rtIsZero == isZero)
+	{
+		const auto& rs = Gpr(context, instruction.rs);
+		auto& rd = Gpr(context, instruction.rd);
+		rd.nV0 = rs.nV0;
+		if(is64) rd.nV1 = rs.nV1;
+	}
+	return true;
+}
+
+template <bool isHi>
+static bool Mfhi(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& source = isHi ? context->m_State.nHI : context->m_State.nLO;
+	auto& rd = Gpr(context, instruction.rd);
+	rd.nV0 = source[0];
+	rd.nV1 = source[1];
+	return true;
+}
+
+template <bool isHi>
+static bool Mthi(CMIPS* context, const INSTRUCTION& instruction)
+{
+	auto& destination = isHi ? context->m_State.nHI : context->m_State.nLO;
+	const auto& rs = Gpr(context, instruction.rs);
+	destination[0] = rs.nV0;
+	destination[1] = rs.nV1;
+	return true;
+}
+
+template <bool is64, bool isSigned>
+static bool Mult(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 rsValue = Gpr(context, instruction.rs).nV0;
+	uint32 rtValue = Gpr(context, instruction.rt).nV0;
+	uint64 result = isSigned
+	                    ? static_cast<uint64>(static_cast<int64>(static_cast<int32>(rsValue)) * static_cast<int64>(static_cast<int32>(rtValue)))
+	                    : static_cast<uint64>(rsValue) * static_cast<uint64>(rtValue);
+	auto& state = context->m_State;
+	state.nLO[0] = static_cast<uint32>(result);
+	state.nHI[0] = static_cast<uint32>(result >> 32);
+	if(is64)
+	{
+		state.nLO[1] = static_cast<int32>(state.nLO[0]) >> 31;
+		state.nHI[1] = static_cast<int32>(state.nHI[0]) >> 31;
+	}
+	//Three operand form, on the EE
+	if(instruction.rd != 0)
+	{
+		auto& rd = Gpr(context, instruction.rd);
+		rd.nV0 = state.nLO[0];
+		rd.nV1 = state.nLO[1];
+	}
+	return true;
+}
+
+template <bool is64, bool isSigned>
+static bool Div(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 rsValue = Gpr(context, instruction.rs).nV0;
+	uint32 rtValue = Gpr(context, instruction.rt).nV0;
+	auto& state = context->m_State;
+	if(rtValue == 0)
+	{
+		state.nLO[0] = (isSigned && (static_cast<int32>(rsValue) < 0)) ? 1 : ~0U;
+		state.nHI[0] = rsValue;
+	}
+	else if(isSigned && (rsValue == 0x80000000) && (rtValue == 0xFFFFFFFF))
+	{
+		state.nLO[0] = 0x80000000;
+		state.nHI[0] = 0;
+	}
+	else if(isSigned)
+	{
+		state.nLO[0] = static_cast<int32>(rsValue) / static_cast<int32>(rtValue);
+		state.nHI[0] = static_cast<int32>(rsValue) % static_cast<int32>(rtValue);
+	}
+	else
+	{
+		state.nLO[0] = rsValue / rtValue;
+		state.nHI[0] = rsValue % rtValue;
+	}
+	if(is64)
+	{
+		state.nLO[1] = static_cast<int32>(state.nLO[0]) >> 31;
+		state.nHI[1] = static_cast<int32>(state.nHI[0]) >> 31;
+	}
+	return true;
+}
+
+template <bool is64>
+static bool Addu(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rd, Gpr(context, instruction.rs).nV0 + Gpr(context, instruction.rt).nV0);
+	return true;
+}
+
+template <bool is64>
+static bool Subu(CMIPS* context, const INSTRUCTION& instruction)
+{
+	WriteGpr32<is64>(context, instruction.rd, Gpr(context, instruction.rs).nV0 - Gpr(context, instruction.rt).nV0);
+	return true;
+}
+
+static bool Daddu(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rd).nD0 = Gpr(context, instruction.rs).nD0 + Gpr(context, instruction.rt).nD0;
+	return true;
+}
+
+static bool Dsubu(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, instruction.rd).nD0 = Gpr(context, instruction.rs).nD0 - Gpr(context, instruction.rt).nD0;
+	return true;
+}
+
+enum LOGICAL_OPERATION
+{
+	LOGICAL_AND,
+	LOGICAL_OR,
+	LOGICAL_XOR,
+	LOGICAL_NOR,
+};
+
+template <bool is64, LOGICAL_OPERATION operation>
+static bool Logical(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& rs = Gpr(context, instruction.rs);
+	const auto& rt = Gpr(context, instruction.rt);
+	auto& rd = Gpr(context, instruction.rd);
+	for(uint32 i = 0; i < (is64 ? 2 : 1); i++)
+	{
+		uint32 value = 0;
+		switch(operation)
+		{
+		case LOGICAL_AND:
+			value = rs.nV[i] & rt.nV[i];
+			break;
+		case LOGICAL_OR:
+			value = rs.nV[i] | rt.nV[i];
+			break;
+		case LOGICAL_XOR:
+			value = rs.nV[i] ^ rt.nV[i];
+			break;
+		case LOGICAL_NOR:
+			value = ~(rs.nV[i] | rt.nV[i]);
+			break;
+		}
+		rd.nV[i] = value;
+	}
+	return true;
+}
+
+template <bool is64, bool isSigned>
+static bool Slt(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& rs = Gpr(context, instruction.rs);
+	const auto& rt = Gpr(context, instruction.rt);
+	uint32 result = 0;
+	if(is64)
+	{
+		result = isSigned ? (static_cast<int64>(rs.nD0) < static_cast<int64>(rt.nD0)) : (rs.nD0 < rt.nD0);
+	}
+	else
+	{
+		result = isSigned ? (static_cast<int32>(rs.nV0) < static_cast<int32>(rt.nV0)) : (rs.nV0 < rt.nV0);
+	}
+	auto& rd = Gpr(context, instruction.rd);
+	rd.nV0 = result;
+	if(is64) rd.nV1 = 0;
+	return true;
+}
+
+//////////////////////////////////////////////////
+//Jumps & branches
+//////////////////////////////////////////////////
+
+static bool J(CMIPS* context, const INSTRUCTION& instruction)
+{
+	context->m_State.nDelayedJumpAddr = instruction.target;
+	return true;
+}
+
+static bool Jal(CMIPS* context, const INSTRUCTION& instruction)
+{
+	Gpr(context, CMIPS::RA).nV0 = instruction.address + 8;
+	context->m_State.nDelayedJumpAddr = instruction.target;
+	return true;
+}
+
+static bool Jr(CMIPS* context, const INSTRUCTION& instruction)
+{
+	context->m_State.nDelayedJumpAddr = Gpr(context, instruction.rs).nV0;
+	return true;
+}
+
+static bool Jalr(CMIPS* context, const INSTRUCTION& instruction)
+{
+	context->m_State.nDelayedJumpAddr = Gpr(context, instruction.rs).nV0;
+	if(instruction.rd != 0)
+	{
+		Gpr(context, instruction.rd).nV0 = instruction.address + 8;
+	}
+	return true;
+}
+
+//Likely branches nullify their delay slot when not taken, which is always the last
+//instruction of the block
+template <bool isLikely>
+static bool Branch(CMIPS* context, const INSTRUCTION& instruction, bool condition)
+{
+	auto& state = context->m_State;
+	if(condition)
+	{
+		state.nDelayedJumpAddr = instruction.target;
+		return true;
+	}
+	state.nDelayedJumpAddr = MIPS_INVALID_PC;
+	return !isLikely;
+}
+
+template <bool is64, bool isEqual, bool isLikely>
+static bool Beq(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& rs = Gpr(context, instruction.rs);
+	const auto& rt = Gpr(context, instruction.rt);
+	bool equal = is64 ? (rs.nD0 == rt.nD0) : (rs.nV0 == rt.nV0);
+	return Branch<isLikely>(context, instruction, equal == isEqual);
+}
+
+template <bool is64, bool isLez, bool isLikely>
+static bool Blez(CMIPS* context, const INSTRUCTION& instruction)
+{
+	const auto& rs = Gpr(context, instruction.rs);
+	bool lessOrEqual = is64 ? (static_cast<int64>(rs.nD0) <= 0) : (static_cast<int32>(rs.nV0) <= 0);
+	return Branch<isLikely>(context, instruction, lessOrEqual == isLez);
+}
+
+template <bool is64, bool isGez, bool isLikely, bool isLink>
+static bool Bgez(CMIPS* context, const INSTRUCTION& instruction)
+{
+	if(isLink)
+	{
+		Gpr(context, CMIPS::RA).nV0 = instruction.address + 8;
+	}
+	const auto& rs = Gpr(context, instruction.rs);
+	bool negative = ((is64 ? rs.nV1 : rs.nV0) & 0x80000000) != 0;
+	return Branch<isLikely>(context, instruction, negative != isGez);
+}
+
+//////////////////////////////////////////////////
+//Loads & stores
+//////////////////////////////////////////////////
+
+template <bool is64, typename ValueType, uint32 (*proxyFunction)(CMIPS*, uint32)>
+static bool Load(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	uint32 value = 0;
+	if(auto pointer = GetPagePointer(context, address, sizeof(ValueType)))
+	{
+		value = static_cast<uint32>(*reinterpret_cast<const ValueType*>(pointer));
+	}
+	else
+	{
+		value = static_cast<uint32>(static_cast<ValueType>(proxyFunction(context, address)));
+	}
+	WriteGpr32<is64>(context, instruction.rt, value);
+	return true;
+}
+
+template <typename ValueType, void (*proxyFunction)(CMIPS*, uint32, uint32)>
+static bool Store(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	uint32 value = Gpr(context, instruction.rt).nV0;
+	if(auto pointer = GetPagePointer(context, address, sizeof(ValueType)))
+	{
+		*reinterpret_cast<ValueType*>(pointer) = static_cast<ValueType>(value);
+	}
+	else
+	{
+		proxyFunction(context, value, address);
+	}
+	return true;
+}
+
+static bool Lwu(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	auto& rt = Gpr(context, instruction.rt);
+	rt.nV0 = MemoryUtils_GetWordProxy(context, address);
+	rt.nV1 = 0;
+	return true;
+}
+
+static bool Ld(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	auto pointer = GetPagePointer(context, address, 8);
+	Gpr(context, instruction.rt).nD0 = pointer ? *reinterpret_cast<const uint64*>(pointer) : MemoryUtils_GetDoubleProxy(context, address);
+	return true;
+}
+
+static bool Sd(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	uint64 value = Gpr(context, instruction.rt).nD0;
+	if(auto pointer = GetPagePointer(context, address, 8))
+	{
+		*reinterpret_cast<uint64*>(pointer) = value;
+	}
+	else
+	{
+		MemoryUtils_SetDoubleProxy(context, value, address);
+	}
+	return true;
+}
+
+static bool Lq(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	auto pointer = GetPagePointer(context, address, 16);
+	Gpr(context, instruction.rt) = pointer ? *reinterpret_cast<const uint128*>(pointer) : MemoryUtils_GetQuadProxy(context, address);
+	return true;
+}
+
+static bool Sq(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	const auto& value = Gpr(context, instruction.rt);
+	if(auto pointer = GetPagePointer(context, address, 16))
+	{
+		*reinterpret_cast<uint128*>(pointer) = value;
+	}
+	else
+	{
+		MemoryUtils_SetQuadProxy(context, value, address);
+	}
+	return true;
+}
+
+template <bool is64, uint32 (*proxyFunction)(uint32, uint32, CMIPS*)>
+static bool LoadWordUnaligned(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	WriteGpr32<is64>(context, instruction.rt, proxyFunction(address, Gpr(context, instruction.rt).nV0, context));
+	return true;
+}
+
+template <uint64 (*proxyFunction)(uint32, uint64, CMIPS*)>
+static bool LoadDoubleUnaligned(CMIPS* context, const INSTRUCTION& instruction)
+{
+	uint32 address = GetEffectiveAddress(context, instruction);
+	auto& rt = Gpr(context, instruction.rt);
+	rt.nD0 = proxyFunction(address, rt.nD0, context);
+	return true;
+}
+
+template <void (*proxyFunction)(uint32, uint32, CMIPS*)>
+static bool StoreWordUnaligned(CMIPS* context, const INSTRUCTION& instruction)
+{
+	proxyFunction(GetEffectiveAddress(context, instruction), Gpr(context, instruction.rt).nV0, context);
+	return true;
+}
+
+template <void (*proxyFunction)(uint32, uint64, CMIPS*)>
+static bool StoreDoubleUnaligned(CMIPS* context, const INSTRUCTION& instruction)
+{
+	proxyFunction(GetEffectiveAddress(context, instruction), Gpr(context, instruction.rt).nD0, context);
+	return true;
+}
+
+//////////////////////////////////////////////////
+//Decoding
+//////////////////////////////////////////////////
+
+template <bool is64>
+static CInterpretedBlock::HandlerType DecodeSpecial(INSTRUCTION& instruction, uint32 opcode)
+{
+	//Handlers that write to rd, only used if rd isn't R0
+	CInterpretedBlock::HandlerType handler = nullptr;
+	switch(opcode & 0x3F)
+	{
+	case 0x00:
+		handler = &Sll<is64>;
+		break;
+	case 0x02:
+		handler = &Srl<is64>;
+		break;
+	case 0x03:
+		handler = &Sra<is64>;
+		break;
+	case 0x04:
+		handler = &Sllv<is64>;
+		break;
+	case 0x06:
+		handler = &Srlv<is64>;
+		break;
+	case 0x07:
+		handler = &Srav<is64>;
+		break;
+	case 0x08:
+		return &Jr;
+	case 0x09:
+		return &Jalr;
+	case 0x0A:
+		handler = &Movz<is64, true>;
+		break;
+	case 0x0B:
+		handler = &Movz<is64, false>;
+		break;
+	case 0x0C:
+		return &Syscall;
+	case 0x0D: //BREAK
+	case 0x0F: //SYNC
+		return &Nop;
+	case 0x10:
+		handler = &Mfhi<true>;
+		break;
+	case 0x11:
+		return &Mthi<true>;
+	case 0x12:
+		handler = &Mfhi<false>;
+		break;
+	case 0x13:
+		return &Mthi<false>;
+	case 0x18:
+		return &Mult<is64, true>;
+	case 0x19:
+		return &Mult<is64, false>;
+	case 0x1A:
+		return &Div<is64, true>;
+	case 0x1B:
+		return &Div<is64, false>;
+	case 0x20: //ADD
+	case 0x21:
+		handler = &Addu<is64>;
+		break;
+	case 0x22: //SUB
+	case 0x23:
+		handler = &Subu<is64>;
+		break;
+	case 0x24:
+		handler = &Logical<is64, LOGICAL_AND>;
+		break;
+	case 0x25:
+		handler = &Logical<is64, LOGICAL_OR>;
+		break;
+	case 0x26:
+		handler = &Logical<is64, LOGICAL_XOR>;
+		break;
+	case 0x27:
+		handler = &Logical<is64, LOGICAL_NOR>;
+		break;
+	case 0x2A:
+		handler = &Slt<is64, true>;
+		break;
+	case 0x2B:
+		handler = &Slt<is64, false>;
+		break;
+	}
+	if(is64 && (handler == nullptr))
+	{
+		switch(opcode & 0x3F)
+		{
+		case 0x14:
+			handler = &Dsllv;
+			break;
+		case 0x16:
+			handler = &Dsrlv;
+			break;
+		case 0x17:
+			handler = &Dsrav;
+			break;
+		case 0x2C: //DADD
+		case 0x2D:
+			handler = &Daddu;
+			break;
+		case 0x2E: //DSUB
+		case 0x2F:
+			handler = &Dsubu;
+			break;
+		case 0x38:
+			handler = &Dsll;
+			break;
+		case 0x3A:
+			handler = &Dsrl;
+			break;
+		case 0x3B:
+			handler = &Dsra;
+			break;
+		case 0x3C:
+			instruction.sa += 32;
+			handler = &Dsll;
+			break;
+		case 0x3E:
+			instruction.sa += 32;
+			handler = &Dsrl;
+			break;
+		case 0x3F:
+			instruction.sa += 32;
+			handler = &Dsra;
+			break;
+		}
+	}
+	if(handler == nullptr) return nullptr;
+	return (instruction.rd == 0) ? &Nop : handler;
+}
+
+template <bool is64>
+static CInterpretedBlock::HandlerType DecodeRegImm(INSTRUCTION& instruction, uint32 opcode)
+{
+	instruction.target = instruction.address + 4 + CMIPS::GetBranch(static_cast<uint16>(opcode));
+	switch(instruction.rt)
+	{
+	case 0x00:
+		return &Bgez<is64, false, false, false>;
+	case 0x01:
+		return &Bgez<is64, true, false, false>;
+	case 0x02:
+		return &Bgez<is64, false, true, false>;
+	case 0x03:
+		return &Bgez<is64, true, true, false>;
+	case 0x10:
+		return &Bgez<is64, false, false, true>;
+	case 0x11:
+		return &Bgez<is64, true, false, true>;
+	case 0x12:
+		return &Bgez<is64, false, true, true>;
+	case 0x13:
+		return &Bgez<is64, true, true, true>;
+	}
+	return nullptr;
+}
+
+template <bool is64>
+static CInterpretedBlock::HandlerType DecodeCop0(INSTRUCTION& instruction, CMIPS& context)
+{
+	if(context.m_pCOP[0] == nullptr) return nullptr;
+	//Performance counter registers have their own encoding, leave them to the compiler
+	if(instruction.rd == 25) return nullptr;
+	switch(instruction.rs)
+	{
+	case 0x00:
+		return (instruction.rt == 0) ? &Nop : &Mfc0<is64>;
+	case 0x04:
+		return &Mtc0;
+	}
+	return nullptr;
+}
+
+template <bool is64>
+static CInterpretedBlock::HandlerType DecodeGeneral(INSTRUCTION& instruction, uint32 opcode, CMIPS& context, bool allowMemoryAccess)
+{
+	uint32 signedImmediate = static_cast<int16>(opcode & 0xFFFF);
+	uint32 unsignedImmediate = opcode & 0xFFFF;
+	uint32 branchTarget = instruction.address + 4 + CMIPS::GetBranch(static_cast<uint16>(opcode));
+
+	//Handlers that write to rt, only used if rt isn't R0
+	CInterpretedBlock::HandlerType handler = nullptr;
+	switch(opcode >> 26)
+	{
+	case 0x00:
+		return DecodeSpecial<is64>(instruction, opcode);
+	case 0x01:
+		return DecodeRegImm<is64>(instruction, opcode);
+	case 0x02:
+		instruction.target = (instruction.address & 0xF0000000) | ((opcode & 0x03FFFFFF) << 2);
+		return &J;
+	case 0x03:
+		instruction.target = (instruction.address & 0xF0000000) | ((opcode & 0x03FFFFFF) << 2);
+		return &Jal;
+	case 0x04:
+		instruction.target = branchTarget;
+		return &Beq<is64, true, false>;
+	case 0x05:
+		instruction.target = branchTarget;
+		return &Beq<is64, false, false>;
+	case 0x06:
+		instruction.target = branchTarget;
+		return &Blez<is64, true, false>;
+	case 0x07:
+		instruction.target = branchTarget;
+		return &Blez<is64, false, false>;
+	case 0x08: //ADDI
+	case 0x09:
+		instruction.immediate = signedImmediate;
+		if((instruction.rt == 0) && (instruction.rs == 0))
+		{
+			//Hack: ADDIU R0, R0, $x acts as a syscall (see CMA_MIPSIV::ADDIU)
+			return &Syscall;
+		}
+		handler = &Addiu<is64>;
+		break;
+	case 0x0A:
+		instruction.immediate = signedImmediate;
+		handler = &Slti<is64, true>;
+		break;
+	case 0x0B:
+		instruction.immediate = signedImmediate;
+		handler = &Slti<is64, false>;
+		break;
+	case 0x0C:
+		instruction.immediate = unsignedImmediate;
+		handler = &Andi<is64>;
+		break;
+	case 0x0D:
+		instruction.immediate = unsignedImmediate;
+		handler = &Ori<is64>;
+		break;
+	case 0x0E:
+		instruction.immediate = unsignedImmediate;
+		handler = &Xori;
+		break;
+	case 0x0F:
+		instruction.immediate = unsignedImmediate;
+		handler = &Lui<is64>;
+		break;
+	case 0x10:
+		return DecodeCop0<is64>(instruction, context);
+	case 0x14:
+		instruction.target = branchTarget;
+		return &Beq<is64, true, true>;
+	case 0x15:
+		instruction.target = branchTarget;
+		return &Beq<is64, false, true>;
+	case 0x16:
+		instruction.target = branchTarget;
+		return &Blez<is64, true, true>;
+	case 0x17:
+		instruction.target = branchTarget;
+		return &Blez<is64, false, true>;
+	case 0x2F: //CACHE
+	case 0x33: //PREF
+		return &Nop;
+	}
+
+	if(is64 && (handler == nullptr))
+	{
+		switch(opcode >> 26)
+		{
+		case 0x18: //DADDI
+		case 0x19:
+			instruction.immediate = signedImmediate;
+			handler = &Daddiu;
+			break;
+		}
+	}
+
+	if(allowMemoryAccess && (handler == nullptr))
+	{
+		instruction.immediate = signedImmediate;
+		switch(opcode >> 26)
+		{
+		case 0x20:
+			handler = &Load<is64, int8, &MemoryUtils_GetByteProxy>;
+			break;
+		case 0x21:
+			handler = &Load<is64, int16, &MemoryUtils_GetHalfProxy>;
+			break;
+		case 0x22:
+			handler = &LoadWordUnaligned<is64, &LWL_Proxy>;
+			break;
+		case 0x23:
+			handler = &Load<is64, uint32, &MemoryUtils_GetWordProxy>;
+			break;
+		case 0x24:
+			handler = &Load<is64, uint8, &MemoryUtils_GetByteProxy>;
+			break;
+		case 0x25:
+			handler = &Load<is64, uint16, &MemoryUtils_GetHalfProxy>;
+			break;
+		case 0x26:
+			handler = &LoadWordUnaligned<is64, &LWR_Proxy>;
+			break;
+		case 0x28:
+			return &Store<uint8, &MemoryUtils_SetByteProxy>;
+		case 0x29:
+			return &Store<uint16, &MemoryUtils_SetHalfProxy>;
+		case 0x2A:
+			return &StoreWordUnaligned<&SWL_Proxy>;
+		case 0x2B:
+			return &Store<uint32, &MemoryUtils_SetWordProxy>;
+		case 0x2E:
+			return &StoreWordUnaligned<&SWR_Proxy>;
+		}
+		if(is64 && (handler == nullptr))
+		{
+			switch(opcode >> 26)
+			{
+			case 0x1A:
+				handler = &LoadDoubleUnaligned<&LDL_Proxy>;
+				break;
+			case 0x1B:
+				handler = &LoadDoubleUnaligned<&LDR_Proxy>;
+				break;
+			case 0x27:
+				handler = &Lwu;
+				break;
+			case 0x2C:
+				return &StoreDoubleUnaligned<&SDL_Proxy>;
+			case 0x2D:
+				return &StoreDoubleUnaligned<&SDR_Proxy>;
+			case 0x37:
+				handler = &Ld;
+				break;
+			case 0x3F:
+				return &Sd;
+			}
+		}
+	}
+
+	if(handler == nullptr) return nullptr;
+	return (instruction.rt == 0) ? &Nop : handler;
+}
+
+//////////////////////////////////////////////////
+//CInterpretedBlock
+//////////////////////////////////////////////////
+
+CInterpretedBlock::CInterpretedBlock(CMIPS& context, uint32 begin, uint32 end)
+    : CBasicBlock(context, begin, end)
+{
+	m_type = BLOCK_TYPE_INTERPRETED;
+}
+
+bool CInterpretedBlock::Predecode()
+{
+	assert(!IsEmpty());
+	m_is64 = (m_context.m_pArch->GetRegSize() == MIPS_REGSIZE_64);
+	//TLB exceptions are only checked by compiled code
+	m_useTlbChecks = (m_context.m_TLBExceptionChecker != nullptr) && (m_context.m_pAddrTranslator != &CMIPS::TranslateAddress64);
+
+	m_instructions.clear();
+	m_instructions.reserve(((m_end - m_begin) / 4) + 1);
+	for(uint32 address = m_begin; address <= m_end; address += 4)
+	{
+		uint32 opcode = m_context.m_pMemoryMap->GetInstruction(address);
+		INSTRUCTION instruction;
+		instruction.address = address;
+		instruction.rs = static_cast<uint8>((opcode >> 21) & 0x1F);
+		instruction.rt = static_cast<uint8>((opcode >> 16) & 0x1F);
+		instruction.rd = static_cast<uint8>((opcode >> 11) & 0x1F);
+		instruction.sa = static_cast<uint8>((opcode >> 6) & 0x1F);
+		if(!DecodeInstruction(instruction, opcode))
+		{
+			m_instructions.clear();
+			return false;
+		}
+		m_instructions.push_back(instruction);
+	}
+
+	m_isIdleLoop = CMIPSAnalysis::IsIdleLoop(&m_context, m_begin, m_end);
+	return true;
+}
+
+bool CInterpretedBlock::DecodeInstruction(INSTRUCTION& instruction, uint32 opcode) const
+{
+	if(opcode == 0)
+	{
+		instruction.handler = &Nop;
+		return true;
+	}
+	bool allowMemoryAccess = !m_useTlbChecks;
+	if(m_is64)
+	{
+		instruction.handler = DecodeGeneral<true>(instruction, opcode, m_context, allowMemoryAccess);
+		if((instruction.handler == nullptr) && allowMemoryAccess)
+		{
+			//LQ/SQ (EE)
+			switch(opcode >> 26)
+			{
+			case 0x1E:
+				instruction.immediate = static_cast<int16>(opcode & 0xFFFF);
+				instruction.handler = (instruction.rt == 0) ? &Nop : &Lq;
+				break;
+			case 0x1F:
+				instruction.immediate = static_cast<int16>(opcode & 0xFFFF);
+				instruction.handler = &Sq;
+				break;
+			}
+		}
+	}
+	else
+	{
+		instruction.handler = DecodeGeneral<false>(instruction, opcode, m_context, allowMemoryAccess);
+	}
+	return instruction.handler != nullptr;
+}
+
+void CInterpretedBlock::Interpret()
+{
+	auto context = &m_context;
+	auto& state = m_context.m_State;
+	for(const auto& instruction : m_instructions)
+	{
+		if(!instruction.handler(context, instruction)) break;
+	}
+
+	//Same as the epilog of compiled blocks
+	state.cycleQuota -= ((m_end - m_begin) / 4) + 1;
+	if(state.cycleQuota <= 0)
+	{
+		state.nHasException |= MIPS_EXECUTION_STATUS_QUOTADONE;
+	}
+	if(state.nDelayedJumpAddr != MIPS_INVALID_PC)
+	{
+		state.nPC = state.nDelayedJumpAddr;
+		state.nDelayedJumpAddr = MIPS_INVALID_PC;
+		if(m_isIdleLoop)
+		{
+			m_context.m_executor->NotifyIdleLoop();
+		}
+	}
+	else
+	{
+		state.nPC = m_end + 4;
+	}
+
+	assert(state.nGPR[0].nV[0] == 0);
+	assert(state.nGPR[0].nV[1] == 0);
+	assert(state.nGPR[0].nV[2] == 0);
+	assert(state.nGPR[0].nV[3] == 0);
+}
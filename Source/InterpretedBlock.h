@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include "BasicBlock.h"
+
+//Basic block executed by a threaded-code interpreter instead of generated code.
+//
+//Instructions are decoded once when the block is created into records holding the
+//handler to call along with the operands extracted from the opcode. Executing the block
+//walks the records and then performs the same bookkeeping as the epilog of a compiled
+//block (cycle quota, delayed jump resolution, idle loop notification).
+//
+//Only the integer core of the MIPS IV architecture (plus COP0 moves and LQ/SQ on the EE)
+//is handled. Predecode fails if the block contains anything else (FPU, MMI, COP2), in which
+//case the executor falls back to compiling the block. This is not a replacement for the JIT:
+//EE code uses those instructions all the time and VU code is always compiled, so the VM still
+//needs to generate code. Interpreted blocks are mainly useful to check the JIT against and
+//to cut down on the amount of generated code for the IOP, which rarely needs a fallback.
+//
+//CBasicBlock::Execute dispatches to Interpret according to the block's type.
+
+class CInterpretedBlock : public CBasicBlock
+{
+public:
+	CInterpretedBlock(CMIPS&, uint32, uint32);
+	virtual ~CInterpretedBlock() = default;
+
+	bool Predecode();
+	void Interpret();
+
+	struct INSTRUCTION;
+
+	//Returns false if execution of the block must stop (nullified delay slot)
+	typedef bool (*HandlerType)(CMIPS*, const INSTRUCTION&);
+
+	struct INSTRUCTION
+	{
+		HandlerType handler = nullptr;
+		uint8 rs = 0;
+		uint8 rt = 0;
+		uint8 rd = 0;
+		uint8 sa = 0;
+		uint32 immediate = 0;
+		uint32 address = 0;
+		uint32 target = 0;
+	};
+
+private:
+	typedef std::vector<INSTRUCTION> InstructionArray;
+
+	bool DecodeInstruction(INSTRUCTION&, uint32) const;
+
+	InstructionArray m_instructions;
+	bool m_is64 = false;
+	bool m_useTlbChecks = false;
+};
@@ -89,6 +89,19 @@ void CMA_MIPSIV::Template_Load32(const MemoryAccessTraits& traits)
 		    m_codeGen->PullRel(offsetof(CMIPS, m_State.nGPR[m_nRT].nV[0]));
 	    };
 
+	bool useFastMem = IsFastMemAccess();
+
+	if(useFastMem)
+	{
+		BeginFastMemAccess(traits.elementSize);
+		{
+			ComputeFastMemAccessRef(traits.elementSize);
+			((m_codeGen)->*(traits.loadFunction))();
+			finishLoad();
+		}
+		m_codeGen->Else();
+	}
+
 	bool usePageLookup = (m_pCtx->m_pageLookup != nullptr);
 
 	if(usePageLookup)
@@ -122,12 +135,30 @@ void CMA_MIPSIV::Template_Load32(const MemoryAccessTraits& traits)
 	{
 		m_codeGen->EndIf();
 	}
+
+	if(useFastMem)
+	{
+		m_codeGen->EndIf();
+	}
 }
 
 void CMA_MIPSIV::Template_Store32(const MemoryAccessTraits& traits)
 {
 	CheckTLBExceptions(true);
 
+	bool useFastMem = IsFastMemAccess();
+
+	if(useFastMem)
+	{
+		BeginFastMemAccess(traits.elementSize);
+		{
+			ComputeFastMemAccessRef(traits.elementSize);
+			m_codeGen->PushRel(offsetof(CMIPS, m_State.nGPR[m_nRT].nV[0]));
+			((m_codeGen)->*(traits.storeFunction))();
+		}
+		m_codeGen->Else();
+	}
+
 	bool usePageLookup = (m_pCtx->m_pageLookup != nullptr);
 
 	if(usePageLookup)
@@ -161,6 +192,11 @@ void CMA_MIPSIV::Template_Store32(const MemoryAccessTraits& traits)
 	{
 		m_codeGen->EndIf();
 	}
+
+	if(useFastMem)
+	{
+		m_codeGen->EndIf();
+	}
 }
 
 void CMA_MIPSIV::Template_ShiftCst32(const TemplateParamedOperationFunctionType& Function)
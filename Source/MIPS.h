@@ -165,8 +165,14 @@ public:
 
 	void* m_vuMem = nullptr;
 	void** m_pageLookup = nullptr;
+	//Base of host memory window mirroring guest memory, when fast memory is enabled
+	uint8* m_fastMemBase = nullptr;
+	//Masked guest addresses below this are backed by RAM in the window
+	uint32 m_fastMemSize = 0;
 
 	std::function<void(CMIPS*)> m_emptyBlockHandler;
+	//Tells if a physical address is a timer register, used to rule out idle loops polling timers
+	std::function<bool(uint32)> m_timerAddressPredicate;
 
 	CMIPSArchitecture* m_pArch = nullptr;
 	CMIPSCoprocessor* m_pCOP[4];
@@ -54,6 +54,18 @@ const CMIPSAnalysis::SUBROUTINE* CMIPSAnalysis::FindSubroutine(uint32 address) c
 	}
 }
 
+//Returns subroutines sorted by ascending start address
+CMIPSAnalysis::SubroutineArray CMIPSAnalysis::GetSubroutines() const
+{
+	SubroutineArray subroutines;
+	subroutines.reserve(m_subroutines.size());
+	for(auto subroutineIterator = m_subroutines.rbegin(); subroutineIterator != m_subroutines.rend(); subroutineIterator++)
+	{
+		subroutines.push_back(subroutineIterator->second);
+	}
+	return subroutines;
+}
+
 void CMIPSAnalysis::ChangeSubroutineStart(uint32 currStart, uint32 newStart)
 {
 	auto subroutineIterator = m_subroutines.find(currStart);
@@ -456,3 +468,201 @@ CMIPSAnalysis::CallStackItemArray CMIPSAnalysis::GetCallStack(CMIPS* context, ui
 
 	return result;
 }
+
+enum
+{
+	IDLE_LOOP_MAX_INSTRUCTIONS = 16,
+};
+
+struct REGISTER_USAGE
+{
+	uint32 reads = 0;
+	uint32 writes = 0;
+};
+
+//Returns false if instruction has side effects other than reading memory and writing to a GPR.
+//64-bit instructions only exist on the EE.
+static bool GetIdleLoopInstructionUsage(uint32 opcode, bool is64Bits, REGISTER_USAGE& usage)
+{
+	uint32 rs = (opcode >> 21) & 0x1F;
+	uint32 rt = (opcode >> 16) & 0x1F;
+	uint32 rd = (opcode >> 11) & 0x1F;
+	switch(opcode >> 26)
+	{
+	case 0x00:
+		//SPECIAL
+		switch(opcode & 0x3F)
+		{
+		case 0x38: //DSLL
+		case 0x3A: //DSRL
+		case 0x3B: //DSRA
+		case 0x3C: //DSLL32
+		case 0x3E: //DSRL32
+		case 0x3F: //DSRA32
+			if(!is64Bits) return false;
+			[[fallthrough]];
+		case 0x00: //SLL
+		case 0x02: //SRL
+		case 0x03: //SRA
+			usage.reads = (1U << rt);
+			usage.writes = (1U << rd);
+			return true;
+		case 0x2D: //DADDU
+		case 0x2F: //DSUBU
+			if(!is64Bits) return false;
+			[[fallthrough]];
+		case 0x04: //SLLV
+		case 0x06: //SRLV
+		case 0x07: //SRAV
+		case 0x21: //ADDU
+		case 0x23: //SUBU
+		case 0x24: //AND
+		case 0x25: //OR
+		case 0x26: //XOR
+		case 0x27: //NOR
+		case 0x2A: //SLT
+		case 0x2B: //SLTU
+			usage.reads = (1U << rs) | (1U << rt);
+			usage.writes = (1U << rd);
+			return true;
+		case 0x0F: //SYNC
+			return true;
+		default:
+			return false;
+		}
+	case 0x01:
+		//REGIMM (only BLTZ, BGEZ, BLTZL and BGEZL, others link or trap)
+		if(rt > 0x03) return false;
+		usage.reads = (1U << rs);
+		return true;
+	case 0x04: //BEQ
+	case 0x05: //BNE
+	case 0x14: //BEQL
+	case 0x15: //BNEL
+		usage.reads = (1U << rs) | (1U << rt);
+		return true;
+	case 0x06: //BLEZ
+	case 0x07: //BGTZ
+	case 0x16: //BLEZL
+	case 0x17: //BGTZL
+		usage.reads = (1U << rs);
+		return true;
+	case 0x19: //DADDIU
+	case 0x1E: //LQ
+	case 0x27: //LWU
+	case 0x37: //LD
+		if(!is64Bits) return false;
+		[[fallthrough]];
+	case 0x09: //ADDIU
+	case 0x0A: //SLTI
+	case 0x0B: //SLTIU
+	case 0x0C: //ANDI
+	case 0x0D: //ORI
+	case 0x0E: //XORI
+	case 0x20: //LB
+	case 0x21: //LH
+	case 0x23: //LW
+	case 0x24: //LBU
+	case 0x25: //LHU
+		usage.reads = (1U << rs);
+		usage.writes = (1U << rt);
+		return true;
+	case 0x0F: //LUI
+		usage.writes = (1U << rt);
+		return true;
+	default:
+		return false;
+	}
+}
+
+//Checks if a block is a loop that only polls memory (or hardware registers) until a value changes.
+//Such a loop is a fixed point: every iteration computes the same thing from the same memory state,
+//so it will spin until something external (interrupt, DMA, other processor) changes memory.
+//Registers written in the loop must not be read before being written in the same iteration,
+//which rules out counters and delay loops.
+bool CMIPSAnalysis::IsIdleLoop(CMIPS* context, uint32 begin, uint32 end)
+{
+	if(end < (begin + 4)) return false;
+	if(((end - begin) / 4) >= IDLE_LOOP_MAX_INSTRUCTIONS) return false;
+
+	//Last instruction is the delay slot, instruction before must branch back to the beginning
+	uint32 branchAddress = end - 4;
+	uint32 branchOpcode = context->m_pMemoryMap->GetInstruction(branchAddress);
+	if(context->m_pArch->IsInstructionBranch(context, branchAddress, branchOpcode) != MIPS_BRANCH_NORMAL) return false;
+	if(context->m_pArch->GetInstructionEffectiveAddress(context, branchAddress, branchOpcode) != begin) return false;
+
+	bool is64Bits = (context->m_pArch->GetRegSize() == MIPS_REGSIZE_64);
+	uint32 writtenRegs = 0;
+	uint32 carriedRegs = 0;
+	for(uint32 address = begin; address <= end; address += 4)
+	{
+		uint32 opcode = context->m_pMemoryMap->GetInstruction(address);
+		REGISTER_USAGE usage;
+		if(!GetIdleLoopInstructionUsage(opcode, is64Bits, usage)) return false;
+		if((address != branchAddress) && (context->m_pArch->IsInstructionBranch(context, address, opcode) != MIPS_BRANCH_NONE))
+		{
+			//Branch in delay slot
+			return false;
+		}
+		carriedRegs |= (usage.reads & ~writtenRegs);
+		writtenRegs |= usage.writes;
+	}
+
+	//R0 is never modified
+	writtenRegs &= ~1U;
+	return (carriedRegs & writtenRegs) == 0;
+}
+
+//Checks if an idle loop reads a timer register. Such a loop waits for time to pass instead of
+//an external event and can't be skipped. Load addresses can only be known at run time, current
+//register values are used, along with the constants the loop builds itself. Reading COP0's COUNT
+//register is already ruled out by IsIdleLoop.
+bool CMIPSAnalysis::IsIdleLoopPollingTimer(CMIPS* context, uint32 begin, uint32 end)
+{
+	if(!context->m_timerAddressPredicate) return false;
+
+	uint32 regs[32];
+	for(uint32 i = 0; i < 32; i++)
+	{
+		regs[i] = context->m_State.nGPR[i].nV[0];
+	}
+
+	for(uint32 address = begin; address <= end; address += 4)
+	{
+		uint32 opcode = context->m_pMemoryMap->GetInstruction(address);
+		uint32 rs = (opcode >> 21) & 0x1F;
+		uint32 rt = (opcode >> 16) & 0x1F;
+		uint16 immediate = static_cast<uint16>(opcode & 0xFFFF);
+		switch(opcode >> 26)
+		{
+		case 0x09: //ADDIU
+		case 0x19: //DADDIU
+			regs[rt] = regs[rs] + static_cast<int16>(immediate);
+			break;
+		case 0x0D: //ORI
+			regs[rt] = regs[rs] | immediate;
+			break;
+		case 0x0F: //LUI
+			regs[rt] = static_cast<uint32>(immediate) << 16;
+			break;
+		case 0x1E: //LQ
+		case 0x20: //LB
+		case 0x21: //LH
+		case 0x23: //LW
+		case 0x24: //LBU
+		case 0x25: //LHU
+		case 0x27: //LWU
+		case 0x37: //LD
+		{
+			uint32 loadAddress = regs[rs] + static_cast<int16>(immediate);
+			uint32 physAddress = context->m_pAddrTranslator(context, loadAddress);
+			if(context->m_timerAddressPredicate(physAddress)) return true;
+			regs[rt] = context->m_State.nGPR[rt].nV[0];
+		}
+		break;
+		}
+		regs[0] = 0;
+	}
+
+	return false;
+}
@@ -21,11 +21,14 @@ public:
 	};
 
 	typedef std::vector<uint32> CallStackItemArray;
+	typedef std::vector<SUBROUTINE> SubroutineArray;
 
 	CMIPSAnalysis(CMIPS*);
 	~CMIPSAnalysis();
 	void Analyse(uint32, uint32, uint32 = -1);
+	void AnalyseSubroutines(uint32, uint32, uint32 = -1);
 	const SUBROUTINE* FindSubroutine(uint32) const;
+	SubroutineArray GetSubroutines() const;
 	void Clear();
 
 	void InsertSubroutine(uint32, uint32, uint32, uint32, uint32, uint32);
@@ -33,11 +36,12 @@ public:
 	void ChangeSubroutineEnd(uint32, uint32);
 
 	static CallStackItemArray GetCallStack(CMIPS*, uint32 pc, uint32 sp, uint32 ra);
+	static bool IsIdleLoop(CMIPS*, uint32 begin, uint32 end);
+	static bool IsIdleLoopPollingTimer(CMIPS*, uint32 begin, uint32 end);
 
 private:
 	typedef std::map<uint32, SUBROUTINE, std::greater<uint32>> SubroutineList;
 
-	void AnalyseSubroutines(uint32, uint32, uint32);
 	void AnalyseStringReferences();
 
 	void FindSubroutinesByStackAllocation(uint32, uint32);
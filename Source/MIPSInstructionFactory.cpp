@@ -5,12 +5,18 @@
 #include "offsetof_def.h"
 #include "BitManip.h"
 #include "COP_SCU.h"
+#include "FastMemWindow.h"
 
 CMIPSInstructionFactory::CMIPSInstructionFactory(MIPS_REGSIZE nRegSize)
     : m_regSize(nRegSize)
 {
 }
 
+MIPS_REGSIZE CMIPSInstructionFactory::GetRegSize() const
+{
+	return m_regSize;
+}
+
 void CMIPSInstructionFactory::SetupQuickVariables(uint32 nAddress, CMipsJitter* codeGen, CMIPS* pCtx)
 {
 	m_pCtx = pCtx;
@@ -144,6 +150,43 @@ void CMIPSInstructionFactory::ComputeMemAccessPageRef()
 	m_codeGen->LoadRefFromRef();
 }
 
+//Computes the offset of the accessed guest memory inside the fast memory window
+void CMIPSInstructionFactory::ComputeFastMemAccessAddr(uint32 accessSize)
+{
+	auto rs = static_cast<uint8>((m_nOpcode >> 21) & 0x001F);
+	auto immediate = static_cast<uint16>((m_nOpcode >> 0) & 0xFFFF);
+
+	m_codeGen->PushRel(offsetof(CMIPS, m_State.nGPR[rs].nV[0]));
+	m_codeGen->PushCst(static_cast<int16>(immediate));
+	m_codeGen->Add();
+	m_codeGen->PushCst(CFastMemWindow::WINDOW_MASK & ~(accessSize - 1));
+	m_codeGen->And();
+}
+
+//Computes a direct pointer to guest memory inside the fast memory window
+void CMIPSInstructionFactory::ComputeFastMemAccessRef(uint32 accessSize)
+{
+	m_codeGen->PushRelRef(offsetof(CMIPS, m_fastMemBase));
+	ComputeFastMemAccessAddr(accessSize);
+	m_codeGen->AddRef();
+}
+
+//Generated code can't recover from a fault inside the window, direct accesses must be
+//preceded by BeginFastMemAccess which checks that the address is backed by RAM and
+//leaves everything else (hardware registers, BIOS, other mirrors) to the regular path.
+bool CMIPSInstructionFactory::IsFastMemAccess() const
+{
+	return (m_pCtx->m_fastMemBase != nullptr) && (m_pCtx->m_fastMemSize != 0);
+}
+
+//Opens an if block taken when the access can be done directly in the fast memory window
+void CMIPSInstructionFactory::BeginFastMemAccess(uint32 accessSize)
+{
+	ComputeFastMemAccessAddr(accessSize);
+	m_codeGen->PushCst(m_pCtx->m_fastMemSize);
+	m_codeGen->BeginIf(Jitter::CONDITION_BL);
+}
+
 void CMIPSInstructionFactory::Branch(Jitter::CONDITION condition)
 {
 	uint16 nImmediate = (uint16)(m_nOpcode & 0xFFFF);
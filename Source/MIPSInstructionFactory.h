@@ -26,11 +26,17 @@ public:
 	virtual void CompileInstruction(uint32, CMipsJitter*, CMIPS*) = 0;
 	void Illegal();
 
+	MIPS_REGSIZE GetRegSize() const;
+
 protected:
 	void ComputeMemAccessAddr();
 	void ComputeMemAccessAddrNoXlat();
 	void ComputeMemAccessRef(uint32);
 	void ComputeMemAccessPageRef();
+	void ComputeFastMemAccessAddr(uint32);
+	void ComputeFastMemAccessRef(uint32);
+	bool IsFastMemAccess() const;
+	void BeginFastMemAccess(uint32);
 
 	void CheckTLBExceptions(bool);
 	void Branch(Jitter::CONDITION);
@@ -26,6 +26,14 @@ void CMailBox::FlushCalls()
 	SendCall([]() {}, true);
 }
 
+bool CMailBox::TryCallDirect(const FunctionType& function)
+{
+	std::lock_guard<std::mutex> callLock(m_callMutex);
+	if(IsPending() || m_callInProgress) return false;
+	function();
+	return true;
+}
+
 void CMailBox::SendCall(const FunctionType& function, bool waitForCompletion)
 {
 	std::unique_lock<std::mutex> callLock(m_callMutex);
@@ -71,12 +79,16 @@ void CMailBox::ReceiveCall()
 		if(!IsPending()) return;
 		message = std::move(m_calls.front());
 		m_calls.pop_front();
+		m_callInProgress = true;
 	}
 	message.function();
-	if(message.sync)
 	{
 		std::lock_guard<std::mutex> waitLock(m_callMutex);
-		m_callDone = true;
-		m_callFinished.notify_all();
+		m_callInProgress = false;
+		if(message.sync)
+		{
+			m_callDone = true;
+			m_callFinished.notify_all();
+		}
 	}
 }
@@ -16,6 +16,10 @@ public:
 	void SendCall(FunctionType&&);
 	void FlushCalls();
 
+	//Executes the call on the caller's thread if there are no calls queued or being executed.
+	//Calls can't be received while it executes, it must not send calls to this mailbox.
+	bool TryCallDirect(const FunctionType&);
+
 	bool IsPending() const;
 	void ReceiveCall();
 	void WaitForCall();
@@ -43,4 +47,5 @@ private:
 	std::condition_variable m_callFinished;
 	std::condition_variable m_waitCondition;
 	bool m_callDone;
+	bool m_callInProgress = false;
 };
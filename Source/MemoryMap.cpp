@@ -7,31 +7,80 @@
 void CMemoryMap::InsertReadMap(uint32 start, uint32 end, void* pointer, unsigned char key)
 {
 	assert(GetReadMap(start) == nullptr);
-	InsertMap(m_readMap, start, end, pointer, key);
+	MEMORYMAPELEMENT element = {};
+	element.nStart = start;
+	element.nEnd = end;
+	element.pPointer = pointer;
+	element.nType = MEMORYMAP_TYPE_MEMORY;
+	InsertMap(m_readMap, m_readMapIndex, std::move(element));
 }
 
 void CMemoryMap::InsertReadMap(uint32 start, uint32 end, const MemoryMapHandlerType& handler, unsigned char key)
 {
 	assert(GetReadMap(start) == nullptr);
-	InsertMap(m_readMap, start, end, handler, key);
+	MEMORYMAPELEMENT element = {};
+	element.nStart = start;
+	element.nEnd = end;
+	element.handler = handler;
+	element.nType = MEMORYMAP_TYPE_FUNCTION;
+	InsertMap(m_readMap, m_readMapIndex, std::move(element));
+}
+
+void CMemoryMap::InsertReadMap(uint32 start, uint32 end, MemoryMapDirectHandlerType handler, void* context, unsigned char key)
+{
+	assert(GetReadMap(start) == nullptr);
+	MEMORYMAPELEMENT element = {};
+	element.nStart = start;
+	element.nEnd = end;
+	element.directHandler = handler;
+	element.directHandlerContext = context;
+	element.nType = MEMORYMAP_TYPE_FUNCTION;
+	InsertMap(m_readMap, m_readMapIndex, std::move(element));
 }
 
 void CMemoryMap::InsertWriteMap(uint32 start, uint32 end, void* pointer, unsigned char key)
 {
 	assert(GetWriteMap(start) == nullptr);
-	InsertMap(m_writeMap, start, end, pointer, key);
+	MEMORYMAPELEMENT element = {};
+	element.nStart = start;
+	element.nEnd = end;
+	element.pPointer = pointer;
+	element.nType = MEMORYMAP_TYPE_MEMORY;
+	InsertMap(m_writeMap, m_writeMapIndex, std::move(element));
 }
 
 void CMemoryMap::InsertWriteMap(uint32 start, uint32 end, const MemoryMapHandlerType& handler, unsigned char key)
 {
 	assert(GetWriteMap(start) == nullptr);
-	InsertMap(m_writeMap, start, end, handler, key);
+	MEMORYMAPELEMENT element = {};
+	element.nStart = start;
+	element.nEnd = end;
+	element.handler = handler;
+	element.nType = MEMORYMAP_TYPE_FUNCTION;
+	InsertMap(m_writeMap, m_writeMapIndex, std::move(element));
+}
+
+void CMemoryMap::InsertWriteMap(uint32 start, uint32 end, MemoryMapDirectHandlerType handler, void* context, unsigned char key)
+{
+	assert(GetWriteMap(start) == nullptr);
+	MEMORYMAPELEMENT element = {};
+	element.nStart = start;
+	element.nEnd = end;
+	element.directHandler = handler;
+	element.directHandlerContext = context;
+	element.nType = MEMORYMAP_TYPE_FUNCTION;
+	InsertMap(m_writeMap, m_writeMapIndex, std::move(element));
 }
 
 void CMemoryMap::InsertInstructionMap(uint32 start, uint32 end, void* pointer, unsigned char key)
 {
-	assert(GetMap(m_instructionMap, start) == nullptr);
-	InsertMap(m_instructionMap, start, end, pointer, key);
+	assert(GetMap(m_instructionMap, m_instructionMapIndex, start) == nullptr);
+	MEMORYMAPELEMENT element = {};
+	element.nStart = start;
+	element.nEnd = end;
+	element.pPointer = pointer;
+	element.nType = MEMORYMAP_TYPE_MEMORY;
+	InsertMap(m_instructionMap, m_instructionMapIndex, std::move(element));
 }
 
 const CMemoryMap::MemoryMapListType& CMemoryMap::GetInstructionMaps()
@@ -41,39 +90,46 @@ const CMemoryMap::MemoryMapListType& CMemoryMap::GetInstructionMaps()
 
 const CMemoryMap::MEMORYMAPELEMENT* CMemoryMap::GetReadMap(uint32 address) const
 {
-	return GetMap(m_readMap, address);
+	return GetMap(m_readMap, m_readMapIndex, address);
 }
 
 const CMemoryMap::MEMORYMAPELEMENT* CMemoryMap::GetWriteMap(uint32 address) const
 {
-	return GetMap(m_writeMap, address);
+	return GetMap(m_writeMap, m_writeMapIndex, address);
 }
 
-void CMemoryMap::InsertMap(MemoryMapListType& memoryMap, uint32 start, uint32 end, void* pointer, unsigned char key)
+void CMemoryMap::InsertMap(MemoryMapListType& memoryMap, MemoryMapIndexType& memoryMapIndex, MEMORYMAPELEMENT element)
 {
-	MEMORYMAPELEMENT element;
-	element.nStart = start;
-	element.nEnd = end;
-	element.pPointer = pointer;
-	element.nType = MEMORYMAP_TYPE_MEMORY;
-	memoryMap.push_back(element);
+	memoryMap.push_back(std::move(element));
+	BuildIndex(memoryMap, memoryMapIndex);
 }
 
-void CMemoryMap::InsertMap(MemoryMapListType& memoryMap, uint32 start, uint32 end, const MemoryMapHandlerType& handler, unsigned char key)
+//Elements that come before the one referenced by the index of a page all end before
+//that page, skipping them gives the same result as scanning from the beginning.
+//Index can only grow from one page to the next, so everything is computed in one pass.
+void CMemoryMap::BuildIndex(const MemoryMapListType& memoryMap, MemoryMapIndexType& memoryMapIndex)
 {
-	MEMORYMAPELEMENT element;
-	element.nStart = start;
-	element.nEnd = end;
-	element.handler = handler;
-	element.pPointer = nullptr;
-	element.nType = MEMORYMAP_TYPE_FUNCTION;
-	memoryMap.push_back(element);
+	assert(memoryMap.size() < 0x10000);
+	memoryMapIndex.resize(INDEX_PAGE_COUNT);
+	size_t elementIndex = 0;
+	for(uint32 page = 0; page < INDEX_PAGE_COUNT; page++)
+	{
+		uint32 pageStart = page << INDEX_PAGE_SHIFT;
+		while((elementIndex < memoryMap.size()) && (memoryMap[elementIndex].nEnd < pageStart))
+		{
+			elementIndex++;
+		}
+		memoryMapIndex[page] = static_cast<uint16>(elementIndex);
+	}
 }
 
-const CMemoryMap::MEMORYMAPELEMENT* CMemoryMap::GetMap(const MemoryMapListType& memoryMap, uint32 nAddress)
+const CMemoryMap::MEMORYMAPELEMENT* CMemoryMap::GetMap(const MemoryMapListType& memoryMap, const MemoryMapIndexType& memoryMapIndex, uint32 nAddress)
 {
-	for(const auto& mapElement : memoryMap)
+	if(memoryMapIndex.empty()) return nullptr;
+	size_t elementCount = memoryMap.size();
+	for(size_t elementIndex = memoryMapIndex[nAddress >> INDEX_PAGE_SHIFT]; elementIndex < elementCount; elementIndex++)
 	{
+		const auto& mapElement = memoryMap[elementIndex];
 		if(nAddress <= mapElement.nEnd)
 		{
 			if(!(nAddress >= mapElement.nStart)) return nullptr;
@@ -85,7 +141,7 @@ const CMemoryMap::MEMORYMAPELEMENT* CMemoryMap::GetMap(const MemoryMapListType&
 
 uint8 CMemoryMap::GetByte(uint32 nAddress)
 {
-	const auto e = GetMap(m_readMap, nAddress);
+	const auto e = GetMap(m_readMap, m_readMapIndex, nAddress);
 	if(!e)
 	{
 		CLog::GetInstance().Print(LOG_NAME, "Read byte from unmapped memory (0x%08X).\r\n", nAddress);
@@ -97,7 +153,7 @@ uint8 CMemoryMap::GetByte(uint32 nAddress)
 		return *(uint8*)&((uint8*)e->pPointer)[nAddress - e->nStart];
 		break;
 	case MEMORYMAP_TYPE_FUNCTION:
-		return static_cast<uint8>(e->handler(nAddress, 0));
+		return static_cast<uint8>(e->CallHandler(nAddress, 0));
 		break;
 	default:
 		assert(0);
@@ -108,7 +164,7 @@ uint8 CMemoryMap::GetByte(uint32 nAddress)
 
 void CMemoryMap::SetByte(uint32 nAddress, uint8 nValue)
 {
-	const auto e = GetMap(m_writeMap, nAddress);
+	const auto e = GetMap(m_writeMap, m_writeMapIndex, nAddress);
 	if(!e)
 	{
 		CLog::GetInstance().Print(LOG_NAME, "Wrote byte to unmapped memory (0x%08X, 0x%02X).\r\n", nAddress, nValue);
@@ -120,7 +176,7 @@ void CMemoryMap::SetByte(uint32 nAddress, uint8 nValue)
 		*(uint8*)&((uint8*)e->pPointer)[nAddress - e->nStart] = nValue;
 		break;
 	case MEMORYMAP_TYPE_FUNCTION:
-		e->handler(nAddress, nValue);
+		e->CallHandler(nAddress, nValue);
 		break;
 	default:
 		assert(0);
@@ -135,7 +191,7 @@ void CMemoryMap::SetByte(uint32 nAddress, uint8 nValue)
 uint16 CMemoryMap_LSBF::GetHalf(uint32 nAddress)
 {
 	assert((nAddress & 0x01) == 0);
-	const auto e = GetMap(m_readMap, nAddress);
+	const auto e = GetMap(m_readMap, m_readMapIndex, nAddress);
 	if(!e)
 	{
 		CLog::GetInstance().Print(LOG_NAME, "Read half from unmapped memory (0x%08X).\r\n", nAddress);
@@ -147,7 +203,7 @@ uint16 CMemoryMap_LSBF::GetHalf(uint32 nAddress)
 		return *(uint16*)&((uint8*)e->pPointer)[nAddress - e->nStart];
 		break;
 	default:
-		return static_cast<uint16>(e->handler(nAddress, 0));
+		return static_cast<uint16>(e->CallHandler(nAddress, 0));
 		break;
 	}
 }
@@ -155,7 +211,7 @@ uint16 CMemoryMap_LSBF::GetHalf(uint32 nAddress)
 uint32 CMemoryMap_LSBF::GetWord(uint32 nAddress)
 {
 	assert((nAddress & 0x03) == 0);
-	const auto e = GetMap(m_readMap, nAddress);
+	const auto e = GetMap(m_readMap, m_readMapIndex, nAddress);
 	if(!e)
 	{
 		CLog::GetInstance().Print(LOG_NAME, "Read word from unmapped memory (0x%08X).\r\n", nAddress);
@@ -167,7 +223,7 @@ uint32 CMemoryMap_LSBF::GetWord(uint32 nAddress)
 		return *(uint32*)&((uint8*)e->pPointer)[nAddress - e->nStart];
 		break;
 	case MEMORYMAP_TYPE_FUNCTION:
-		return e->handler(nAddress, 0);
+		return e->CallHandler(nAddress, 0);
 		break;
 	default:
 		assert(0);
@@ -179,7 +235,7 @@ uint32 CMemoryMap_LSBF::GetWord(uint32 nAddress)
 uint32 CMemoryMap_LSBF::GetInstruction(uint32 address)
 {
 	assert((address & 0x03) == 0);
-	const auto e = GetMap(m_instructionMap, address);
+	const auto e = GetMap(m_instructionMap, m_instructionMapIndex, address);
 	if(!e) return 0xCCCCCCCC;
 	switch(e->nType)
 	{
@@ -196,7 +252,7 @@ uint32 CMemoryMap_LSBF::GetInstruction(uint32 address)
 void CMemoryMap_LSBF::SetHalf(uint32 nAddress, uint16 nValue)
 {
 	assert((nAddress & 0x01) == 0);
-	const auto e = GetMap(m_writeMap, nAddress);
+	const auto e = GetMap(m_writeMap, m_writeMapIndex, nAddress);
 	if(!e)
 	{
 		CLog::GetInstance().Print(LOG_NAME, "Wrote half to unmapped memory (0x%08X, 0x%04X).\r\n", nAddress, nValue);
@@ -208,7 +264,7 @@ void CMemoryMap_LSBF::SetHalf(uint32 nAddress, uint16 nValue)
 		*reinterpret_cast<uint16*>(&reinterpret_cast<uint8*>(e->pPointer)[nAddress - e->nStart]) = nValue;
 		break;
 	case MEMORYMAP_TYPE_FUNCTION:
-		e->handler(nAddress, nValue);
+		e->CallHandler(nAddress, nValue);
 		break;
 	default:
 		assert(0);
@@ -219,7 +275,7 @@ void CMemoryMap_LSBF::SetHalf(uint32 nAddress, uint16 nValue)
 void CMemoryMap_LSBF::SetWord(uint32 nAddress, uint32 nValue)
 {
 	assert((nAddress & 0x03) == 0);
-	const auto e = GetMap(m_writeMap, nAddress);
+	const auto e = GetMap(m_writeMap, m_writeMapIndex, nAddress);
 	if(!e)
 	{
 		CLog::GetInstance().Print(LOG_NAME, "Wrote word to unmapped memory (0x%08X, 0x%08X).\r\n", nAddress, nValue);
@@ -231,7 +287,7 @@ void CMemoryMap_LSBF::SetWord(uint32 nAddress, uint32 nValue)
 		*(uint32*)&((uint8*)e->pPointer)[nAddress - e->nStart] = nValue;
 		break;
 	case MEMORYMAP_TYPE_FUNCTION:
-		e->handler(nAddress, nValue);
+		e->CallHandler(nAddress, nValue);
 		break;
 	default:
 		assert(0);
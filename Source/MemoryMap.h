@@ -15,6 +15,8 @@ class CMemoryMap
 {
 public:
 	typedef std::function<uint32(uint32, uint32)> MemoryMapHandlerType;
+	//Cheaper alternative to std::function for hot register blocks, first parameter is the context
+	typedef uint32 (*MemoryMapDirectHandlerType)(void*, uint32, uint32);
 
 	enum MEMORYMAP_TYPE
 	{
@@ -28,7 +30,14 @@ public:
 		uint32 nEnd;
 		void* pPointer;
 		MemoryMapHandlerType handler;
+		MemoryMapDirectHandlerType directHandler;
+		void* directHandlerContext;
 		MEMORYMAP_TYPE nType;
+
+		uint32 CallHandler(uint32 address, uint32 value) const
+		{
+			return directHandler ? directHandler(directHandlerContext, address, value) : handler(address, value);
+		}
 	};
 	typedef std::vector<MEMORYMAPELEMENT> MemoryMapListType;
 
@@ -42,23 +51,38 @@ public:
 	virtual void SetWord(uint32, uint32) = 0;
 	void InsertReadMap(uint32, uint32, void*, unsigned char);
 	void InsertReadMap(uint32, uint32, const MemoryMapHandlerType&, unsigned char);
+	void InsertReadMap(uint32, uint32, MemoryMapDirectHandlerType, void*, unsigned char);
 	void InsertWriteMap(uint32, uint32, void*, unsigned char);
 	void InsertWriteMap(uint32, uint32, const MemoryMapHandlerType&, unsigned char);
+	void InsertWriteMap(uint32, uint32, MemoryMapDirectHandlerType, void*, unsigned char);
 	void InsertInstructionMap(uint32, uint32, void*, unsigned char);
 	const MemoryMapListType& GetInstructionMaps();
 	const MEMORYMAPELEMENT* GetReadMap(uint32) const;
 	const MEMORYMAPELEMENT* GetWriteMap(uint32) const;
 
 protected:
-	static const MEMORYMAPELEMENT* GetMap(const MemoryMapListType&, uint32);
+	enum
+	{
+		INDEX_PAGE_SHIFT = 16,
+		INDEX_PAGE_COUNT = (1 << (32 - INDEX_PAGE_SHIFT)),
+	};
+
+	//For every page, index of the first element that could contain an address of that page
+	typedef std::vector<uint16> MemoryMapIndexType;
+
+	static const MEMORYMAPELEMENT* GetMap(const MemoryMapListType&, const MemoryMapIndexType&, uint32);
 
 	MemoryMapListType m_instructionMap;
 	MemoryMapListType m_readMap;
 	MemoryMapListType m_writeMap;
 
+	MemoryMapIndexType m_instructionMapIndex;
+	MemoryMapIndexType m_readMapIndex;
+	MemoryMapIndexType m_writeMapIndex;
+
 private:
-	static void InsertMap(MemoryMapListType&, uint32, uint32, void*, unsigned char);
-	static void InsertMap(MemoryMapListType&, uint32, uint32, const MemoryMapHandlerType&, unsigned char);
+	static void InsertMap(MemoryMapListType&, MemoryMapIndexType&, MEMORYMAPELEMENT);
+	static void BuildIndex(const MemoryMapListType&, MemoryMapIndexType&);
 };
 
 class CMemoryMap_LSBF : public CMemoryMap
@@ -5,11 +5,48 @@
 class CMipsExecutor
 {
 public:
+	enum EXECUTION_MODE
+	{
+		EXECUTION_MODE_JIT,
+		//Blocks only using the integer core are interpreted, others (FPU, MMI, COP2, breakpoints)
+		//are still compiled. This mode still requires a working JIT.
+		EXECUTION_MODE_MIXED,
+	};
+
+	struct IDLE_LOOP_STATS
+	{
+		uint32 loopCount = 0;
+		uint64 hitCount = 0;
+		uint64 skippedCycles = 0;
+	};
+
+	struct PRECOMPILE_STATS
+	{
+		uint32 queuedCount = 0;
+		uint32 compiledCount = 0;
+		uint32 usedCount = 0;
+	};
+
 	virtual ~CMipsExecutor() = default;
 	virtual void Reset() = 0;
 	virtual int Execute(int) = 0;
 	virtual void ClearActiveBlocksInRange(uint32 start, uint32 end, bool executing) = 0;
 
+	virtual uint32 GetCompiledBlockCount() const = 0;
+
+	virtual void SetExecutionMode(EXECUTION_MODE) = 0;
+	virtual EXECUTION_MODE GetExecutionMode() const = 0;
+	virtual uint32 GetInterpretedBlockCount() const = 0;
+
+	virtual void NotifyIdleLoop() = 0;
+	virtual IDLE_LOOP_STATS GetIdleLoopStats() const = 0;
+	virtual void ResetIdleLoopStats() = 0;
+
+	virtual void SetPrecompileEnabled(bool) = 0;
+	virtual void PrecompileRange(uint32, uint32, uint32) = 0;
+	virtual PRECOMPILE_STATS GetPrecompileStats() const = 0;
+	virtual void ResetPrecompileStats() = 0;
+
 #ifdef DEBUGGER_INCLUDED
 	virtual bool MustBreak() const = 0;
 	virtual void DisableBreakpointsOnce() = 0;
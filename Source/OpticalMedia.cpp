@@ -140,6 +140,7 @@ void COpticalMedia::CheckDualLayerDvd(const StreamPtr& stream)
 void COpticalMedia::SetupSecondLayer(const StreamPtr& stream)
 {
 	if(!m_dvdIsDualLayer) return;
-	auto blockProvider = std::make_shared<ISO9660::CBlockProvider2048>(stream, GetDvdSecondLayerStart());
+	//Both layers read from the same stream
+	auto blockProvider = std::make_shared<ISO9660::CBlockProvider2048>(stream, GetDvdSecondLayerStart(), m_track0BlockProvider->GetStreamMutex());
 	m_fileSystemL1 = std::make_unique<CISO9660>(blockProvider);
 }
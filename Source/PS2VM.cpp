@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <exception>
 #include <memory>
+#include <algorithm>
 #include <fenv.h>
 #include "FpUtils.h"
 #include "make_unique.h"
@@ -46,11 +47,9 @@ CPS2VM::CPS2VM()
     , m_singleStepIop(false)
     , m_singleStepVu0(false)
     , m_singleStepVu1(false)
-    , m_vblankTicks(0)
     , m_inVblank(false)
     , m_eeExecutionTicks(0)
     , m_iopExecutionTicks(0)
-    , m_spuUpdateTicks(SPU_UPDATE_TICKS)
     , m_eeProfilerZone(CProfiler::GetInstance().RegisterZone("EE"))
     , m_iopProfilerZone(CProfiler::GetInstance().RegisterZone("IOP"))
     , m_spuProfilerZone(CProfiler::GetInstance().RegisterZone("SPU"))
@@ -88,18 +87,37 @@ CPS2VM::CPS2VM()
 
 	Framework::PathUtils::EnsurePathExists(GetStateDirectoryPath());
 
-	m_iop = std::make_unique<Iop::CSubSystem>(true);
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_PS2_FASTMEM, false);
+	bool fastMem = CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_FASTMEM);
+
+	m_iop = std::make_unique<Iop::CSubSystem>(true, fastMem);
 	auto iopOs = dynamic_cast<CIopBios*>(m_iop->m_bios.get());
 
-	m_ee = std::make_unique<Ee::CSubSystem>(m_iop->m_ram, *iopOs);
+	m_ee = std::make_unique<Ee::CSubSystem>(m_iop->m_ram, *iopOs, fastMem);
 	m_OnRequestLoadExecutableConnection = m_ee->m_os->OnRequestLoadExecutable.Connect(std::bind(&CPS2VM::ReloadExecutable, this, std::placeholders::_1, std::placeholders::_2));
 	m_OnCrtModeChangeConnection = m_ee->m_os->OnCrtModeChange.Connect(std::bind(&CPS2VM::OnCrtModeChange, this));
+	m_OnExecutableUnloadingConnection = m_ee->m_os->OnExecutableUnloading.Connect([this]() {
+		ReportIdleLoopStats();
+		ReportPrecompileStats();
+	});
 
 	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_PS2_LIMIT_FRAMERATE, true);
 	ReloadFrameRateLimit();
 
 	CAppConfig::GetInstance().RegisterPreferenceInteger(PREF_AUDIO_SPUBLOCKCOUNT, 100);
 	m_spuBlockCount = CAppConfig::GetInstance().GetPreferenceInteger(PREF_AUDIO_SPUBLOCKCOUNT);
+
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_PS2_IOP_THREAD, false);
+	CAppConfig::GetInstance().RegisterPreferenceInteger(PREF_PS2_IOP_THREAD_WINDOW, MAX_BUSY_SLICE_TICKS);
+	m_ee->m_sif.SetSyncHandler([this]() { WaitIopWindow(); });
+
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_PS2_EE_MIXED_EXECUTION, false);
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_PS2_IOP_MIXED_EXECUTION, false);
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_PS2_PRECOMPILE, false);
+
+	m_vblankEventId = m_eventScheduler.RegisterEvent(std::bind(&CPS2VM::OnVBlankEvent, this));
+	m_spuUpdateEventId = m_eventScheduler.RegisterEvent(std::bind(&CPS2VM::OnSpuUpdateEvent, this));
+	m_gsSubmitEventId = m_eventScheduler.RegisterEvent(std::bind(&CPS2VM::OnGsSubmitEvent, this));
 }
 
 //////////////////////////////////////////////////
@@ -177,6 +195,40 @@ void CPS2VM::ReloadFrameRateLimit()
 	m_vblankTicksTotal = frameTicks / 10;
 }
 
+void CPS2VM::ReloadIopThreadMode()
+{
+	bool enabled = CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_IOP_THREAD);
+	uint32 windowTicks = CAppConfig::GetInstance().GetPreferenceInteger(PREF_PS2_IOP_THREAD_WINDOW);
+	SetIopThreadMode(enabled, windowTicks);
+}
+
+void CPS2VM::SetIopThreadMode(bool enabled, uint32 windowTicks)
+{
+	m_mailBox.SendCall([this, enabled, windowTicks]() { SetIopThreadModeImpl(enabled, windowTicks); }, true);
+}
+
+void CPS2VM::ReloadExecutionModes()
+{
+	bool eeMixed = CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_EE_MIXED_EXECUTION);
+	bool iopMixed = CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_IOP_MIXED_EXECUTION);
+	SetExecutionModes(eeMixed, iopMixed);
+}
+
+void CPS2VM::SetExecutionModes(bool eeMixed, bool iopMixed)
+{
+	m_mailBox.SendCall([this, eeMixed, iopMixed]() { SetExecutionModesImpl(eeMixed, iopMixed); }, true);
+}
+
+void CPS2VM::ReloadPrecompile()
+{
+	SetPrecompileEnabled(CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_PRECOMPILE));
+}
+
+void CPS2VM::SetPrecompileEnabled(bool enabled)
+{
+	m_mailBox.SendCall([this, enabled]() { SetPrecompileEnabledImpl(enabled); }, true);
+}
+
 CVirtualMachine::STATUS CPS2VM::GetStatus() const
 {
 	return m_nStatus;
@@ -315,6 +367,48 @@ void CPS2VM::TriggerFrameDump(const FrameDumpCallback& frameDumpCallback)
 	    false);
 }
 
+void CPS2VM::BeginFrameDumpStream(const fs::path& frameDumpStreamPath)
+{
+	m_mailBox.SendCall(
+	    [=]() {
+		    std::unique_lock<std::mutex> frameDumpCallbackMutexLock(m_frameDumpCallbackMutex);
+		    if(m_frameDumpStream || m_pendingFrameDumpStream) return;
+		    try
+		    {
+			    auto stream = std::make_unique<Framework::CStdStream>(Framework::CreateOutputStdStream(frameDumpStreamPath.native()));
+			    //Capture will start on the next frame
+			    m_pendingFrameDumpStream = std::make_unique<CFrameDumpStreamWriter>(std::move(stream));
+		    }
+		    catch(const std::exception& exception)
+		    {
+			    CLog::GetInstance().Warn(LOG_NAME, "Failed to begin frame dump stream: %s\r\n", exception.what());
+		    }
+	    },
+	    false);
+}
+
+void CPS2VM::EndFrameDumpStream()
+{
+	m_mailBox.SendCall(
+	    [this]() {
+		    std::unique_ptr<CFrameDumpStreamWriter> frameDumpStream;
+		    {
+			    std::unique_lock<std::mutex> frameDumpCallbackMutexLock(m_frameDumpCallbackMutex);
+			    if(m_ee->m_gs)
+			    {
+				    m_ee->m_gs->SetFrameDumpStream(nullptr);
+			    }
+			    frameDumpStream = std::move(m_frameDumpStream);
+			    m_pendingFrameDumpStream.reset();
+		    }
+		    if(frameDumpStream)
+		    {
+			    frameDumpStream->Finish();
+		    }
+	    },
+	    true);
+}
+
 CPS2VM::CPU_UTILISATION_INFO CPS2VM::GetCpuUtilisationInfo() const
 {
 	return m_cpuUtilisation;
@@ -407,6 +501,9 @@ void CPS2VM::CreateVM()
 
 void CPS2VM::ResetVM()
 {
+	ReportIdleLoopStats();
+	ReportPrecompileStats();
+
 	m_ee->Reset();
 	m_iop->Reset();
 
@@ -437,13 +534,14 @@ void CPS2VM::ResetVM()
 
 	CDROM0_SyncPath();
 
-	m_vblankTicks = m_onScreenTicksTotal;
 	m_inVblank = false;
 
 	m_eeExecutionTicks = 0;
 	m_iopExecutionTicks = 0;
 
-	m_spuUpdateTicks = SPU_UPDATE_TICKS;
+	m_eventScheduler.Reset();
+	m_eventScheduler.Schedule(m_vblankEventId, m_onScreenTicksTotal);
+	m_eventScheduler.Schedule(m_spuUpdateEventId, SPU_UPDATE_EE_TICKS);
 	m_currentSpuBlock = 0;
 
 	RegisterModulesInPadHandler();
@@ -534,6 +632,8 @@ void CPS2VM::ResumeImpl()
 
 void CPS2VM::DestroyImpl()
 {
+	ReportIdleLoopStats();
+	ReportPrecompileStats();
 	DestroyGsHandlerImpl();
 	DestroyPadHandlerImpl();
 	DestroySoundHandlerImpl();
@@ -619,6 +719,37 @@ void CPS2VM::OnGsNewFrame()
 #endif
 }
 
+//Called on the EE thread once the GS handler was given every packet of the frame.
+//Packets are added to the stream on this thread, the frame is cut here and key frames
+//are taken once the GS thread is done with the frame's packets.
+void CPS2VM::UpdateFrameDumpStream()
+{
+#ifdef DEBUGGER_INCLUDED
+	std::unique_lock<std::mutex> frameDumpCallbackMutexLock(m_frameDumpCallbackMutex);
+	if(!m_frameDumpStream)
+	{
+		if(!m_pendingFrameDumpStream) return;
+		m_frameDumpStream = std::move(m_pendingFrameDumpStream);
+		m_ee->m_gs->SetFrameDumpStream(m_frameDumpStream.get());
+	}
+	if(m_frameDumpStream->AddVSync())
+	{
+		auto gs = m_ee->m_gs;
+		std::vector<uint8> gsRam(CGSHandler::RAMSIZE);
+		uint64 gsRegisters[CGSHandler::REGISTER_MAX];
+		uint64 smode2 = 0;
+		gs->SendGSCall(
+		    [&]() {
+			    memcpy(gsRam.data(), gs->GetRam(), CGSHandler::RAMSIZE);
+			    memcpy(gsRegisters, gs->GetRegisters(), sizeof(gsRegisters));
+			    smode2 = gs->GetSMODE2();
+		    },
+		    true, true);
+		m_frameDumpStream->AddKeyFrame(gsRam.data(), gsRegisters, smode2);
+	}
+#endif
+}
+
 void CPS2VM::UpdateEe()
 {
 #ifdef PROFILE
@@ -644,7 +775,7 @@ void CPS2VM::UpdateEe()
 
 		m_eeExecutionTicks -= executed;
 		m_ee->CountTicks(executed);
-		m_vblankTicks -= executed;
+		m_eventScheduler.AdvanceTime(executed);
 
 #ifdef DEBUGGER_INCLUDED
 		if(m_singleStepEe) break;
@@ -659,6 +790,11 @@ void CPS2VM::UpdateIop()
 	CProfilerZone profilerZone(m_iopProfilerZone);
 #endif
 
+	ExecuteIop();
+}
+
+void CPS2VM::ExecuteIop()
+{
 	while(m_iopExecutionTicks > 0)
 	{
 		int executed = m_iop->ExecuteCpu(m_singleStepIop ? 1 : m_iopExecutionTicks);
@@ -674,7 +810,6 @@ void CPS2VM::UpdateIop()
 #endif
 
 		m_iopExecutionTicks -= executed;
-		m_spuUpdateTicks -= executed;
 		m_iop->CountTicks(executed);
 
 #ifdef DEBUGGER_INCLUDED
@@ -721,6 +856,258 @@ void CPS2VM::UpdateSpu()
 	}
 }
 
+void CPS2VM::OnVBlankEvent()
+{
+	m_inVblank = !m_inVblank;
+	if(m_inVblank)
+	{
+		m_eventScheduler.ScheduleNext(m_vblankEventId, m_vblankTicksTotal);
+		m_ee->NotifyVBlankStart();
+		m_iop->NotifyVBlankStart();
+
+		if(m_ee->m_gs != NULL)
+		{
+#ifdef PROFILE
+			CProfilerZone profilerZone(m_gsSyncProfilerZone);
+#endif
+			m_ee->m_gs->SetVBlank();
+			UpdateFrameDumpStream();
+		}
+
+		if(m_pad != NULL)
+		{
+			m_pad->Update(m_ee->m_ram);
+		}
+#ifdef PROFILE
+		{
+			auto sifStats = m_ee->m_sif.GetStats();
+			m_cpuUtilisation.sifPacketCount = sifStats.packetCount;
+			m_cpuUtilisation.sifPacketBytes = sifStats.packetBytes;
+			m_cpuUtilisation.sifDmaCount = sifStats.dmaCount;
+			m_cpuUtilisation.sifDmaBytes = sifStats.dmaBytes;
+			m_ee->m_sif.ResetStats();
+		}
+		if(m_ee->m_gs != NULL)
+		{
+			auto imageDataStats = m_ee->m_gs->GetImageDataStats();
+			m_cpuUtilisation.gsImagePacketCount = imageDataStats.packetCount;
+			m_cpuUtilisation.gsImageBytes = static_cast<int32>(imageDataStats.byteCount);
+			m_cpuUtilisation.gsImageStallCount = imageDataStats.stallCount;
+			m_cpuUtilisation.gsImageOverflowCount = imageDataStats.overflowCount;
+			m_ee->m_gs->ResetImageDataStats();
+
+			auto writeBufferStats = m_ee->m_gs->GetWriteBufferStats();
+			m_cpuUtilisation.gsWriteCount = writeBufferStats.writeCount;
+			m_cpuUtilisation.gsSubmitCount = writeBufferStats.submitCount;
+			m_cpuUtilisation.gsSubmitThreshold = writeBufferStats.submitThreshold;
+			m_cpuUtilisation.gsWriteStallCount = writeBufferStats.stallCount;
+			m_cpuUtilisation.gsIdleTime = writeBufferStats.gsIdleTime;
+			m_cpuUtilisation.gsWaitTime = writeBufferStats.gsWaitTime;
+			m_ee->m_gs->ResetWriteBufferStats();
+		}
+		if(auto iopOs = dynamic_cast<CIopBios*>(m_iop->m_bios.get()))
+		{
+			auto ioman = iopOs->GetIoman();
+			for(const auto& deviceStatsPair : ioman->GetDeviceStats())
+			{
+				const auto& deviceStats = deviceStatsPair.second;
+				auto& deviceInfo = m_cpuUtilisation.iomanDevices[deviceStatsPair.first];
+				deviceInfo.readCount = deviceStats.readCount;
+				deviceInfo.asyncReadCount = deviceStats.asyncReadCount;
+				deviceInfo.readBytes = deviceStats.readBytes;
+				deviceInfo.readTime = deviceStats.readTime;
+				deviceInfo.maxReadTime = deviceStats.maxReadTime;
+			}
+			ioman->ResetDeviceStats();
+		}
+		{
+			CProfiler::GetInstance().CountCurrentZone();
+			auto stats = CProfiler::GetInstance().GetStats();
+			ProfileFrameDone(stats);
+			CProfiler::GetInstance().Reset();
+		}
+
+		m_cpuUtilisation = CPU_UTILISATION_INFO();
+#endif
+	}
+	else
+	{
+		m_eventScheduler.ScheduleNext(m_vblankEventId, m_onScreenTicksTotal);
+		m_ee->NotifyVBlankEnd();
+		m_iop->NotifyVBlankEnd();
+		if(m_ee->m_gs != NULL)
+		{
+			m_ee->m_gs->ResetVBlank();
+		}
+		m_frameLimiter.EndFrame();
+		m_frameLimiter.BeginFrame();
+	}
+}
+
+void CPS2VM::OnSpuUpdateEvent()
+{
+	m_eventScheduler.ScheduleNext(m_spuUpdateEventId, SPU_UPDATE_EE_TICKS);
+	UpdateSpu();
+}
+
+//Writes that didn't reach the submit threshold would otherwise wait for the next packet or the end of the frame
+void CPS2VM::OnGsSubmitEvent()
+{
+	if(m_ee->m_gs == NULL) return;
+	m_ee->m_gs->SubmitWriteBuffer();
+	//Writes of a packet that is still in progress can't be submitted yet, check them again later
+	if(m_ee->m_gs->HasPendingRegisterWrites())
+	{
+		m_eventScheduler.ScheduleNext(m_gsSubmitEventId, GS_SUBMIT_TICKS);
+	}
+}
+
+void CPS2VM::ScheduleGsSubmit()
+{
+	if(m_eventScheduler.IsScheduled(m_gsSubmitEventId)) return;
+	if((m_ee->m_gs == NULL) || !m_ee->m_gs->HasPendingRegisterWrites()) return;
+	m_eventScheduler.Schedule(m_gsSubmitEventId, GS_SUBMIT_TICKS);
+}
+
+uint32 CPS2VM::GetNextSliceTicks()
+{
+	SLICE_STATE state;
+	state.nextEventTicks = m_eventScheduler.GetTicksUntilNextEvent();
+	state.busySliceTicks = m_busySliceTicks;
+	state.cpusIdle = m_ee->IsCpuIdle() && m_iop->IsCpuIdle();
+	if(state.cpusIdle)
+	{
+		state.eeWakeUpTicks = m_ee->GetTicksUntilNextEvent();
+		state.iopWakeUpTicks = m_iop->GetTicksUntilNextEvent();
+#ifdef PROFILE
+		m_cpuUtilisation.idleSkipCount++;
+#endif
+	}
+#ifdef PROFILE
+	m_cpuUtilisation.sliceCount++;
+#endif
+	return ComputeSliceTicks(state);
+}
+
+//Runs CPUs until the next scheduled event, but not for too long if one of them is busy since
+//they need to communicate with each other. If both CPUs are idle, nothing can happen until an
+//interrupt or a scheduled event occurs, so we can skip straight to the earliest of those.
+//Wake up times are only lower bounds and are 0 when something is pending (DMA transfer, VU
+//program, ready thread), idle slices never get shorter than busy slices for that reason.
+uint32 CPS2VM::ComputeSliceTicks(const SLICE_STATE& state)
+{
+	uint64 sliceTicks = std::min<uint64>(state.nextEventTicks, state.busySliceTicks);
+	if(state.cpusIdle)
+	{
+		uint64 wakeUpTicks = std::min<uint64>(state.eeWakeUpTicks, static_cast<uint64>(state.iopWakeUpTicks) * IOP_TICK_RATIO);
+		sliceTicks = std::min<uint64>({state.nextEventTicks, std::max<uint64>(wakeUpTicks, state.busySliceTicks), MAX_IDLE_SLICE_TICKS});
+	}
+	//Keep slices aligned on IOP ticks
+	sliceTicks = std::max<uint64>(sliceTicks - (sliceTicks % IOP_TICK_RATIO), IOP_TICK_RATIO);
+	return static_cast<uint32>(sliceTicks);
+}
+
+void CPS2VM::SetIopThreadModeImpl(bool enabled, uint32 windowTicks)
+{
+	//Window needs to contain at least one IOP tick
+	windowTicks = std::max<uint32>(windowTicks, IOP_TICK_RATIO);
+	m_busySliceTicks = enabled ? windowTicks : MAX_BUSY_SLICE_TICKS;
+	if(enabled == m_iopThreadEnabled) return;
+	if(enabled)
+	{
+		StartIopThread();
+	}
+	else
+	{
+		StopIopThread();
+	}
+	CLog::GetInstance().Print(LOG_NAME, "IOP thread %s (window: %d ticks).\r\n", enabled ? "enabled" : "disabled", m_busySliceTicks);
+}
+
+void CPS2VM::SetExecutionModesImpl(bool eeMixed, bool iopMixed)
+{
+	//Changing modes discards all blocks, IOP must not be running
+	WaitIopWindow();
+	m_ee->m_EE.m_executor->SetExecutionMode(eeMixed ? CMipsExecutor::EXECUTION_MODE_MIXED : CMipsExecutor::EXECUTION_MODE_JIT);
+	m_iop->m_cpu.m_executor->SetExecutionMode(iopMixed ? CMipsExecutor::EXECUTION_MODE_MIXED : CMipsExecutor::EXECUTION_MODE_JIT);
+	if(eeMixed || iopMixed)
+	{
+		CLog::GetInstance().Print(LOG_NAME, "Mixed execution enabled (EE: %s, IOP: %s), blocks using the FPU, MMI or COP2 and VU code are still compiled.\r\n",
+		                          eeMixed ? "on" : "off", iopMixed ? "on" : "off");
+	}
+}
+
+void CPS2VM::SetPrecompileEnabledImpl(bool enabled)
+{
+	//Only affects executables and modules loaded from now on
+	WaitIopWindow();
+	m_ee->m_EE.m_executor->SetPrecompileEnabled(enabled);
+	m_iop->m_cpu.m_executor->SetPrecompileEnabled(enabled);
+	CLog::GetInstance().Print(LOG_NAME, "Block precompilation %s.\r\n", enabled ? "enabled" : "disabled");
+}
+
+void CPS2VM::StartIopThread()
+{
+	assert(!m_iopThread.joinable());
+	m_iopWindowPending = false;
+	m_iopThreadEnd = false;
+	m_iopThread = std::thread([this]() { IopThreadProc(); });
+	m_iopThreadEnabled = true;
+}
+
+void CPS2VM::StopIopThread()
+{
+	if(!m_iopThread.joinable()) return;
+	WaitIopWindow();
+	{
+		std::lock_guard<std::mutex> windowLock(m_iopWindowMutex);
+		m_iopThreadEnd = true;
+	}
+	m_iopWindowCondition.notify_all();
+	m_iopThread.join();
+	m_iopThreadEnabled = false;
+}
+
+void CPS2VM::IopThreadProc()
+{
+	fesetround(FE_TOWARDZERO);
+	FpUtils::SetDenormalHandlingMode();
+	while(1)
+	{
+		{
+			std::unique_lock<std::mutex> windowLock(m_iopWindowMutex);
+			m_iopWindowCondition.wait(windowLock, [this]() { return m_iopWindowPending || m_iopThreadEnd; });
+			if(m_iopThreadEnd) break;
+		}
+		ExecuteIop();
+		{
+			std::lock_guard<std::mutex> windowLock(m_iopWindowMutex);
+			m_iopWindowPending = false;
+		}
+		m_iopWindowCondition.notify_all();
+	}
+}
+
+//Lets the IOP thread execute the ticks that were allotted to it
+void CPS2VM::BeginIopWindow()
+{
+	{
+		std::lock_guard<std::mutex> windowLock(m_iopWindowMutex);
+		assert(!m_iopWindowPending);
+		m_iopWindowPending = true;
+	}
+	m_iopWindowCondition.notify_all();
+}
+
+//Waits until the IOP thread is done with its current window. Once this returns,
+//the IOP is stopped until the next window begins and its state can be accessed safely.
+void CPS2VM::WaitIopWindow()
+{
+	if(!m_iopThreadEnabled) return;
+	std::unique_lock<std::mutex> windowLock(m_iopWindowMutex);
+	m_iopWindowCondition.wait(windowLock, [this]() { return !m_iopWindowPending; });
+}
+
 void CPS2VM::CDROM0_SyncPath()
 {
 	//TODO: Check if there's an m_cdrom0 already
@@ -754,6 +1141,9 @@ void CPS2VM::SetIopOpticalMedia(COpticalMedia* opticalMedia)
 	auto iopOs = dynamic_cast<CIopBios*>(m_iop->m_bios.get());
 	assert(iopOs);
 
+	//Reads in flight might be using the previous media
+	iopOs->GetIoman()->CompleteAsyncReads();
+
 	iopOs->GetCdvdfsv()->SetOpticalMedia(opticalMedia);
 	iopOs->GetCdvdman()->SetOpticalMedia(opticalMedia);
 }
@@ -788,6 +1178,46 @@ void CPS2VM::OnCrtModeChange()
 	ReloadFrameRateLimit();
 }
 
+void CPS2VM::ReportIdleLoopStats()
+{
+	//Can be called while the EE is running, make sure IOP isn't
+	WaitIopWindow();
+
+	auto& eeExecutor = m_ee->m_EE.m_executor;
+	auto& iopExecutor = m_iop->m_cpu.m_executor;
+	auto eeStats = eeExecutor->GetIdleLoopStats();
+	auto iopStats = iopExecutor->GetIdleLoopStats();
+	if((eeStats.hitCount != 0) || (iopStats.hitCount != 0))
+	{
+		CLog::GetInstance().Print(LOG_NAME, "Idle loops for '%s': EE: %d detected, %llu cycles skipped. IOP: %d detected, %llu cycles skipped.\r\n",
+		                          m_ee->m_os->GetExecutableName(),
+		                          eeStats.loopCount, static_cast<unsigned long long>(eeStats.skippedCycles),
+		                          iopStats.loopCount, static_cast<unsigned long long>(iopStats.skippedCycles));
+	}
+	eeExecutor->ResetIdleLoopStats();
+	iopExecutor->ResetIdleLoopStats();
+}
+
+void CPS2VM::ReportPrecompileStats()
+{
+	//Can be called while the EE is running, make sure IOP isn't
+	WaitIopWindow();
+
+	auto& eeExecutor = m_ee->m_EE.m_executor;
+	auto& iopExecutor = m_iop->m_cpu.m_executor;
+	auto eeStats = eeExecutor->GetPrecompileStats();
+	auto iopStats = iopExecutor->GetPrecompileStats();
+	if((eeStats.queuedCount != 0) || (iopStats.queuedCount != 0))
+	{
+		CLog::GetInstance().Print(LOG_NAME, "Precompiled blocks for '%s': EE: %d queued, %d compiled, %d used. IOP: %d queued, %d compiled, %d used.\r\n",
+		                          m_ee->m_os->GetExecutableName(),
+		                          eeStats.queuedCount, eeStats.compiledCount, eeStats.usedCount,
+		                          iopStats.queuedCount, iopStats.compiledCount, iopStats.usedCount);
+	}
+	eeExecutor->ResetPrecompileStats();
+	iopExecutor->ResetPrecompileStats();
+}
+
 void CPS2VM::EmuThread()
 {
 	fesetround(FE_TOWARDZERO);
@@ -797,6 +1227,11 @@ void CPS2VM::EmuThread()
 	CProfilerZone profilerZone(m_otherProfilerZone);
 #endif
 	static_cast<CEeExecutor*>(m_ee->m_EE.m_executor.get())->AddExceptionHandler();
+	SetIopThreadModeImpl(CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_IOP_THREAD),
+	                     CAppConfig::GetInstance().GetPreferenceInteger(PREF_PS2_IOP_THREAD_WINDOW));
+	SetExecutionModesImpl(CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_EE_MIXED_EXECUTION),
+	                      CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_IOP_MIXED_EXECUTION));
+	SetPrecompileEnabledImpl(CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_PRECOMPILE));
 	m_frameLimiter.BeginFrame();
 	while(1)
 	{
@@ -811,68 +1246,26 @@ void CPS2VM::EmuThread()
 		}
 		if(m_nStatus == RUNNING)
 		{
-			if(m_spuUpdateTicks <= 0)
-			{
-				UpdateSpu();
-				m_spuUpdateTicks += SPU_UPDATE_TICKS;
-			}
+			m_eventScheduler.ProcessEvents();
 
 			//EE execution
 			{
-				//Check vblank stuff
-				if(m_vblankTicks <= 0)
-				{
-					m_inVblank = !m_inVblank;
-					if(m_inVblank)
-					{
-						m_vblankTicks += m_vblankTicksTotal;
-						m_ee->NotifyVBlankStart();
-						m_iop->NotifyVBlankStart();
-
-						if(m_ee->m_gs != NULL)
-						{
-#ifdef PROFILE
-							CProfilerZone profilerZone(m_gsSyncProfilerZone);
-#endif
-							m_ee->m_gs->SetVBlank();
-						}
+				int sliceTicks = GetNextSliceTicks();
+				m_eeExecutionTicks += sliceTicks;
+				m_iopExecutionTicks += sliceTicks / IOP_TICK_RATIO;
 
-						if(m_pad != NULL)
-						{
-							m_pad->Update(m_ee->m_ram);
-						}
-#ifdef PROFILE
-						{
-							CProfiler::GetInstance().CountCurrentZone();
-							auto stats = CProfiler::GetInstance().GetStats();
-							ProfileFrameDone(stats);
-							CProfiler::GetInstance().Reset();
-						}
-
-						m_cpuUtilisation = CPU_UTILISATION_INFO();
-#endif
-					}
-					else
-					{
-						m_vblankTicks += m_onScreenTicksTotal;
-						m_ee->NotifyVBlankEnd();
-						m_iop->NotifyVBlankEnd();
-						if(m_ee->m_gs != NULL)
-						{
-							m_ee->m_gs->ResetVBlank();
-						}
-						m_frameLimiter.EndFrame();
-						m_frameLimiter.BeginFrame();
-					}
+				if(m_iopThreadEnabled)
+				{
+					BeginIopWindow();
+					UpdateEe();
+					WaitIopWindow();
 				}
-
-				//EE CPU is 8 times faster than the IOP CPU
-				static const int tickStep = 4800;
-				m_eeExecutionTicks += tickStep;
-				m_iopExecutionTicks += tickStep / 8;
-
-				UpdateEe();
-				UpdateIop();
+				else
+				{
+					UpdateEe();
+					UpdateIop();
+				}
+				ScheduleGsSubmit();
 			}
 #ifdef DEBUGGER_INCLUDED
 			if(
@@ -892,5 +1285,6 @@ void CPS2VM::EmuThread()
 #endif
 		}
 	}
+	StopIopThread();
 	static_cast<CEeExecutor*>(m_ee->m_EE.m_executor.get())->RemoveExceptionHandler();
 }
@@ -2,6 +2,10 @@
 
 #include <thread>
 #include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <condition_variable>
 #include "filesystem_def.h"
 #include "Types.h"
 #include "MIPS.h"
@@ -12,7 +16,9 @@
 #include "ee/Ee_SubSystem.h"
 #include "iop/Iop_SubSystem.h"
 #include "../tools/PsfPlayer/Source/SoundHandler.h"
+#include "EventScheduler.h"
 #include "FrameDump.h"
+#include "FrameDumpStream.h"
 #include "FrameLimiter.h"
 #include "Profiler.h"
 
@@ -26,6 +32,61 @@ public:
 
 		int32 iopTotalTicks = 0;
 		int32 iopIdleTicks = 0;
+
+		//Number of times execution was scheduled and number of times both CPUs were idle
+		int32 sliceCount = 0;
+		int32 idleSkipCount = 0;
+
+		//SIF traffic (command packets to EE, DMA transfers to IOP)
+		int32 sifPacketCount = 0;
+		int32 sifPacketBytes = 0;
+		int32 sifDmaCount = 0;
+		int32 sifDmaBytes = 0;
+
+		//GS image transfer packets (stalls waiting for the GS thread, packets that didn't fit in the ring)
+		int32 gsImagePacketCount = 0;
+		int32 gsImageBytes = 0;
+		int32 gsImageStallCount = 0;
+		int32 gsImageOverflowCount = 0;
+
+		//GS register writes (submissions to the GS thread, time it spent idle and time spent waiting on it, in microseconds)
+		int32 gsWriteCount = 0;
+		int32 gsSubmitCount = 0;
+		int32 gsSubmitThreshold = 0;
+		int32 gsWriteStallCount = 0;
+		int64 gsIdleTime = 0;
+		int64 gsWaitTime = 0;
+
+		//Reads done through ioman, by device (times in microseconds)
+		struct IOMAN_DEVICE_INFO
+		{
+			int32 readCount = 0;
+			int32 asyncReadCount = 0;
+			int64 readBytes = 0;
+			int64 readTime = 0;
+			int64 maxReadTime = 0;
+		};
+		std::map<std::string, IOMAN_DEVICE_INFO> iomanDevices;
+	};
+
+	//Execution slice parameters
+	enum
+	{
+		//EE CPU is 8 times faster than the IOP CPU
+		IOP_TICK_RATIO = 8,
+		//Longest amount of time a CPU runs before giving the other one a chance to run
+		MAX_BUSY_SLICE_TICKS = 4800,
+		MAX_IDLE_SLICE_TICKS = 0x1000000,
+	};
+
+	//State used to compute the length of an execution slice (wake up times are in each CPU's ticks)
+	struct SLICE_STATE
+	{
+		uint64 nextEventTicks = ~0ULL;
+		uint32 busySliceTicks = MAX_BUSY_SLICE_TICKS;
+		bool cpusIdle = false;
+		uint32 eeWakeUpTicks = ~0U;
+		uint32 iopWakeUpTicks = ~0U;
 	};
 
 	typedef std::unique_ptr<Ee::CSubSystem> EeSubSystemPtr;
@@ -69,6 +130,15 @@ public:
 
 	void ReloadFrameRateLimit();
 
+	void ReloadIopThreadMode();
+	void SetIopThreadMode(bool, uint32);
+
+	void ReloadExecutionModes();
+	void SetExecutionModes(bool, bool);
+
+	void ReloadPrecompile();
+	void SetPrecompileEnabled(bool);
+
 	static fs::path GetStateDirectoryPath();
 	fs::path GenerateStatePath(unsigned int) const;
 
@@ -76,9 +146,13 @@ public:
 	std::future<bool> LoadState(const fs::path&);
 
 	void TriggerFrameDump(const FrameDumpCallback&);
+	void BeginFrameDumpStream(const fs::path&);
+	void EndFrameDumpStream();
 
 	CPU_UTILISATION_INFO GetCpuUtilisationInfo() const;
 
+	static uint32 ComputeSliceTicks(const SLICE_STATE&);
+
 #ifdef DEBUGGER_INCLUDED
 	std::string MakeDebugTagsPackagePath(const char*);
 	void LoadDebugTags(const char*);
@@ -103,6 +177,8 @@ private:
 
 	void ReloadExecutable(const char*, const CPS2OS::ArgumentList&);
 	void OnCrtModeChange();
+	void ReportIdleLoopStats();
+	void ReportPrecompileStats();
 
 	void ResumeImpl();
 	void PauseImpl();
@@ -121,6 +197,23 @@ private:
 	void UpdateIop();
 	void UpdateSpu();
 
+	void OnVBlankEvent();
+	void OnSpuUpdateEvent();
+	void UpdateFrameDumpStream();
+	void OnGsSubmitEvent();
+	void ScheduleGsSubmit();
+	uint32 GetNextSliceTicks();
+
+	void SetIopThreadModeImpl(bool, uint32);
+	void SetExecutionModesImpl(bool, bool);
+	void SetPrecompileEnabledImpl(bool);
+	void StartIopThread();
+	void StopIopThread();
+	void IopThreadProc();
+	void BeginIopWindow();
+	void WaitIopWindow();
+	void ExecuteIop();
+
 	void OnGsNewFrame();
 
 	void CDROM0_SyncPath();
@@ -138,13 +231,27 @@ private:
 
 	uint32 m_onScreenTicksTotal = 0;
 	uint32 m_vblankTicksTotal = 0;
-	int m_vblankTicks = 0;
 	bool m_inVblank = 0;
-	int m_spuUpdateTicks = 0;
 	int m_eeExecutionTicks = 0;
 	int m_iopExecutionTicks = 0;
 	CFrameLimiter m_frameLimiter;
 
+	//IOP thread (optional). Both CPUs run concurrently for a window of ticks and
+	//meet at the end of it, or earlier if the EE needs to access the SIF.
+	std::thread m_iopThread;
+	std::mutex m_iopWindowMutex;
+	std::condition_variable m_iopWindowCondition;
+	bool m_iopWindowPending = false;
+	bool m_iopThreadEnd = false;
+	bool m_iopThreadEnabled = false;
+	uint32 m_busySliceTicks = MAX_BUSY_SLICE_TICKS;
+
+	//Time base is EE ticks
+	CEventScheduler m_eventScheduler;
+	CEventScheduler::EventId m_vblankEventId = 0;
+	CEventScheduler::EventId m_spuUpdateEventId = 0;
+	CEventScheduler::EventId m_gsSubmitEventId = 0;
+
 	CPU_UTILISATION_INFO m_cpuUtilisation;
 
 	bool m_singleStepEe;
@@ -156,15 +263,24 @@ private:
 	FrameDumpCallback m_frameDumpCallback;
 	std::mutex m_frameDumpCallbackMutex;
 	bool m_dumpingFrame = false;
+	std::unique_ptr<CFrameDumpStreamWriter> m_frameDumpStream;
+	std::unique_ptr<CFrameDumpStreamWriter> m_pendingFrameDumpStream;
 
 	OpticalMediaPtr m_cdrom0;
 
+	enum
+	{
+		//Longest amount of time GS register writes are buffered before being submitted to the GS thread
+		GS_SUBMIT_TICKS = 0x20000,
+	};
+
 	//SPU update parameters
 	enum
 	{
 		DST_SAMPLE_RATE = 44100,
 		UPDATE_RATE = 1000, //Number of SPU updates per second (on PS2 time scale)
 		SPU_UPDATE_TICKS = PS2::IOP_CLOCK_OVER_FREQ / UPDATE_RATE,
+		SPU_UPDATE_EE_TICKS = SPU_UPDATE_TICKS * IOP_TICK_RATIO,
 		SAMPLE_COUNT = DST_SAMPLE_RATE / UPDATE_RATE,
 		BLOCK_SIZE = SAMPLE_COUNT * 2,
 		BLOCK_COUNT = 400,
@@ -183,5 +299,6 @@ private:
 
 	CPS2OS::RequestLoadExecutableEvent::Connection m_OnRequestLoadExecutableConnection;
 	Framework::CSignal<void()>::Connection m_OnCrtModeChangeConnection;
-	Framework::CSignal<void(uint32)>::Connection m_OnNewFrameConnection;
+	Framework::CSignal<void()>::Connection m_OnExecutableUnloadingConnection;
+	CGSHandler::NewFrameEvent::Connection m_OnNewFrameConnection;
 };
@@ -9,6 +9,12 @@
 #define PREF_PS2_HDD_DIRECTORY ("ps2.hdd.directory")
 
 #define PREF_PS2_LIMIT_FRAMERATE ("ps2.limitframerate")
+#define PREF_PS2_FASTMEM ("ps2.fastmem")
+#define PREF_PS2_IOP_THREAD ("ps2.iopthread")
+#define PREF_PS2_IOP_THREAD_WINDOW ("ps2.iopthread.window")
+#define PREF_PS2_EE_MIXED_EXECUTION ("ps2.ee.mixedexecution")
+#define PREF_PS2_IOP_MIXED_EXECUTION ("ps2.iop.mixedexecution")
+#define PREF_PS2_PRECOMPILE ("ps2.precompile")
 
 #define PREF_AUDIO_SPUBLOCKCOUNT ("audio.spublockcount")
 
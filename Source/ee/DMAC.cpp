@@ -235,6 +235,12 @@ bool CDMAC::IsDMA4Started() const
 	return (m_D4.m_CHCR.nSTR != 0) && (m_D_ENABLE == 0);
 }
 
+//Transfers on these channels can stall and are retried periodically (see CSubSystem::CountTicks)
+bool CDMAC::HasResumableTransfers() const
+{
+	return (m_D0.m_CHCR.nSTR != 0) || (m_D1.m_CHCR.nSTR != 0) || (m_D2.m_CHCR.nSTR != 0) || (m_D4.m_CHCR.nSTR != 0) || (m_D8.m_CHCR.nSTR != 0);
+}
+
 uint64 CDMAC::FetchDMATag(uint32 nAddress)
 {
 	if(nAddress & 0x80000000)
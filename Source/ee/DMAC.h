@@ -124,6 +124,7 @@ public:
 	void ResumeDMA4();
 	void ResumeDMA8();
 	bool IsDMA4Started() const;
+	bool HasResumableTransfers() const;
 	static bool IsEndSrcTagId(uint32);
 
 private:
@@ -156,8 +156,7 @@ BasicBlockPtr CEeExecutor::BlockFactory(CMIPS& context, uint32 start, uint32 end
 		}
 	}
 
-	auto result = std::make_shared<CBasicBlock>(context, start, end);
-	result->Compile();
+	auto result = CreateBasicBlock(context, start, end);
 	if(!hasBreakpoint)
 	{
 		m_cachedBlocks.insert(std::make_pair(blockKey, result));
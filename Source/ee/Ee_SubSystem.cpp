@@ -24,10 +24,11 @@ using namespace Ee;
 
 #define FAKE_IOP_RAM_SIZE (0x1000)
 
-CSubSystem::CSubSystem(uint8* iopRam, CIopBios& iopBios)
-    : m_ram(reinterpret_cast<uint8*>(framework_aligned_alloc(PS2::EE_RAM_SIZE, framework_getpagesize())))
+CSubSystem::CSubSystem(uint8* iopRam, CIopBios& iopBios, bool fastMem)
+    : m_fastMemWindow(fastMem ? CFastMemWindow::Create(PS2::EE_RAM_SIZE + PS2::EE_SPR_SIZE) : nullptr)
+    , m_ram(m_fastMemWindow ? m_fastMemWindow->AllocateBacking(PS2::EE_RAM_SIZE) : reinterpret_cast<uint8*>(framework_aligned_alloc(PS2::EE_RAM_SIZE, framework_getpagesize())))
     , m_bios(new uint8[PS2::EE_BIOS_SIZE])
-    , m_spr(reinterpret_cast<uint8*>(framework_aligned_alloc(PS2::EE_SPR_SIZE, 0x10)))
+    , m_spr(m_fastMemWindow ? m_fastMemWindow->AllocateBacking(PS2::EE_SPR_SIZE) : reinterpret_cast<uint8*>(framework_aligned_alloc(PS2::EE_SPR_SIZE, 0x10)))
     , m_fakeIopRam(new uint8[FAKE_IOP_RAM_SIZE])
     , m_vuMem0(reinterpret_cast<uint8*>(framework_aligned_alloc(PS2::VUMEM0SIZE, 0x10)))
     , m_microMem0(new uint8[PS2::MICROMEM0SIZE])
@@ -70,24 +71,24 @@ CSubSystem::CSubSystem(uint8* iopRam, CIopBios& iopBios)
 		//Read map
 		m_EE.m_pMemoryMap->InsertReadMap(0x00000000, 0x01FFFFFF, m_ram, 0x00);
 		m_EE.m_pMemoryMap->InsertReadMap(PS2::EE_SPR_ADDR, PS2::EE_SPR_ADDR + PS2::EE_SPR_SIZE - 1, m_spr, 0x01);
-		m_EE.m_pMemoryMap->InsertReadMap(0x10000000, 0x10FFFFFF, std::bind(&CSubSystem::IOPortReadHandler, this, PLACEHOLDER_1), 0x02);
+		m_EE.m_pMemoryMap->InsertReadMap(0x10000000, 0x10FFFFFF, &CSubSystem::IOPortReadHandlerProxy, this, 0x02);
 		m_EE.m_pMemoryMap->InsertReadMap(PS2::MICROMEM0ADDR, PS2::MICROMEM0ADDR + PS2::MICROMEM0SIZE - 1, m_microMem0, 0x03);
 		m_EE.m_pMemoryMap->InsertReadMap(PS2::VUMEM0ADDR, PS2::VUMEM0ADDR + PS2::VUMEM0SIZE - 1, m_vuMem0, 0x04);
 		m_EE.m_pMemoryMap->InsertReadMap(PS2::MICROMEM1ADDR, PS2::MICROMEM1ADDR + PS2::MICROMEM1SIZE - 1, m_microMem1, 0x05);
 		m_EE.m_pMemoryMap->InsertReadMap(PS2::VUMEM1ADDR, PS2::VUMEM1ADDR + PS2::VUMEM1SIZE - 1, m_vuMem1, 0x06);
-		m_EE.m_pMemoryMap->InsertReadMap(0x12000000, 0x12FFFFFF, std::bind(&CSubSystem::IOPortReadHandler, this, PLACEHOLDER_1), 0x07);
+		m_EE.m_pMemoryMap->InsertReadMap(0x12000000, 0x12FFFFFF, &CSubSystem::IOPortReadHandlerProxy, this, 0x07);
 		m_EE.m_pMemoryMap->InsertReadMap(0x1C000000, 0x1C001000, m_fakeIopRam, 0x08);
 		m_EE.m_pMemoryMap->InsertReadMap(PS2::EE_BIOS_ADDR, PS2::EE_BIOS_ADDR + PS2::EE_BIOS_SIZE - 1, m_bios, 0x09);
 
 		//Write map
 		m_EE.m_pMemoryMap->InsertWriteMap(0x00000000, 0x01FFFFFF, m_ram, 0x00);
 		m_EE.m_pMemoryMap->InsertWriteMap(PS2::EE_SPR_ADDR, PS2::EE_SPR_ADDR + PS2::EE_SPR_SIZE - 1, m_spr, 0x01);
-		m_EE.m_pMemoryMap->InsertWriteMap(0x10000000, 0x10FFFFFF, std::bind(&CSubSystem::IOPortWriteHandler, this, PLACEHOLDER_1, PLACEHOLDER_2), 0x02);
+		m_EE.m_pMemoryMap->InsertWriteMap(0x10000000, 0x10FFFFFF, &CSubSystem::IOPortWriteHandlerProxy, this, 0x02);
 		m_EE.m_pMemoryMap->InsertWriteMap(PS2::MICROMEM0ADDR, PS2::MICROMEM0ADDR + PS2::MICROMEM0SIZE - 1, std::bind(&CSubSystem::Vu0MicroMemWriteHandler, this, PLACEHOLDER_1, PLACEHOLDER_2), 0x03);
 		m_EE.m_pMemoryMap->InsertWriteMap(PS2::VUMEM0ADDR, PS2::VUMEM0ADDR + PS2::VUMEM0SIZE - 1, m_vuMem0, 0x04);
 		m_EE.m_pMemoryMap->InsertWriteMap(PS2::MICROMEM1ADDR, PS2::MICROMEM1ADDR + PS2::MICROMEM1SIZE - 1, std::bind(&CSubSystem::Vu1MicroMemWriteHandler, this, PLACEHOLDER_1, PLACEHOLDER_2), 0x05);
 		m_EE.m_pMemoryMap->InsertWriteMap(PS2::VUMEM1ADDR, PS2::VUMEM1ADDR + PS2::VUMEM1SIZE - 1, m_vuMem1, 0x06);
-		m_EE.m_pMemoryMap->InsertWriteMap(0x12000000, 0x12FFFFFF, std::bind(&CSubSystem::IOPortWriteHandler, this, PLACEHOLDER_1, PLACEHOLDER_2), 0x07);
+		m_EE.m_pMemoryMap->InsertWriteMap(0x12000000, 0x12FFFFFF, &CSubSystem::IOPortWriteHandlerProxy, this, 0x07);
 
 		//Instruction map
 		m_EE.m_pMemoryMap->InsertInstructionMap(0x00000000, 0x01FFFFFF, m_ram, 0x00);
@@ -99,6 +100,7 @@ CSubSystem::CSubSystem(uint8* iopRam, CIopBios& iopBios)
 		m_EE.m_pCOP[2] = &m_COP_VU;
 
 		m_EE.m_pAddrTranslator = CPS2OS::TranslateAddress;
+		m_EE.m_timerAddressPredicate = [](uint32 address) { return (address >= 0x10000000) && (address <= 0x1000183F); };
 	}
 
 	//Vector Unit 0 context setup
@@ -162,9 +164,12 @@ CSubSystem::~CSubSystem()
 {
 	m_EE.m_executor->Reset();
 	delete m_os;
-	framework_aligned_free(m_ram);
+	if(!m_fastMemWindow)
+	{
+		framework_aligned_free(m_ram);
+		framework_aligned_free(m_spr);
+	}
 	delete[] m_bios;
-	framework_aligned_free(m_spr);
 	delete[] m_fakeIopRam;
 	framework_aligned_free(m_vuMem0);
 	delete[] m_microMem0;
@@ -335,6 +340,15 @@ void CSubSystem::CountTicks(int ticks)
 	CheckPendingInterrupts();
 }
 
+//Returns a lower bound on the number of ticks before something can happen without
+//the CPU's intervention (interrupt, DMA transfer progress, etc.)
+uint32 CSubSystem::GetTicksUntilNextEvent() const
+{
+	if(m_dmac.HasResumableTransfers()) return 0;
+	if(m_vpu0->IsVuRunning() || m_vpu1->IsVuRunning()) return 0;
+	return m_timer.GetTicksUntilNextInterrupt();
+}
+
 void CSubSystem::NotifyVBlankStart()
 {
 	m_timer.NotifyVBlankStart();
@@ -403,6 +417,26 @@ void CSubSystem::SetupEePageTable()
 	m_EE.MapPages(0x20000000, PS2::EE_RAM_SIZE, m_ram);
 	m_EE.MapPages(0x70000000, PS2::EE_SPR_SIZE, m_spr);
 	m_EE.MapPages(0x80000000, PS2::EE_RAM_SIZE, m_ram);
+
+	if(m_fastMemWindow)
+	{
+		//0x80000000 mirror is handled by masking addresses with the window's size.
+		//Generated code only uses the window for addresses below m_fastMemSize, uncached
+		//RAM (0x20000000) and scratchpad (0x70000000) accesses go through the page table.
+		bool mapped = m_fastMemWindow->Map(0x00000000, m_ram, PS2::EE_RAM_SIZE);
+		m_EE.m_fastMemBase = mapped ? m_fastMemWindow->GetBase() : nullptr;
+		m_EE.m_fastMemSize = mapped ? PS2::EE_RAM_SIZE : 0;
+	}
+}
+
+uint32 CSubSystem::IOPortReadHandlerProxy(void* context, uint32 address, uint32)
+{
+	return reinterpret_cast<CSubSystem*>(context)->IOPortReadHandler(address);
+}
+
+uint32 CSubSystem::IOPortWriteHandlerProxy(void* context, uint32 address, uint32 value)
+{
+	return reinterpret_cast<CSubSystem*>(context)->IOPortWriteHandler(address, value);
 }
 
 uint32 CSubSystem::IOPortReadHandler(uint32 nAddress)
@@ -16,6 +16,7 @@
 #include "COP_VU.h"
 #include "PS2OS.h"
 #include "../gs/GSHandler.h"
+#include "../FastMemWindow.h"
 
 #include "signal/Signal.h"
 
@@ -24,13 +25,14 @@ namespace Ee
 	class CSubSystem
 	{
 	public:
-		CSubSystem(uint8*, CIopBios&);
+		CSubSystem(uint8*, CIopBios&, bool = false);
 		virtual ~CSubSystem();
 
 		void Reset();
 		int ExecuteCpu(int);
 		bool IsCpuIdle() const;
 		void CountTicks(int);
+		uint32 GetTicksUntilNextEvent() const;
 
 		void NotifyVBlankStart();
 		void NotifyVBlankEnd();
@@ -41,6 +43,9 @@ namespace Ee
 		void SetVpu0(std::shared_ptr<CVpu>);
 		void SetVpu1(std::shared_ptr<CVpu>);
 
+		//Must be declared before memory blocks that are allocated from it
+		std::unique_ptr<CFastMemWindow> m_fastMemWindow;
+
 		uint8* m_ram = nullptr;
 		uint8* m_bios = nullptr;
 		uint8* m_spr = nullptr;
@@ -85,6 +90,8 @@ namespace Ee
 
 		uint32 IOPortReadHandler(uint32);
 		uint32 IOPortWriteHandler(uint32, uint32);
+		static uint32 IOPortReadHandlerProxy(void*, uint32, uint32);
+		static uint32 IOPortWriteHandlerProxy(void*, uint32, uint32);
 
 		uint32 Vu0MicroMemWriteHandler(uint32, uint32);
 
@@ -8,6 +8,14 @@
 #include "GIF.h"
 #include "DMAC.h"
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define USE_SSE
+#include <emmintrin.h>
+#elif defined(_M_ARM64) || defined(__aarch64__) || defined(__ARM_NEON)
+#define USE_NEON
+#include <arm_neon.h>
+#endif
+
 #define QTEMP_INIT (0x3F800000)
 
 #define LOG_NAME ("ee_gif")
@@ -44,6 +52,7 @@ void CGIF::Reset()
 	m_regs = 0;
 	m_regsTemp = 0;
 	m_regList = 0;
+	ExpandRegList();
 	m_eop = false;
 	m_qtemp = QTEMP_INIT;
 	m_signalState = SIGNAL_STATE_NONE;
@@ -61,6 +70,7 @@ void CGIF::LoadState(Framework::CZipArchiveReader& archive)
 	m_regs = static_cast<uint8>(registerFile.GetRegister32(STATE_REGS_REGS));
 	m_regsTemp = static_cast<uint8>(registerFile.GetRegister32(STATE_REGS_REGSTEMP));
 	m_regList = registerFile.GetRegister64(STATE_REGS_REGLIST);
+	ExpandRegList();
 	m_eop = registerFile.GetRegister32(STATE_REGS_EOP) != 0;
 	m_qtemp = registerFile.GetRegister32(STATE_REGS_QTEMP);
 }
@@ -81,123 +91,192 @@ void CGIF::SaveState(Framework::CZipArchiveWriter& archive)
 	archive.InsertFile(registerFile);
 }
 
+void CGIF::ExpandRegList()
+{
+	//Register descriptors are decoded once per tag instead of once per field
+	m_packedVertexOnly = (m_regs != 0);
+	for(uint32 i = 0; i < MAX_REGS; i++)
+	{
+		uint8 regDesc = static_cast<uint8>((m_regList >> (i * 4)) & 0x0F);
+		m_regDescs[i] = regDesc;
+		if(i >= m_regs) continue;
+		switch(regDesc)
+		{
+		case 0x01: //RGBA
+		case 0x02: //ST
+		case 0x03: //UV
+		case 0x04: //XYZF2
+		case 0x05: //XYZ2
+			break;
+		default:
+			m_packedVertexOnly = false;
+			break;
+		}
+	}
+}
+
+static inline uint64 PackRgbaq(const uint8* field, uint32 qtemp)
+{
+	uint32 rgba = 0;
+#if defined(USE_SSE)
+	__m128i color = _mm_loadu_si128(reinterpret_cast<const __m128i*>(field));
+	color = _mm_and_si128(color, _mm_set1_epi32(0xFF));
+	color = _mm_packs_epi32(color, color);
+	color = _mm_packus_epi16(color, color);
+	rgba = static_cast<uint32>(_mm_cvtsi128_si32(color));
+#elif defined(USE_NEON)
+	uint32x4_t color = vandq_u32(vld1q_u32(reinterpret_cast<const uint32*>(field)), vdupq_n_u32(0xFF));
+	uint16x4_t color16 = vmovn_u32(color);
+	uint8x8_t color8 = vmovn_u16(vcombine_u16(color16, color16));
+	rgba = vget_lane_u32(vreinterpret_u32_u8(color8), 0);
+#else
+	auto packet = reinterpret_cast<const uint128*>(field);
+	rgba = (packet->nV[0] & 0xFF);
+	rgba |= (packet->nV[1] & 0xFF) << 8;
+	rgba |= (packet->nV[2] & 0xFF) << 16;
+	rgba |= (packet->nV[3] & 0xFF) << 24;
+#endif
+	return rgba | (static_cast<uint64>(qtemp) << 32);
+}
+
+static inline uint64 PackXyz(const uint8* field)
+{
+#if defined(USE_SSE)
+	__m128i xyz = _mm_loadu_si128(reinterpret_cast<const __m128i*>(field));
+	//Gather the low halves of X and Y in the first dword and move Z in the second one
+	xyz = _mm_shufflelo_epi16(xyz, _MM_SHUFFLE(3, 1, 2, 0));
+	xyz = _mm_shuffle_epi32(xyz, _MM_SHUFFLE(3, 3, 2, 0));
+	uint64 result = 0;
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(&result), xyz);
+	return result;
+#else
+	auto packet = reinterpret_cast<const uint128*>(field);
+	uint64 result = (packet->nV[0] & 0xFFFF);
+	result |= (packet->nV[1] & 0xFFFF) << 16;
+	result |= static_cast<uint64>(packet->nV[2]) << 32;
+	return result;
+#endif
+}
+
+//Decodes a PACKED field other than A+D, returns the position following the register writes it produced
+static inline CGSHandler::RegisterWrite* DecodePackedField(uint8 regDesc, const uint8* field, CGSHandler::RegisterWrite* output, uint32& qtemp)
+{
+	const auto& packet = *reinterpret_cast<const uint128*>(field);
+	switch(regDesc)
+	{
+	case 0x00:
+		//PRIM
+		*output++ = CGSHandler::RegisterWrite(GS_REG_PRIM, packet.nV0);
+		break;
+	case 0x01:
+		//RGBA
+		*output++ = CGSHandler::RegisterWrite(GS_REG_RGBAQ, PackRgbaq(field, qtemp));
+		break;
+	case 0x02:
+		//ST
+		qtemp = packet.nV2;
+		*output++ = CGSHandler::RegisterWrite(GS_REG_ST, packet.nD0);
+		break;
+	case 0x03:
+	{
+		//UV
+		uint64 temp = (packet.nV[0] & 0x7FFF);
+		temp |= (packet.nV[1] & 0x7FFF) << 16;
+		*output++ = CGSHandler::RegisterWrite(GS_REG_UV, temp);
+	}
+	break;
+	case 0x04:
+	{
+		//XYZF2
+		uint64 temp = (packet.nV[0] & 0xFFFF);
+		temp |= (packet.nV[1] & 0xFFFF) << 16;
+		temp |= static_cast<uint64>(packet.nV[2] & 0x0FFFFFF0) << 28;
+		temp |= static_cast<uint64>(packet.nV[3] & 0x00000FF0) << 52;
+		*output++ = CGSHandler::RegisterWrite((packet.nV[3] & 0x8000) ? GS_REG_XYZF3 : GS_REG_XYZF2, temp);
+	}
+	break;
+	case 0x05:
+		//XYZ2
+		*output++ = CGSHandler::RegisterWrite((packet.nV[3] & 0x8000) ? GS_REG_XYZ3 : GS_REG_XYZ2, PackXyz(field));
+		break;
+	case 0x06:
+		//TEX0_1
+		*output++ = CGSHandler::RegisterWrite(GS_REG_TEX0_1, packet.nD0);
+		break;
+	case 0x07:
+		//TEX0_2
+		*output++ = CGSHandler::RegisterWrite(GS_REG_TEX0_2, packet.nD0);
+		break;
+	case 0x08:
+		//CLAMP_1
+		*output++ = CGSHandler::RegisterWrite(GS_REG_CLAMP_1, packet.nD0);
+		break;
+	case 0x09:
+		//CLAMP_2
+		*output++ = CGSHandler::RegisterWrite(GS_REG_CLAMP_2, packet.nD0);
+		break;
+	case 0x0A:
+		//FOG
+		*output++ = CGSHandler::RegisterWrite(GS_REG_FOG, (packet.nD1 >> 36) << 56);
+		break;
+	case 0x0D:
+		//XYZ3
+		*output++ = CGSHandler::RegisterWrite(GS_REG_XYZ3, packet.nD0);
+		break;
+	case 0x0F:
+		//NOP
+		break;
+	default:
+		assert(0);
+		break;
+	}
+	return output;
+}
+
 uint32 CGIF::ProcessPacked(const uint8* memory, uint32 address, uint32 end)
 {
 	uint32 start = address;
 
 	while((m_loops != 0) && (address < end))
 	{
-		while((m_regsTemp != 0) && (address < end))
+		if(m_regsTemp == m_regs)
 		{
-			uint64 temp = 0;
-			uint32 regDesc = (uint32)((m_regList >> ((m_regs - m_regsTemp) * 4)) & 0x0F);
+			address += ProcessPackedLoops(memory, address, end);
+			if((m_loops == 0) || (address == end)) break;
+		}
 
-			uint128 packet = *reinterpret_cast<const uint128*>(memory + address);
+		//Remaining fields of an incomplete loop or loop that needs to be handled separately
+		while((m_regsTemp != 0) && (address < end))
+		{
+			uint8 regDesc = m_regDescs[m_regs - m_regsTemp];
+			const uint8* field = memory + address;
 
-			switch(regDesc)
+			if(regDesc == 0x0E)
 			{
-			case 0x00:
-				//PRIM
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_PRIM, packet.nV0));
-				break;
-			case 0x01:
-				//RGBA
-				temp = (packet.nV[0] & 0xFF);
-				temp |= (packet.nV[1] & 0xFF) << 8;
-				temp |= (packet.nV[2] & 0xFF) << 16;
-				temp |= (packet.nV[3] & 0xFF) << 24;
-				temp |= ((uint64)m_qtemp << 32);
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_RGBAQ, temp));
-				break;
-			case 0x02:
-				//ST
-				m_qtemp = packet.nV2;
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_ST, packet.nD0));
-				break;
-			case 0x03:
-				//UV
-				temp = (packet.nV[0] & 0x7FFF);
-				temp |= (packet.nV[1] & 0x7FFF) << 16;
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_UV, temp));
-				break;
-			case 0x04:
-				//XYZF2
-				temp = (packet.nV[0] & 0xFFFF);
-				temp |= (packet.nV[1] & 0xFFFF) << 16;
-				temp |= (uint64)(packet.nV[2] & 0x0FFFFFF0) << 28;
-				temp |= (uint64)(packet.nV[3] & 0x00000FF0) << 52;
-				if(packet.nV[3] & 0x8000)
-				{
-					m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_XYZF3, temp));
-				}
-				else
-				{
-					m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_XYZF2, temp));
-				}
-				break;
-			case 0x05:
-				//XYZ2
-				temp = (packet.nV[0] & 0xFFFF);
-				temp |= (packet.nV[1] & 0xFFFF) << 16;
-				temp |= (uint64)(packet.nV[2] & 0xFFFFFFFF) << 32;
-				if(packet.nV[3] & 0x8000)
-				{
-					m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_XYZ3, temp));
-				}
-				else
-				{
-					m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_XYZ2, temp));
-				}
-				break;
-			case 0x06:
-				//TEX0_1
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_TEX0_1, packet.nD0));
-				break;
-			case 0x07:
-				//TEX0_2
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_TEX0_2, packet.nD0));
-				break;
-			case 0x08:
-				//CLAMP_1
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_CLAMP_1, packet.nD0));
-				break;
-			case 0x09:
-				//CLAMP_2
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_CLAMP_2, packet.nD0));
-				break;
-			case 0x0A:
-				//FOG
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_FOG, (packet.nD1 >> 36) << 56));
-				break;
-			case 0x0D:
-				//XYZ3
-				m_gs->WriteRegister(CGSHandler::RegisterWrite(GS_REG_XYZ3, packet.nD0));
-				break;
-			case 0x0E:
 				//A + D
+				const auto& packet = *reinterpret_cast<const uint128*>(field);
+				uint8 reg = static_cast<uint8>(packet.nD1);
+				if(reg == GS_REG_SIGNAL)
 				{
-					uint8 reg = static_cast<uint8>(packet.nD1);
-					if(reg == GS_REG_SIGNAL)
+					//Check if there's already a signal pending
+					auto csr = m_gs->ReadPrivRegister(CGSHandler::GS_CSR);
+					if((m_signalState == SIGNAL_STATE_ENCOUNTERED) || ((csr & CGSHandler::CSR_SIGNAL_EVENT) != 0))
 					{
-						//Check if there's already a signal pending
-						auto csr = m_gs->ReadPrivRegister(CGSHandler::GS_CSR);
-						if((m_signalState == SIGNAL_STATE_ENCOUNTERED) || ((csr & CGSHandler::CSR_SIGNAL_EVENT) != 0))
-						{
-							//If there is, we need to wait for previous signal to be cleared
-							m_signalState = SIGNAL_STATE_PENDING;
-							return address - start;
-						}
-						m_signalState = SIGNAL_STATE_ENCOUNTERED;
+						//If there is, we need to wait for previous signal to be cleared
+						m_signalState = SIGNAL_STATE_PENDING;
+						return address - start;
 					}
-					m_gs->WriteRegister(CGSHandler::RegisterWrite(reg, packet.nD0));
+					m_signalState = SIGNAL_STATE_ENCOUNTERED;
+				}
+				m_gs->WriteRegister(CGSHandler::RegisterWrite(reg, packet.nD0));
+			}
+			else
+			{
+				CGSHandler::RegisterWrite write;
+				if(DecodePackedField(regDesc, field, &write, m_qtemp) != &write)
+				{
+					m_gs->WriteRegister(write);
 				}
-				break;
-			case 0x0F:
-				//NOP
-				break;
-			default:
-				assert(0);
-				break;
 			}
 
 			address += 0x10;
@@ -214,22 +293,102 @@ uint32 CGIF::ProcessPacked(const uint8* memory, uint32 address, uint32 end)
 	return address - start;
 }
 
+//Decodes as many complete loops as available at once, directly in the GS write buffer.
+//Must be called at the start of a loop. Stops before a loop writing to SIGNAL,
+//that one needs to be handled by ProcessPacked.
+uint32 CGIF::ProcessPackedLoops(const uint8* memory, uint32 address, uint32 end)
+{
+	assert(m_regsTemp == m_regs);
+
+	uint32 loopSize = m_regs * 0x10;
+	uint32 loopCount = std::min<uint32>(m_loops, (end - address) / loopSize);
+	if(loopCount == 0) return 0;
+
+	auto writes = m_gs->BeginRegisterWrites(loopCount * m_regs);
+
+	const uint8* field = memory + address;
+	auto output = writes;
+	uint32 qtemp = m_qtemp;
+	uint32 loopIndex = 0;
+
+	if(m_packedVertexOnly)
+	{
+		//Vertex streams (XYZ2, RGBAQ, ST, etc.): no A+D and no side effects other than Q
+		for(; loopIndex < loopCount; loopIndex++)
+		{
+			for(uint32 regIndex = 0; regIndex < m_regs; regIndex++)
+			{
+				output = DecodePackedField(m_regDescs[regIndex], field, output, qtemp);
+				field += 0x10;
+			}
+		}
+	}
+	else
+	{
+		for(; loopIndex < loopCount; loopIndex++)
+		{
+			auto loopOutput = output;
+			uint32 loopQtemp = qtemp;
+			bool hasSignal = false;
+			for(uint32 regIndex = 0; regIndex < m_regs; regIndex++)
+			{
+				uint8 regDesc = m_regDescs[regIndex];
+				if(regDesc == 0x0E)
+				{
+					//A + D
+					const auto& packet = *reinterpret_cast<const uint128*>(field);
+					uint8 reg = static_cast<uint8>(packet.nD1);
+					if(reg == GS_REG_SIGNAL)
+					{
+						hasSignal = true;
+						break;
+					}
+					*output++ = CGSHandler::RegisterWrite(reg, packet.nD0);
+				}
+				else
+				{
+					output = DecodePackedField(regDesc, field, output, qtemp);
+				}
+				field += 0x10;
+			}
+			if(hasSignal)
+			{
+				//Drop what was decoded from this loop, it will be processed field by field
+				output = loopOutput;
+				qtemp = loopQtemp;
+				break;
+			}
+		}
+	}
+
+	m_gs->CommitRegisterWrites(static_cast<uint32>(output - writes));
+	m_qtemp = qtemp;
+	m_loops -= loopIndex;
+	return loopIndex * loopSize;
+}
+
 uint32 CGIF::ProcessRegList(const uint8* memory, uint32 address, uint32 end)
 {
 	uint32 start = address;
 
 	while((m_loops != 0) && (address < end))
 	{
+		if(m_regsTemp == m_regs)
+		{
+			address += ProcessRegListLoops(memory, address, end);
+			if((m_loops == 0) || (address == end)) break;
+		}
+
 		while((m_regsTemp != 0) && (address < end))
 		{
-			uint32 regDesc = (uint32)((m_regList >> ((m_regs - m_regsTemp) * 4)) & 0x0F);
+			uint8 regDesc = m_regDescs[m_regs - m_regsTemp];
 			uint64 packet = *reinterpret_cast<const uint64*>(memory + address);
 
 			address += 0x08;
 			m_regsTemp--;
 
 			if(regDesc == 0x0F) continue;
-			m_gs->WriteRegister(CGSHandler::RegisterWrite(static_cast<uint8>(regDesc), packet));
+			m_gs->WriteRegister(CGSHandler::RegisterWrite(regDesc, packet));
 		}
 
 		if(m_regsTemp == 0)
@@ -248,6 +407,36 @@ uint32 CGIF::ProcessRegList(const uint8* memory, uint32 address, uint32 end)
 	return address - start;
 }
 
+//Decodes as many complete loops as available at once, directly in the GS write buffer.
+//Must be called at the start of a loop.
+uint32 CGIF::ProcessRegListLoops(const uint8* memory, uint32 address, uint32 end)
+{
+	assert(m_regsTemp == m_regs);
+
+	uint32 loopSize = m_regs * 0x08;
+	uint32 loopCount = std::min<uint32>(m_loops, (end - address) / loopSize);
+	if(loopCount == 0) return 0;
+
+	auto writes = m_gs->BeginRegisterWrites(loopCount * m_regs);
+
+	auto field = reinterpret_cast<const uint64*>(memory + address);
+	auto output = writes;
+	for(uint32 loopIndex = 0; loopIndex < loopCount; loopIndex++)
+	{
+		for(uint32 regIndex = 0; regIndex < m_regs; regIndex++)
+		{
+			uint8 regDesc = m_regDescs[regIndex];
+			uint64 value = *field++;
+			if(regDesc == 0x0F) continue;
+			*output++ = CGSHandler::RegisterWrite(regDesc, value);
+		}
+	}
+
+	m_gs->CommitRegisterWrites(static_cast<uint32>(output - writes));
+	m_loops -= loopCount;
+	return loopCount * loopSize;
+}
+
 uint32 CGIF::ProcessImage(const uint8* memory, uint32 memorySize, uint32 address, uint32 end)
 {
 	uint16 totalLoops = static_cast<uint16>((end - address) / 0x10);
@@ -321,8 +510,9 @@ uint32 CGIF::ProcessSinglePacket(const uint8* memory, uint32 memorySize, uint32
 				}
 			}
 
-			if(m_regs == 0) m_regs = 0x10;
+			if(m_regs == 0) m_regs = MAX_REGS;
 			m_regsTemp = m_regs;
+			ExpandRegList();
 			m_activePath = packetMetadata.pathIndex;
 			continue;
 		}
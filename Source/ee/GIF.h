@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include "Types.h"
 #include "zip/ZipArchiveWriter.h"
 #include "zip/ZipArchiveReader.h"
@@ -77,8 +78,19 @@ private:
 		MASKED_PATH3_XFER_DONE,
 	};
 
+	enum
+	{
+		MAX_REGS = 0x10,
+	};
+
+	typedef std::array<uint8, MAX_REGS> RegDescArray;
+
+	void ExpandRegList();
+
 	uint32 ProcessPacked(const uint8*, uint32, uint32);
+	uint32 ProcessPackedLoops(const uint8*, uint32, uint32);
 	uint32 ProcessRegList(const uint8*, uint32, uint32);
+	uint32 ProcessRegListLoops(const uint8*, uint32, uint32);
 	uint32 ProcessImage(const uint8*, uint32, uint32, uint32);
 
 	void DisassembleGet(uint32);
@@ -93,6 +105,8 @@ private:
 	uint8 m_regs = 0;
 	uint8 m_regsTemp = 0;
 	uint64 m_regList = 0;
+	RegDescArray m_regDescs = {};
+	bool m_packedVertexOnly = false;
 	bool m_eop = false;
 	uint32 m_qtemp;
 	SIGNAL_STATE m_signalState = SIGNAL_STATE_NONE;
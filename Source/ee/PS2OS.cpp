@@ -468,6 +468,11 @@ void CPS2OS::LoadELF(Framework::CStream& stream, const char* executablePath, con
 	LoadExecutableInternal();
 	ApplyPatches();
 
+	{
+		auto executableRange = GetExecutableRange();
+		m_ee.m_executor->PrecompileRange(executableRange.first, executableRange.second, m_elf->GetHeader().nEntryPoint);
+	}
+
 	OnExecutableChange();
 
 	CLog::GetInstance().Print(LOG_NAME, "Loaded '%s' executable file.\r\n", executablePath);
@@ -567,6 +572,8 @@ uint32 CPS2OS::LoadExecutable(const char* path, const char* section)
 	}
 
 	uint32 result = 0;
+	uint32 minAddr = 0xFFFFFFF0;
+	uint32 maxAddr = 0x00000000;
 
 	//We don't support loading anything else than all sections
 	assert(strcmp(section, "all") == 0);
@@ -583,6 +590,11 @@ uint32 CPS2OS::LoadExecutable(const char* path, const char* section)
 			if(p)
 			{
 				memcpy(m_ram + p->nVAddress, executable.GetContent() + p->nOffset, p->nFileSize);
+				if((p->nFlags & CELF::PF_X) && (p->nFileSize != 0))
+				{
+					minAddr = std::min<uint32>(minAddr, p->nVAddress);
+					maxAddr = std::max<uint32>(maxAddr, p->nVAddress + p->nFileSize);
+				}
 			}
 		}
 
@@ -592,6 +604,11 @@ uint32 CPS2OS::LoadExecutable(const char* path, const char* section)
 	//Flush all instruction cache
 	OnRequestInstructionCacheFlush();
 
+	if(minAddr < maxAddr)
+	{
+		m_ee.m_executor->PrecompileRange(minAddr, maxAddr, result);
+	}
+
 	ioman->Close(handle);
 
 	return result;
@@ -2982,6 +2999,7 @@ void CPS2OS::sc_Deci2Call()
 				uint32 length = m_ram[stringAddr + 0x00] - 0x0C;
 				uint8* string = &m_ram[stringAddr + 0x0C];
 
+				m_sif.Sync();
 				m_iopBios.GetIoman()->Write(Iop::CIoman::FID_STDOUT, length, string);
 			}
 
@@ -3009,6 +3027,7 @@ void CPS2OS::sc_Deci2Call()
 		{
 			uint32 stringAddr = *reinterpret_cast<uint32*>(GetStructPtr(param));
 			uint8* string = &m_ram[stringAddr];
+			m_sif.Sync();
 			m_iopBios.GetIoman()->Write(1, static_cast<uint32>(strlen(reinterpret_cast<char*>(string))), string);
 		}
 		break;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <stdio.h>
 #include "../Log.h"
@@ -76,8 +77,14 @@ void CSIF::Reset()
 	m_cmdBufferAddress = 0;
 	m_cmdBufferSize = 0;
 
-	m_packetQueue.clear();
+	{
+		std::lock_guard<std::mutex> packetQueueLock(m_packetQueueMutex);
+		m_packetQueue.clear();
+		m_freePacketBuffers.clear();
+	}
 	m_packetProcessed = true;
+	m_currentPacket.clear();
+	m_stats = STATS();
 
 	m_callReplies.clear();
 
@@ -123,7 +130,18 @@ uint32 CSIF::ReceiveDMA5(uint32 srcAddress, uint32 size, uint32 unused, bool isT
 	{
 		throw std::runtime_error("Packet too big.");
 	}
-	memcpy(m_eeRam + srcAddress, m_iopRam + m_dmaBufferAddress, size);
+	if(m_dmaSource)
+	{
+		//Packet sent by SendDMA, copy it directly without going through the IOP's buffer
+		uint32 copySize = std::min<uint32>(size, m_dmaSourceSize);
+		memcpy(m_eeRam + srcAddress, m_dmaSource, copySize);
+		//Transfer is done in quadwords, clear what's left of the last one
+		memset(m_eeRam + srcAddress + copySize, 0, size - copySize);
+	}
+	else
+	{
+		memcpy(m_eeRam + srcAddress, m_iopRam + m_dmaBufferAddress, size);
+	}
 	return size;
 }
 
@@ -131,6 +149,12 @@ uint32 CSIF::ReceiveDMA6(uint32 nSrcAddr, uint32 nSize, uint32 nDstAddr, bool is
 {
 	assert(!isTagIncluded);
 
+	//Commands are handled by IOP modules, make sure the IOP is not running
+	Sync();
+
+	m_stats.dmaCount++;
+	m_stats.dmaBytes += nSize;
+
 	//Humm, this is kinda odd, but it ors the address with 0x20000000
 	nSrcAddr &= (PS2::EE_RAM_SIZE - 1);
 
@@ -209,24 +233,38 @@ uint32 CSIF::ReceiveDMA6(uint32 nSrcAddr, uint32 nSize, uint32 nDstAddr, bool is
 
 void CSIF::SendPacket(void* packet, uint32 size)
 {
-	m_packetQueue.insert(m_packetQueue.begin(),
-	                     reinterpret_cast<uint8*>(packet),
-	                     reinterpret_cast<uint8*>(packet) + size);
-	m_packetQueue.insert(m_packetQueue.begin(),
-	                     reinterpret_cast<uint8*>(&size),
-	                     reinterpret_cast<uint8*>(&size) + 4);
+	auto packetBytes = reinterpret_cast<const uint8*>(packet);
+	std::lock_guard<std::mutex> packetQueueLock(m_packetQueueMutex);
+	PacketBuffer packetBuffer;
+	if(!m_freePacketBuffers.empty())
+	{
+		packetBuffer = std::move(m_freePacketBuffers.back());
+		m_freePacketBuffers.pop_back();
+	}
+	packetBuffer.assign(packetBytes, packetBytes + size);
+	//Most recent packet is sent first
+	m_packetQueue.push_front(std::move(packetBuffer));
 }
 
 void CSIF::ProcessPackets()
 {
-	if(m_packetProcessed && !m_packetQueue.empty())
+	if(!m_packetProcessed) return;
 	{
-		assert(m_packetQueue.size() > 4);
-		uint32 size = *reinterpret_cast<uint32*>(&m_packetQueue[0]);
-		SendDMA(&m_packetQueue[4], size);
-		m_packetQueue.erase(m_packetQueue.begin(), m_packetQueue.begin() + 4 + size);
-		m_packetProcessed = false;
+		std::lock_guard<std::mutex> packetQueueLock(m_packetQueueMutex);
+		if(m_packetQueue.empty()) return;
+		//Storage of the previous packet can be reused by upcoming ones
+		if(m_currentPacket.capacity() != 0)
+		{
+			m_freePacketBuffers.push_back(std::move(m_currentPacket));
+		}
+		m_currentPacket = std::move(m_packetQueue.front());
+		m_packetQueue.pop_front();
 	}
+	uint32 size = static_cast<uint32>(m_currentPacket.size());
+	m_stats.packetCount++;
+	m_stats.packetBytes += size;
+	SendDMA(m_currentPacket.data(), size);
+	m_packetProcessed = false;
 }
 
 void CSIF::MarkPacketProcessed()
@@ -244,12 +282,18 @@ void CSIF::SendDMA(void* pData, uint32 nSize)
 		throw std::runtime_error("Packet too big.");
 	}
 
-	memcpy(m_iopRam + m_dmaBufferAddress, pData, nSize);
+	//The DMAC executes the transfer right away, ReceiveDMA5 copies from the source directly
+	m_dmaSource = reinterpret_cast<const uint8*>(pData);
+	m_dmaSourceSize = nSize;
+
 	uint32 nQuads = (nSize + 0x0F) / 0x10;
 
 	m_dmac.SetRegister(CDMAC::D5_MADR, m_nEERecvAddr);
 	m_dmac.SetRegister(CDMAC::D5_QWC, nQuads);
 	m_dmac.SetRegister(CDMAC::D5_CHCR, CDMAC::CHCR_STR);
+
+	m_dmaSource = nullptr;
+	m_dmaSourceSize = 0;
 }
 
 void CSIF::LoadState(Framework::CZipArchiveReader& archive)
@@ -265,7 +309,11 @@ void CSIF::LoadState(Framework::CZipArchiveReader& archive)
 		m_packetProcessed = registerFile.GetRegister32(STATE_REG_PACKETPROCESSED) != 0;
 	}
 
-	m_packetQueue = LoadPacketQueue(archive);
+	{
+		auto packetQueue = LoadPacketQueue(archive);
+		std::lock_guard<std::mutex> packetQueueLock(m_packetQueueMutex);
+		m_packetQueue = std::move(packetQueue);
+	}
 
 	m_callReplies = LoadCallReplies(archive);
 }
@@ -284,11 +332,36 @@ void CSIF::SaveState(Framework::CZipArchiveWriter& archive)
 		archive.InsertFile(registerFile);
 	}
 
-	archive.InsertFile(new CMemoryStateFile(STATE_PACKETQUEUE, m_packetQueue.data(), m_packetQueue.size()));
+	SavePacketQueue(archive);
 
 	SaveCallReplies(archive);
 }
 
+CSIF::STATS CSIF::GetStats() const
+{
+	return m_stats;
+}
+
+void CSIF::ResetStats()
+{
+	m_stats = STATS();
+}
+
+void CSIF::SavePacketQueue(Framework::CZipArchiveWriter& archive)
+{
+	m_savedPacketQueue.clear();
+	{
+		std::lock_guard<std::mutex> packetQueueLock(m_packetQueueMutex);
+		for(const auto& packet : m_packetQueue)
+		{
+			uint32 size = static_cast<uint32>(packet.size());
+			m_savedPacketQueue.insert(std::end(m_savedPacketQueue), reinterpret_cast<uint8*>(&size), reinterpret_cast<uint8*>(&size) + 4);
+			m_savedPacketQueue.insert(std::end(m_savedPacketQueue), std::begin(packet), std::end(packet));
+		}
+	}
+	archive.InsertFile(new CMemoryStateFile(STATE_PACKETQUEUE, m_savedPacketQueue.data(), m_savedPacketQueue.size()));
+}
+
 void CSIF::SaveCallReplies(Framework::CZipArchiveWriter& archive)
 {
 	auto callRepliesFile = new CStructCollectionStateFile(STATE_CALL_REPLIES_XML);
@@ -308,7 +381,7 @@ void CSIF::SaveCallReplies(Framework::CZipArchiveWriter& archive)
 
 CSIF::PacketQueue CSIF::LoadPacketQueue(Framework::CZipArchiveReader& archive)
 {
-	PacketQueue packetQueue;
+	PacketBuffer packetQueueData;
 	auto file = archive.BeginReadFile(STATE_PACKETQUEUE);
 	while(1)
 	{
@@ -316,7 +389,20 @@ CSIF::PacketQueue CSIF::LoadPacketQueue(Framework::CZipArchiveReader& archive)
 		uint8 buffer[bufferSize];
 		auto readSize = file->Read(buffer, bufferSize);
 		if(readSize == 0) break;
-		packetQueue.insert(std::end(packetQueue), buffer, buffer + readSize);
+		packetQueueData.insert(std::end(packetQueueData), buffer, buffer + readSize);
+	}
+
+	//Saved as a sequence of packets, each one prefixed by its size
+	PacketQueue packetQueue;
+	size_t position = 0;
+	while((position + 4) <= packetQueueData.size())
+	{
+		uint32 size = *reinterpret_cast<const uint32*>(packetQueueData.data() + position);
+		position += 4;
+		assert((position + size) <= packetQueueData.size());
+		size = std::min<uint32>(size, static_cast<uint32>(packetQueueData.size() - position));
+		packetQueue.emplace_back(packetQueueData.begin() + position, packetQueueData.begin() + position + size);
+		position += size;
 	}
 	return packetQueue;
 }
@@ -605,12 +691,26 @@ void CSIF::SetCustomCommandHandler(const CustomCommandHandler& customCommandHand
 	m_customCommandHandler = customCommandHandler;
 }
 
+void CSIF::SetSyncHandler(const SyncHandler& syncHandler)
+{
+	m_syncHandler = syncHandler;
+}
+
+void CSIF::Sync()
+{
+	if(m_syncHandler)
+	{
+		m_syncHandler();
+	}
+}
+
 /////////////////////////////////////////////////////////
 //Get/Set Register
 /////////////////////////////////////////////////////////
 
 uint32 CSIF::GetRegister(uint32 nRegister)
 {
+	Sync();
 	switch(nRegister)
 	{
 	case 0x00000001:
@@ -640,6 +740,7 @@ uint32 CSIF::GetRegister(uint32 nRegister)
 
 void CSIF::SetRegister(uint32 nRegister, uint32 nValue)
 {
+	Sync();
 	switch(nRegister)
 	{
 	case 0x00000001:
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <deque>
 #include <map>
+#include <mutex>
 #include <vector>
 #include "../SifDefs.h"
 #include "../SifModule.h"
@@ -15,6 +17,17 @@ class CSIF
 public:
 	typedef std::function<void(const std::string&)> ModuleResetHandler;
 	typedef std::function<void(uint32)> CustomCommandHandler;
+	//Called before the EE accesses state shared with the IOP (when the IOP runs on its own thread)
+	typedef std::function<void()> SyncHandler;
+
+	//Transfer counters, reset by ResetStats
+	struct STATS
+	{
+		uint32 packetCount = 0; //Command packets sent from the IOP to the EE
+		uint32 packetBytes = 0;
+		uint32 dmaCount = 0; //Transfers from the EE to the IOP
+		uint32 dmaBytes = 0;
+	};
 
 	CSIF(CDMAC&, uint8*, uint8*);
 	virtual ~CSIF() = default;
@@ -32,6 +45,8 @@ public:
 	void SendCallReply(uint32, const void*);
 	void SetModuleResetHandler(const ModuleResetHandler&);
 	void SetCustomCommandHandler(const CustomCommandHandler&);
+	void SetSyncHandler(const SyncHandler&);
+	void Sync();
 
 	uint32 ReceiveDMA5(uint32, uint32, uint32, bool);
 	uint32 ReceiveDMA6(uint32, uint32, uint32, bool);
@@ -46,6 +61,9 @@ public:
 	void LoadState(Framework::CZipArchiveReader&);
 	void SaveState(Framework::CZipArchiveWriter&);
 
+	STATS GetStats() const;
+	void ResetStats();
+
 private:
 	struct CALLREQUESTINFO
 	{
@@ -54,12 +72,15 @@ private:
 	};
 
 	typedef std::map<uint32, CSifModule*> ModuleMap;
-	typedef std::vector<uint8> PacketQueue;
+	typedef std::vector<uint8> PacketBuffer;
+	//Next packet to be sent is at the front
+	typedef std::deque<PacketBuffer> PacketQueue;
 	typedef std::map<uint32, CALLREQUESTINFO> CallReplyMap;
 
 	void DeleteModules();
 
 	void SaveCallReplies(Framework::CZipArchiveWriter&);
+	void SavePacketQueue(Framework::CZipArchiveWriter&);
 
 	static PacketQueue LoadPacketQueue(Framework::CZipArchiveReader&);
 	static CallReplyMap LoadCallReplies(Framework::CZipArchiveReader&);
@@ -96,11 +117,25 @@ private:
 
 	ModuleMap m_modules;
 
+	//Packets can be sent from the IOP's thread
+	std::mutex m_packetQueueMutex;
 	PacketQueue m_packetQueue;
+	std::vector<PacketBuffer> m_freePacketBuffers;
 	bool m_packetProcessed;
 
+	//Packet being transferred to the EE, DMA copies it straight to EE RAM
+	PacketBuffer m_currentPacket;
+	const uint8* m_dmaSource = nullptr;
+	uint32 m_dmaSourceSize = 0;
+
+	//Flattened packet queue (size followed by data for each packet), referenced by saved states
+	PacketBuffer m_savedPacketQueue;
+
+	STATS m_stats;
+
 	CallReplyMap m_callReplies;
 
 	ModuleResetHandler m_moduleResetHandler;
 	CustomCommandHandler m_customCommandHandler;
+	SyncHandler m_syncHandler;
 };
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 #include <stdio.h>
 #include "../Log.h"
@@ -33,27 +34,7 @@ void CTimer::Count(unsigned int ticks)
 		uint32 previousCount = timer.nCOUNT;
 		uint32 nextCount = timer.nCOUNT;
 
-		uint32 divider = 1;
-		//BUSCLOCK runs at half EE frequency
-		switch(timer.nMODE & MODE_CLOCK_SELECT)
-		{
-		case MODE_CLOCK_SELECT_BUSCLOCK:
-			divider = 1 * 2;
-			break;
-		case MODE_CLOCK_SELECT_BUSCLOCK16:
-			divider = 16 * 2;
-			break;
-		case MODE_CLOCK_SELECT_BUSCLOCK256:
-			divider = 256 * 2;
-			break;
-		case MODE_CLOCK_SELECT_EXTERNAL:
-		{
-			assert(m_gs);
-			uint32 hSyncFreq = m_gs->GetCrtHSyncFrequency();
-			divider = PS2::EE_CLOCK_FREQ / hSyncFreq;
-		}
-		break;
-		}
+		uint32 divider = GetDivider(timer);
 
 		//Compute increment
 		uint32 totalTicks = timer.clockRemain + ticks;
@@ -98,6 +79,65 @@ void CTimer::Count(unsigned int ticks)
 	}
 }
 
+//Returns a lower bound on the number of ticks before a timer can raise an interrupt
+uint32 CTimer::GetTicksUntilNextInterrupt() const
+{
+	uint32 result = ~0U;
+	for(unsigned int i = 0; i < MAX_TIMER; i++)
+	{
+		const auto& timer = m_timer[i];
+
+		if(!(timer.nMODE & MODE_COUNT_ENABLE)) continue;
+
+		bool compareIntEnabled = (timer.nMODE & MODE_EQUAL_INT_ENABLE) != 0;
+		bool overflowIntEnabled = (timer.nMODE & MODE_OVERFLOW_INT_ENABLE) != 0;
+		if(!compareIntEnabled && !overflowIntEnabled) continue;
+
+		uint32 compare = (timer.nCOMP == 0) ? 0x10000 : timer.nCOMP;
+		//Counter wraps around at least once every 0x10000 counts
+		uint32 target = timer.nCOUNT + 0x10000;
+		if(compareIntEnabled && (timer.nCOUNT < compare))
+		{
+			target = std::min(target, compare);
+		}
+		if(overflowIntEnabled)
+		{
+			target = std::min<uint32>(target, 0xFFFF);
+		}
+
+		uint64 ticks = static_cast<uint64>(target - timer.nCOUNT) * GetDivider(timer);
+		ticks -= std::min<uint64>(ticks, timer.clockRemain);
+		result = static_cast<uint32>(std::min<uint64>(result, ticks));
+	}
+	return result;
+}
+
+uint32 CTimer::GetDivider(const TIMER& timer) const
+{
+	uint32 divider = 1;
+	//BUSCLOCK runs at half EE frequency
+	switch(timer.nMODE & MODE_CLOCK_SELECT)
+	{
+	case MODE_CLOCK_SELECT_BUSCLOCK:
+		divider = 1 * 2;
+		break;
+	case MODE_CLOCK_SELECT_BUSCLOCK16:
+		divider = 16 * 2;
+		break;
+	case MODE_CLOCK_SELECT_BUSCLOCK256:
+		divider = 256 * 2;
+		break;
+	case MODE_CLOCK_SELECT_EXTERNAL:
+	{
+		assert(m_gs);
+		uint32 hSyncFreq = m_gs->GetCrtHSyncFrequency();
+		divider = PS2::EE_CLOCK_FREQ / hSyncFreq;
+	}
+	break;
+	}
+	return divider;
+}
+
 uint32 CTimer::GetRegister(uint32 nAddress)
 {
 	DisassembleGet(nAddress);
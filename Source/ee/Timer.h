@@ -33,6 +33,8 @@ public:
 
 		MODE_ZERO_RETURN = 0x040,
 		MODE_COUNT_ENABLE = 0x080,
+		MODE_EQUAL_INT_ENABLE = 0x100,
+		MODE_OVERFLOW_INT_ENABLE = 0x200,
 		MODE_EQUAL_FLAG = 0x400,
 		MODE_OVERFLOW_FLAG = 0x800,
 	};
@@ -48,6 +50,7 @@ public:
 	void Reset();
 
 	void Count(unsigned int);
+	uint32 GetTicksUntilNextInterrupt() const;
 
 	uint32 GetRegister(uint32);
 	void SetRegister(uint32, uint32);
@@ -79,6 +82,8 @@ private:
 		uint32 clockRemain;
 	};
 
+	uint32 GetDivider(const TIMER&) const;
+
 	TIMER m_timer[MAX_TIMER];
 	CINTC& m_intc;
 	CGSHandler*& m_gs;
@@ -51,6 +51,7 @@ BasicBlockPtr CVuExecutor::BlockFactory(CMIPS& context, uint32 begin, uint32 end
 
 	auto result = std::make_shared<CVuBasicBlock>(context, begin, end);
 	result->Compile();
+	m_compiledBlockCount++;
 	m_cachedBlocks.insert(std::make_pair(checksum, result));
 	return result;
 }
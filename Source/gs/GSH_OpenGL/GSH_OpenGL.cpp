@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <assert.h>
+#include <algorithm>
 #include <cstring>
 #include <math.h>
+#include <chrono>
 
 #include "../../Log.h"
 #include "../../AppConfig.h"
@@ -18,6 +20,8 @@
 #define BLEND_ONE_MINUS_SRC_ALPHA GL_ONE_MINUS_SRC_ALPHA
 #endif
 
+#define LOG_NAME ("gsh_opengl")
+
 #define NUM_SAMPLES 8
 #define FRAMEBUFFER_HEIGHT 1024
 
@@ -66,6 +70,11 @@ CGSH_OpenGL::CGSH_OpenGL(bool gsThreaded)
 	m_pCvtBuffer = new uint8[CVTBUFFERSIZE];
 
 	memset(&m_renderState, 0, sizeof(m_renderState));
+	m_renderState.blendSrcFactor = GL_ONE;
+	m_renderState.blendDstFactor = GL_ZERO;
+	m_renderState.blendEquation = GL_FUNC_ADD;
+	m_renderState.depthFunc = GL_ALWAYS;
+	memset(&m_appliedBatchState, 0, sizeof(m_appliedBatchState));
 	m_vertexBuffer.reserve(VERTEX_BUFFER_SIZE);
 }
 
@@ -94,6 +103,7 @@ void CGSH_OpenGL::ReleaseImpl()
 	ResetImpl();
 
 	m_paletteCache.clear();
+	ProgramCache_Save();
 	m_shaders.clear();
 	m_presentProgram.reset();
 	m_presentVertexBuffer.Reset();
@@ -113,9 +123,10 @@ void CGSH_OpenGL::ResetImpl()
 	LoadPreferences();
 	m_textureCache.Flush();
 	PalCache_Flush();
-	m_framebuffers.clear();
-	m_depthbuffers.clear();
+	ClearRenderTargets();
 	m_vertexBuffer.clear();
+	m_batches.clear();
+	m_batchVertexBuffer.clear();
 	m_renderState.isValid = false;
 	m_validGlState = 0;
 	m_drawingToDepth = false;
@@ -124,7 +135,8 @@ void CGSH_OpenGL::ResetImpl()
 
 void CGSH_OpenGL::FlipImpl()
 {
-	FlushVertexBuffer();
+	FlushBatchQueue();
+	ProgramCache_Prewarm();
 	m_renderState.isValid = false;
 	m_validGlState = 0;
 
@@ -138,24 +150,12 @@ void CGSH_OpenGL::FlipImpl()
 	bool halfHeight = GetCrtIsInterlaced() && GetCrtIsFrameMode();
 	if(halfHeight) dispHeight /= 2;
 
-	FramebufferPtr framebuffer;
-	for(const auto& candidateFramebuffer : m_framebuffers)
-	{
-		if(
-		    (candidateFramebuffer->m_basePtr == fb.GetBufPtr()) &&
-		    (GetFramebufferBitDepth(candidateFramebuffer->m_psm) == GetFramebufferBitDepth(fb.nPSM)) &&
-		    (candidateFramebuffer->m_width == fb.GetBufWidth()))
-		{
-			//We have a winner
-			framebuffer = candidateFramebuffer;
-			break;
-		}
-	}
+	auto framebuffer = FindDisplayFramebuffer(fb);
 
 	if(!framebuffer && (fb.GetBufWidth() != 0))
 	{
 		framebuffer = FramebufferPtr(new CFramebuffer(fb.GetBufPtr(), fb.GetBufWidth(), FRAMEBUFFER_HEIGHT, fb.nPSM, m_fbScale, m_multisampleEnabled));
-		m_framebuffers.push_back(framebuffer);
+		InsertFramebuffer(framebuffer);
 		PopulateFramebuffer(framebuffer);
 	}
 
@@ -234,6 +234,10 @@ void CGSH_OpenGL::FlipImpl()
 	}
 
 	PresentBackbuffer();
+
+	m_frameCounter++;
+	EvictRenderTargets();
+
 	CGSHandler::FlipImpl();
 }
 
@@ -251,15 +255,19 @@ void CGSH_OpenGL::RegisterPreferences()
 	CGSHandler::RegisterPreferences();
 	CAppConfig::GetInstance().RegisterPreferenceInteger(PREF_CGSH_OPENGL_RESOLUTION_FACTOR, 1);
 	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_CGSH_OPENGL_FORCEBILINEARTEXTURES, false);
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_CGSH_OPENGL_PROGRAMCACHE_ENABLED, true);
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_CGSH_OPENGL_PROGRAMCACHE_PREWARM, false);
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_CGSH_OPENGL_DRAWBATCHING, true);
+	CAppConfig::GetInstance().RegisterPreferenceInteger(PREF_CGSH_OPENGL_VRAMBUDGET, DEFAULT_VRAM_BUDGET);
 }
 
 void CGSH_OpenGL::NotifyPreferencesChangedImpl()
 {
+	FlushBatchQueue();
 	LoadPreferences();
 	m_textureCache.Flush();
 	PalCache_Flush();
-	m_framebuffers.clear();
-	m_depthbuffers.clear();
+	ClearRenderTargets();
 	CGSHandler::NotifyPreferencesChangedImpl();
 }
 
@@ -267,6 +275,8 @@ void CGSH_OpenGL::LoadPreferences()
 {
 	m_fbScale = CAppConfig::GetInstance().GetPreferenceInteger(PREF_CGSH_OPENGL_RESOLUTION_FACTOR);
 	m_forceBilinearTextures = CAppConfig::GetInstance().GetPreferenceBoolean(PREF_CGSH_OPENGL_FORCEBILINEARTEXTURES);
+	m_drawBatchingEnabled = CAppConfig::GetInstance().GetPreferenceBoolean(PREF_CGSH_OPENGL_DRAWBATCHING);
+	m_vramBudget = static_cast<uint64>(std::max(CAppConfig::GetInstance().GetPreferenceInteger(PREF_CGSH_OPENGL_VRAMBUDGET), 0)) * 0x100000;
 }
 
 void CGSH_OpenGL::InitializeRC()
@@ -277,6 +287,7 @@ void CGSH_OpenGL::InitializeRC()
 
 	CheckExtensions();
 	SetupTextureUpdaters();
+	ProgramCache_Load();
 
 	m_presentProgram = GeneratePresentProgram();
 	m_presentVertexBuffer = GeneratePresentVertexBuffer();
@@ -489,7 +500,17 @@ Framework::OpenGl::ProgramPtr CGSH_OpenGL::GetShaderFromCaps(const SHADERCAPS& s
 	auto shaderIterator = m_shaders.find(shaderCaps);
 	if(shaderIterator == m_shaders.end())
 	{
-		auto shader = GenerateShader(shaderCaps);
+		auto vertexShaderSource = GenerateVertexShaderSource(shaderCaps);
+		auto fragmentShaderSource = GenerateFragmentShaderSource(shaderCaps);
+		auto sourceHash = ProgramCache_HashSource(vertexShaderSource, fragmentShaderSource);
+		auto shader = ProgramCache_Search(shaderCaps, sourceHash);
+		if(!shader)
+		{
+			auto startTime = std::chrono::steady_clock::now();
+			shader = GenerateShader(vertexShaderSource, fragmentShaderSource);
+			auto compileTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+			ProgramCache_Insert(shaderCaps, sourceHash, shader, static_cast<uint32>(compileTime.count()));
+		}
 
 		glUseProgram(*shader);
 		m_validGlState &= ~GLSTATE_PROGRAM;
@@ -620,7 +641,8 @@ void CGSH_OpenGL::SetRenderingContext(uint64 primReg)
 	   (m_renderState.scissorReg != scissorReg) ||
 	   (m_renderState.testReg != testReg))
 	{
-		FlushVertexBuffer();
+		//Framebuffer setup modifies framebuffer objects and contents, batches need to be submitted
+		FlushBatchQueue();
 		SetupFramebuffer(frameReg, zbufReg, scissorReg, testReg);
 		CHECKGLERROR();
 	}
@@ -679,208 +701,251 @@ void CGSH_OpenGL::SetupBlendingFunction(uint64 alphaReg)
 		return;
 	}
 
-	int nFunction = GL_FUNC_ADD;
+	GLenum nFunction = GL_FUNC_ADD;
+	GLenum srcFactor = GL_ONE;
+	GLenum dstFactor = GL_ZERO;
+	float constantAlpha = 0;
 	if((alpha.nA == alpha.nB) && (alpha.nD == ALPHABLEND_ABD_CS))
 	{
 		//ab*0 (when a == b) - Cs
-		glBlendFuncSeparate(GL_ONE, GL_ZERO, GL_ONE, GL_ZERO);
+		srcFactor = GL_ONE;
+		dstFactor = GL_ZERO;
 	}
 	else if((alpha.nA == alpha.nB) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//ab*1 (when a == b) - Cd
-		glBlendFuncSeparate(GL_ZERO, GL_ONE, GL_ONE, GL_ZERO);
+		srcFactor = GL_ZERO;
+		dstFactor = GL_ONE;
 	}
 	else if((alpha.nA == alpha.nB) && (alpha.nD == ALPHABLEND_ABD_ZERO))
 	{
 		//ab*2 (when a == b) - Zero
-		glBlendFuncSeparate(GL_ZERO, GL_ZERO, GL_ONE, GL_ZERO);
+		srcFactor = GL_ZERO;
+		dstFactor = GL_ZERO;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CS) && (alpha.nB == ALPHABLEND_ABD_CD) && (alpha.nC == ALPHABLEND_C_AS) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//0101 - Cs * As + Cd * (1 - As)
-		glBlendFuncSeparate(BLEND_SRC_ALPHA, BLEND_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = BLEND_SRC_ALPHA;
+		dstFactor = BLEND_ONE_MINUS_SRC_ALPHA;
 	}
 	else if((alpha.nA == 0) && (alpha.nB == 1) && (alpha.nC == 1) && (alpha.nD == 1))
 	{
 		//Cs * Ad + Cd * (1 - Ad)
-		glBlendFuncSeparate(GL_DST_ALPHA, GL_ONE_MINUS_DST_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = GL_DST_ALPHA;
+		dstFactor = GL_ONE_MINUS_DST_ALPHA;
 	}
 	else if((alpha.nA == 0) && (alpha.nB == 1) && (alpha.nC == 2) && (alpha.nD == 1))
 	{
 		if(alpha.nFix == 0x80)
 		{
-			glBlendFuncSeparate(GL_ONE, GL_ZERO, GL_ONE, GL_ZERO);
+			srcFactor = GL_ONE;
+			dstFactor = GL_ZERO;
 		}
 		else
 		{
 			//Source alpha value is implied in the formula
 			//As = FIX / 0x80
-			glBlendColor(0.0f, 0.0f, 0.0f, (float)alpha.nFix / 128.0f);
-			glBlendFuncSeparate(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA, GL_ONE, GL_ZERO);
+			constantAlpha = (float)alpha.nFix / 128.0f;
+			srcFactor = GL_CONSTANT_ALPHA;
+			dstFactor = GL_ONE_MINUS_CONSTANT_ALPHA;
 		}
 	}
 	else if((alpha.nA == 0) && (alpha.nB == 2) && (alpha.nC == 0) && (alpha.nD == 1))
 	{
-		glBlendFuncSeparate(BLEND_SRC_ALPHA, GL_ONE, GL_ONE, GL_ZERO);
+		srcFactor = BLEND_SRC_ALPHA;
+		dstFactor = GL_ONE;
 	}
 	else if((alpha.nA == 0) && (alpha.nB == 2) && (alpha.nC == 0) && (alpha.nD == 2))
 	{
 		//Cs * As
-		glBlendFuncSeparate(BLEND_SRC_ALPHA, GL_ZERO, GL_ONE, GL_ZERO);
+		srcFactor = BLEND_SRC_ALPHA;
+		dstFactor = GL_ZERO;
 	}
 	else if((alpha.nA == 0) && (alpha.nB == 2) && (alpha.nC == 1) && (alpha.nD == 1))
 	{
 		//Cs * Ad + Cd
-		glBlendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ONE, GL_ZERO);
+		srcFactor = GL_DST_ALPHA;
+		dstFactor = GL_ONE;
 	}
 	else if((alpha.nA == 0) && (alpha.nB == 2) && (alpha.nC == 2) && (alpha.nD == 1))
 	{
 		if(alpha.nFix == 0x80)
 		{
-			glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ZERO);
+			srcFactor = GL_ONE;
+			dstFactor = GL_ONE;
 		}
 		else
 		{
 			//Cs * FIX + Cd
-			glBlendColor(0, 0, 0, static_cast<float>(alpha.nFix) / 128.0f);
-			glBlendFuncSeparate(GL_CONSTANT_ALPHA, GL_ONE, GL_ONE, GL_ZERO);
+			constantAlpha = static_cast<float>(alpha.nFix) / 128.0f;
+			srcFactor = GL_CONSTANT_ALPHA;
+			dstFactor = GL_ONE;
 		}
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CS) && (alpha.nB == ALPHABLEND_ABD_ZERO) && (alpha.nC == ALPHABLEND_C_FIX) && (alpha.nD == ALPHABLEND_ABD_ZERO))
 	{
 		//0222 - Cs * FIX
-		glBlendColor(0, 0, 0, static_cast<float>(alpha.nFix) / 128.0f);
-		glBlendFuncSeparate(GL_CONSTANT_ALPHA, GL_ZERO, GL_ONE, GL_ZERO);
+		constantAlpha = static_cast<float>(alpha.nFix) / 128.0f;
+		srcFactor = GL_CONSTANT_ALPHA;
+		dstFactor = GL_ZERO;
 	}
 	else if((alpha.nA == 1) && (alpha.nB == 0) && (alpha.nC == 0) && (alpha.nD == 0))
 	{
 		//(Cd - Cs) * As + Cs
-		glBlendFuncSeparate(BLEND_ONE_MINUS_SRC_ALPHA, BLEND_SRC_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = BLEND_ONE_MINUS_SRC_ALPHA;
+		dstFactor = BLEND_SRC_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_AS) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//1001 -> (Cd - Cs) * As + Cd (Inaccurate, needs +1 to As)
 		nFunction = GL_FUNC_REVERSE_SUBTRACT;
-		glBlendFuncSeparate(BLEND_SRC_ALPHA, BLEND_SRC_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = BLEND_SRC_ALPHA;
+		dstFactor = BLEND_SRC_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_AS) && (alpha.nD == ALPHABLEND_ABD_ZERO))
 	{
 		//1002 -> (Cd - Cs) * As
 		nFunction = GL_FUNC_REVERSE_SUBTRACT;
-		glBlendFuncSeparate(BLEND_SRC_ALPHA, BLEND_SRC_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = BLEND_SRC_ALPHA;
+		dstFactor = BLEND_SRC_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_AD) && (alpha.nD == ALPHABLEND_ABD_CS))
 	{
 		//1010 -> Cs * (1 - Ad) + Cd * Ad
-		glBlendFuncSeparate(GL_ONE_MINUS_DST_ALPHA, GL_DST_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = GL_ONE_MINUS_DST_ALPHA;
+		dstFactor = GL_DST_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_FIX) && (alpha.nD == ALPHABLEND_ABD_CS))
 	{
 		//1020 -> Cs * (1 - FIX) + Cd * FIX
-		glBlendColor(0, 0, 0, static_cast<float>(alpha.nFix) / 128.0f);
-		glBlendFuncSeparate(GL_ONE_MINUS_CONSTANT_ALPHA, GL_CONSTANT_ALPHA, GL_ONE, GL_ZERO);
+		constantAlpha = static_cast<float>(alpha.nFix) / 128.0f;
+		srcFactor = GL_ONE_MINUS_CONSTANT_ALPHA;
+		dstFactor = GL_CONSTANT_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_FIX) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//1021 -> (Cd - Cs) * FIX + Cd
 		nFunction = GL_FUNC_REVERSE_SUBTRACT;
-		glBlendColor(0.0f, 0.0f, 0.0f, (float)alpha.nFix / 128.0f);
-		glBlendFuncSeparate(GL_CONSTANT_ALPHA, GL_ONE, GL_ONE, GL_ZERO);
+		constantAlpha = (float)alpha.nFix / 128.0f;
+		srcFactor = GL_CONSTANT_ALPHA;
+		dstFactor = GL_ONE;
 	}
 	else if((alpha.nA == 1) && (alpha.nB == 0) && (alpha.nC == 2) && (alpha.nD == 2))
 	{
 		nFunction = GL_FUNC_REVERSE_SUBTRACT;
-		glBlendColor(0.0f, 0.0f, 0.0f, (float)alpha.nFix / 128.0f);
-		glBlendFuncSeparate(GL_CONSTANT_ALPHA, GL_CONSTANT_ALPHA, GL_ONE, GL_ZERO);
+		constantAlpha = (float)alpha.nFix / 128.0f;
+		srcFactor = GL_CONSTANT_ALPHA;
+		dstFactor = GL_CONSTANT_ALPHA;
 	}
 	else if((alpha.nA == 1) && (alpha.nB == 2) && (alpha.nC == 0) && (alpha.nD == 0))
 	{
 		//Cd * As + Cs
-		glBlendFuncSeparate(GL_ONE, BLEND_SRC_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = GL_ONE;
+		dstFactor = BLEND_SRC_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_ZERO) && (alpha.nC == ALPHABLEND_C_AS) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//1201 -> Cd * (As + 1)
 		//Relies on colorOutputWhite shader cap
-		glBlendFuncSeparate(GL_DST_COLOR, BLEND_SRC_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = GL_DST_COLOR;
+		dstFactor = BLEND_SRC_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_ZERO) && (alpha.nC == ALPHABLEND_C_AS) && (alpha.nD == ALPHABLEND_ABD_ZERO))
 	{
 		//1202 - Cd * As
-		glBlendFuncSeparate(GL_ZERO, BLEND_SRC_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = GL_ZERO;
+		dstFactor = BLEND_SRC_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_ZERO) && (alpha.nC == ALPHABLEND_C_AD) && (alpha.nD == ALPHABLEND_ABD_CS))
 	{
 		//1210 - Cs + (Cd * Ad)
-		glBlendFuncSeparate(GL_ONE, GL_DST_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = GL_ONE;
+		dstFactor = GL_DST_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_ZERO) && (alpha.nC == ALPHABLEND_C_AD) && (alpha.nD == ALPHABLEND_ABD_ZERO))
 	{
 		//1212 - Cd * Ad
-		glBlendFuncSeparate(GL_ZERO, GL_DST_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = GL_ZERO;
+		dstFactor = GL_DST_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_ZERO) && (alpha.nC == ALPHABLEND_C_FIX) && (alpha.nD == ALPHABLEND_ABD_CS))
 	{
 		//1220 -> Cd * FIX + Cs
-		glBlendColor(0, 0, 0, static_cast<float>(alpha.nFix) / 128.0f);
-		glBlendFuncSeparate(GL_ONE, GL_CONSTANT_ALPHA, GL_ONE, GL_ZERO);
+		constantAlpha = static_cast<float>(alpha.nFix) / 128.0f;
+		srcFactor = GL_ONE;
+		dstFactor = GL_CONSTANT_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_CD) && (alpha.nB == ALPHABLEND_ABD_ZERO) && (alpha.nC == ALPHABLEND_C_FIX) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//1221 -> Cd * (1 + FIX)
 		//Relies on colorOutputWhite shader cap
-		glBlendColor(0, 0, 0, static_cast<float>(alpha.nFix) / 128.0f);
-		glBlendFuncSeparate(GL_DST_COLOR, GL_CONSTANT_ALPHA, GL_ONE, GL_ZERO);
+		constantAlpha = static_cast<float>(alpha.nFix) / 128.0f;
+		srcFactor = GL_DST_COLOR;
+		dstFactor = GL_CONSTANT_ALPHA;
 	}
 	else if((alpha.nA == 1) && (alpha.nB == 2) && (alpha.nC == 2) && (alpha.nD == 2))
 	{
 		//1222 -> Cd * FIX
-		glBlendColor(0, 0, 0, static_cast<float>(alpha.nFix) / 128.0f);
-		glBlendFuncSeparate(GL_ZERO, GL_CONSTANT_ALPHA, GL_ONE, GL_ZERO);
+		constantAlpha = static_cast<float>(alpha.nFix) / 128.0f;
+		srcFactor = GL_ZERO;
+		dstFactor = GL_CONSTANT_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_ZERO) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_AS) && (alpha.nD == ALPHABLEND_ABD_CS))
 	{
 		//2000 -> Cs * (1 - As)
-		glBlendFuncSeparate(BLEND_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE, GL_ZERO);
+		srcFactor = BLEND_ONE_MINUS_SRC_ALPHA;
+		dstFactor = GL_ZERO;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_ZERO) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_AS) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//2001 -> Cd - Cs * As
 		nFunction = GL_FUNC_REVERSE_SUBTRACT;
-		glBlendFuncSeparate(BLEND_SRC_ALPHA, GL_ONE, GL_ONE, GL_ZERO);
+		srcFactor = BLEND_SRC_ALPHA;
+		dstFactor = GL_ONE;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_ZERO) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_AD) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//2011 -> Cd - Cs * Ad
 		nFunction = GL_FUNC_REVERSE_SUBTRACT;
-		glBlendFuncSeparate(GL_DST_ALPHA, GL_ONE, GL_ONE, GL_ZERO);
+		srcFactor = GL_DST_ALPHA;
+		dstFactor = GL_ONE;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_ZERO) && (alpha.nB == ALPHABLEND_ABD_CS) && (alpha.nC == ALPHABLEND_C_FIX) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//2021 -> Cd - Cs * FIX
 		nFunction = GL_FUNC_REVERSE_SUBTRACT;
-		glBlendColor(0, 0, 0, static_cast<float>(alpha.nFix) / 128.0f);
-		glBlendFuncSeparate(GL_CONSTANT_ALPHA, GL_ONE, GL_ONE, GL_ZERO);
+		constantAlpha = static_cast<float>(alpha.nFix) / 128.0f;
+		srcFactor = GL_CONSTANT_ALPHA;
+		dstFactor = GL_ONE;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_ZERO) && (alpha.nB == ALPHABLEND_ABD_CD) && (alpha.nC == ALPHABLEND_C_AS) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//2101 -> Cd * (1 - As)
-		glBlendFuncSeparate(GL_ZERO, BLEND_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO);
+		srcFactor = GL_ZERO;
+		dstFactor = BLEND_ONE_MINUS_SRC_ALPHA;
 	}
 	else if((alpha.nA == ALPHABLEND_ABD_ZERO) && (alpha.nB == ALPHABLEND_ABD_CD) && (alpha.nC == ALPHABLEND_C_FIX) && (alpha.nD == ALPHABLEND_ABD_CD))
 	{
 		//2121 -> Cd * (1 - FIX)
-		glBlendColor(0, 0, 0, static_cast<float>(alpha.nFix) / 128.0f);
-		glBlendFuncSeparate(GL_ZERO, GL_ONE_MINUS_CONSTANT_ALPHA, GL_ONE, GL_ZERO);
+		constantAlpha = static_cast<float>(alpha.nFix) / 128.0f;
+		srcFactor = GL_ZERO;
+		dstFactor = GL_ONE_MINUS_CONSTANT_ALPHA;
 	}
 	else
 	{
 		assert(0);
 		//Default blending
-		glBlendFuncSeparate(GL_ONE, GL_ZERO, GL_ONE, GL_ZERO);
+		srcFactor = GL_ONE;
+		dstFactor = GL_ZERO;
 	}
 
-	glBlendEquationSeparate(nFunction, GL_FUNC_ADD);
+	//Applied when the draw is issued
+	m_renderState.blendSrcFactor = srcFactor;
+	m_renderState.blendDstFactor = dstFactor;
+	m_renderState.blendEquation = nFunction;
+	m_renderState.blendConstantAlpha = constantAlpha;
+	m_validGlState &= ~GLSTATE_BLENDFUNC;
 }
 
 void CGSH_OpenGL::SetupTestFunctions(uint64 testReg)
@@ -913,7 +978,8 @@ void CGSH_OpenGL::SetupTestFunctions(uint64 testReg)
 			break;
 		}
 
-		glDepthFunc(nFunc);
+		m_renderState.depthFunc = nFunc;
+		m_validGlState &= ~GLSTATE_DEPTHFUNC;
 	}
 }
 
@@ -985,7 +1051,7 @@ void CGSH_OpenGL::SetupFramebuffer(uint64 frameReg, uint64 zbufReg, uint64 sciss
 	if(!framebuffer)
 	{
 		framebuffer = FramebufferPtr(new CFramebuffer(frame.GetBasePtr(), frame.GetWidth(), FRAMEBUFFER_HEIGHT, frame.nPsm, m_fbScale, m_multisampleEnabled));
-		m_framebuffers.push_back(framebuffer);
+		InsertFramebuffer(framebuffer);
 		PopulateFramebuffer(framebuffer);
 	}
 
@@ -995,7 +1061,7 @@ void CGSH_OpenGL::SetupFramebuffer(uint64 frameReg, uint64 zbufReg, uint64 sciss
 	if(!depthbuffer)
 	{
 		depthbuffer = DepthbufferPtr(new CDepthbuffer(zbuf.GetBasePtr(), frame.GetWidth(), FRAMEBUFFER_HEIGHT, zbuf.nPsm, m_fbScale, m_multisampleEnabled));
-		m_depthbuffers.push_back(depthbuffer);
+		InsertDepthbuffer(depthbuffer);
 	}
 
 	assert(framebuffer->m_width == depthbuffer->m_width);
@@ -1008,7 +1074,9 @@ void CGSH_OpenGL::SetupFramebuffer(uint64 frameReg, uint64 zbufReg, uint64 sciss
 	assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
 
 	m_renderState.framebufferHandle = framebuffer->m_framebuffer;
-	m_validGlState |= GLSTATE_FRAMEBUFFER; //glBindFramebuffer used to set just above
+	m_renderState.framebufferTextureHandle = framebuffer->m_texture;
+	//Binding will be restored when batches are submitted
+	m_validGlState &= ~GLSTATE_FRAMEBUFFER;
 
 	//We assume that we will be drawing to this framebuffer and that we'll need
 	//to resolve samples at some point if multisampling is enabled
@@ -1314,26 +1382,152 @@ void CGSH_OpenGL::SetupTexture(uint64 primReg, uint64 tex0Reg, uint64 tex1Reg, u
 	m_validGlState &= ~GLSTATE_FRAGMENT_PARAMS;
 }
 
-CGSH_OpenGL::FramebufferPtr CGSH_OpenGL::FindFramebuffer(const FRAME& frame) const
+uint64 CGSH_OpenGL::MakeRenderTargetKey(uint32 basePtr, uint32 width)
 {
-	auto framebufferIterator = std::find_if(std::begin(m_framebuffers), std::end(m_framebuffers),
-	                                        [&](const FramebufferPtr& framebuffer) {
-		                                        return (framebuffer->m_basePtr == frame.GetBasePtr()) &&
-		                                               IsCompatibleFramebufferPSM(framebuffer->m_psm, frame.nPsm) &&
-		                                               (framebuffer->m_width == frame.GetWidth());
-	                                        });
+	return static_cast<uint64>(basePtr) | (static_cast<uint64>(width) << 32);
+}
 
-	return (framebufferIterator != std::end(m_framebuffers)) ? *(framebufferIterator) : FramebufferPtr();
+const CGSH_OpenGL::FramebufferList* CGSH_OpenGL::GetFramebufferCandidates(uint32 basePtr, uint32 width) const
+{
+	auto framebufferIterator = m_framebufferIndex.find(MakeRenderTargetKey(basePtr, width));
+	return (framebufferIterator != std::end(m_framebufferIndex)) ? &framebufferIterator->second : nullptr;
 }
 
-CGSH_OpenGL::DepthbufferPtr CGSH_OpenGL::FindDepthbuffer(const ZBUF& zbuf, const FRAME& frame) const
+CGSH_OpenGL::FramebufferPtr CGSH_OpenGL::FindFramebuffer(const FRAME& frame)
 {
-	auto depthbufferIterator = std::find_if(std::begin(m_depthbuffers), std::end(m_depthbuffers),
-	                                        [&](const DepthbufferPtr& depthbuffer) {
-		                                        return (depthbuffer->m_basePtr == zbuf.GetBasePtr()) && (depthbuffer->m_width == frame.GetWidth());
-	                                        });
+	//Buffers are indexed by base pointer and width, PSM compatibility is checked
+	//on the (usually single) buffer that matches these
+	if(auto candidates = GetFramebufferCandidates(frame.GetBasePtr(), frame.GetWidth()))
+	{
+		for(const auto& framebuffer : *candidates)
+		{
+			if(!IsCompatibleFramebufferPSM(framebuffer->m_psm, frame.nPsm)) continue;
+			framebuffer->m_lastUsedFrame = m_frameCounter;
+			m_resourceCacheStats.framebufferHits++;
+			return framebuffer;
+		}
+	}
+
+	m_resourceCacheStats.framebufferMisses++;
+	return FramebufferPtr();
+}
+
+CGSH_OpenGL::FramebufferPtr CGSH_OpenGL::FindDisplayFramebuffer(const DISPFB& fb)
+{
+	if(auto candidates = GetFramebufferCandidates(fb.GetBufPtr(), fb.GetBufWidth()))
+	{
+		for(const auto& framebuffer : *candidates)
+		{
+			if(GetFramebufferBitDepth(framebuffer->m_psm) != GetFramebufferBitDepth(fb.nPSM)) continue;
+			framebuffer->m_lastUsedFrame = m_frameCounter;
+			return framebuffer;
+		}
+	}
+
+	return FramebufferPtr();
+}
+
+CGSH_OpenGL::DepthbufferPtr CGSH_OpenGL::FindDepthbuffer(const ZBUF& zbuf, const FRAME& frame)
+{
+	auto depthbufferIterator = m_depthbufferIndex.find(MakeRenderTargetKey(zbuf.GetBasePtr(), frame.GetWidth()));
+	if(depthbufferIterator != std::end(m_depthbufferIndex))
+	{
+		const auto& depthbuffer = depthbufferIterator->second.front();
+		depthbuffer->m_lastUsedFrame = m_frameCounter;
+		m_resourceCacheStats.depthbufferHits++;
+		return depthbuffer;
+	}
+
+	m_resourceCacheStats.depthbufferMisses++;
+	return DepthbufferPtr();
+}
+
+void CGSH_OpenGL::InsertFramebuffer(const FramebufferPtr& framebuffer)
+{
+	framebuffer->m_lastUsedFrame = m_frameCounter;
+	m_framebuffers.push_back(framebuffer);
+	m_framebufferIndex[MakeRenderTargetKey(framebuffer->m_basePtr, framebuffer->m_width)].push_back(framebuffer);
+	m_resourceCacheStats.vramFootprint += framebuffer->m_vramSize;
+}
+
+void CGSH_OpenGL::InsertDepthbuffer(const DepthbufferPtr& depthbuffer)
+{
+	depthbuffer->m_lastUsedFrame = m_frameCounter;
+	m_depthbuffers.push_back(depthbuffer);
+	m_depthbufferIndex[MakeRenderTargetKey(depthbuffer->m_basePtr, depthbuffer->m_width)].push_back(depthbuffer);
+	m_resourceCacheStats.vramFootprint += depthbuffer->m_vramSize;
+}
+
+void CGSH_OpenGL::ClearRenderTargets()
+{
+	m_framebuffers.clear();
+	m_depthbuffers.clear();
+	m_framebufferIndex.clear();
+	m_depthbufferIndex.clear();
+	m_resourceCacheStats.vramFootprint = 0;
+}
+
+//Frees framebuffers that haven't been used for a while, oldest first, until we're
+//back under the VRAM budget. Evicted framebuffers are written back to RAM first and will
+//be populated from there if they're needed again. Depth buffers are never populated from
+//RAM and we can't read them back on all platforms, they are thus never evicted.
+void CGSH_OpenGL::EvictRenderTargets()
+{
+	if(m_vramBudget == 0) return;
+	if(m_resourceCacheStats.vramFootprint <= m_vramBudget) return;
+
+	//Find the minimum age a buffer must have to be evicted for us to fit in the budget
+	std::vector<std::pair<uint32, uint64>> candidates;
+	for(const auto& framebuffer : m_framebuffers)
+	{
+		uint32 age = m_frameCounter - framebuffer->m_lastUsedFrame;
+		if(age >= RENDERTARGET_MIN_EVICTION_AGE) candidates.emplace_back(age, framebuffer->m_vramSize);
+	}
+	if(candidates.empty()) return;
+
+	std::sort(candidates.begin(), candidates.end(),
+	          [](const auto& lhs, const auto& rhs) { return lhs.first > rhs.first; });
+
+	uint64 footprint = m_resourceCacheStats.vramFootprint;
+	uint32 evictionAge = UINT32_MAX;
+	for(const auto& candidate : candidates)
+	{
+		if(footprint <= m_vramBudget) break;
+		evictionAge = candidate.first;
+		footprint -= candidate.second;
+	}
+
+	FlushBatchQueue();
+
+	uint32 evictionCount = 0;
+	auto evictFromIndex =
+	    [](auto& index, uint64 key, const auto& buffer) {
+		    auto& bucket = index[key];
+		    bucket.erase(std::remove(bucket.begin(), bucket.end(), buffer), bucket.end());
+		    if(bucket.empty()) index.erase(key);
+	    };
+
+	m_framebuffers.erase(
+	    std::remove_if(m_framebuffers.begin(), m_framebuffers.end(),
+	                   [&](const FramebufferPtr& framebuffer) {
+		                   if((m_frameCounter - framebuffer->m_lastUsedFrame) < evictionAge) return false;
+		                   WriteBackFramebuffer(framebuffer);
+		                   evictFromIndex(m_framebufferIndex, MakeRenderTargetKey(framebuffer->m_basePtr, framebuffer->m_width), framebuffer);
+		                   m_resourceCacheStats.vramFootprint -= framebuffer->m_vramSize;
+		                   evictionCount++;
+		                   return true;
+	                   }),
+	    m_framebuffers.end());
 
-	return (depthbufferIterator != std::end(m_depthbuffers)) ? *(depthbufferIterator) : DepthbufferPtr();
+	m_resourceCacheStats.evictions += evictionCount;
+
+	CLog::GetInstance().Print(LOG_NAME, "Evicted %d render targets, VRAM footprint is now %dMB.\r\n",
+	                          evictionCount, static_cast<int>(m_resourceCacheStats.vramFootprint / 0x100000));
+}
+
+CGSH_OpenGL::RESOURCECACHE_STATS CGSH_OpenGL::GetResourceCacheStats() const
+{
+	return m_resourceCacheStats;
 }
 
 /////////////////////////////////////////////////////////////
@@ -1619,16 +1813,262 @@ void CGSH_OpenGL::FlushVertexBuffer()
 		m_renderState.shaderHandle = *shader;
 		m_validGlState &= ~GLSTATE_PROGRAM;
 	}
-	DoRenderPass();
+
+	BATCH batch;
+	CaptureBatchState(batch.state);
+	batch.vertexStart = static_cast<uint32>(m_batchVertexBuffer.size());
+	batch.vertexCount = static_cast<uint32>(m_vertexBuffer.size());
+	batch.feedback = (m_renderState.texture0Handle != 0) && (m_renderState.texture0Handle == m_renderState.framebufferTextureHandle);
+
+	//Compute the area touched by this batch, points and lines can spill over by a pixel
+	batch.minX = batch.maxX = m_vertexBuffer[0].x;
+	batch.minY = batch.maxY = m_vertexBuffer[0].y;
+	for(const auto& vertex : m_vertexBuffer)
+	{
+		batch.minX = std::min(batch.minX, vertex.x);
+		batch.minY = std::min(batch.minY, vertex.y);
+		batch.maxX = std::max(batch.maxX, vertex.x);
+		batch.maxY = std::max(batch.maxY, vertex.y);
+	}
+	batch.minX = std::max(batch.minX - 1, static_cast<float>(m_renderState.scissorX));
+	batch.minY = std::max(batch.minY - 1, static_cast<float>(m_renderState.scissorY));
+	batch.maxX = std::min(batch.maxX + 1, static_cast<float>(m_renderState.scissorX + m_renderState.scissorWidth));
+	batch.maxY = std::min(batch.maxY + 1, static_cast<float>(m_renderState.scissorY + m_renderState.scissorHeight));
+
+	switch(batch.state.primitiveMode)
+	{
+	case GL_POINTS:
+		m_primitiveCount += batch.vertexCount;
+		break;
+	case GL_LINES:
+		m_primitiveCount += batch.vertexCount / 2;
+		break;
+	default:
+		m_primitiveCount += batch.vertexCount / 3;
+		break;
+	}
+
+	m_batchVertexBuffer.insert(m_batchVertexBuffer.end(), m_vertexBuffer.begin(), m_vertexBuffer.end());
+	m_batches.push_back(batch);
 	m_vertexBuffer.clear();
+
+	if(
+	    !m_drawBatchingEnabled ||
+	    (m_batches.size() >= BATCH_QUEUE_MAX_BATCHES) ||
+	    (m_batchVertexBuffer.size() >= BATCH_QUEUE_MAX_VERTICES))
+	{
+		FlushBatchQueue();
+	}
 }
 
-void CGSH_OpenGL::DoRenderPass()
+//Submits all pending batches. Batches that share the same state are merged in a single draw
+//if the batches between them don't overlap (in that case, drawing order doesn't matter).
+void CGSH_OpenGL::FlushBatchQueue()
 {
+	FlushVertexBuffer();
+	if(m_batches.empty()) return;
+
+	m_batchGroups.clear();
+	uint32 firstMergeableGroup = 0;
+	for(uint32 batchIndex = 0; batchIndex < m_batches.size(); batchIndex++)
+	{
+		const auto& batch = m_batches[batchIndex];
+		bool merged = false;
+		if(!batch.feedback)
+		{
+			uint32 groupCount = static_cast<uint32>(m_batchGroups.size());
+			uint32 windowStart = std::max<int32>(static_cast<int32>(firstMergeableGroup), static_cast<int32>(groupCount) - BATCH_MERGE_WINDOW);
+			for(uint32 groupIndex = groupCount; groupIndex > windowStart; groupIndex--)
+			{
+				auto& group = m_batchGroups[groupIndex - 1];
+				const auto& groupState = m_batches[group.batchIndices[0]].state;
+				if(!memcmp(&groupState, &batch.state, sizeof(BATCHSTATE)))
+				{
+					group.batchIndices.push_back(batchIndex);
+					group.minX = std::min(group.minX, batch.minX);
+					group.minY = std::min(group.minY, batch.minY);
+					group.maxX = std::max(group.maxX, batch.maxX);
+					group.maxY = std::max(group.maxY, batch.maxY);
+					merged = true;
+					break;
+				}
+				bool overlaps =
+				    (batch.minX <= group.maxX) && (group.minX <= batch.maxX) &&
+				    (batch.minY <= group.maxY) && (group.minY <= batch.maxY);
+				if(overlaps) break;
+			}
+		}
+		if(!merged)
+		{
+			BATCHGROUP group;
+			group.batchIndices.push_back(batchIndex);
+			group.minX = batch.minX;
+			group.minY = batch.minY;
+			group.maxX = batch.maxX;
+			group.maxY = batch.maxY;
+			m_batchGroups.push_back(std::move(group));
+			if(batch.feedback)
+			{
+				//Nothing can be moved before a batch that reads from the framebuffer
+				firstMergeableGroup = static_cast<uint32>(m_batchGroups.size());
+			}
+		}
+	}
+
+	//Upload vertices in group order, this allows each group to be drawn with a single call
+	m_batchUploadBuffer.clear();
+	m_batchUploadBuffer.reserve(m_batchVertexBuffer.size());
+	for(const auto& group : m_batchGroups)
+	{
+		for(const auto& batchIndex : group.batchIndices)
+		{
+			const auto& batch = m_batches[batchIndex];
+			auto batchVertexBegin = m_batchVertexBuffer.begin() + batch.vertexStart;
+			m_batchUploadBuffer.insert(m_batchUploadBuffer.end(), batchVertexBegin, batchVertexBegin + batch.vertexCount);
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_primBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PRIM_VERTEX) * m_batchUploadBuffer.size(), m_batchUploadBuffer.data(), GL_STREAM_DRAW);
+
+	glBindVertexArray(m_primVertexArray);
+
+	uint32 vertexStart = 0;
+	for(const auto& group : m_batchGroups)
+	{
+		uint32 vertexCount = 0;
+		for(const auto& batchIndex : group.batchIndices)
+		{
+			vertexCount += m_batches[batchIndex].vertexCount;
+		}
+		DoRenderPass(m_batches[group.batchIndices[0]].state, vertexStart, vertexCount);
+		vertexStart += vertexCount;
+	}
+
+	CHECKGLERROR();
+
+	m_batches.clear();
+	m_batchVertexBuffer.clear();
+}
+
+void CGSH_OpenGL::CaptureBatchState(BATCHSTATE& state) const
+{
+	memset(&state, 0, sizeof(BATCHSTATE));
+	state.shaderHandle = m_renderState.shaderHandle;
+	state.framebufferHandle = m_renderState.framebufferHandle;
+	state.texture0Handle = m_renderState.texture0Handle;
+	state.texture0MinFilter = m_renderState.texture0MinFilter;
+	state.texture0MagFilter = m_renderState.texture0MagFilter;
+	state.texture0WrapS = m_renderState.texture0WrapS;
+	state.texture0WrapT = m_renderState.texture0WrapT;
+	state.texture1Handle = m_renderState.texture1Handle;
+	state.viewportWidth = m_renderState.viewportWidth;
+	state.viewportHeight = m_renderState.viewportHeight;
+	state.scissorX = m_renderState.scissorX;
+	state.scissorY = m_renderState.scissorY;
+	state.scissorWidth = m_renderState.scissorWidth;
+	state.scissorHeight = m_renderState.scissorHeight;
+	state.blendSrcFactor = m_renderState.blendSrcFactor;
+	state.blendDstFactor = m_renderState.blendDstFactor;
+	state.blendEquation = m_renderState.blendEquation;
+	state.blendConstantAlpha = m_renderState.blendConstantAlpha;
+	state.depthFunc = m_renderState.depthFunc;
+	state.texture0AlphaAsIndex = m_renderState.texture0AlphaAsIndex;
+	state.blendEnabled = m_renderState.blendEnabled;
+	state.colorMaskR = m_renderState.colorMaskR;
+	state.colorMaskG = m_renderState.colorMaskG;
+	state.colorMaskB = m_renderState.colorMaskB;
+	state.colorMaskA = m_renderState.colorMaskA;
+	state.depthMask = m_renderState.depthMask;
+	state.depthTest = m_renderState.depthTest;
+	state.vertexParams = m_vertexParams;
+	state.fragmentParams = m_fragmentParams;
+
+	switch(m_primitiveType)
+	{
+	case PRIM_POINT:
+		state.primitiveMode = GL_POINTS;
+		break;
+	case PRIM_LINE:
+	case PRIM_LINESTRIP:
+		state.primitiveMode = GL_LINES;
+		break;
+	case PRIM_TRIANGLE:
+	case PRIM_TRIANGLESTRIP:
+	case PRIM_TRIANGLEFAN:
+	case PRIM_SPRITE:
+		state.primitiveMode = GL_TRIANGLES;
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+uint32 CGSH_OpenGL::GetBatchStateDirtyBits(const BATCHSTATE& prevState, const BATCHSTATE& state)
+{
+	uint32 dirtyBits = 0;
+	if(memcmp(&prevState.vertexParams, &state.vertexParams, sizeof(VERTEXPARAMS))) dirtyBits |= GLSTATE_VERTEX_PARAMS;
+	if(memcmp(&prevState.fragmentParams, &state.fragmentParams, sizeof(FRAGMENTPARAMS))) dirtyBits |= GLSTATE_FRAGMENT_PARAMS;
+	if(prevState.shaderHandle != state.shaderHandle) dirtyBits |= GLSTATE_PROGRAM;
+	if(
+	    (prevState.viewportWidth != state.viewportWidth) ||
+	    (prevState.viewportHeight != state.viewportHeight))
+	{
+		dirtyBits |= GLSTATE_VIEWPORT;
+	}
+	if(
+	    (prevState.scissorX != state.scissorX) ||
+	    (prevState.scissorY != state.scissorY) ||
+	    (prevState.scissorWidth != state.scissorWidth) ||
+	    (prevState.scissorHeight != state.scissorHeight))
+	{
+		dirtyBits |= GLSTATE_SCISSOR;
+	}
+	if(prevState.blendEnabled != state.blendEnabled) dirtyBits |= GLSTATE_BLEND;
+	if(
+	    (prevState.blendSrcFactor != state.blendSrcFactor) ||
+	    (prevState.blendDstFactor != state.blendDstFactor) ||
+	    (prevState.blendEquation != state.blendEquation) ||
+	    (prevState.blendConstantAlpha != state.blendConstantAlpha))
+	{
+		dirtyBits |= GLSTATE_BLENDFUNC;
+	}
+	if(prevState.depthTest != state.depthTest) dirtyBits |= GLSTATE_DEPTHTEST;
+	if(prevState.depthFunc != state.depthFunc) dirtyBits |= GLSTATE_DEPTHFUNC;
+	if(
+	    (prevState.colorMaskR != state.colorMaskR) ||
+	    (prevState.colorMaskG != state.colorMaskG) ||
+	    (prevState.colorMaskB != state.colorMaskB) ||
+	    (prevState.colorMaskA != state.colorMaskA))
+	{
+		dirtyBits |= GLSTATE_COLORMASK;
+	}
+	if(prevState.depthMask != state.depthMask) dirtyBits |= GLSTATE_DEPTHMASK;
+	if(
+	    (prevState.texture0Handle != state.texture0Handle) ||
+	    (prevState.texture0MinFilter != state.texture0MinFilter) ||
+	    (prevState.texture0MagFilter != state.texture0MagFilter) ||
+	    (prevState.texture0WrapS != state.texture0WrapS) ||
+	    (prevState.texture0WrapT != state.texture0WrapT) ||
+	    (prevState.texture0AlphaAsIndex != state.texture0AlphaAsIndex) ||
+	    (prevState.texture1Handle != state.texture1Handle))
+	{
+		dirtyBits |= GLSTATE_TEXTURE;
+	}
+	if(prevState.framebufferHandle != state.framebufferHandle) dirtyBits |= GLSTATE_FRAMEBUFFER;
+	return dirtyBits;
+}
+
+void CGSH_OpenGL::DoRenderPass(const BATCHSTATE& state, uint32 vertexStart, uint32 vertexCount)
+{
+	m_validGlState &= ~GetBatchStateDirtyBits(m_appliedBatchState, state);
+	m_appliedBatchState = state;
+
 	if((m_validGlState & GLSTATE_VERTEX_PARAMS) == 0)
 	{
 		glBindBuffer(GL_UNIFORM_BUFFER, m_vertexParamsBuffer);
-		glBufferData(GL_UNIFORM_BUFFER, sizeof(VERTEXPARAMS), &m_vertexParams, GL_STREAM_DRAW);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(VERTEXPARAMS), &state.vertexParams, GL_STREAM_DRAW);
 		CHECKGLERROR();
 		m_validGlState |= GLSTATE_VERTEX_PARAMS;
 	}
@@ -1636,69 +2076,83 @@ void CGSH_OpenGL::DoRenderPass()
 	if((m_validGlState & GLSTATE_FRAGMENT_PARAMS) == 0)
 	{
 		glBindBuffer(GL_UNIFORM_BUFFER, m_fragmentParamsBuffer);
-		glBufferData(GL_UNIFORM_BUFFER, sizeof(FRAGMENTPARAMS), &m_fragmentParams, GL_STREAM_DRAW);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FRAGMENTPARAMS), &state.fragmentParams, GL_STREAM_DRAW);
 		CHECKGLERROR();
 		m_validGlState |= GLSTATE_FRAGMENT_PARAMS;
 	}
 
 	if((m_validGlState & GLSTATE_PROGRAM) == 0)
 	{
-		glUseProgram(m_renderState.shaderHandle);
+		glUseProgram(state.shaderHandle);
 		m_validGlState |= GLSTATE_PROGRAM;
 	}
 
 	if((m_validGlState & GLSTATE_VIEWPORT) == 0)
 	{
-		glViewport(0, 0, m_renderState.viewportWidth * m_fbScale, m_renderState.viewportHeight * m_fbScale);
+		glViewport(0, 0, state.viewportWidth * m_fbScale, state.viewportHeight * m_fbScale);
 		m_validGlState |= GLSTATE_VIEWPORT;
 	}
 
 	if((m_validGlState & GLSTATE_SCISSOR) == 0)
 	{
 		glEnable(GL_SCISSOR_TEST);
-		glScissor(m_renderState.scissorX * m_fbScale, m_renderState.scissorY * m_fbScale,
-		          m_renderState.scissorWidth * m_fbScale, m_renderState.scissorHeight * m_fbScale);
+		glScissor(state.scissorX * m_fbScale, state.scissorY * m_fbScale,
+		          state.scissorWidth * m_fbScale, state.scissorHeight * m_fbScale);
 		m_validGlState |= GLSTATE_SCISSOR;
 	}
 
 	if((m_validGlState & GLSTATE_BLEND) == 0)
 	{
-		m_renderState.blendEnabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+		state.blendEnabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
 		m_validGlState |= GLSTATE_BLEND;
 	}
 
+	if((m_validGlState & GLSTATE_BLENDFUNC) == 0)
+	{
+		glBlendColor(0, 0, 0, state.blendConstantAlpha);
+		glBlendFuncSeparate(state.blendSrcFactor, state.blendDstFactor, GL_ONE, GL_ZERO);
+		glBlendEquationSeparate(state.blendEquation, GL_FUNC_ADD);
+		m_validGlState |= GLSTATE_BLENDFUNC;
+	}
+
 	if((m_validGlState & GLSTATE_DEPTHTEST) == 0)
 	{
-		m_renderState.depthTest ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+		state.depthTest ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
 		m_validGlState |= GLSTATE_DEPTHTEST;
 	}
 
+	if((m_validGlState & GLSTATE_DEPTHFUNC) == 0)
+	{
+		glDepthFunc(state.depthFunc);
+		m_validGlState |= GLSTATE_DEPTHFUNC;
+	}
+
 	if((m_validGlState & GLSTATE_COLORMASK) == 0)
 	{
 		glColorMask(
-		    m_renderState.colorMaskR, m_renderState.colorMaskG,
-		    m_renderState.colorMaskB, m_renderState.colorMaskA);
+		    state.colorMaskR, state.colorMaskG,
+		    state.colorMaskB, state.colorMaskA);
 		m_validGlState |= GLSTATE_COLORMASK;
 	}
 
 	if((m_validGlState & GLSTATE_DEPTHMASK) == 0)
 	{
-		glDepthMask(m_renderState.depthMask ? GL_TRUE : GL_FALSE);
+		glDepthMask(state.depthMask ? GL_TRUE : GL_FALSE);
 		m_validGlState |= GLSTATE_DEPTHMASK;
 	}
 
 	if((m_validGlState & GLSTATE_TEXTURE) == 0)
 	{
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, m_renderState.texture0Handle);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, m_renderState.texture0MinFilter);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, m_renderState.texture0MagFilter);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, m_renderState.texture0WrapS);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, m_renderState.texture0WrapT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, m_renderState.texture0AlphaAsIndex ? GL_ALPHA : GL_RED);
+		glBindTexture(GL_TEXTURE_2D, state.texture0Handle);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, state.texture0MinFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, state.texture0MagFilter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, state.texture0WrapS);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, state.texture0WrapT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, state.texture0AlphaAsIndex ? GL_ALPHA : GL_RED);
 
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, m_renderState.texture1Handle);
+		glBindTexture(GL_TEXTURE_2D, state.texture1Handle);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -1709,40 +2163,14 @@ void CGSH_OpenGL::DoRenderPass()
 
 	if((m_validGlState & GLSTATE_FRAMEBUFFER) == 0)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, m_renderState.framebufferHandle);
+		glBindFramebuffer(GL_FRAMEBUFFER, state.framebufferHandle);
 		m_validGlState |= GLSTATE_FRAMEBUFFER;
 	}
 
 	glBindBufferBase(GL_UNIFORM_BUFFER, 0, m_vertexParamsBuffer);
 	glBindBufferBase(GL_UNIFORM_BUFFER, 1, m_fragmentParamsBuffer);
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_primBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(PRIM_VERTEX) * m_vertexBuffer.size(), m_vertexBuffer.data(), GL_STREAM_DRAW);
-
-	glBindVertexArray(m_primVertexArray);
-
-	GLenum primitiveMode = GL_NONE;
-	switch(m_primitiveType)
-	{
-	case PRIM_POINT:
-		primitiveMode = GL_POINTS;
-		break;
-	case PRIM_LINE:
-	case PRIM_LINESTRIP:
-		primitiveMode = GL_LINES;
-		break;
-	case PRIM_TRIANGLE:
-	case PRIM_TRIANGLESTRIP:
-	case PRIM_TRIANGLEFAN:
-	case PRIM_SPRITE:
-		primitiveMode = GL_TRIANGLES;
-		break;
-	default:
-		assert(false);
-		break;
-	}
-
-	glDrawArrays(primitiveMode, 0, m_vertexBuffer.size());
+	glDrawArrays(state.primitiveMode, vertexStart, vertexCount);
 
 	m_drawCallCount++;
 }
@@ -1760,7 +2188,7 @@ void CGSH_OpenGL::DrawToDepth(unsigned int primitiveType, uint64 primReg)
 	if(primitiveType != PRIM_SPRITE) return;
 
 	//Invalidate state
-	FlushVertexBuffer();
+	FlushBatchQueue();
 	m_renderState.isValid = false;
 
 	auto prim = make_convertible<PRMODE>(primReg);
@@ -1966,7 +2394,7 @@ void CGSH_OpenGL::ProcessHostToLocalTransfer()
 {
 	if(m_trxCtx.nDirty)
 	{
-		FlushVertexBuffer();
+		FlushBatchQueue();
 		m_renderState.isTextureStateValid = false;
 		m_renderState.isFramebufferStateValid = false;
 
@@ -2010,7 +2438,7 @@ void CGSH_OpenGL::ProcessLocalToHostTransfer()
 	if(framebufferIterator == std::end(m_framebuffers)) return;
 	const auto& framebuffer = (*framebufferIterator);
 
-	FlushVertexBuffer();
+	FlushBatchQueue();
 	m_renderState.isValid = false;
 
 	auto pixels = new uint32[trxReg.nRRW * trxReg.nRRH];
@@ -2038,27 +2466,19 @@ void CGSH_OpenGL::ProcessLocalToHostTransfer()
 void CGSH_OpenGL::ProcessLocalToLocalTransfer()
 {
 	auto bltBuf = make_convertible<BITBLTBUF>(m_nReg[GS_REG_BITBLTBUF]);
-	auto srcFramebufferIterator = std::find_if(m_framebuffers.begin(), m_framebuffers.end(),
-	                                           [&](const FramebufferPtr& framebuffer) {
-		                                           return (framebuffer->m_basePtr == bltBuf.GetSrcPtr()) &&
-		                                                  (framebuffer->m_width == bltBuf.GetSrcWidth());
-	                                           });
-	auto dstFramebufferIterator = std::find_if(m_framebuffers.begin(), m_framebuffers.end(),
-	                                           [&](const FramebufferPtr& framebuffer) {
-		                                           return (framebuffer->m_basePtr == bltBuf.GetDstPtr()) &&
-		                                                  (framebuffer->m_width == bltBuf.GetDstWidth());
-	                                           });
-
-	bool foundSrc = srcFramebufferIterator != std::end(m_framebuffers);
-	bool foundDest = dstFramebufferIterator != std::end(m_framebuffers);
+	auto srcCandidates = GetFramebufferCandidates(bltBuf.GetSrcPtr(), bltBuf.GetSrcWidth());
+	auto dstCandidates = GetFramebufferCandidates(bltBuf.GetDstPtr(), bltBuf.GetDstWidth());
+
+	bool foundSrc = (srcCandidates != nullptr);
+	bool foundDest = (dstCandidates != nullptr);
 
 	if(foundSrc && foundDest)
 	{
-		FlushVertexBuffer();
+		FlushBatchQueue();
 		m_renderState.isValid = false;
 
-		const auto& srcFramebuffer = (*srcFramebufferIterator);
-		const auto& dstFramebuffer = (*dstFramebufferIterator);
+		const auto& srcFramebuffer = srcCandidates->front();
+		const auto& dstFramebuffer = dstCandidates->front();
 
 		glBindFramebuffer(GL_FRAMEBUFFER, dstFramebuffer->m_framebuffer);
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, srcFramebuffer->m_framebuffer);
@@ -2074,14 +2494,14 @@ void CGSH_OpenGL::ProcessLocalToLocalTransfer()
 	}
 	else if(foundSrc && !foundDest)
 	{
-		FlushVertexBuffer();
+		FlushBatchQueue();
 		m_renderState.isValid = false;
 
 		auto trxPos = make_convertible<TRXPOS>(m_nReg[GS_REG_TRXPOS]);
 		auto trxReg = make_convertible<TRXREG>(m_nReg[GS_REG_TRXREG]);
 		auto imgbuffer = Framework::CBitmap(trxReg.nRRW * m_fbScale, trxReg.nRRH * m_fbScale, 32);
 
-		glBindFramebuffer(GL_FRAMEBUFFER, (*srcFramebufferIterator)->m_framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, srcCandidates->front()->m_framebuffer);
 		glReadPixels(trxPos.nSSAX * m_fbScale, trxPos.nSSAY * m_fbScale, trxReg.nRRW * m_fbScale, trxReg.nRRH * m_fbScale, GL_RGBA, GL_UNSIGNED_BYTE, imgbuffer.GetPixels());
 		CHECKGLERROR();
 
@@ -2141,19 +2561,7 @@ Framework::CBitmap CGSH_OpenGL::GetScreenshot()
 	bool halfHeight = GetCrtIsInterlaced() && GetCrtIsFrameMode();
 	if(halfHeight) dispHeight /= 2;
 
-	FramebufferPtr framebuffer;
-	for(const auto& candidateFramebuffer : m_framebuffers)
-	{
-		if(
-		    (candidateFramebuffer->m_basePtr == fb.GetBufPtr()) &&
-		    (GetFramebufferBitDepth(candidateFramebuffer->m_psm) == GetFramebufferBitDepth(fb.nPSM)) &&
-		    (candidateFramebuffer->m_width == fb.GetBufWidth()))
-		{
-			//We have a winner
-			framebuffer = candidateFramebuffer;
-			break;
-		}
-	}
+	auto framebuffer = FindDisplayFramebuffer(fb);
 
 	auto imgbuffer = Framework::CBitmap(dispWidth * m_fbScale, dispHeight * m_fbScale, 32);
 	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer->m_framebuffer);
@@ -2175,6 +2583,7 @@ Framework::CBitmap CGSH_OpenGL::GetFramebuffer(uint64 frameReg)
 
 Framework::CBitmap CGSH_OpenGL::GetFramebufferImpl(uint64 frameReg)
 {
+	FlushBatchQueue();
 #ifndef GLES_COMPATIBILITY
 	auto frame = make_convertible<FRAME>(frameReg);
 	auto framebuffer = FindFramebuffer(frame);
@@ -2311,6 +2720,9 @@ CGSH_OpenGL::CFramebuffer::CFramebuffer(uint32 basePtr, uint32 width, uint32 hei
     , m_psm(psm)
 {
 	m_cachedArea.SetArea(psm, basePtr, width, height);
+	//Multisampled framebuffers have a NUM_SAMPLES renderbuffer on top of the resolve texture
+	m_vramSize = static_cast<uint64>(m_width * scale) * static_cast<uint64>(m_height * scale) * 4;
+	if(multisampled) m_vramSize *= (NUM_SAMPLES + 1);
 
 	//Build color attachment
 	glGenTextures(1, &m_texture);
@@ -2400,6 +2812,101 @@ void CGSH_OpenGL::PopulateFramebuffer(const FramebufferPtr& framebuffer)
 	CHECKGLERROR();
 }
 
+//Copies the contents of a framebuffer to RAM, this is the same thing as a local to host
+//transfer of the whole framebuffer area. Pages that were modified in RAM are committed first,
+//so what was transferred there after the framebuffer was populated is kept.
+void CGSH_OpenGL::WriteBackFramebuffer(const FramebufferPtr& framebuffer)
+{
+	CommitFramebufferDirtyPages(framebuffer, 0, framebuffer->m_height);
+
+	GLuint readFramebuffer = framebuffer->m_framebuffer;
+	if(framebuffer->m_resolveFramebuffer != 0)
+	{
+		ResolveFramebufferMultisample(framebuffer, m_fbScale);
+		readFramebuffer = framebuffer->m_resolveFramebuffer;
+	}
+
+	m_renderState.isValid = false;
+	m_validGlState &= ~GLSTATE_FRAMEBUFFER;
+
+	uint32 scaledWidth = framebuffer->m_width * m_fbScale;
+	uint32 scaledHeight = framebuffer->m_height * m_fbScale;
+	std::vector<uint32> pixels(scaledWidth * scaledHeight);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, readFramebuffer);
+	glReadPixels(0, 0, scaledWidth, scaledHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	CHECKGLERROR();
+
+	auto getPixel =
+	    [&](uint32 x, uint32 y) {
+		    return pixels[(x * m_fbScale) + (y * m_fbScale * scaledWidth)];
+	    };
+
+	auto writeBack16 =
+	    [&](auto& indexor) {
+		    for(uint32 y = 0; y < framebuffer->m_height; y++)
+		    {
+			    for(uint32 x = 0; x < framebuffer->m_width; x++)
+			    {
+				    uint32 pixel = getPixel(x, y);
+				    uint16 color =
+				        ((pixel >> 3) & 0x001F) |
+				        ((pixel >> 6) & 0x03E0) |
+				        ((pixel >> 9) & 0x7C00) |
+				        ((pixel >> 16) & 0x8000);
+				    indexor.SetPixel(x, y, color);
+			    }
+		    }
+	    };
+
+	switch(framebuffer->m_psm)
+	{
+	case PSMCT32:
+	{
+		CGsPixelFormats::CPixelIndexorPSMCT32 indexor(m_pRAM, framebuffer->m_basePtr, framebuffer->m_width / 64);
+		for(uint32 y = 0; y < framebuffer->m_height; y++)
+		{
+			for(uint32 x = 0; x < framebuffer->m_width; x++)
+			{
+				indexor.SetPixel(x, y, getPixel(x, y));
+			}
+		}
+	}
+	break;
+	case PSMCT24:
+	{
+		//Upper byte of each pixel doesn't belong to the framebuffer, keep what's in RAM
+		CGsPixelFormats::CPixelIndexorPSMCT32 indexor(m_pRAM, framebuffer->m_basePtr, framebuffer->m_width / 64);
+		for(uint32 y = 0; y < framebuffer->m_height; y++)
+		{
+			for(uint32 x = 0; x < framebuffer->m_width; x++)
+			{
+				uint32 pixel = (indexor.GetPixel(x, y) & 0xFF000000) | (getPixel(x, y) & 0x00FFFFFF);
+				indexor.SetPixel(x, y, pixel);
+			}
+		}
+	}
+	break;
+	case PSMCT16:
+	{
+		CGsPixelFormats::CPixelIndexorPSMCT16 indexor(m_pRAM, framebuffer->m_basePtr, framebuffer->m_width / 64);
+		writeBack16(indexor);
+	}
+	break;
+	case PSMCT16S:
+	{
+		CGsPixelFormats::CPixelIndexorPSMCT16S indexor(m_pRAM, framebuffer->m_basePtr, framebuffer->m_width / 64);
+		writeBack16(indexor);
+	}
+	break;
+	default:
+		assert(false);
+		return;
+	}
+
+	m_textureCache.InvalidateRange(framebuffer->m_basePtr, framebuffer->m_cachedArea.GetSize());
+}
+
 void CGSH_OpenGL::CommitFramebufferDirtyPages(const FramebufferPtr& framebuffer, unsigned int minY, unsigned int maxY)
 {
 	class CCopyToFbEnabler
@@ -2514,6 +3021,9 @@ CGSH_OpenGL::CDepthbuffer::CDepthbuffer(uint32 basePtr, uint32 width, uint32 hei
     , m_psm(psm)
     , m_depthBuffer(0)
 {
+	m_vramSize = static_cast<uint64>(m_width * scale) * static_cast<uint64>(m_height * scale) * 4;
+	if(multisampled) m_vramSize *= NUM_SAMPLES;
+
 	//Build depth attachment
 	glGenRenderbuffers(1, &m_depthBuffer);
 	glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
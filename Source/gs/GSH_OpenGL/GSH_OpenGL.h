@@ -1,7 +1,9 @@
 #pragma once
 
+#include <deque>
 #include <list>
 #include <unordered_map>
+#include "filesystem_def.h"
 #include "../GSHandler.h"
 #include "../GsCachedArea.h"
 #include "../GsTextureCache.h"
@@ -12,6 +14,10 @@
 
 #define PREF_CGSH_OPENGL_RESOLUTION_FACTOR "renderer.opengl.resfactor"
 #define PREF_CGSH_OPENGL_FORCEBILINEARTEXTURES "renderer.opengl.forcebilineartextures"
+#define PREF_CGSH_OPENGL_PROGRAMCACHE_ENABLED "renderer.opengl.programcache.enabled"
+#define PREF_CGSH_OPENGL_PROGRAMCACHE_PREWARM "renderer.opengl.programcache.prewarm"
+#define PREF_CGSH_OPENGL_DRAWBATCHING "renderer.opengl.drawbatching"
+#define PREF_CGSH_OPENGL_VRAMBUDGET "renderer.opengl.vrambudget"
 
 #if !defined(GLES_COMPATIBILITY) && !defined(__APPLE__)
 //- Dual source blending is disabled on macOS because it seems to be problematic on
@@ -30,6 +36,27 @@ public:
 		uint64 nST;
 		uint8 nFog;
 	};
+
+	struct PROGRAMCACHE_STATS
+	{
+		uint32 hits = 0;
+		uint32 misses = 0;
+		uint32 prewarmed = 0;
+		double avoidedCompileMs = 0;
+	};
+
+	struct RESOURCECACHE_STATS
+	{
+		uint32 framebufferHits = 0;
+		uint32 framebufferMisses = 0;
+		uint32 depthbufferHits = 0;
+		uint32 depthbufferMisses = 0;
+		uint32 paletteHits = 0;
+		uint32 paletteMisses = 0;
+		uint32 evictions = 0;
+		uint64 vramFootprint = 0;
+	};
+
 	CGSH_OpenGL(bool = true);
 	virtual ~CGSH_OpenGL();
 
@@ -43,6 +70,8 @@ public:
 	void ProcessClutTransfer(uint32, uint32) override;
 	void ReadFramebuffer(uint32, uint32, void*) override;
 
+	RESOURCECACHE_STATS GetResourceCacheStats() const;
+
 	bool GetDepthTestingEnabled() const;
 	void SetDepthTestingEnabled(bool);
 
@@ -58,6 +87,8 @@ public:
 
 	Framework::CBitmap GetScreenshot() override;
 
+	PROGRAMCACHE_STATS GetProgramCacheStats() const;
+
 protected:
 	void PalCache_Flush();
 	void LoadPreferences();
@@ -145,7 +176,13 @@ private:
 		GLint scissorY;
 		GLsizei scissorWidth;
 		GLsizei scissorHeight;
+		GLuint framebufferTextureHandle;
 		bool blendEnabled;
+		GLenum blendSrcFactor;
+		GLenum blendDstFactor;
+		GLenum blendEquation;
+		float blendConstantAlpha;
+		GLenum depthFunc;
 		bool colorMaskR;
 		bool colorMaskG;
 		bool colorMaskB;
@@ -177,12 +214,79 @@ private:
 	};
 	static_assert(sizeof(FRAGMENTPARAMS) == 0x40, "Size of FRAGMENTPARAMS must be 64 bytes.");
 
+	//Snapshot of everything needed to issue a draw, compared with memcmp to find compatible batches
+	struct BATCHSTATE
+	{
+		GLuint shaderHandle;
+		GLuint framebufferHandle;
+		GLuint texture0Handle;
+		GLint texture0MinFilter;
+		GLint texture0MagFilter;
+		GLint texture0WrapS;
+		GLint texture0WrapT;
+		GLuint texture1Handle;
+		GLsizei viewportWidth;
+		GLsizei viewportHeight;
+		GLint scissorX;
+		GLint scissorY;
+		GLsizei scissorWidth;
+		GLsizei scissorHeight;
+		GLenum blendSrcFactor;
+		GLenum blendDstFactor;
+		GLenum blendEquation;
+		float blendConstantAlpha;
+		GLenum depthFunc;
+		GLenum primitiveMode;
+		uint8 texture0AlphaAsIndex;
+		uint8 blendEnabled;
+		uint8 colorMaskR;
+		uint8 colorMaskG;
+		uint8 colorMaskB;
+		uint8 colorMaskA;
+		uint8 depthMask;
+		uint8 depthTest;
+		VERTEXPARAMS vertexParams;
+		FRAGMENTPARAMS fragmentParams;
+	};
+
+	struct BATCH
+	{
+		BATCHSTATE state;
+		uint32 vertexStart = 0;
+		uint32 vertexCount = 0;
+		float minX = 0;
+		float minY = 0;
+		float maxX = 0;
+		float maxY = 0;
+		//Samples from the framebuffer it's drawing to, can't be reordered
+		bool feedback = false;
+	};
+	typedef std::vector<BATCH> BatchArray;
+
+	struct BATCHGROUP
+	{
+		std::vector<uint32> batchIndices;
+		float minX = 0;
+		float minY = 0;
+		float maxX = 0;
+		float maxY = 0;
+	};
+	typedef std::vector<BATCHGROUP> BatchGroupArray;
+
 	enum
 	{
 		MAX_TEXTURE_CACHE = 256,
 		MAX_PALETTE_CACHE = 256,
 	};
 
+	enum
+	{
+		//Default VRAM budget for render targets (in MB), 0 means unlimited.
+		DEFAULT_VRAM_BUDGET = 1024,
+		//Render targets used within this amount of frames are never evicted
+		RENDERTARGET_MIN_EVICTION_AGE = 60,
+	};
+
 	enum CVTBUFFERSIZE
 	{
 		CVTBUFFERSIZE = 0x800000,
@@ -209,6 +313,17 @@ private:
 
 	typedef std::unordered_map<ShaderCapsInt, Framework::OpenGl::ProgramPtr> ShaderMap;
 
+	struct PROGRAMCACHE_ENTRY
+	{
+		//Hash of the GLSL source the binary was built from
+		uint64 sourceHash = 0;
+		uint32 compileTimeUs = 0;
+		uint32 binaryFormat = 0;
+		std::vector<uint8> binary;
+	};
+	typedef std::unordered_map<ShaderCapsInt, PROGRAMCACHE_ENTRY> ProgramCacheMap;
+	typedef std::deque<ShaderCapsInt> ProgramCachePrewarmQueue;
+
 	class CPalette
 	{
 	public:
@@ -219,6 +334,8 @@ private:
 		void Free();
 
 		bool m_live;
+		uint32 m_useStamp;
+		uint32 m_contentHash;
 
 		bool m_isIDTEX4;
 		uint32 m_cpsm;
@@ -228,6 +345,7 @@ private:
 	};
 	typedef std::shared_ptr<CPalette> PalettePtr;
 	typedef std::list<PalettePtr> PaletteList;
+	typedef std::unordered_multimap<uint32, PalettePtr> PaletteIndex;
 
 	class CFramebuffer
 	{
@@ -248,9 +366,13 @@ private:
 		GLuint m_colorBufferMs = 0;
 
 		CGsCachedArea m_cachedArea;
+
+		uint64 m_vramSize = 0;
+		uint32 m_lastUsedFrame = 0;
 	};
 	typedef std::shared_ptr<CFramebuffer> FramebufferPtr;
 	typedef std::vector<FramebufferPtr> FramebufferList;
+	typedef std::unordered_map<uint64, FramebufferList> FramebufferIndex;
 
 	class CDepthbuffer
 	{
@@ -263,9 +385,13 @@ private:
 		uint32 m_height;
 		uint32 m_psm;
 		GLuint m_depthBuffer;
+
+		uint64 m_vramSize = 0;
+		uint32 m_lastUsedFrame = 0;
 	};
 	typedef std::shared_ptr<CDepthbuffer> DepthbufferPtr;
 	typedef std::vector<DepthbufferPtr> DepthbufferList;
+	typedef std::unordered_map<uint64, DepthbufferList> DepthbufferIndex;
 
 	struct TEXTURE_INFO
 	{
@@ -306,6 +432,14 @@ private:
 		VERTEX_BUFFER_SIZE = 0x1000,
 	};
 
+	enum
+	{
+		BATCH_QUEUE_MAX_BATCHES = 0x400,
+		BATCH_QUEUE_MAX_VERTICES = 0x40000,
+		//How many groups we look back to find a compatible batch
+		BATCH_MERGE_WINDOW = 32,
+	};
+
 	typedef std::vector<PRIM_VERTEX> VertexBuffer;
 
 	void WriteRegisterImpl(uint8, uint64) override;
@@ -322,13 +456,23 @@ private:
 	void VertexKick(uint8, uint64);
 
 	Framework::OpenGl::ProgramPtr GetShaderFromCaps(const SHADERCAPS&);
-	Framework::OpenGl::ProgramPtr GenerateShader(const SHADERCAPS&);
-	Framework::OpenGl::CShader GenerateVertexShader(const SHADERCAPS&);
-	Framework::OpenGl::CShader GenerateFragmentShader(const SHADERCAPS&);
+	Framework::OpenGl::ProgramPtr GenerateShader(const std::string&, const std::string&);
+	static Framework::OpenGl::CShader CompileShader(GLenum, const std::string&);
+	std::string GenerateVertexShaderSource(const SHADERCAPS&);
+	std::string GenerateFragmentShaderSource(const SHADERCAPS&);
 	std::string GenerateTexCoordClampingSection(TEXTURE_CLAMP_MODE, const char*);
 	std::string GenerateAlphaTestSection(ALPHA_TEST_METHOD, ALPHA_TEST_FAIL_METHOD);
 	std::string GenerateAlphaBlendSection(ALPHABLEND_ABD, ALPHABLEND_ABD, ALPHABLEND_C, ALPHABLEND_ABD);
 
+	static fs::path ProgramCache_GetPath();
+	std::string ProgramCache_GetDriverId() const;
+	void ProgramCache_Load();
+	void ProgramCache_Save();
+	static uint64 ProgramCache_HashSource(const std::string&, const std::string&);
+	Framework::OpenGl::ProgramPtr ProgramCache_Search(const SHADERCAPS&, uint64);
+	void ProgramCache_Insert(const SHADERCAPS&, uint64, const Framework::OpenGl::ProgramPtr&, uint32);
+	void ProgramCache_Prewarm();
+
 	Framework::OpenGl::ProgramPtr GeneratePresentProgram();
 	Framework::OpenGl::CBuffer GeneratePresentVertexBuffer();
 	Framework::OpenGl::CVertexArray GeneratePresentVertexArray();
@@ -346,7 +490,10 @@ private:
 	void Prim_Sprite();
 
 	void FlushVertexBuffer();
-	void DoRenderPass();
+	void FlushBatchQueue();
+	void DoRenderPass(const BATCHSTATE&, uint32, uint32);
+	void CaptureBatchState(BATCHSTATE&) const;
+	static uint32 GetBatchStateDirtyBits(const BATCHSTATE&, const BATCHSTATE&);
 
 	void CopyToFb(int32, int32, int32, int32, int32, int32, int32, int32, int32, int32);
 	void DrawToDepth(unsigned int, uint64);
@@ -367,8 +514,15 @@ private:
 	static uint32 GetFramebufferBitDepth(uint32);
 	static TEXTUREFORMAT_INFO GetTextureFormatInfo(uint32);
 
-	FramebufferPtr FindFramebuffer(const FRAME&) const;
-	DepthbufferPtr FindDepthbuffer(const ZBUF&, const FRAME&) const;
+	static uint64 MakeRenderTargetKey(uint32, uint32);
+	const FramebufferList* GetFramebufferCandidates(uint32, uint32) const;
+	FramebufferPtr FindFramebuffer(const FRAME&);
+	FramebufferPtr FindDisplayFramebuffer(const DISPFB&);
+	DepthbufferPtr FindDepthbuffer(const ZBUF&, const FRAME&);
+	void InsertFramebuffer(const FramebufferPtr&);
+	void InsertDepthbuffer(const DepthbufferPtr&);
+	void ClearRenderTargets();
+	void EvictRenderTargets();
 
 	void DumpTexture(unsigned int, unsigned int, uint32);
 
@@ -409,9 +563,12 @@ private:
 	GLuint PalCache_Search(unsigned int, const uint32*);
 	void PalCache_Insert(const TEX0&, const uint32*, GLuint);
 	void PalCache_Invalidate(uint32);
+	static uint32 PalCache_GetKey(bool, uint32, uint32);
+	static uint32 PalCache_HashContents(const uint32*, unsigned int);
 
 	void PopulateFramebuffer(const FramebufferPtr&);
 	void CommitFramebufferDirtyPages(const FramebufferPtr&, unsigned int, unsigned int);
+	void WriteBackFramebuffer(const FramebufferPtr&);
 	void ResolveFramebufferMultisample(const FramebufferPtr&, uint32);
 
 	Framework::OpenGl::ProgramPtr m_presentProgram;
@@ -429,8 +586,16 @@ private:
 
 	TextureCache m_textureCache;
 	PaletteList m_paletteCache;
+	PaletteIndex m_paletteKeyIndex;
+	PaletteIndex m_paletteContentIndex;
+	uint32 m_paletteUseStamp = 0;
 	FramebufferList m_framebuffers;
 	DepthbufferList m_depthbuffers;
+	FramebufferIndex m_framebufferIndex;
+	DepthbufferIndex m_depthbufferIndex;
+	uint64 m_vramBudget = 0;
+	uint32 m_frameCounter = 0;
+	RESOURCECACHE_STATS m_resourceCacheStats;
 
 	Framework::OpenGl::CBuffer m_primBuffer;
 	Framework::OpenGl::CVertexArray m_primVertexArray;
@@ -461,9 +626,16 @@ private:
 		GLSTATE_FRAMEBUFFER = 0x0100,
 		GLSTATE_VIEWPORT = 0x0200,
 		GLSTATE_DEPTHTEST = 0x0400,
+		GLSTATE_BLENDFUNC = 0x0800,
+		GLSTATE_DEPTHFUNC = 0x1000,
 	};
 
 	ShaderMap m_shaders;
+	ProgramCacheMap m_programCache;
+	ProgramCachePrewarmQueue m_programCachePrewarmQueue;
+	PROGRAMCACHE_STATS m_programCacheStats;
+	bool m_programCacheEnabled = false;
+	bool m_programCacheDirty = false;
 	RENDERSTATE m_renderState;
 	uint32 m_validGlState = 0;
 	VERTEXPARAMS m_vertexParams;
@@ -472,6 +644,14 @@ private:
 	Framework::OpenGl::CBuffer m_fragmentParamsBuffer;
 	VertexBuffer m_vertexBuffer;
 
+	//Draw batching
+	bool m_drawBatchingEnabled = true;
+	BatchArray m_batches;
+	BatchGroupArray m_batchGroups;
+	VertexBuffer m_batchVertexBuffer;
+	VertexBuffer m_batchUploadBuffer;
+	BATCHSTATE m_appliedBatchState;
+
 	//If GPU has framebuffer fetch extension, some things will be done
 	//within the shader, such alpha blending
 	bool m_hasFramebufferFetchExtension = false;
@@ -0,0 +1,262 @@
+#include <chrono>
+#include <cstring>
+#include "GSH_OpenGL.h"
+#include "../../AppConfig.h"
+#include "../../Log.h"
+#include "PathUtils.h"
+#include "StdStreamUtils.h"
+
+#define LOG_NAME ("gsh_opengl")
+
+#define PROGRAMCACHE_FILENAME ("opengl_programs.bin")
+
+//Increment this when the file format changes. Changes to the generated shaders
+//are detected with the source hash stored with every entry.
+#define PROGRAMCACHE_VERSION (2)
+#define PROGRAMCACHE_MAGIC (0x43474C50) //'PLGC'
+
+//Maximum amount of time spent precompiling shaders per frame
+#define PROGRAMCACHE_PREWARM_BUDGET_US (2000)
+
+fs::path CGSH_OpenGL::ProgramCache_GetPath()
+{
+	return CAppConfig::GetBasePath() / fs::path("shadercache") / fs::path(PROGRAMCACHE_FILENAME);
+}
+
+std::string CGSH_OpenGL::ProgramCache_GetDriverId() const
+{
+	auto vendor = reinterpret_cast<const char*>(glGetString(GL_VENDOR));
+	auto renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+	auto version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+	std::string driverId;
+	driverId += vendor ? vendor : "";
+	driverId += "/";
+	driverId += renderer ? renderer : "";
+	driverId += "/";
+	driverId += version ? version : "";
+	//Generated shaders depend on this
+	driverId += m_hasFramebufferFetchExtension ? "/fbfetch" : "";
+	return driverId;
+}
+
+//64-bit FNV-1a
+uint64 CGSH_OpenGL::ProgramCache_HashSource(const std::string& vertexShaderSource, const std::string& fragmentShaderSource)
+{
+	uint64 hash = 0xCBF29CE484222325ULL;
+	auto hashString =
+	    [&hash](const std::string& source) {
+		    for(auto character : source)
+		    {
+			    hash ^= static_cast<uint8>(character);
+			    hash *= 0x100000001B3ULL;
+		    }
+		    //Separator, so that moving text from one stage to the other changes the hash
+		    hash ^= 0xFF;
+		    hash *= 0x100000001B3ULL;
+	    };
+	hashString(vertexShaderSource);
+	hashString(fragmentShaderSource);
+	return hash;
+}
+
+void CGSH_OpenGL::ProgramCache_Load()
+{
+	m_programCache.clear();
+	m_programCachePrewarmQueue.clear();
+	m_programCacheStats = PROGRAMCACHE_STATS();
+	m_programCacheDirty = false;
+
+	GLint binaryFormatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormatCount);
+	m_programCacheEnabled = CAppConfig::GetInstance().GetPreferenceBoolean(PREF_CGSH_OPENGL_PROGRAMCACHE_ENABLED) && (binaryFormatCount != 0);
+	if(!m_programCacheEnabled) return;
+
+	auto cachePath = ProgramCache_GetPath();
+	if(!fs::exists(cachePath)) return;
+
+	try
+	{
+		auto stream = Framework::CreateInputStdStream(cachePath.native());
+		uint32 magic = stream.Read32();
+		uint32 version = stream.Read32();
+		if((magic != PROGRAMCACHE_MAGIC) || (version != PROGRAMCACHE_VERSION))
+		{
+			CLog::GetInstance().Print(LOG_NAME, "Discarding program cache created by a different version.\r\n");
+			return;
+		}
+
+		uint32 driverIdSize = stream.Read32();
+		std::string driverId(driverIdSize, 0);
+		stream.Read(&driverId[0], driverIdSize);
+		//Binaries are only valid for the same driver, but we still keep the list
+		//of combinations to be able to prewarm them
+		bool binariesValid = (driverId == ProgramCache_GetDriverId());
+
+		uint32 entryCount = stream.Read32();
+		for(uint32 i = 0; i < entryCount; i++)
+		{
+			uint32 capsLo = stream.Read32();
+			uint32 capsHi = stream.Read32();
+			ShaderCapsInt caps = static_cast<ShaderCapsInt>(capsLo) | (static_cast<ShaderCapsInt>(capsHi) << 32);
+			PROGRAMCACHE_ENTRY entry;
+			uint32 sourceHashLo = stream.Read32();
+			uint32 sourceHashHi = stream.Read32();
+			entry.sourceHash = static_cast<uint64>(sourceHashLo) | (static_cast<uint64>(sourceHashHi) << 32);
+			entry.compileTimeUs = stream.Read32();
+			entry.binaryFormat = stream.Read32();
+			uint32 binarySize = stream.Read32();
+			entry.binary.resize(binarySize);
+			if(stream.Read(entry.binary.data(), binarySize) != binarySize)
+			{
+				throw std::runtime_error("Program cache is truncated.");
+			}
+			if(!binariesValid)
+			{
+				entry.binaryFormat = 0;
+				entry.binary.clear();
+				m_programCacheDirty = true;
+			}
+			m_programCache.insert(std::make_pair(caps, std::move(entry)));
+			m_programCachePrewarmQueue.push_back(caps);
+		}
+	}
+	catch(const std::exception& exception)
+	{
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to load program cache: %s\r\n", exception.what());
+		m_programCache.clear();
+		m_programCachePrewarmQueue.clear();
+	}
+
+	if(!CAppConfig::GetInstance().GetPreferenceBoolean(PREF_CGSH_OPENGL_PROGRAMCACHE_PREWARM))
+	{
+		m_programCachePrewarmQueue.clear();
+	}
+
+	CLog::GetInstance().Print(LOG_NAME, "Loaded %d entries from program cache.\r\n", static_cast<int>(m_programCache.size()));
+}
+
+void CGSH_OpenGL::ProgramCache_Save()
+{
+	if(!m_programCacheEnabled) return;
+
+	CLog::GetInstance().Print(LOG_NAME, "Program cache stats: %d hits, %d misses, %d prewarmed, %0.2fms of compilation avoided.\r\n",
+	                          m_programCacheStats.hits, m_programCacheStats.misses, m_programCacheStats.prewarmed, m_programCacheStats.avoidedCompileMs);
+
+	if(!m_programCacheDirty) return;
+
+	try
+	{
+		auto cachePath = ProgramCache_GetPath();
+		Framework::PathUtils::EnsurePathExists(cachePath.parent_path());
+		auto stream = Framework::CreateOutputStdStream(cachePath.native());
+		auto driverId = ProgramCache_GetDriverId();
+		stream.Write32(PROGRAMCACHE_MAGIC);
+		stream.Write32(PROGRAMCACHE_VERSION);
+		stream.Write32(static_cast<uint32>(driverId.size()));
+		stream.Write(driverId.data(), driverId.size());
+		stream.Write32(static_cast<uint32>(m_programCache.size()));
+		for(const auto& entryPair : m_programCache)
+		{
+			const auto& entry = entryPair.second;
+			stream.Write32(static_cast<uint32>(entryPair.first));
+			stream.Write32(static_cast<uint32>(entryPair.first >> 32));
+			stream.Write32(static_cast<uint32>(entry.sourceHash));
+			stream.Write32(static_cast<uint32>(entry.sourceHash >> 32));
+			stream.Write32(entry.compileTimeUs);
+			stream.Write32(entry.binaryFormat);
+			stream.Write32(static_cast<uint32>(entry.binary.size()));
+			stream.Write(entry.binary.data(), entry.binary.size());
+		}
+		m_programCacheDirty = false;
+	}
+	catch(const std::exception& exception)
+	{
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to save program cache: %s\r\n", exception.what());
+	}
+}
+
+Framework::OpenGl::ProgramPtr CGSH_OpenGL::ProgramCache_Search(const SHADERCAPS& shaderCaps, uint64 sourceHash)
+{
+	if(!m_programCacheEnabled) return Framework::OpenGl::ProgramPtr();
+
+	auto entryIterator = m_programCache.find(shaderCaps);
+	if(entryIterator == std::end(m_programCache)) return Framework::OpenGl::ProgramPtr();
+
+	const auto& entry = entryIterator->second;
+	if(entry.binary.empty()) return Framework::OpenGl::ProgramPtr();
+	//Shader generation code changed since the binary was saved
+	if(entry.sourceHash != sourceHash) return Framework::OpenGl::ProgramPtr();
+
+	auto startTime = std::chrono::steady_clock::now();
+
+	auto program = std::make_shared<Framework::OpenGl::CProgram>();
+	glProgramBinary(*program, entry.binaryFormat, entry.binary.data(), static_cast<GLsizei>(entry.binary.size()));
+
+	GLint linkStatus = GL_FALSE;
+	glGetProgramiv(*program, GL_LINK_STATUS, &linkStatus);
+	if(linkStatus == GL_FALSE)
+	{
+		//Driver rejected the binary, it will be recompiled from source
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to load program binary for caps 0x%016llX.\r\n", static_cast<uint64>(shaderCaps));
+		return Framework::OpenGl::ProgramPtr();
+	}
+
+	auto loadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+	m_programCacheStats.hits++;
+	m_programCacheStats.avoidedCompileMs += static_cast<double>(static_cast<int64>(entry.compileTimeUs) - loadTime.count()) / 1000.0;
+
+	CHECKGLERROR();
+
+	return program;
+}
+
+void CGSH_OpenGL::ProgramCache_Insert(const SHADERCAPS& shaderCaps, uint64 sourceHash, const Framework::OpenGl::ProgramPtr& program, uint32 compileTimeUs)
+{
+	m_programCacheStats.misses++;
+	if(!m_programCacheEnabled) return;
+
+	PROGRAMCACHE_ENTRY entry;
+	entry.sourceHash = sourceHash;
+	entry.compileTimeUs = compileTimeUs;
+
+	GLint binaryLength = 0;
+	glGetProgramiv(*program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+	if(binaryLength != 0)
+	{
+		GLenum binaryFormat = 0;
+		GLsizei writtenLength = 0;
+		entry.binary.resize(binaryLength);
+		glGetProgramBinary(*program, binaryLength, &writtenLength, &binaryFormat, entry.binary.data());
+		entry.binary.resize(writtenLength);
+		entry.binaryFormat = binaryFormat;
+	}
+
+	CHECKGLERROR();
+
+	m_programCache[shaderCaps] = std::move(entry);
+	m_programCacheDirty = true;
+}
+
+void CGSH_OpenGL::ProgramCache_Prewarm()
+{
+	if(m_programCachePrewarmQueue.empty()) return;
+
+	auto startTime = std::chrono::steady_clock::now();
+	while(!m_programCachePrewarmQueue.empty())
+	{
+		auto shaderCaps = make_convertible<SHADERCAPS>(m_programCachePrewarmQueue.front());
+		m_programCachePrewarmQueue.pop_front();
+		if(m_shaders.find(shaderCaps) == std::end(m_shaders))
+		{
+			GetShaderFromCaps(shaderCaps);
+			m_programCacheStats.prewarmed++;
+		}
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+		if(elapsed.count() >= PROGRAMCACHE_PREWARM_BUDGET_US) break;
+	}
+}
+
+CGSH_OpenGL::PROGRAMCACHE_STATS CGSH_OpenGL::GetProgramCacheStats() const
+{
+	return m_programCacheStats;
+}
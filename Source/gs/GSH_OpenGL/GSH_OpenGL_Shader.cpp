@@ -54,10 +54,10 @@ static const char* s_orFunction =
     "	return float(r);\r\n"
     "}\r\n";
 
-Framework::OpenGl::ProgramPtr CGSH_OpenGL::GenerateShader(const SHADERCAPS& caps)
+Framework::OpenGl::ProgramPtr CGSH_OpenGL::GenerateShader(const std::string& vertexShaderSource, const std::string& fragmentShaderSource)
 {
-	auto vertexShader = GenerateVertexShader(caps);
-	auto fragmentShader = GenerateFragmentShader(caps);
+	auto vertexShader = CompileShader(GL_VERTEX_SHADER, vertexShaderSource);
+	auto fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
 
 	auto result = std::make_shared<Framework::OpenGl::CProgram>();
 
@@ -75,6 +75,11 @@ Framework::OpenGl::ProgramPtr CGSH_OpenGL::GenerateShader(const SHADERCAPS& caps
 	glBindFragDataLocationIndexed(*result, 0, 1, "blendColor");
 #endif
 
+	if(m_programCacheEnabled)
+	{
+		glProgramParameteri(*result, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
 	FRAMEWORK_MAYBE_UNUSED bool linkResult = result->Link();
 	assert(linkResult);
 
@@ -83,7 +88,19 @@ Framework::OpenGl::ProgramPtr CGSH_OpenGL::GenerateShader(const SHADERCAPS& caps
 	return result;
 }
 
-Framework::OpenGl::CShader CGSH_OpenGL::GenerateVertexShader(const SHADERCAPS& caps)
+Framework::OpenGl::CShader CGSH_OpenGL::CompileShader(GLenum type, const std::string& shaderSource)
+{
+	Framework::OpenGl::CShader result(type);
+	result.SetSource(shaderSource.c_str(), shaderSource.size());
+	FRAMEWORK_MAYBE_UNUSED bool compilationResult = result.Compile();
+	assert(compilationResult);
+
+	CHECKGLERROR();
+
+	return result;
+}
+
+std::string CGSH_OpenGL::GenerateVertexShaderSource(const SHADERCAPS& caps)
 {
 	std::stringstream shaderBuilder;
 	shaderBuilder << GLSL_VERSION << std::endl;
@@ -122,18 +139,10 @@ Framework::OpenGl::CShader CGSH_OpenGL::GenerateVertexShader(const SHADERCAPS& c
 	shaderBuilder << "}" << std::endl;
 
 	auto shaderSource = shaderBuilder.str();
-
-	Framework::OpenGl::CShader result(GL_VERTEX_SHADER);
-	result.SetSource(shaderSource.c_str(), shaderSource.size());
-	FRAMEWORK_MAYBE_UNUSED bool compilationResult = result.Compile();
-	assert(compilationResult);
-
-	CHECKGLERROR();
-
-	return result;
+	return shaderSource;
 }
 
-Framework::OpenGl::CShader CGSH_OpenGL::GenerateFragmentShader(const SHADERCAPS& caps)
+std::string CGSH_OpenGL::GenerateFragmentShaderSource(const SHADERCAPS& caps)
 {
 	bool useFramebufferFetch = (caps.hasAlphaBlend || caps.hasAlphaTest || caps.hasDestAlphaTest) && m_hasFramebufferFetchExtension;
 
@@ -423,15 +432,7 @@ Framework::OpenGl::CShader CGSH_OpenGL::GenerateFragmentShader(const SHADERCAPS&
 	shaderBuilder << "}" << std::endl;
 
 	auto shaderSource = shaderBuilder.str();
-
-	Framework::OpenGl::CShader result(GL_FRAGMENT_SHADER);
-	result.SetSource(shaderSource.c_str(), shaderSource.size());
-	FRAMEWORK_MAYBE_UNUSED bool compilationResult = result.Compile();
-	assert(compilationResult);
-
-	CHECKGLERROR();
-
-	return result;
+	return shaderSource;
 }
 
 std::string CGSH_OpenGL::GenerateTexCoordClampingSection(TEXTURE_CLAMP_MODE clampMode, const char* coordinate)
@@ -7,6 +7,7 @@
 #include "StdStream.h"
 #include "bitmap/BMP.h"
 #include "../GsPixelFormats.h"
+#include "../GsDeswizzle.h"
 
 /////////////////////////////////////////////////////////////
 // Texture Loading
@@ -82,27 +83,26 @@ CGSH_OpenGL::TEXTURE_INFO CGSH_OpenGL::SearchTextureFramebuffer(const TEX0& tex0
 	FramebufferPtr framebuffer;
 
 	//First pass, look for an exact match
-	for(const auto& candidateFramebuffer : m_framebuffers)
+	if(auto candidates = GetFramebufferCandidates(tex0.GetBufPtr(), tex0.GetBufWidth()))
 	{
-		//Case: TEX0 points at the start of a frame buffer with the same width
-		if(candidateFramebuffer->m_basePtr == tex0.GetBufPtr() &&
-		   candidateFramebuffer->m_width == tex0.GetBufWidth() &&
-		   IsCompatibleFramebufferPSM(candidateFramebuffer->m_psm, tex0.nPsm))
+		for(const auto& candidateFramebuffer : *candidates)
 		{
-			framebuffer = candidateFramebuffer;
-			break;
-		}
+			//Case: TEX0 points at the start of a frame buffer with the same width
+			if(IsCompatibleFramebufferPSM(candidateFramebuffer->m_psm, tex0.nPsm))
+			{
+				framebuffer = candidateFramebuffer;
+				break;
+			}
 
-		//Case: TEX0 point at the start of a frame buffer with the same width
-		//but uses upper 8-bits (alpha) as an indexed texture (used in Yakuza)
-		else if(candidateFramebuffer->m_basePtr == tex0.GetBufPtr() &&
-		        candidateFramebuffer->m_width == tex0.GetBufWidth() &&
-		        candidateFramebuffer->m_psm == CGSHandler::PSMCT32 &&
-		        tex0.nPsm == CGSHandler::PSMT8H)
-		{
-			framebuffer = candidateFramebuffer;
-			texInfo.alphaAsIndex = true;
-			break;
+			//Case: TEX0 point at the start of a frame buffer with the same width
+			//but uses upper 8-bits (alpha) as an indexed texture (used in Yakuza)
+			else if(candidateFramebuffer->m_psm == CGSHandler::PSMCT32 &&
+			        tex0.nPsm == CGSHandler::PSMT8H)
+			{
+				framebuffer = candidateFramebuffer;
+				texInfo.alphaAsIndex = true;
+				break;
+			}
 		}
 	}
 
@@ -137,6 +137,10 @@ CGSH_OpenGL::TEXTURE_INFO CGSH_OpenGL::SearchTextureFramebuffer(const TEX0& tex0
 
 	if(framebuffer)
 	{
+		framebuffer->m_lastUsedFrame = m_frameCounter;
+
+		//Pending batches might draw to this framebuffer
+		FlushBatchQueue();
 		CommitFramebufferDirtyPages(framebuffer, 0, tex0.GetHeight());
 		if(m_multisampleEnabled)
 		{
@@ -168,6 +172,9 @@ CGSH_OpenGL::TEXTURE_INFO CGSH_OpenGL::PrepareTexture(const TEX0& tex0)
 	auto texture = m_textureCache.Search(tex0);
 	if(!texture)
 	{
+		//Inserting in the cache will release a texture that pending batches might be using
+		FlushBatchQueue();
+
 		//Validate texture dimensions to prevent problems
 		auto texWidth = tex0.GetWidth();
 		auto texHeight = tex0.GetHeight();
@@ -196,6 +203,12 @@ CGSH_OpenGL::TEXTURE_INFO CGSH_OpenGL::PrepareTexture(const TEX0& tex0)
 	auto texturePageSize = CGsPixelFormats::GetPsmPageSize(tex0.nPsm);
 	auto areaRect = cachedArea.GetAreaPageRect();
 
+	if(cachedArea.HasDirtyPages())
+	{
+		//Pending batches might be sampling this texture
+		FlushBatchQueue();
+	}
+
 	while(cachedArea.HasDirtyPages())
 	{
 		auto dirtyRect = cachedArea.GetDirtyPageRect();
@@ -231,6 +244,7 @@ GLuint CGSH_OpenGL::PreparePalette(const TEX0& tex0)
 	GLuint textureHandle = PalCache_Search(tex0);
 	if(textureHandle != 0)
 	{
+		m_resourceCacheStats.paletteHits++;
 		return textureHandle;
 	}
 
@@ -241,9 +255,15 @@ GLuint CGSH_OpenGL::PreparePalette(const TEX0& tex0)
 	textureHandle = PalCache_Search(entryCount, convertedClut.data());
 	if(textureHandle != 0)
 	{
+		m_resourceCacheStats.paletteHits++;
 		return textureHandle;
 	}
 
+	m_resourceCacheStats.paletteMisses++;
+
+	//Inserting in the cache will release a texture that pending batches might be using
+	FlushBatchQueue();
+
 	glGenTextures(1, &textureHandle);
 	glBindTexture(GL_TEXTURE_2D, textureHandle);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, entryCount, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, convertedClut.data());
@@ -323,230 +343,6 @@ void CGSH_OpenGL::TexUpdater_Psm16(uint32 bufPtr, uint32 bufWidth, unsigned int
 	CHECKGLERROR();
 }
 
-#ifdef _WIN32
-#define USE_SSE
-#elif defined(__APPLE__)
-#include <TargetConditionals.h>
-#if TARGET_CPU_X86_64
-#define USE_SSE
-#elif TARGET_CPU_ARM64
-#define USE_NEON
-#endif
-#elif defined(__ANDROID__) || defined(__linux__) || defined(__FreeBSD__)
-#if defined(__x86_64__) || defined(__i386__)
-#define USE_SSE
-#elif defined(__aarch64__) || defined(__arm__)
-#define USE_NEON
-#endif
-#endif
-
-#if defined(USE_SSE)
-#include <xmmintrin.h>
-#include <emmintrin.h>
-#include <tmmintrin.h>
-
-void convertColumn8(uint8* dest, const int destStride, int colNum, __m128i a, __m128i b, __m128i c, __m128i d)
-{
-	__m128i* mdest = (__m128i*)dest;
-
-	__m128i temp_a = a;
-	__m128i temp_c = c;
-
-	a = _mm_unpacklo_epi8(temp_a, b);
-	c = _mm_unpackhi_epi8(temp_a, b);
-	b = _mm_unpacklo_epi8(temp_c, d);
-	d = _mm_unpackhi_epi8(temp_c, d);
-
-	temp_a = a;
-	temp_c = c;
-
-	a = _mm_unpacklo_epi16(temp_a, b);
-	c = _mm_unpackhi_epi16(temp_a, b);
-	b = _mm_unpacklo_epi16(temp_c, d);
-	d = _mm_unpackhi_epi16(temp_c, d);
-
-	temp_a = a;
-	__m128i temp_b = b;
-
-	a = _mm_unpacklo_epi8(temp_a, c);
-	b = _mm_unpackhi_epi8(temp_a, c);
-	c = _mm_unpacklo_epi8(temp_b, d);
-	d = _mm_unpackhi_epi8(temp_b, d);
-
-	temp_a = a;
-	temp_c = c;
-
-	a = _mm_unpacklo_epi64(temp_a, b);
-	c = _mm_unpackhi_epi64(temp_a, b);
-	b = _mm_unpacklo_epi64(temp_c, d);
-	d = _mm_unpackhi_epi64(temp_c, d);
-
-	if((colNum & 1) == 0)
-	{
-		c = _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1));
-		d = _mm_shuffle_epi32(d, _MM_SHUFFLE(2, 3, 0, 1));
-	}
-	else
-	{
-		a = _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1));
-		b = _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1));
-	}
-
-	int mStride = destStride / 16;
-
-	mdest[0] = a;
-	mdest[mStride] = b;
-	mdest[mStride * 2] = c;
-	mdest[mStride * 3] = d;
-}
-
-inline void convertColumn8(uint8* dest, const int destStride, uint8* src, int colNum)
-{
-	__m128i* mSrc = (__m128i*)src;
-
-	__m128i a = mSrc[0];
-	__m128i b = mSrc[1];
-	__m128i c = mSrc[2];
-	__m128i d = mSrc[3];
-	convertColumn8(dest, destStride, colNum, a, b, c, d);
-}
-
-inline void convertColumn4(uint8* dest, const int destStride, uint8* src, int colNum)
-{
-	__m128i* mSrc = (__m128i*)src;
-
-	__m128i a = mSrc[0];
-	__m128i b = mSrc[1];
-	__m128i c = mSrc[2];
-	__m128i d = mSrc[3];
-
-	// 4 bpp looks like 2 8bpp columns side by side.
-	// The 4pp are expanded to 8bpp.
-	// so 01 23 45 67 89 ab cd ef gh ij kl mn op qr st uv expands to
-	// 00 01 02 03 08 09 0a 0b 0g 0h 0i 0j 0o 0p 0q 0r as the first row on the left hand block.
-
-	__m128i perm = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 0x0c, 0x0d, 2, 3, 6, 7, 0x0a, 0x0b, 0x0e, 0x0f);
-	a = _mm_shuffle_epi8(a, perm);
-	b = _mm_shuffle_epi8(b, perm);
-	c = _mm_shuffle_epi8(c, perm);
-	d = _mm_shuffle_epi8(d, perm);
-
-	__m128i a_orig = a;
-
-	const __m128i mask = _mm_set1_epi32(0x0f0f0f0f);
-	const __m128i shiftCount = _mm_set_epi32(0, 0, 0, 4);
-	__m128i lowNybbles = _mm_and_si128(a, mask);
-	__m128i highNybbles = _mm_and_si128(_mm_srl_epi32(a, shiftCount), mask);
-	a = _mm_unpacklo_epi8(lowNybbles, highNybbles);
-	__m128i a2 = _mm_unpackhi_epi8(lowNybbles, highNybbles);
-
-	lowNybbles = _mm_and_si128(b, mask);
-	highNybbles = _mm_and_si128(_mm_srl_epi32(b, shiftCount), mask);
-	b = _mm_unpacklo_epi8(lowNybbles, highNybbles);
-	__m128i b2 = _mm_unpackhi_epi8(lowNybbles, highNybbles);
-
-	lowNybbles = _mm_and_si128(c, mask);
-	highNybbles = _mm_and_si128(_mm_srl_epi32(c, shiftCount), mask);
-	c = _mm_unpacklo_epi8(lowNybbles, highNybbles);
-	__m128i c2 = _mm_unpackhi_epi8(lowNybbles, highNybbles);
-
-	lowNybbles = _mm_and_si128(d, mask);
-	highNybbles = _mm_and_si128(_mm_srl_epi32(d, shiftCount), mask);
-	d = _mm_unpacklo_epi8(lowNybbles, highNybbles);
-	__m128i d2 = _mm_unpackhi_epi8(lowNybbles, highNybbles);
-
-	convertColumn8(dest, destStride, colNum, a, b, c, d);
-	if(destStride > 16)
-	{
-		convertColumn8(dest + 16, destStride, colNum, a2, b2, c2, d2);
-	}
-}
-
-#elif defined(USE_NEON)
-#include <arm_neon.h>
-
-inline void convertColumn8(uint8x16x4_t data, uint8* dest, const int destStride, int colNum)
-{
-	uint16x8_t row0 = vcombine_u16(vmovn_u32(vreinterpretq_u32_u8(data.val[0])), vmovn_u32(vreinterpretq_u32_u8(data.val[2])));
-	uint16x8_t revr0 = vrev32q_u16(vreinterpretq_u16_u8(data.val[0]));
-	uint16x8_t revr2 = vrev32q_u16(vreinterpretq_u16_u8(data.val[2]));
-	uint16x8_t row1 = vcombine_u16(vmovn_u32(vreinterpretq_u32_u16(revr0)), vmovn_u32(vreinterpretq_u32_u16(revr2)));
-
-	uint16x8_t row2 = vcombine_u16(vmovn_u32(vreinterpretq_u32_u8(data.val[1])), vmovn_u32(vreinterpretq_u32_u8(data.val[3])));
-	uint16x8_t revr1 = vrev32q_u16(vreinterpretq_u16_u8(data.val[1]));
-	uint16x8_t revr3 = vrev32q_u16(vreinterpretq_u16_u8(data.val[3]));
-	uint16x8_t row3 = vcombine_u16(vmovn_u32(vreinterpretq_u32_u16(revr1)), vmovn_u32(vreinterpretq_u32_u16(revr3)));
-
-	if((colNum & 1) == 0)
-	{
-		row2 = vreinterpretq_u16_u32(vrev64q_u32(vreinterpretq_u32_u16(row2)));
-		row3 = vreinterpretq_u16_u32(vrev64q_u32(vreinterpretq_u32_u16(row3)));
-	}
-	else
-	{
-		row0 = vreinterpretq_u16_u32(vrev64q_u32(vreinterpretq_u32_u16(row0)));
-		row1 = vreinterpretq_u16_u32(vrev64q_u32(vreinterpretq_u32_u16(row1)));
-	}
-
-	vst1q_u8(dest, vreinterpretq_u8_u16(row0));
-	vst1q_u8(dest + destStride, vreinterpretq_u8_u16(row1));
-	vst1q_u8(dest + 2 * destStride, vreinterpretq_u8_u16(row2));
-	vst1q_u8(dest + 3 * destStride, vreinterpretq_u8_u16(row3));
-}
-
-inline void convertColumn8(uint8* dest, const int destStride, uint8* src, int colNum)
-{
-	// This sucks in the entire column and de-interleaves it
-	uint8x16x4_t data = vld4q_u8(src);
-	convertColumn8(data, dest, destStride, colNum);
-}
-
-inline void convertColumn4(uint8* dest, const int destStride, uint8* src, int colNum)
-{
-	// https://developer.arm.com/architectures/instruction-sets/simd-isas/neon/intrinsics
-
-	uint8x16x4_t data = vld4q_u8(src);
-
-	const auto mask = vdupq_n_u8(0x0F);
-
-	auto high_nybbles = vshrq_n_u8(data.val[0], 4);
-	auto lo_nybbles = vandq_u8(data.val[0], mask);
-
-	uint8x16x4_t col8Data;
-	col8Data.val[0] = lo_nybbles;
-	col8Data.val[1] = high_nybbles;
-
-	high_nybbles = vshrq_n_u8(data.val[1], 4);
-	lo_nybbles = vandq_u8(data.val[1], mask);
-	col8Data.val[2] = lo_nybbles;
-	col8Data.val[3] = high_nybbles;
-	convertColumn8(col8Data, dest, destStride, colNum);
-
-	if(destStride > 16)
-	{
-
-		high_nybbles = vshrq_n_u8(data.val[2], 4);
-		lo_nybbles = vandq_u8(data.val[2], mask);
-		col8Data.val[0] = lo_nybbles;
-		col8Data.val[1] = high_nybbles;
-		high_nybbles = vshrq_n_u8(data.val[3], 4);
-		lo_nybbles = vandq_u8(data.val[3], mask);
-		col8Data.val[2] = lo_nybbles;
-		col8Data.val[3] = high_nybbles;
-		convertColumn8(col8Data, dest + 16, destStride, colNum);
-	}
-}
-
-#else
-/*
-// If we have a platform that does not have SIMD then implement the basic case here.
-void convertColumn8(uint8* dest, const int destStride, uint8* src, int colNum)
-{
-	
-}
-*/
-#endif
-
 void CGSH_OpenGL::TexUpdater_Psm8(uint32 bufPtr, uint32 bufWidth, unsigned int texX, unsigned int texY, unsigned int texWidth, unsigned int texHeight)
 {
 	if(texWidth < 16)
@@ -572,7 +368,7 @@ void CGSH_OpenGL::TexUpdater_Psm8(uint32 bufPtr, uint32 bufWidth, unsigned int t
 			int colNum = 0;
 			for(unsigned int coly = 0; coly < 16; coly += 4)
 			{
-				convertColumn8(colDst + x, texWidth, src, colNum++);
+				CGsDeswizzle::ConvertColumn8(colDst + x, texWidth, src, colNum++);
 				src += 64;
 				colDst += texWidth * 4;
 			}
@@ -614,7 +410,7 @@ void CGSH_OpenGL::TexUpdater_Psm4(unsigned int bufPtr, unsigned int bufWidth, un
 
 			for(unsigned int colNum = 0; colNum < 4; ++colNum)
 			{
-				convertColumn4(colDst, texWidth, src, colNum);
+				CGsDeswizzle::ConvertColumn4(colDst, texWidth, src, colNum);
 				src += 64;
 				colDst += texWidth * 4;
 			}
@@ -675,6 +471,8 @@ void CGSH_OpenGL::TexUpdater_Psm48H(uint32 bufPtr, uint32 bufWidth, unsigned int
 
 CGSH_OpenGL::CPalette::CPalette()
     : m_live(false)
+    , m_useStamp(0)
+    , m_contentHash(0)
     , m_isIDTEX4(false)
     , m_cpsm(0)
     , m_csa(0)
@@ -708,30 +506,49 @@ void CGSH_OpenGL::CPalette::Invalidate(uint32 csa)
 // Palette Caching
 /////////////////////////////////////////////////////////////
 
+uint32 CGSH_OpenGL::PalCache_GetKey(bool isIDTEX4, uint32 cpsm, uint32 csa)
+{
+	return (isIDTEX4 ? 0x10000 : 0) | (cpsm << 8) | csa;
+}
+
+uint32 CGSH_OpenGL::PalCache_HashContents(const uint32* contents, unsigned int entryCount)
+{
+	//FNV-1a
+	uint32 hash = 0x811C9DC5;
+	for(unsigned int i = 0; i < entryCount; i++)
+	{
+		hash ^= contents[i];
+		hash *= 0x01000193;
+	}
+	return hash;
+}
+
 GLuint CGSH_OpenGL::PalCache_Search(const TEX0& tex0)
 {
-	for(auto paletteIterator(m_paletteCache.begin());
-	    paletteIterator != m_paletteCache.end(); paletteIterator++)
+	//More than one palette can match if some were revived by a content search, use the most recent one
+	PalettePtr result;
+	auto range = m_paletteKeyIndex.equal_range(PalCache_GetKey(CGsPixelFormats::IsPsmIDTEX4(tex0.nPsm), tex0.nCPSM, tex0.nCSA));
+	for(auto paletteIterator = range.first; paletteIterator != range.second; paletteIterator++)
 	{
-		auto palette = *paletteIterator;
+		const auto& palette = paletteIterator->second;
 		if(!palette->m_live) continue;
-		if(CGsPixelFormats::IsPsmIDTEX4(tex0.nPsm) != palette->m_isIDTEX4) continue;
-		if(tex0.nCPSM != palette->m_cpsm) continue;
-		if(tex0.nCSA != palette->m_csa) continue;
-		m_paletteCache.erase(paletteIterator);
-		m_paletteCache.push_front(palette);
-		return palette->m_texture;
+		if(result && (result->m_useStamp > palette->m_useStamp)) continue;
+		result = palette;
 	}
 
-	return 0;
+	if(!result) return 0;
+
+	result->m_useStamp = ++m_paletteUseStamp;
+	return result->m_texture;
 }
 
 GLuint CGSH_OpenGL::PalCache_Search(unsigned int entryCount, const uint32* contents)
 {
-	for(auto paletteIterator(m_paletteCache.begin());
-	    paletteIterator != m_paletteCache.end(); paletteIterator++)
+	PalettePtr result;
+	auto range = m_paletteContentIndex.equal_range(PalCache_HashContents(contents, entryCount));
+	for(auto paletteIterator = range.first; paletteIterator != range.second; paletteIterator++)
 	{
-		auto palette = *paletteIterator;
+		const auto& palette = paletteIterator->second;
 
 		if(palette->m_texture == 0) continue;
 
@@ -740,19 +557,39 @@ GLuint CGSH_OpenGL::PalCache_Search(unsigned int entryCount, const uint32* conte
 
 		if(memcmp(contents, palette->m_contents, sizeof(uint32) * entryCount) != 0) continue;
 
-		palette->m_live = true;
-
-		m_paletteCache.erase(paletteIterator);
-		m_paletteCache.push_front(palette);
-		return palette->m_texture;
+		if(result && (result->m_useStamp > palette->m_useStamp)) continue;
+		result = palette;
 	}
 
-	return 0;
+	if(!result) return 0;
+
+	result->m_live = true;
+	result->m_useStamp = ++m_paletteUseStamp;
+	return result->m_texture;
 }
 
 void CGSH_OpenGL::PalCache_Insert(const TEX0& tex0, const uint32* contents, GLuint textureHandle)
 {
-	auto texture = *m_paletteCache.rbegin();
+	//Recycle the least recently used palette
+	auto texture = *std::min_element(std::begin(m_paletteCache), std::end(m_paletteCache),
+	                                 [](const PalettePtr& lhs, const PalettePtr& rhs) { return lhs->m_useStamp < rhs->m_useStamp; });
+
+	if(texture->m_texture != 0)
+	{
+		auto removeFromIndex =
+		    [&texture](PaletteIndex& index, uint32 key) {
+			    auto range = index.equal_range(key);
+			    for(auto paletteIterator = range.first; paletteIterator != range.second; paletteIterator++)
+			    {
+				    if(paletteIterator->second != texture) continue;
+				    index.erase(paletteIterator);
+				    break;
+			    }
+		    };
+		removeFromIndex(m_paletteKeyIndex, PalCache_GetKey(texture->m_isIDTEX4, texture->m_cpsm, texture->m_csa));
+		removeFromIndex(m_paletteContentIndex, texture->m_contentHash);
+	}
+
 	texture->Free();
 
 	unsigned int entryCount = CGsPixelFormats::IsPsmIDTEX4(tex0.nPsm) ? 16 : 256;
@@ -762,10 +599,12 @@ void CGSH_OpenGL::PalCache_Insert(const TEX0& tex0, const uint32* contents, GLui
 	texture->m_csa = tex0.nCSA;
 	texture->m_texture = textureHandle;
 	texture->m_live = true;
+	texture->m_useStamp = ++m_paletteUseStamp;
+	texture->m_contentHash = PalCache_HashContents(contents, entryCount);
 	memcpy(texture->m_contents, contents, entryCount * sizeof(uint32));
 
-	m_paletteCache.pop_back();
-	m_paletteCache.push_front(texture);
+	m_paletteKeyIndex.insert(std::make_pair(PalCache_GetKey(texture->m_isIDTEX4, texture->m_cpsm, texture->m_csa), texture));
+	m_paletteContentIndex.insert(std::make_pair(texture->m_contentHash, texture));
 }
 
 void CGSH_OpenGL::PalCache_Invalidate(uint32 csa)
@@ -777,5 +616,10 @@ void CGSH_OpenGL::PalCache_Invalidate(uint32 csa)
 void CGSH_OpenGL::PalCache_Flush()
 {
 	std::for_each(std::begin(m_paletteCache), std::end(m_paletteCache),
-	              [](PalettePtr& palette) { palette->Free(); });
+	              [](PalettePtr& palette) {
+		              palette->Free();
+		              palette->m_useStamp = 0;
+	              });
+	m_paletteKeyIndex.clear();
+	m_paletteContentIndex.clear();
 }
@@ -1,13 +1,21 @@
 #include <cstring>
 #include "../GsPixelFormats.h"
 #include "../../Log.h"
+#include "../../AppConfig.h"
 #include "GSH_Vulkan.h"
 #include "GSH_VulkanDeviceInfo.h"
 #include "vulkan/StructDefs.h"
 #include "vulkan/Utils.h"
+#include "PathUtils.h"
+#include "StdStreamUtils.h"
+#include "string_format.h"
 
 #define LOG_NAME ("gsh_vulkan")
 
+#define PIPELINECACHE_MAGIC (0x43505650) //'PVPC'
+//Increment this when pipeline generation code changes to invalidate existing caches
+#define PIPELINECACHE_VERSION (1)
+
 using namespace GSH_Vulkan;
 
 static uint32 MakeColor(uint8 r, uint8 g, uint8 b, uint8 a)
@@ -41,9 +49,16 @@ static Framework::Vulkan::CImage CreateSwizzleTable(Framework::Vulkan::CDevice&
 
 CGSH_Vulkan::CGSH_Vulkan()
 {
+	RegisterPreferences();
 	m_context = std::make_shared<CContext>();
 }
 
+void CGSH_Vulkan::RegisterPreferences()
+{
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_CGSH_VULKAN_PIPELINECACHE_ENABLED, true);
+	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_CGSH_VULKAN_ASYNCPIPELINES, true);
+}
+
 Framework::Vulkan::CInstance CGSH_Vulkan::CreateInstance(bool useValidationLayers)
 {
 	auto instanceCreateInfo = Framework::Vulkan::InstanceCreateInfo();
@@ -106,6 +121,7 @@ void CGSH_Vulkan::InitializeImpl()
 	m_context->commandBufferPool = Framework::Vulkan::CCommandBufferPool(m_context->device, renderQueueFamily);
 
 	CreateDescriptorPool();
+	CreatePipelineCache();
 	CreateMemoryBuffer();
 	CreateClutBuffer();
 
@@ -127,7 +143,8 @@ void CGSH_Vulkan::InitializeImpl()
 
 	m_frameCommandBuffer = std::make_shared<CFrameCommandBuffer>(m_context);
 	m_clutLoad = std::make_shared<CClutLoad>(m_context, m_frameCommandBuffer);
-	m_draw = std::make_shared<CDraw>(m_context, m_frameCommandBuffer);
+	m_draw = std::make_shared<CDraw>(m_context, m_frameCommandBuffer, CAppConfig::GetInstance().GetPreferenceBoolean(PREF_CGSH_VULKAN_ASYNCPIPELINES));
+	m_draw->PrecompilePipelines(m_cachedDrawPipelineCaps);
 	m_present = std::make_shared<CPresent>(m_context);
 	m_transferHost = std::make_shared<CTransferHost>(m_context, m_frameCommandBuffer);
 	m_transferLocal = std::make_shared<CTransferLocal>(m_context, m_frameCommandBuffer);
@@ -144,6 +161,11 @@ void CGSH_Vulkan::ReleaseImpl()
 	//Flush any pending rendering commands
 	m_context->device.vkQueueWaitIdle(m_context->queue);
 
+	auto drawPipelineCaps = m_draw->GetPipelineCapsList();
+	auto drawPipelineStats = m_draw->GetPipelineStats();
+	CLog::GetInstance().Print(LOG_NAME, "Draw pipeline stats: %d sync compiles, %d async compiles, %d stalls, %d precompiled.\r\n",
+	                          drawPipelineStats.syncCompiles, drawPipelineStats.asyncCompiles, drawPipelineStats.compileStalls, drawPipelineStats.precompiled);
+
 	m_clutLoad.reset();
 	m_draw.reset();
 	m_present.reset();
@@ -167,6 +189,10 @@ void CGSH_Vulkan::ReleaseImpl()
 	m_swizzleTablePSMZ32.Reset();
 	m_swizzleTablePSMZ16.Reset();
 
+	SavePipelineCache(drawPipelineCaps);
+	m_context->device.vkDestroyPipelineCache(m_context->device, m_context->pipelineCache, nullptr);
+	m_context->pipelineCache = VK_NULL_HANDLE;
+
 	m_context->device.vkDestroyDescriptorPool(m_context->device, m_context->descriptorPool, nullptr);
 	m_context->clutBuffer.Reset();
 	m_context->memoryBuffer.Reset();
@@ -457,6 +483,118 @@ void CGSH_Vulkan::CreateClutBuffer()
 	                                                   clutBufferSize);
 }
 
+fs::path CGSH_Vulkan::GetPipelineCachePath() const
+{
+	//Pipeline cache data is only valid for the device that created it, use one file per device
+	VkPhysicalDeviceProperties physicalDeviceProperties = {};
+	m_instance.vkGetPhysicalDeviceProperties(m_context->physicalDevice, &physicalDeviceProperties);
+	std::string uuidString;
+	for(uint32 i = 0; i < VK_UUID_SIZE; i++)
+	{
+		uuidString += string_format("%02x", physicalDeviceProperties.pipelineCacheUUID[i]);
+	}
+	auto fileName = string_format("vulkan_%04x_%04x_%s.bin", physicalDeviceProperties.vendorID, physicalDeviceProperties.deviceID, uuidString.c_str());
+	return CAppConfig::GetBasePath() / fs::path("shadercache") / fs::path(fileName);
+}
+
+void CGSH_Vulkan::CreatePipelineCache()
+{
+	assert(m_context->pipelineCache == VK_NULL_HANDLE);
+
+	m_cachedDrawPipelineCaps.clear();
+
+	std::vector<uint8> cacheData;
+	if(CAppConfig::GetInstance().GetPreferenceBoolean(PREF_CGSH_VULKAN_PIPELINECACHE_ENABLED))
+	{
+		auto cachePath = GetPipelineCachePath();
+		if(fs::exists(cachePath))
+		{
+			try
+			{
+				auto stream = Framework::CreateInputStdStream(cachePath.native());
+				uint32 magic = stream.Read32();
+				uint32 version = stream.Read32();
+				if((magic != PIPELINECACHE_MAGIC) || (version != PIPELINECACHE_VERSION))
+				{
+					throw std::runtime_error("Pipeline cache was created by a different version.");
+				}
+				uint32 capsCount = stream.Read32();
+				for(uint32 i = 0; i < capsCount; i++)
+				{
+					uint32 capsLo = stream.Read32();
+					uint32 capsHi = stream.Read32();
+					m_cachedDrawPipelineCaps.push_back(static_cast<CDraw::PipelineCapsInt>(capsLo) | (static_cast<CDraw::PipelineCapsInt>(capsHi) << 32));
+				}
+				uint32 dataSize = stream.Read32();
+				cacheData.resize(dataSize);
+				if(stream.Read(cacheData.data(), dataSize) != dataSize)
+				{
+					throw std::runtime_error("Pipeline cache is truncated.");
+				}
+			}
+			catch(const std::exception& exception)
+			{
+				CLog::GetInstance().Warn(LOG_NAME, "Failed to load pipeline cache: %s\r\n", exception.what());
+				m_cachedDrawPipelineCaps.clear();
+				cacheData.clear();
+			}
+		}
+	}
+
+	//The driver validates the data header (vendor, device and cache UUID) and ignores it if it doesn't match
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+	pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+	pipelineCacheCreateInfo.pInitialData = cacheData.empty() ? nullptr : cacheData.data();
+
+	auto result = m_context->device.vkCreatePipelineCache(m_context->device, &pipelineCacheCreateInfo, nullptr, &m_context->pipelineCache);
+	if(result != VK_SUCCESS)
+	{
+		//Retry without initial data in case the driver didn't like it
+		pipelineCacheCreateInfo.initialDataSize = 0;
+		pipelineCacheCreateInfo.pInitialData = nullptr;
+		result = m_context->device.vkCreatePipelineCache(m_context->device, &pipelineCacheCreateInfo, nullptr, &m_context->pipelineCache);
+		CHECKVULKANERROR(result);
+	}
+
+	CLog::GetInstance().Print(LOG_NAME, "Loaded pipeline cache (%d bytes, %d draw pipelines).\r\n",
+	                          static_cast<int>(cacheData.size()), static_cast<int>(m_cachedDrawPipelineCaps.size()));
+}
+
+void CGSH_Vulkan::SavePipelineCache(const std::vector<CDraw::PipelineCapsInt>& drawPipelineCaps)
+{
+	if(!CAppConfig::GetInstance().GetPreferenceBoolean(PREF_CGSH_VULKAN_PIPELINECACHE_ENABLED)) return;
+
+	try
+	{
+		size_t dataSize = 0;
+		auto result = m_context->device.vkGetPipelineCacheData(m_context->device, m_context->pipelineCache, &dataSize, nullptr);
+		CHECKVULKANERROR(result);
+
+		std::vector<uint8> cacheData(dataSize);
+		result = m_context->device.vkGetPipelineCacheData(m_context->device, m_context->pipelineCache, &dataSize, cacheData.data());
+		CHECKVULKANERROR(result);
+		cacheData.resize(dataSize);
+
+		auto cachePath = GetPipelineCachePath();
+		Framework::PathUtils::EnsurePathExists(cachePath.parent_path());
+		auto stream = Framework::CreateOutputStdStream(cachePath.native());
+		stream.Write32(PIPELINECACHE_MAGIC);
+		stream.Write32(PIPELINECACHE_VERSION);
+		stream.Write32(static_cast<uint32>(drawPipelineCaps.size()));
+		for(const auto& caps : drawPipelineCaps)
+		{
+			stream.Write32(static_cast<uint32>(caps));
+			stream.Write32(static_cast<uint32>(caps >> 32));
+		}
+		stream.Write32(static_cast<uint32>(cacheData.size()));
+		stream.Write(cacheData.data(), cacheData.size());
+	}
+	catch(const std::exception& exception)
+	{
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to save pipeline cache: %s\r\n", exception.what());
+	}
+}
+
 void CGSH_Vulkan::VertexKick(uint8 registerId, uint64 data)
 {
 	if(m_vtxCount == 0) return;
@@ -14,6 +14,10 @@
 #include "../GSHandler.h"
 #include "../GsCachedArea.h"
 #include "../GsTextureCache.h"
+#include "filesystem_def.h"
+
+#define PREF_CGSH_VULKAN_PIPELINECACHE_ENABLED "renderer.vulkan.pipelinecache.enabled"
+#define PREF_CGSH_VULKAN_ASYNCPIPELINES "renderer.vulkan.asyncpipelines"
 
 class CGSH_Vulkan : public CGSHandler
 {
@@ -22,6 +26,7 @@ public:
 	virtual ~CGSH_Vulkan() = default;
 
 	static Framework::Vulkan::CInstance CreateInstance(bool);
+	static void RegisterPreferences();
 
 	void SetPresentationParams(const CGSHandler::PRESENTATION_PARAMS&) override;
 
@@ -92,6 +97,10 @@ private:
 	void CreateMemoryBuffer();
 	void CreateClutBuffer();
 
+	fs::path GetPipelineCachePath() const;
+	void CreatePipelineCache();
+	void SavePipelineCache(const std::vector<GSH_Vulkan::CDraw::PipelineCapsInt>&);
+
 	void VertexKick(uint8, uint64);
 	void SetRenderingContext(uint64);
 
@@ -111,6 +120,8 @@ private:
 
 	uint8* m_memoryCache = nullptr;
 
+	std::vector<GSH_Vulkan::CDraw::PipelineCapsInt> m_cachedDrawPipelineCaps;
+
 	//Draw context
 	VERTEX m_vtxBuffer[3];
 	uint32 m_vtxCount = 0;
@@ -19,6 +19,7 @@ namespace GSH_Vulkan
 		Framework::Vulkan::CCommandBufferPool commandBufferPool;
 		VkQueue queue = VK_NULL_HANDLE;
 		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
 		VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
 		Framework::Vulkan::CBuffer memoryBuffer;
 		Framework::Vulkan::CBuffer memoryBufferCopy;
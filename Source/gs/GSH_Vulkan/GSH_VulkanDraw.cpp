@@ -1,4 +1,5 @@
 #include "GSH_VulkanDraw.h"
+#include <algorithm>
 #include "GSH_VulkanMemoryUtils.h"
 #include "MemStream.h"
 #include "vulkan/StructDefs.h"
@@ -28,10 +29,11 @@ using namespace GSH_Vulkan;
 
 #define DEPTH_MAX (4294967296.0f)
 
-CDraw::CDraw(const ContextPtr& context, const FrameCommandBufferPtr& frameCommandBuffer)
+CDraw::CDraw(const ContextPtr& context, const FrameCommandBufferPtr& frameCommandBuffer, bool asyncCompile)
     : m_context(context)
     , m_frameCommandBuffer(frameCommandBuffer)
     , m_pipelineCache(context->device)
+    , m_asyncCompile(asyncCompile)
 {
 	CreateRenderPass();
 	CreateDrawImage();
@@ -50,10 +52,28 @@ CDraw::CDraw(const ContextPtr& context, const FrameCommandBufferPtr& frameComman
 	}
 
 	m_pipelineCaps <<= 0;
+
+	if(m_asyncCompile)
+	{
+		m_compileThread = std::thread([this]() { CompileThreadProc(); });
+	}
 }
 
 CDraw::~CDraw()
 {
+	if(m_compileThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> compileLock(m_compileMutex);
+			m_compileThreadDone = true;
+		}
+		m_compileCondition.notify_all();
+		m_compileThread.join();
+	}
+	for(const auto& pipelinePair : m_compiledPipelines)
+	{
+		DestroyDrawPipeline(pipelinePair.second);
+	}
 	for(auto& frame : m_frames)
 	{
 		m_context->device.vkUnmapMemory(m_context->device, frame.vertexBuffer.GetMemory());
@@ -73,6 +93,35 @@ void CDraw::SetPipelineCaps(const PIPELINE_CAPS& caps)
 	}
 	FlushVertices();
 	m_pipelineCaps = caps;
+	QueuePipelineCompile(caps, true);
+}
+
+void CDraw::PrecompilePipelines(const std::vector<PipelineCapsInt>& capsList)
+{
+	if(!m_asyncCompile) return;
+	for(const auto& caps : capsList)
+	{
+		QueuePipelineCompile(make_convertible<PIPELINE_CAPS>(caps), false);
+	}
+	std::lock_guard<std::mutex> compileLock(m_compileMutex);
+	m_pipelineStats.precompiled += static_cast<uint32>(capsList.size());
+}
+
+std::vector<CDraw::PipelineCapsInt> CDraw::GetPipelineCapsList() const
+{
+	auto capsList = m_pipelineCache.GetKeys();
+	std::lock_guard<std::mutex> compileLock(m_compileMutex);
+	for(const auto& pipelinePair : m_compiledPipelines)
+	{
+		capsList.push_back(pipelinePair.first);
+	}
+	return capsList;
+}
+
+CDraw::PIPELINE_STATS CDraw::GetPipelineStats() const
+{
+	std::lock_guard<std::mutex> compileLock(m_compileMutex);
+	return m_pipelineStats;
 }
 
 void CDraw::SetFramebufferParams(uint32 addr, uint32 width, uint32 writeMask)
@@ -263,12 +312,7 @@ void CDraw::FlushVertices()
 		m_memoryCopyRegion.Reset();
 	}
 
-	//Find pipeline and create it if we've never encountered it before
-	auto drawPipeline = m_pipelineCache.TryGetPipeline(m_pipelineCaps);
-	if(!drawPipeline)
-	{
-		drawPipeline = m_pipelineCache.RegisterPipeline(m_pipelineCaps, CreateDrawPipeline(m_pipelineCaps));
-	}
+	auto drawPipeline = GetDrawPipeline(m_pipelineCaps);
 
 	{
 		VkViewport viewport = {};
@@ -547,6 +591,112 @@ void CDraw::CreateRenderPass()
 	CHECKVULKANERROR(result);
 }
 
+const PIPELINE* CDraw::GetDrawPipeline(const PIPELINE_CAPS& caps)
+{
+	//Find pipeline and create it if we've never encountered it before
+	auto drawPipeline = m_pipelineCache.TryGetPipeline(caps);
+	if(drawPipeline) return drawPipeline;
+
+	if(m_asyncCompile)
+	{
+		std::unique_lock<std::mutex> compileLock(m_compileMutex);
+		if(m_compilePending.count(caps) != 0)
+		{
+			//There's no safe substitute for a draw pipeline since they write directly to GS memory,
+			//wait for the compile thread to be done with it
+			auto compiledIterator = m_compiledPipelines.find(caps);
+			if(compiledIterator == std::end(m_compiledPipelines))
+			{
+				//If the compile thread didn't get to it yet, don't wait behind the rest of its queue
+				auto queueIterator = std::find(std::begin(m_compileQueue), std::end(m_compileQueue), static_cast<PipelineCapsInt>(caps));
+				if(queueIterator != std::end(m_compileQueue))
+				{
+					m_compileQueue.erase(queueIterator);
+					m_compilePending.erase(caps);
+					m_pipelineStats.syncCompiles++;
+					compileLock.unlock();
+					return m_pipelineCache.RegisterPipeline(caps, CreateDrawPipeline(caps));
+				}
+				m_pipelineStats.compileStalls++;
+				m_compileCondition.wait(compileLock, [&]() { return m_compiledPipelines.find(caps) != std::end(m_compiledPipelines); });
+				compiledIterator = m_compiledPipelines.find(caps);
+			}
+			auto pipeline = compiledIterator->second;
+			m_compiledPipelines.erase(compiledIterator);
+			m_compilePending.erase(caps);
+			return m_pipelineCache.RegisterPipeline(caps, pipeline);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		m_pipelineStats.syncCompiles++;
+	}
+	return m_pipelineCache.RegisterPipeline(caps, CreateDrawPipeline(caps));
+}
+
+//Pipelines that are about to be used go in front of the ones that are precompiled
+void CDraw::QueuePipelineCompile(const PIPELINE_CAPS& caps, bool urgent)
+{
+	if(!m_asyncCompile) return;
+	if(m_pipelineCache.TryGetPipeline(caps)) return;
+	{
+		std::lock_guard<std::mutex> compileLock(m_compileMutex);
+		PipelineCapsInt capsInt = caps;
+		if(m_compilePending.count(caps) != 0)
+		{
+			if(!urgent) return;
+			auto queueIterator = std::find(std::begin(m_compileQueue), std::end(m_compileQueue), capsInt);
+			//Already being compiled or compiled
+			if(queueIterator == std::end(m_compileQueue)) return;
+			m_compileQueue.erase(queueIterator);
+		}
+		else
+		{
+			m_compilePending.insert(caps);
+		}
+		if(urgent)
+		{
+			m_compileQueue.push_front(capsInt);
+		}
+		else
+		{
+			m_compileQueue.push_back(capsInt);
+		}
+	}
+	m_compileCondition.notify_all();
+}
+
+void CDraw::CompileThreadProc()
+{
+	while(1)
+	{
+		PipelineCapsInt caps = 0;
+		{
+			std::unique_lock<std::mutex> compileLock(m_compileMutex);
+			m_compileCondition.wait(compileLock, [this]() { return m_compileThreadDone || !m_compileQueue.empty(); });
+			if(m_compileThreadDone) break;
+			caps = m_compileQueue.front();
+			m_compileQueue.pop_front();
+		}
+		//CreateDrawPipeline only depends on caps and objects that are immutable after construction
+		auto pipeline = CreateDrawPipeline(make_convertible<PIPELINE_CAPS>(caps));
+		{
+			std::lock_guard<std::mutex> compileLock(m_compileMutex);
+			m_compiledPipelines.insert(std::make_pair(caps, pipeline));
+			m_pipelineStats.asyncCompiles++;
+		}
+		m_compileCondition.notify_all();
+	}
+}
+
+void CDraw::DestroyDrawPipeline(const PIPELINE& pipeline)
+{
+	m_context->device.vkDestroyPipeline(m_context->device, pipeline.pipeline, nullptr);
+	m_context->device.vkDestroyPipelineLayout(m_context->device, pipeline.pipelineLayout, nullptr);
+	m_context->device.vkDestroyDescriptorSetLayout(m_context->device, pipeline.descriptorSetLayout, nullptr);
+}
+
 PIPELINE CDraw::CreateDrawPipeline(const PIPELINE_CAPS& caps)
 {
 	PIPELINE drawPipeline;
@@ -764,7 +914,7 @@ PIPELINE CDraw::CreateDrawPipeline(const PIPELINE_CAPS& caps)
 	pipelineCreateInfo.renderPass = m_renderPass;
 	pipelineCreateInfo.layout = drawPipeline.pipelineLayout;
 
-	result = m_context->device.vkCreateGraphicsPipelines(m_context->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &drawPipeline.pipeline);
+	result = m_context->device.vkCreateGraphicsPipelines(m_context->device, m_context->pipelineCache, 1, &pipelineCreateInfo, nullptr, &drawPipeline.pipeline);
 	CHECKVULKANERROR(result);
 
 	return drawPipeline;
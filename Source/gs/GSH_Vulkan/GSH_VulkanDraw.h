@@ -1,6 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_set>
 #include "GSH_VulkanContext.h"
 #include "GSH_VulkanFrameCommandBuffer.h"
 #include "GSH_VulkanPipelineCache.h"
@@ -77,9 +82,21 @@ namespace GSH_Vulkan
 			float f;
 		};
 
-		CDraw(const ContextPtr&, const FrameCommandBufferPtr&);
+		struct PIPELINE_STATS
+		{
+			uint32 syncCompiles = 0;
+			uint32 asyncCompiles = 0;
+			uint32 compileStalls = 0;
+			uint32 precompiled = 0;
+		};
+
+		CDraw(const ContextPtr&, const FrameCommandBufferPtr&, bool = false);
 		virtual ~CDraw();
 
+		void PrecompilePipelines(const std::vector<PipelineCapsInt>&);
+		std::vector<PipelineCapsInt> GetPipelineCapsList() const;
+		PIPELINE_STATS GetPipelineStats() const;
+
 		void SetPipelineCaps(const PIPELINE_CAPS&);
 		void SetFramebufferParams(uint32, uint32, uint32);
 		void SetDepthbufferParams(uint32, uint32);
@@ -120,6 +137,8 @@ namespace GSH_Vulkan
 		typedef std::unordered_map<DescriptorSetCapsInt, VkDescriptorSet> DescriptorSetCache;
 
 		typedef CPipelineCache<PipelineCapsInt> PipelineCache;
+		typedef std::unordered_map<PipelineCapsInt, PIPELINE> CompiledPipelineMap;
+		typedef std::unordered_set<PipelineCapsInt> PipelineCapsSet;
 
 		struct DRAW_PIPELINE_PUSHCONSTANTS
 		{
@@ -162,7 +181,12 @@ namespace GSH_Vulkan
 		void CreateRenderPass();
 		void CreateDrawImage();
 
+		const PIPELINE* GetDrawPipeline(const PIPELINE_CAPS&);
+		void QueuePipelineCompile(const PIPELINE_CAPS&, bool);
+		void CompileThreadProc();
+
 		PIPELINE CreateDrawPipeline(const PIPELINE_CAPS&);
+		void DestroyDrawPipeline(const PIPELINE&);
 		Framework::Vulkan::CShaderModule CreateVertexShader();
 		Framework::Vulkan::CShaderModule CreateFragmentShader(const PIPELINE_CAPS&);
 
@@ -194,6 +218,18 @@ namespace GSH_Vulkan
 		uint32 m_memoryCopySize = 0;
 
 		CGsSpriteRegion m_memoryCopyRegion;
+
+		//Asynchronous pipeline compilation
+		//Pipelines are queued as soon as their caps are known and picked up by FlushVertices
+		bool m_asyncCompile = false;
+		PIPELINE_STATS m_pipelineStats;
+		mutable std::mutex m_compileMutex;
+		std::condition_variable m_compileCondition;
+		std::deque<PipelineCapsInt> m_compileQueue;
+		PipelineCapsSet m_compilePending;
+		CompiledPipelineMap m_compiledPipelines;
+		bool m_compileThreadDone = false;
+		std::thread m_compileThread;
 	};
 
 	typedef std::shared_ptr<CDraw> DrawPtr;
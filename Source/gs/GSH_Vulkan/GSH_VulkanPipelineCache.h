@@ -2,6 +2,7 @@
 
 #include "vulkan/Device.h"
 #include <unordered_map>
+#include <vector>
 
 namespace GSH_Vulkan
 {
@@ -45,6 +46,17 @@ namespace GSH_Vulkan
 			return TryGetPipeline(key);
 		}
 
+		std::vector<KeyType> GetKeys() const
+		{
+			std::vector<KeyType> keys;
+			keys.reserve(m_pipelines.size());
+			for(const auto& pipelinePair : m_pipelines)
+			{
+				keys.push_back(pipelinePair.first);
+			}
+			return keys;
+		}
+
 	private:
 		typedef std::unordered_map<KeyType, PIPELINE> PipelineMap;
 
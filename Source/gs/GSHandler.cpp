@@ -1,14 +1,18 @@
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <chrono>
 #include <functional>
 #include "../AppConfig.h"
 #include "../Log.h"
 #include "../states/MemoryStateFile.h"
 #include "../states/RegisterStateFile.h"
 #include "../FrameDump.h"
+#include "../FrameDumpStream.h"
 #include "../ee/INTC.h"
 #include "GSHandler.h"
 #include "GsPixelFormats.h"
+#include "GsDeswizzle.h"
 #include "string_format.h"
 
 //Shadow Hearts 2 looks for this specific value
@@ -75,7 +79,10 @@ CGSHandler::CGSHandler(bool gsThreaded)
 
 	m_pRAM = new uint8[RAMSIZE];
 	m_pCLUT = new uint16[CLUTENTRYCOUNT];
-	m_writeBuffer = new RegisterWrite[REGISTERWRITEBUFFER_SIZE];
+
+	m_writeBufferMaxSubmitThreshold = std::max<uint32>(CAppConfig::GetInstance().GetPreferenceInteger(PREF_CGSHANDLER_WRITE_SUBMIT_THRESHOLD), REGISTERWRITEBUFFER_SUBMIT_THRESHOLD_MIN);
+	m_writeBufferSubmitThreshold = std::min(m_writeBufferSubmitThreshold, m_writeBufferMaxSubmitThreshold);
+	SwitchWriteBuffer(0);
 
 	for(int i = 0; i < PSM_MAX; i++)
 	{
@@ -96,7 +103,9 @@ CGSHandler::CGSHandler(bool gsThreaded)
 	m_transferReadHandlers[PSMCT32] = &CGSHandler::TransferReadHandlerGeneric<CGsPixelFormats::STORAGEPSMCT32>;
 	m_transferReadHandlers[PSMCT24] = &CGSHandler::TransferReadHandlerPSMCT24;
 	m_transferReadHandlers[PSMCT16] = &CGSHandler::TransferReadHandlerGeneric<CGsPixelFormats::STORAGEPSMCT16>;
+	m_transferReadHandlers[PSMCT16S] = &CGSHandler::TransferReadHandlerGeneric<CGsPixelFormats::STORAGEPSMCT16S>;
 	m_transferReadHandlers[PSMT8] = &CGSHandler::TransferReadHandlerGeneric<CGsPixelFormats::STORAGEPSMT8>;
+	m_transferReadHandlers[PSMT4] = &CGSHandler::TransferReadHandlerPSMT4;
 	m_transferReadHandlers[PSMZ32] = &CGSHandler::TransferReadHandlerGeneric<CGsPixelFormats::STORAGEPSMZ32>;
 
 	ResetBase();
@@ -116,13 +125,13 @@ CGSHandler::~CGSHandler()
 	}
 	delete[] m_pRAM;
 	delete[] m_pCLUT;
-	delete[] m_writeBuffer;
 }
 
 void CGSHandler::RegisterPreferences()
 {
 	CAppConfig::GetInstance().RegisterPreferenceInteger(PREF_CGSHANDLER_PRESENTATION_MODE, CGSHandler::PRESENTATION_MODE_FIT);
 	CAppConfig::GetInstance().RegisterPreferenceBoolean(PREF_CGSHANDLER_WIDESCREEN, false);
+	CAppConfig::GetInstance().RegisterPreferenceInteger(PREF_CGSHANDLER_WRITE_SUBMIT_THRESHOLD, REGISTERWRITEBUFFER_SUBMIT_THRESHOLD_MAX);
 }
 
 void CGSHandler::NotifyPreferencesChanged()
@@ -165,6 +174,7 @@ void CGSHandler::ResetBase()
 	m_nCBP0 = 0;
 	m_nCBP1 = 0;
 	m_transferCount = 0;
+	m_writeSubmitCount = 0;
 }
 
 void CGSHandler::ResetImpl()
@@ -327,6 +337,11 @@ void CGSHandler::SetFrameDump(CFrameDump* frameDump)
 	m_frameDump = frameDump;
 }
 
+void CGSHandler::SetFrameDumpStream(CFrameDumpStreamWriter* frameDumpStream)
+{
+	m_frameDumpStream = frameDumpStream;
+}
+
 bool CGSHandler::GetDrawEnabled() const
 {
 	return m_drawEnabled;
@@ -499,6 +514,7 @@ void CGSHandler::Finish()
 	FlushWriteBuffer();
 	SendGSCall(std::bind(&CGSHandler::MarkNewFrame, this));
 	Flip(true);
+	TrimWriteBuffers();
 }
 
 void CGSHandler::Flip(bool waitForCompletion)
@@ -514,8 +530,9 @@ void CGSHandler::FlipImpl()
 
 void CGSHandler::MarkNewFrame()
 {
-	OnNewFrame(m_drawCallCount);
+	OnNewFrame(m_drawCallCount, m_primitiveCount);
 	m_drawCallCount = 0;
+	m_primitiveCount = 0;
 #ifdef _DEBUG
 	CLog::GetInstance().Print(LOG_NAME, "Frame Done.\r\n---------------------------------------------------------------------------------\r\n");
 #endif
@@ -553,27 +570,78 @@ void CGSHandler::FeedImageData(const void* data, uint32 length)
 
 	m_transferCount++;
 
-	//Allocate 0x10 more bytes to allow transfer handlers
-	//to read beyond the actual length of the buffer (ie.: PSMCT24)
-
-	std::vector<uint8> imageData(length + 0x10);
-	memcpy(imageData.data(), data, length);
+	//When the GS isn't threaded, the packets are consumed on the thread that calls
+	//ProcessSingleFrame, which might be this one. We can't wait for space in that case.
+	const uint8* imageData = m_imageDataRing.Push(data, length, m_gsThreaded);
+	std::vector<uint8> overflowData;
+	if(imageData == nullptr)
+	{
+		//Allocate 0x10 more bytes to allow transfer handlers
+		//to read beyond the actual length of the buffer (ie.: PSMCT24)
+		m_imageDataRing.CountOverflow();
+		overflowData.resize(length + CGsImageDataRing::PACKET_PADDING);
+		memcpy(overflowData.data(), data, length);
+		imageData = overflowData.data();
+	}
 #ifdef DEBUGGER_INCLUDED
 	if(m_frameDump)
 	{
-		m_frameDump->AddImagePacket(imageData.data(), length);
+		m_frameDump->AddImagePacket(imageData, length);
+	}
+	if(m_frameDumpStream)
+	{
+		m_frameDumpStream->AddImagePacket(imageData, length);
 	}
 #endif
-	SendGSCall(
-	    [this, imageData = std::move(imageData), length]() {
-		    FeedImageDataImpl(imageData.data(), length);
-	    });
+	if(overflowData.empty())
+	{
+		SendGSCall([this]() { FeedImageDataFromRing(); });
+	}
+	else
+	{
+		SendGSCall(
+		    [this, imageData = std::move(overflowData), length]() {
+			    FeedImageDataImpl(imageData.data(), length);
+		    });
+	}
+}
+
+CGsImageDataRing::STATS CGSHandler::GetImageDataStats() const
+{
+	return m_imageDataRing.GetStats();
+}
+
+void CGSHandler::ResetImageDataStats()
+{
+	m_imageDataRing.ResetStats();
+}
+
+CGSHandler::WRITEBUFFER_STATS CGSHandler::GetWriteBufferStats() const
+{
+	auto stats = m_writeBufferStats;
+	stats.submitThreshold = m_writeBufferSubmitThreshold;
+	stats.gsIdleTime = m_gsIdleTime;
+	stats.gsWaitTime = m_gsWaitTime;
+	return stats;
+}
+
+void CGSHandler::ResetWriteBufferStats()
+{
+	m_writeBufferStats = WRITEBUFFER_STATS();
+	m_gsIdleTime = 0;
+	m_gsWaitTime = 0;
 }
 
 void CGSHandler::ReadImageData(void* data, uint32 length)
 {
 	assert(m_writeBufferProcessIndex == m_writeBufferSize);
 	SubmitWriteBuffer();
+	//If the GS thread is done with everything that was sent to it, the local to host transfer
+	//was started and GS memory is up to date: read it from here instead of waiting for a round trip.
+	if(m_mailBox.TryCallDirect([&]() { ReadImageDataImpl(data, length); }))
+	{
+		return;
+	}
 	SendGSCall([this, data, length]() { ReadImageDataImpl(data, length); }, true);
 }
 
@@ -582,20 +650,31 @@ void CGSHandler::ProcessWriteBuffer(const CGsPacketMetadata* metadata)
 	assert(m_writeBufferProcessIndex <= m_writeBufferSize);
 	assert(m_writeBufferSubmitIndex <= m_writeBufferProcessIndex);
 #ifdef DEBUGGER_INCLUDED
-	if(m_frameDump)
+	if(m_frameDump || m_frameDumpStream)
 	{
 		uint32 packetSize = m_writeBufferSize - m_writeBufferProcessIndex;
 		if(packetSize != 0)
 		{
-			m_frameDump->AddRegisterPacket(m_writeBuffer + m_writeBufferProcessIndex, packetSize, metadata);
+			if(m_frameDump)
+			{
+				m_frameDump->AddRegisterPacket(m_writeBuffer + m_writeBufferProcessIndex, packetSize, metadata);
+			}
+			if(m_frameDumpStream)
+			{
+				m_frameDumpStream->AddRegisterPacket(m_writeBuffer + m_writeBufferProcessIndex, packetSize, metadata);
+			}
 		}
 	}
 #endif
+	bool hasLocalToHostTransfer = false;
 	for(uint32 writeIndex = m_writeBufferProcessIndex; writeIndex < m_writeBufferSize; writeIndex++)
 	{
 		const auto& write = m_writeBuffer[writeIndex];
 		switch(write.first)
 		{
+		case GS_REG_TRXDIR:
+			hasLocalToHostTransfer |= ((write.second & 0x03) == 1);
+			break;
 		case GS_REG_SIGNAL:
 		{
 			auto signal = make_convertible<SIGNAL>(write.second);
@@ -625,27 +704,53 @@ void CGSHandler::ProcessWriteBuffer(const CGsPacketMetadata* metadata)
 	}
 	m_writeBufferProcessIndex = m_writeBufferSize;
 	uint32 submitPending = m_writeBufferProcessIndex - m_writeBufferSubmitIndex;
-	if(submitPending >= REGISTERWRITEBUFFER_SUBMIT_THRESHOLD)
+	int pendingSubmits = m_writeSubmitCount;
+	if(hasLocalToHostTransfer)
+	{
+		//Local to host transfers are started right away, the GS thread can then prepare
+		//GS memory (ie.: copy the renderer's framebuffer) before the data is read.
+		SubmitWriteBuffer();
+	}
+	else if(pendingSubmits == 0)
+	{
+		//GS thread is waiting for work, don't make it wait for a complete batch.
+		if(submitPending >= REGISTERWRITEBUFFER_SUBMIT_THRESHOLD_MIN)
+		{
+			m_writeBufferSubmitThreshold = std::max<uint32>(m_writeBufferSubmitThreshold / 2, REGISTERWRITEBUFFER_SUBMIT_THRESHOLD_MIN);
+			SubmitWriteBuffer();
+		}
+	}
+	else if(submitPending >= m_writeBufferSubmitThreshold)
 	{
+		//GS thread is lagging behind, make bigger batches to reduce the number of calls it goes through.
+		if(pendingSubmits > 1)
+		{
+			m_writeBufferSubmitThreshold = std::min<uint32>(m_writeBufferSubmitThreshold * 2, m_writeBufferMaxSubmitThreshold);
+		}
 		SubmitWriteBuffer();
 	}
 }
 
+//Only writes that went through ProcessWriteBuffer are submitted, this can be called while a packet is in progress
 void CGSHandler::SubmitWriteBuffer()
 {
-	assert(m_writeBufferSubmitIndex <= m_writeBufferSize);
-	if(m_writeBufferSubmitIndex == m_writeBufferSize) return;
+	assert(m_writeBufferSubmitIndex <= m_writeBufferProcessIndex);
+	if(m_writeBufferSubmitIndex == m_writeBufferProcessIndex) return;
 
 	m_transferCount++;
-	uint32 bufferStartIndex = m_writeBufferSubmitIndex;
-	uint32 bufferEndIndex = m_writeBufferSize;
+	m_writeSubmitCount++;
+	const RegisterWrite* writes = m_writeBuffer + m_writeBufferSubmitIndex;
+	uint32 writeCount = m_writeBufferProcessIndex - m_writeBufferSubmitIndex;
 
 	SendGSCall(
-	    [this, bufferStartIndex, bufferEndIndex]() {
-		    SubmitWriteBufferImpl(bufferStartIndex, bufferEndIndex);
+	    [this, writes, writeCount]() {
+		    SubmitWriteBufferImpl(writes, writeCount);
 	    });
 
-	m_writeBufferSubmitIndex = m_writeBufferSize;
+	m_writeBufferSubmitIndex = m_writeBufferProcessIndex;
+	m_writeBufferFrameWriteCount += writeCount;
+	m_writeBufferStats.writeCount += writeCount;
+	m_writeBufferStats.submitCount++;
 }
 
 void CGSHandler::FlushWriteBuffer()
@@ -660,6 +765,115 @@ void CGSHandler::FlushWriteBuffer()
 	//Nothing should be written to the buffer after that
 }
 
+//True if some writes still need to be submitted, either because they're below the threshold
+//or because they belong to a packet that isn't complete yet
+bool CGSHandler::HasPendingRegisterWrites() const
+{
+	return m_writeBufferSubmitIndex != m_writeBufferSize;
+}
+
+//Called when the current buffer can't hold 'count' more writes. Writes that were already
+//processed are submitted, the others are moved to the next buffer.
+void CGSHandler::SwitchWriteBuffer(uint32 count)
+{
+	assert(m_writeBufferSubmitIndex <= m_writeBufferProcessIndex);
+	assert(m_writeBufferProcessIndex <= m_writeBufferSize);
+
+	uint32 carryStartIndex = m_writeBufferProcessIndex;
+	uint32 carryEndIndex = m_writeBufferSize;
+	m_writeBufferSize = m_writeBufferProcessIndex;
+	SubmitWriteBuffer();
+
+	auto prevBuffer = m_currentWriteBuffer;
+	uint32 requiredSize = (carryEndIndex - carryStartIndex) + count;
+	if(prevBuffer)
+	{
+		//Current size isn't enough to hold a frame's worth of writes
+		m_writeBufferTargetSize = std::min<uint32>(m_writeBufferTargetSize * 2, REGISTERWRITEBUFFER_MAX_SIZE);
+	}
+	m_writeBufferTargetSize = std::max(m_writeBufferTargetSize, requiredSize);
+
+	//Get the next buffer before giving back the current one, the writes to carry are still in there
+	auto nextBuffer = AcquireWriteBuffer();
+	if(nextBuffer->size() < m_writeBufferTargetSize)
+	{
+		nextBuffer->resize(m_writeBufferTargetSize);
+	}
+	if(prevBuffer)
+	{
+		std::copy(m_writeBuffer + carryStartIndex, m_writeBuffer + carryEndIndex, nextBuffer->data());
+		SendGSCall([this, prevBuffer]() { ReleaseWriteBuffer(prevBuffer); });
+	}
+
+	m_currentWriteBuffer = nextBuffer;
+	m_writeBuffer = nextBuffer->data();
+	m_writeBufferCapacity = static_cast<uint32>(nextBuffer->size());
+	m_writeBufferSize = carryEndIndex - carryStartIndex;
+	m_writeBufferProcessIndex = 0;
+	m_writeBufferSubmitIndex = 0;
+}
+
+CGSHandler::RegisterWriteList* CGSHandler::AcquireWriteBuffer()
+{
+	std::unique_lock<std::mutex> writeBufferLock(m_writeBufferMutex);
+	if(m_freeWriteBuffers.empty())
+	{
+		//When the GS isn't threaded, buffers are given back on the thread that calls
+		//ProcessSingleFrame, which might be this one. We can't wait in that case.
+		if(!m_gsThreaded || (m_writeBuffers.size() < REGISTERWRITEBUFFER_COUNT))
+		{
+			m_writeBuffers.push_back(std::make_unique<RegisterWriteList>());
+			return m_writeBuffers.back().get();
+		}
+		m_writeBufferStats.stallCount++;
+		auto waitStart = std::chrono::steady_clock::now();
+		m_writeBufferCondition.wait(writeBufferLock, [this]() { return !m_freeWriteBuffers.empty(); });
+		m_gsWaitTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count();
+	}
+	auto buffer = m_freeWriteBuffers.back();
+	m_freeWriteBuffers.pop_back();
+	return buffer;
+}
+
+void CGSHandler::ReleaseWriteBuffer(RegisterWriteList* buffer)
+{
+	std::lock_guard<std::mutex> writeBufferLock(m_writeBufferMutex);
+	m_freeWriteBuffers.push_back(buffer);
+	m_writeBufferCondition.notify_one();
+}
+
+//Called at the end of a frame. Gets rid of buffers the pool doesn't need anymore: extra ones
+//allocated when the GS isn't threaded and ones that grew bigger than what recent frames needed.
+void CGSHandler::TrimWriteBuffers()
+{
+	if(m_writeBufferFrameWriteCount < (m_writeBufferTargetSize / 2))
+	{
+		m_writeBufferTargetSize = std::max<uint32>(m_writeBufferTargetSize / 2, REGISTERWRITEBUFFER_INITIAL_SIZE);
+	}
+	m_writeBufferFrameWriteCount = 0;
+
+	std::lock_guard<std::mutex> writeBufferLock(m_writeBufferMutex);
+	for(auto bufferIterator = m_freeWriteBuffers.begin(); bufferIterator != m_freeWriteBuffers.end();)
+	{
+		auto buffer = *bufferIterator;
+		if(m_writeBuffers.size() > REGISTERWRITEBUFFER_COUNT)
+		{
+			auto ownerIterator = std::find_if(m_writeBuffers.begin(), m_writeBuffers.end(),
+			                                  [buffer](const auto& ownedBuffer) { return ownedBuffer.get() == buffer; });
+			assert(ownerIterator != m_writeBuffers.end());
+			m_writeBuffers.erase(ownerIterator);
+			bufferIterator = m_freeWriteBuffers.erase(bufferIterator);
+			continue;
+		}
+		if(buffer->size() > m_writeBufferTargetSize)
+		{
+			buffer->resize(m_writeBufferTargetSize);
+			buffer->shrink_to_fit();
+		}
+		bufferIterator++;
+	}
+}
+
 void CGSHandler::WriteRegisterImpl(uint8 nRegister, uint64 nData)
 {
 	nRegister &= REGISTER_MAX - 1;
@@ -708,6 +922,14 @@ void CGSHandler::WriteRegisterImpl(uint8 nRegister, uint64 nData)
 #endif
 }
 
+void CGSHandler::FeedImageDataFromRing()
+{
+	uint32 length = 0;
+	auto imageData = m_imageDataRing.Front(length);
+	FeedImageDataImpl(imageData, length);
+	m_imageDataRing.Pop();
+}
+
 void CGSHandler::FeedImageDataImpl(const uint8* imageData, uint32 length)
 {
 	if(m_trxCtx.nSize == 0)
@@ -756,14 +978,16 @@ void CGSHandler::ReadImageDataImpl(void* ptr, uint32 size)
 	((this)->*(m_transferReadHandlers[bltBuf.nSrcPsm]))(ptr, size);
 }
 
-void CGSHandler::SubmitWriteBufferImpl(uint32 bufferStartIndex, uint32 bufferEndIndex)
+void CGSHandler::SubmitWriteBufferImpl(const RegisterWrite* writes, uint32 writeCount)
 {
-	for(uint32 i = bufferStartIndex; i < bufferEndIndex; i++)
+	for(uint32 i = 0; i < writeCount; i++)
 	{
-		const auto& write = m_writeBuffer[i];
+		const auto& write = writes[i];
 		WriteRegisterImpl(write.first, write.second);
 	}
 
+	assert(m_writeSubmitCount != 0);
+	m_writeSubmitCount--;
 	assert(m_transferCount != 0);
 	m_transferCount--;
 }
@@ -1082,6 +1306,17 @@ void CGSHandler::TransferReadHandlerInvalid(void*, uint32)
 	assert(0);
 }
 
+//Checks if the next rows of a local to host transfer cover whole blocks and can be converted block by block
+template <typename Storage>
+static bool CanReadBlockRow(uint32 x, uint32 y, uint32 width, uint32 remainingPixels)
+{
+	return (width != 0) &&
+	       ((x % Storage::BLOCKWIDTH) == 0) && ((width % Storage::BLOCKWIDTH) == 0) &&
+	       ((y % Storage::BLOCKHEIGHT) == 0) &&
+	       ((x + width) <= 2048) && ((y + Storage::BLOCKHEIGHT) <= 2048) &&
+	       (remainingPixels >= (width * Storage::BLOCKHEIGHT));
+}
+
 template <typename Storage>
 void CGSHandler::TransferReadHandlerGeneric(void* buffer, uint32 length)
 {
@@ -1089,16 +1324,38 @@ void CGSHandler::TransferReadHandlerGeneric(void* buffer, uint32 length)
 	auto trxReg = make_convertible<TRXREG>(m_nReg[GS_REG_TRXREG]);
 	auto trxBuf = make_convertible<BITBLTBUF>(m_nReg[GS_REG_BITBLTBUF]);
 
-	uint32 typedLength = length / sizeof(typename Storage::Unit);
-	auto typedBuffer = reinterpret_cast<typename Storage::Unit*>(buffer);
+	typedef typename Storage::Unit Unit;
+	uint32 typedLength = length / sizeof(Unit);
+	auto typedBuffer = reinterpret_cast<Unit*>(buffer);
 
 	CGsPixelFormats::CPixelIndexor<Storage> indexor(GetRam(), trxBuf.GetSrcPtr(), trxBuf.nSrcWidth);
-	for(uint32 i = 0; i < typedLength; i++)
+	uint32 i = 0;
+	while(i < typedLength)
 	{
+		if(m_trxCtx.nRRX == 0)
+		{
+			uint32 y = m_trxCtx.nRRY + trxPos.nSSAY;
+			if(CanReadBlockRow<Storage>(trxPos.nSSAX, y, trxReg.nRRW, typedLength - i))
+			{
+				auto dst = reinterpret_cast<uint8*>(typedBuffer + i);
+				uint32 dstStride = trxReg.nRRW * sizeof(Unit);
+				for(uint32 blockX = 0; blockX < trxReg.nRRW; blockX += Storage::BLOCKWIDTH)
+				{
+					unsigned int columnX = trxPos.nSSAX + blockX;
+					unsigned int columnY = y;
+					auto block = GetRam() + indexor.GetColumnAddress(columnX, columnY);
+					CGsDeswizzle::ReadBlock<Storage>(block, dst + (blockX * sizeof(Unit)), dstStride);
+				}
+				i += trxReg.nRRW * Storage::BLOCKHEIGHT;
+				m_trxCtx.nRRY += Storage::BLOCKHEIGHT;
+				continue;
+			}
+		}
+
 		uint32 x = (m_trxCtx.nRRX + trxPos.nSSAX) % 2048;
 		uint32 y = (m_trxCtx.nRRY + trxPos.nSSAY) % 2048;
 		auto pixel = indexor.GetPixel(x, y);
-		typedBuffer[i] = pixel;
+		typedBuffer[i++] = pixel;
 		m_trxCtx.nRRX++;
 		if(m_trxCtx.nRRX == trxReg.nRRW)
 		{
@@ -1110,6 +1367,8 @@ void CGSHandler::TransferReadHandlerGeneric(void* buffer, uint32 length)
 
 void CGSHandler::TransferReadHandlerPSMCT24(void* buffer, uint32 length)
 {
+	typedef CGsPixelFormats::STORAGEPSMCT32 Storage;
+
 	auto trxPos = make_convertible<TRXPOS>(m_nReg[GS_REG_TRXPOS]);
 	auto trxReg = make_convertible<TRXREG>(m_nReg[GS_REG_TRXREG]);
 	auto trxBuf = make_convertible<BITBLTBUF>(m_nReg[GS_REG_BITBLTBUF]);
@@ -1117,14 +1376,48 @@ void CGSHandler::TransferReadHandlerPSMCT24(void* buffer, uint32 length)
 	auto dst = reinterpret_cast<uint8*>(buffer);
 
 	CGsPixelFormats::CPixelIndexorPSMCT32 indexor(GetRam(), trxBuf.GetSrcPtr(), trxBuf.nSrcWidth);
-	for(uint32 i = 0; i < length; i += 3)
+	uint32 i = 0;
+	while(i < length)
 	{
+		if(m_trxCtx.nRRX == 0)
+		{
+			uint32 y = m_trxCtx.nRRY + trxPos.nSSAY;
+			if(CanReadBlockRow<Storage>(trxPos.nSSAX, y, trxReg.nRRW, (length - i) / 3))
+			{
+				//Blocks are converted to 32-bit pixels first, then packed
+				uint32 blockPixels[Storage::BLOCKHEIGHT][Storage::BLOCKWIDTH];
+				uint32 dstStride = trxReg.nRRW * 3;
+				for(uint32 blockX = 0; blockX < trxReg.nRRW; blockX += Storage::BLOCKWIDTH)
+				{
+					unsigned int columnX = trxPos.nSSAX + blockX;
+					unsigned int columnY = y;
+					auto block = GetRam() + indexor.GetColumnAddress(columnX, columnY);
+					CGsDeswizzle::ReadBlockPSMCT32(block, reinterpret_cast<uint8*>(blockPixels), sizeof(blockPixels[0]));
+					for(uint32 row = 0; row < Storage::BLOCKHEIGHT; row++)
+					{
+						auto rowDst = dst + i + (row * dstStride) + (blockX * 3);
+						for(uint32 col = 0; col < Storage::BLOCKWIDTH; col++)
+						{
+							uint32 pixel = blockPixels[row][col];
+							rowDst[(col * 3) + 0] = (pixel >> 0) & 0xFF;
+							rowDst[(col * 3) + 1] = (pixel >> 8) & 0xFF;
+							rowDst[(col * 3) + 2] = (pixel >> 16) & 0xFF;
+						}
+					}
+				}
+				i += dstStride * Storage::BLOCKHEIGHT;
+				m_trxCtx.nRRY += Storage::BLOCKHEIGHT;
+				continue;
+			}
+		}
+
 		uint32 x = (m_trxCtx.nRRX + trxPos.nSSAX) % 2048;
 		uint32 y = (m_trxCtx.nRRY + trxPos.nSSAY) % 2048;
 		auto pixel = indexor.GetPixel(x, y);
 		dst[i + 0] = (pixel >> 0) & 0xFF;
 		dst[i + 1] = (pixel >> 8) & 0xFF;
 		dst[i + 2] = (pixel >> 16) & 0xFF;
+		i += 3;
 		m_trxCtx.nRRX++;
 		if(m_trxCtx.nRRX == trxReg.nRRW)
 		{
@@ -1134,6 +1427,67 @@ void CGSHandler::TransferReadHandlerPSMCT24(void* buffer, uint32 length)
 	}
 }
 
+void CGSHandler::TransferReadHandlerPSMT4(void* buffer, uint32 length)
+{
+	typedef CGsPixelFormats::STORAGEPSMT4 Storage;
+
+	auto trxPos = make_convertible<TRXPOS>(m_nReg[GS_REG_TRXPOS]);
+	auto trxReg = make_convertible<TRXREG>(m_nReg[GS_REG_TRXREG]);
+	auto trxBuf = make_convertible<BITBLTBUF>(m_nReg[GS_REG_BITBLTBUF]);
+
+	auto dst = reinterpret_cast<uint8*>(buffer);
+
+	//Two pixels per byte, first one in the low nibble
+	CGsPixelFormats::CPixelIndexorPSMT4 indexor(GetRam(), trxBuf.GetSrcPtr(), trxBuf.nSrcWidth);
+	uint32 i = 0;
+	while(i < length)
+	{
+		if(m_trxCtx.nRRX == 0)
+		{
+			uint32 y = m_trxCtx.nRRY + trxPos.nSSAY;
+			if(CanReadBlockRow<Storage>(trxPos.nSSAX, y, trxReg.nRRW, (length - i) * 2))
+			{
+				//Blocks are converted to one byte per pixel first, then packed
+				uint8 blockPixels[Storage::BLOCKHEIGHT][Storage::BLOCKWIDTH];
+				uint32 dstStride = trxReg.nRRW / 2;
+				for(uint32 blockX = 0; blockX < trxReg.nRRW; blockX += Storage::BLOCKWIDTH)
+				{
+					unsigned int columnX = trxPos.nSSAX + blockX;
+					unsigned int columnY = y;
+					auto block = GetRam() + indexor.GetColumnAddress(columnX, columnY);
+					CGsDeswizzle::ReadBlockPSMT4(block, reinterpret_cast<uint8*>(blockPixels), sizeof(blockPixels[0]));
+					for(uint32 row = 0; row < Storage::BLOCKHEIGHT; row++)
+					{
+						auto rowDst = dst + i + (row * dstStride) + (blockX / 2);
+						for(uint32 col = 0; col < Storage::BLOCKWIDTH; col += 2)
+						{
+							rowDst[col / 2] = blockPixels[row][col] | (blockPixels[row][col + 1] << 4);
+						}
+					}
+				}
+				i += dstStride * Storage::BLOCKHEIGHT;
+				m_trxCtx.nRRY += Storage::BLOCKHEIGHT;
+				continue;
+			}
+		}
+
+		uint8 pixels[2];
+		for(unsigned int j = 0; j < 2; j++)
+		{
+			uint32 x = (m_trxCtx.nRRX + trxPos.nSSAX) % 2048;
+			uint32 y = (m_trxCtx.nRRY + trxPos.nSSAY) % 2048;
+			pixels[j] = indexor.GetPixel(x, y);
+			m_trxCtx.nRRX++;
+			if(m_trxCtx.nRRX == trxReg.nRRW)
+			{
+				m_trxCtx.nRRX = 0;
+				m_trxCtx.nRRY++;
+			}
+		}
+		dst[i++] = pixels[0] | (pixels[1] << 4);
+	}
+}
+
 void CGSHandler::SetCrt(bool nIsInterlaced, unsigned int nMode, bool nIsFrameMode)
 {
 	m_crtMode = static_cast<CRT_MODE>(nMode);
@@ -1315,28 +1669,24 @@ bool CGSHandler::ProcessCLD(const TEX0& tex0)
 template <typename Indexor>
 bool CGSHandler::ReadCLUT4_16(const TEX0& tex0)
 {
-	bool changed = false;
+	typedef CGsPixelFormats::STORAGEPSMCT16 Storage;
 
 	assert(tex0.nCSA < 32);
 
+	//The 16 colors are the first 8x2 pixels of the block
 	Indexor indexor(m_pRAM, tex0.GetCLUTPtr(), 1);
-	uint32 clutOffset = tex0.nCSA * 16;
-	uint16* pDst = m_pCLUT + clutOffset;
-
-	for(unsigned int j = 0; j < 2; j++)
-	{
-		for(unsigned int i = 0; i < 8; i++)
-		{
-			uint16 color = indexor.GetPixel(i, j);
+	unsigned int columnX = 0;
+	unsigned int columnY = 0;
+	uint16 blockPixels[Storage::BLOCKHEIGHT][Storage::BLOCKWIDTH];
+	CGsDeswizzle::ReadBlockPSMCT16(m_pRAM + indexor.GetColumnAddress(columnX, columnY), reinterpret_cast<uint8*>(blockPixels), sizeof(blockPixels[0]));
 
-			if(*pDst != color)
-			{
-				changed = true;
-			}
+	uint16 colors[0x10];
+	memcpy(colors + 0, blockPixels[0], sizeof(uint16) * 8);
+	memcpy(colors + 8, blockPixels[1], sizeof(uint16) * 8);
 
-			(*pDst++) = color;
-		}
-	}
+	uint16* pDst = m_pCLUT + (tex0.nCSA * 16);
+	bool changed = (memcmp(pDst, colors, sizeof(colors)) != 0);
+	memcpy(pDst, colors, sizeof(colors));
 
 	return changed;
 }
@@ -1344,28 +1694,30 @@ bool CGSHandler::ReadCLUT4_16(const TEX0& tex0)
 template <typename Indexor>
 bool CGSHandler::ReadCLUT8_16(const TEX0& tex0)
 {
-	bool changed = false;
+	typedef CGsPixelFormats::STORAGEPSMCT16 Storage;
 
+	//The 256 colors are 16x16 pixels, made of two blocks stacked vertically
 	Indexor indexor(m_pRAM, tex0.GetCLUTPtr(), 1);
-
-	for(unsigned int j = 0; j < 16; j++)
+	uint16 pixels[0x10][0x10];
+	for(uint32 blockY = 0; blockY < 0x10; blockY += Storage::BLOCKHEIGHT)
 	{
-		for(unsigned int i = 0; i < 16; i++)
-		{
-			uint16 color = indexor.GetPixel(i, j);
-
-			uint8 index = i + (j * 16);
-			index = (index & ~0x18) | ((index & 0x08) << 1) | ((index & 0x10) >> 1);
-
-			if(m_pCLUT[index] != color)
-			{
-				changed = true;
-			}
+		unsigned int columnX = 0;
+		unsigned int columnY = blockY;
+		CGsDeswizzle::ReadBlockPSMCT16(m_pRAM + indexor.GetColumnAddress(columnX, columnY), reinterpret_cast<uint8*>(pixels[blockY]), sizeof(pixels[0]));
+	}
 
-			m_pCLUT[index] = color;
-		}
+	//Entries 8-15 and 16-23 of every group of 32 entries are swapped
+	uint16 colors[0x100];
+	for(uint32 j = 0; j < 0x10; j++)
+	{
+		uint32 index = ((j & ~1) * 16) + ((j & 1) * 8);
+		memcpy(colors + index, pixels[j] + 0, sizeof(uint16) * 8);
+		memcpy(colors + index + 16, pixels[j] + 8, sizeof(uint16) * 8);
 	}
 
+	bool changed = (memcmp(m_pCLUT, colors, sizeof(colors)) != 0);
+	memcpy(m_pCLUT, colors, sizeof(colors));
+
 	return changed;
 }
 
@@ -1378,32 +1730,29 @@ void CGSHandler::ReadCLUT4(const TEX0& tex0)
 		//CSM1 mode
 		if(tex0.nCPSM == PSMCT32 || tex0.nCPSM == PSMCT24)
 		{
+			typedef CGsPixelFormats::STORAGEPSMCT32 Storage;
+
 			assert(tex0.nCSA < 16);
 
+			//The 16 colors are the first 8x2 pixels of the block
 			CGsPixelFormats::CPixelIndexorPSMCT32 Indexor(m_pRAM, tex0.GetCLUTPtr(), 1);
-			uint32 clutOffset = (tex0.nCSA & 0x0F) * 16;
-			uint16* pDst = m_pCLUT + clutOffset;
+			unsigned int columnX = 0;
+			unsigned int columnY = 0;
+			uint32 blockPixels[Storage::BLOCKHEIGHT][Storage::BLOCKWIDTH];
+			CGsDeswizzle::ReadBlockPSMCT32(m_pRAM + Indexor.GetColumnAddress(columnX, columnY), reinterpret_cast<uint8*>(blockPixels), sizeof(blockPixels[0]));
 
-			for(unsigned int j = 0; j < 2; j++)
-			{
-				for(unsigned int i = 0; i < 8; i++)
-				{
-					uint32 color = Indexor.GetPixel(i, j);
-					uint16 colorLo = static_cast<uint16>(color & 0xFFFF);
-					uint16 colorHi = static_cast<uint16>(color >> 16);
+			uint16 colorsLo[0x10];
+			uint16 colorsHi[0x10];
+			CGsDeswizzle::SplitColors32(blockPixels[0], colorsLo + 0, colorsHi + 0);
+			CGsDeswizzle::SplitColors32(blockPixels[1], colorsLo + 8, colorsHi + 8);
 
-					if(
-					    (pDst[0x000] != colorLo) ||
-					    (pDst[0x100] != colorHi))
-					{
-						changed = true;
-					}
+			uint32 clutOffset = (tex0.nCSA & 0x0F) * 16;
+			uint16* pDst = m_pCLUT + clutOffset;
 
-					pDst[0x000] = colorLo;
-					pDst[0x100] = colorHi;
-					pDst++;
-				}
-			}
+			changed = (memcmp(pDst + 0x000, colorsLo, sizeof(colorsLo)) != 0) ||
+			          (memcmp(pDst + 0x100, colorsHi, sizeof(colorsHi)) != 0);
+			memcpy(pDst + 0x000, colorsLo, sizeof(colorsLo));
+			memcpy(pDst + 0x100, colorsHi, sizeof(colorsHi));
 		}
 		else if(tex0.nCPSM == PSMCT16)
 		{
@@ -1460,30 +1809,35 @@ void CGSHandler::ReadCLUT8(const TEX0& tex0)
 	{
 		if(tex0.nCPSM == PSMCT32 || tex0.nCPSM == PSMCT24)
 		{
-			CGsPixelFormats::CPixelIndexorPSMCT32 Indexor(m_pRAM, tex0.GetCLUTPtr(), 1);
+			typedef CGsPixelFormats::STORAGEPSMCT32 Storage;
 
-			for(unsigned int j = 0; j < 16; j++)
+			//The 256 colors are 16x16 pixels, made of 2x2 blocks
+			CGsPixelFormats::CPixelIndexorPSMCT32 Indexor(m_pRAM, tex0.GetCLUTPtr(), 1);
+			uint32 pixels[0x10][0x10];
+			for(uint32 blockY = 0; blockY < 0x10; blockY += Storage::BLOCKHEIGHT)
 			{
-				for(unsigned int i = 0; i < 16; i++)
+				for(uint32 blockX = 0; blockX < 0x10; blockX += Storage::BLOCKWIDTH)
 				{
-					uint32 color = Indexor.GetPixel(i, j);
-					uint16 colorLo = static_cast<uint16>(color & 0xFFFF);
-					uint16 colorHi = static_cast<uint16>(color >> 16);
-
-					uint8 index = i + (j * 16);
-					index = (index & ~0x18) | ((index & 0x08) << 1) | ((index & 0x10) >> 1);
-
-					if(
-					    (m_pCLUT[index + 0x000] != colorLo) ||
-					    (m_pCLUT[index + 0x100] != colorHi))
-					{
-						changed = true;
-					}
-
-					m_pCLUT[index + 0x000] = colorLo;
-					m_pCLUT[index + 0x100] = colorHi;
+					unsigned int columnX = blockX;
+					unsigned int columnY = blockY;
+					CGsDeswizzle::ReadBlockPSMCT32(m_pRAM + Indexor.GetColumnAddress(columnX, columnY), reinterpret_cast<uint8*>(pixels[blockY] + blockX), sizeof(pixels[0]));
 				}
 			}
+
+			//Entries 8-15 and 16-23 of every group of 32 entries are swapped
+			uint16 colorsLo[0x100];
+			uint16 colorsHi[0x100];
+			for(uint32 j = 0; j < 0x10; j++)
+			{
+				uint32 index = ((j & ~1) * 16) + ((j & 1) * 8);
+				CGsDeswizzle::SplitColors32(pixels[j] + 0, colorsLo + index, colorsHi + index);
+				CGsDeswizzle::SplitColors32(pixels[j] + 8, colorsLo + index + 16, colorsHi + index + 16);
+			}
+
+			changed = (memcmp(m_pCLUT + 0x000, colorsLo, sizeof(colorsLo)) != 0) ||
+			          (memcmp(m_pCLUT + 0x100, colorsHi, sizeof(colorsHi)) != 0);
+			memcpy(m_pCLUT + 0x000, colorsLo, sizeof(colorsLo));
+			memcpy(m_pCLUT + 0x100, colorsHi, sizeof(colorsHi));
 		}
 		else if(tex0.nCPSM == PSMCT16)
 		{
@@ -1962,7 +2316,9 @@ void CGSHandler::ThreadProc()
 {
 	while(!m_threadDone)
 	{
+		auto waitStart = std::chrono::steady_clock::now();
 		m_mailBox.WaitForCall();
+		m_gsIdleTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count();
 		while(m_mailBox.IsPending())
 		{
 			m_mailBox.ReceiveCall();
@@ -1977,7 +2333,16 @@ void CGSHandler::SendGSCall(const CMailBox::FunctionType& function, bool waitFor
 		waitForCompletion = false;
 	}
 	waitForCompletion |= forceWaitForCompletion;
-	m_mailBox.SendCall(function, waitForCompletion);
+	if(waitForCompletion)
+	{
+		auto waitStart = std::chrono::steady_clock::now();
+		m_mailBox.SendCall(function, true);
+		m_gsWaitTime += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count();
+	}
+	else
+	{
+		m_mailBox.SendCall(function, false);
+	}
 }
 
 void CGSHandler::SendGSCall(CMailBox::FunctionType&& function)
@@ -2,6 +2,9 @@
 
 #include <thread>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <functional>
 #include <atomic>
 #include <array>
@@ -12,15 +15,18 @@
 #include "Convertible.h"
 #include "../MailBox.h"
 #include "../Integer64.h"
+#include "GsImageDataRing.h"
 #include "zip/ZipArchiveWriter.h"
 #include "zip/ZipArchiveReader.h"
 
 class CFrameDump;
+class CFrameDumpStreamWriter;
 class CGsPacketMetadata;
 class CINTC;
 
 #define PREF_CGSHANDLER_PRESENTATION_MODE "renderer.presentationmode"
 #define PREF_CGSHANDLER_WIDESCREEN "renderer.widescreen"
+#define PREF_CGSHANDLER_WRITE_SUBMIT_THRESHOLD "renderer.writesubmitthreshold"
 
 enum GS_REGS
 {
@@ -760,7 +766,20 @@ public:
 	typedef std::function<CGSHandler*(void)> FactoryFunction;
 
 	typedef Framework::CSignal<void()> FlipCompleteEvent;
-	typedef Framework::CSignal<void(uint32)> NewFrameEvent;
+	typedef Framework::CSignal<void(uint32, uint32)> NewFrameEvent;
+
+	struct WRITEBUFFER_STATS
+	{
+		uint32 writeCount = 0;
+		uint32 submitCount = 0;
+		//Number of writes that need to be buffered before being submitted while the GS thread is busy
+		uint32 submitThreshold = 0;
+		//Number of times the GS thread had to give back a buffer before writes could continue
+		uint32 stallCount = 0;
+		//Time the GS thread spent waiting for calls and time spent waiting on the GS thread (in microseconds)
+		uint64 gsIdleTime = 0;
+		uint64 gsWaitTime = 0;
+	};
 
 	CGSHandler(bool = true);
 	virtual ~CGSHandler();
@@ -777,6 +796,7 @@ public:
 	void Copy(CGSHandler*);
 
 	void SetFrameDump(CFrameDump*);
+	void SetFrameDumpStream(CFrameDumpStreamWriter*);
 
 	bool GetDrawEnabled() const;
 	void SetDrawEnabled(bool);
@@ -793,16 +813,42 @@ public:
 	void FeedImageData(const void*, uint32);
 	void ReadImageData(void*, uint32);
 
+	CGsImageDataRing::STATS GetImageDataStats() const;
+	void ResetImageDataStats();
+
+	WRITEBUFFER_STATS GetWriteBufferStats() const;
+	void ResetWriteBufferStats();
+
 	inline void WriteRegister(const RegisterWrite& write)
 	{
-		assert(m_writeBufferSize < REGISTERWRITEBUFFER_SIZE);
-		if(m_writeBufferSize == REGISTERWRITEBUFFER_SIZE) return;
+		if(m_writeBufferSize == m_writeBufferCapacity)
+		{
+			SwitchWriteBuffer(1);
+		}
 		m_writeBuffer[m_writeBufferSize++] = write;
 	}
 
+	//Returns room for 'count' register writes in the write buffer.
+	//Writes stored there are only added to the buffer once CommitRegisterWrites is called.
+	inline RegisterWrite* BeginRegisterWrites(uint32 count)
+	{
+		if((m_writeBufferCapacity - m_writeBufferSize) < count)
+		{
+			SwitchWriteBuffer(count);
+		}
+		return m_writeBuffer + m_writeBufferSize;
+	}
+
+	inline void CommitRegisterWrites(uint32 count)
+	{
+		assert(count <= (m_writeBufferCapacity - m_writeBufferSize));
+		m_writeBufferSize += count;
+	}
+
 	void ProcessWriteBuffer(const CGsPacketMetadata*);
 	void SubmitWriteBuffer();
 	void FlushWriteBuffer();
+	bool HasPendingRegisterWrites() const;
 
 	virtual void SetCrt(bool, unsigned int, bool);
 	void Initialize();
@@ -864,8 +910,14 @@ protected:
 
 	enum
 	{
-		REGISTERWRITEBUFFER_SIZE = 0x100000,
-		REGISTERWRITEBUFFER_SUBMIT_THRESHOLD = 0x100
+		REGISTERWRITEBUFFER_INITIAL_SIZE = 0x10000,
+		//Buffers don't grow beyond this unless a single packet needs more room
+		REGISTERWRITEBUFFER_MAX_SIZE = 0x100000,
+		//Number of buffers that can be in use before having to wait for the GS thread to give one back
+		REGISTERWRITEBUFFER_COUNT = 3,
+		REGISTERWRITEBUFFER_SUBMIT_THRESHOLD = 0x100,
+		REGISTERWRITEBUFFER_SUBMIT_THRESHOLD_MIN = 0x40,
+		REGISTERWRITEBUFFER_SUBMIT_THRESHOLD_MAX = 0x1000,
 	};
 
 	enum MAG_FILTER
@@ -969,8 +1021,14 @@ protected:
 	virtual void MarkNewFrame();
 	virtual void WriteRegisterImpl(uint8, uint64);
 	void FeedImageDataImpl(const uint8*, uint32);
+	void FeedImageDataFromRing();
 	void ReadImageDataImpl(void*, uint32);
-	void SubmitWriteBufferImpl(uint32, uint32);
+	void SubmitWriteBufferImpl(const RegisterWrite*, uint32);
+
+	void SwitchWriteBuffer(uint32);
+	RegisterWriteList* AcquireWriteBuffer();
+	void ReleaseWriteBuffer(RegisterWriteList*);
+	void TrimWriteBuffers();
 
 	void BeginTransfer();
 
@@ -996,6 +1054,7 @@ protected:
 	template <typename Storage>
 	void TransferReadHandlerGeneric(void*, uint32);
 	void TransferReadHandlerPSMCT24(void*, uint32);
+	void TransferReadHandlerPSMT4(void*, uint32);
 
 	virtual void SyncCLUT(const TEX0&);
 	bool ProcessCLD(const TEX0&);
@@ -1036,12 +1095,31 @@ protected:
 	uint32 m_nCBP1;
 
 	uint32 m_drawCallCount;
+	uint32 m_primitiveCount = 0;
 
-	//Rename to register write buffer?
-	RegisterWrite* m_writeBuffer;
+	//Register writes go in the current buffer. Full buffers are handed to the GS thread,
+	//which gives them back once it has processed their contents.
+	RegisterWrite* m_writeBuffer = nullptr;
+	uint32 m_writeBufferCapacity = 0;
 	uint32 m_writeBufferSize = 0;
 	uint32 m_writeBufferProcessIndex = 0;
 	uint32 m_writeBufferSubmitIndex = 0;
+	uint32 m_writeBufferTargetSize = REGISTERWRITEBUFFER_INITIAL_SIZE;
+	uint32 m_writeBufferFrameWriteCount = 0;
+	uint32 m_writeBufferSubmitThreshold = REGISTERWRITEBUFFER_SUBMIT_THRESHOLD;
+	uint32 m_writeBufferMaxSubmitThreshold = REGISTERWRITEBUFFER_SUBMIT_THRESHOLD_MAX;
+	RegisterWriteList* m_currentWriteBuffer = nullptr;
+	std::vector<std::unique_ptr<RegisterWriteList>> m_writeBuffers;
+	std::vector<RegisterWriteList*> m_freeWriteBuffers;
+	std::mutex m_writeBufferMutex;
+	std::condition_variable m_writeBufferCondition;
+	WRITEBUFFER_STATS m_writeBufferStats;
+	std::atomic<uint64> m_gsIdleTime = 0;
+	std::atomic<uint64> m_gsWaitTime = 0;
+	//Write buffer submissions the GS thread hasn't gone through yet
+	std::atomic<int> m_writeSubmitCount = 0;
+
+	CGsImageDataRing m_imageDataRing;
 
 	CRT_MODE m_crtMode;
 	std::thread m_thread;
@@ -1049,6 +1127,7 @@ protected:
 	std::atomic<int> m_transferCount;
 	bool m_threadDone;
 	CFrameDump* m_frameDump;
+	CFrameDumpStreamWriter* m_frameDumpStream = nullptr;
 	bool m_drawEnabled = true;
 	CINTC* m_intc = nullptr;
 	bool m_gsThreaded = true;
@@ -0,0 +1,436 @@
+#include <cassert>
+#include <cstring>
+#include "GsDeswizzle.h"
+
+#ifdef _WIN32
+#if defined(_M_X64) || defined(_M_IX86)
+#define USE_SSE
+#elif defined(_M_ARM64)
+#define USE_NEON
+#endif
+#elif defined(__APPLE__)
+#include <TargetConditionals.h>
+#if TARGET_CPU_X86_64
+#define USE_SSE
+#elif TARGET_CPU_ARM64
+#define USE_NEON
+#endif
+#elif defined(__ANDROID__) || defined(__linux__) || defined(__FreeBSD__)
+#if defined(__x86_64__) || defined(__i386__)
+#define USE_SSE
+#elif defined(__aarch64__) || (defined(__arm__) && defined(__ARM_NEON))
+#define USE_NEON
+#endif
+#endif
+
+#if defined(USE_SSE)
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+#if defined(USE_SSE)
+
+static void ConvertColumn8(uint8* dest, const int destStride, int colNum, __m128i a, __m128i b, __m128i c, __m128i d)
+{
+	__m128i temp_a = a;
+	__m128i temp_c = c;
+
+	a = _mm_unpacklo_epi8(temp_a, b);
+	c = _mm_unpackhi_epi8(temp_a, b);
+	b = _mm_unpacklo_epi8(temp_c, d);
+	d = _mm_unpackhi_epi8(temp_c, d);
+
+	temp_a = a;
+	temp_c = c;
+
+	a = _mm_unpacklo_epi16(temp_a, b);
+	c = _mm_unpackhi_epi16(temp_a, b);
+	b = _mm_unpacklo_epi16(temp_c, d);
+	d = _mm_unpackhi_epi16(temp_c, d);
+
+	temp_a = a;
+	__m128i temp_b = b;
+
+	a = _mm_unpacklo_epi8(temp_a, c);
+	b = _mm_unpackhi_epi8(temp_a, c);
+	c = _mm_unpacklo_epi8(temp_b, d);
+	d = _mm_unpackhi_epi8(temp_b, d);
+
+	temp_a = a;
+	temp_c = c;
+
+	a = _mm_unpacklo_epi64(temp_a, b);
+	c = _mm_unpackhi_epi64(temp_a, b);
+	b = _mm_unpacklo_epi64(temp_c, d);
+	d = _mm_unpackhi_epi64(temp_c, d);
+
+	if((colNum & 1) == 0)
+	{
+		c = _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1));
+		d = _mm_shuffle_epi32(d, _MM_SHUFFLE(2, 3, 0, 1));
+	}
+	else
+	{
+		a = _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1));
+		b = _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1));
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), a);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + destStride), b);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + destStride * 2), c);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + destStride * 3), d);
+}
+
+//Moves the low halves of the 4 dwords in the low qword and the high halves in the high qword
+static inline __m128i SplitHalves(__m128i value)
+{
+	value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(3, 1, 2, 0));
+	value = _mm_shufflehi_epi16(value, _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm_shuffle_epi32(value, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+void CGsDeswizzle::ConvertColumn8(uint8* dest, int destStride, const uint8* src, int colNum)
+{
+	auto mSrc = reinterpret_cast<const __m128i*>(src);
+
+	__m128i a = _mm_load_si128(mSrc + 0);
+	__m128i b = _mm_load_si128(mSrc + 1);
+	__m128i c = _mm_load_si128(mSrc + 2);
+	__m128i d = _mm_load_si128(mSrc + 3);
+	::ConvertColumn8(dest, destStride, colNum, a, b, c, d);
+}
+
+void CGsDeswizzle::ConvertColumn4(uint8* dest, int destStride, const uint8* src, int colNum)
+{
+	auto mSrc = reinterpret_cast<const __m128i*>(src);
+
+	__m128i a = _mm_load_si128(mSrc + 0);
+	__m128i b = _mm_load_si128(mSrc + 1);
+	__m128i c = _mm_load_si128(mSrc + 2);
+	__m128i d = _mm_load_si128(mSrc + 3);
+
+	// 4 bpp looks like 2 8bpp columns side by side.
+	// The 4pp are expanded to 8bpp.
+	// so 01 23 45 67 89 ab cd ef gh ij kl mn op qr st uv expands to
+	// 00 01 02 03 08 09 0a 0b 0g 0h 0i 0j 0o 0p 0q 0r as the first row on the left hand block.
+
+	__m128i perm = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 0x0c, 0x0d, 2, 3, 6, 7, 0x0a, 0x0b, 0x0e, 0x0f);
+	a = _mm_shuffle_epi8(a, perm);
+	b = _mm_shuffle_epi8(b, perm);
+	c = _mm_shuffle_epi8(c, perm);
+	d = _mm_shuffle_epi8(d, perm);
+
+	const __m128i mask = _mm_set1_epi32(0x0f0f0f0f);
+	const __m128i shiftCount = _mm_set_epi32(0, 0, 0, 4);
+	__m128i lowNybbles = _mm_and_si128(a, mask);
+	__m128i highNybbles = _mm_and_si128(_mm_srl_epi32(a, shiftCount), mask);
+	a = _mm_unpacklo_epi8(lowNybbles, highNybbles);
+	__m128i a2 = _mm_unpackhi_epi8(lowNybbles, highNybbles);
+
+	lowNybbles = _mm_and_si128(b, mask);
+	highNybbles = _mm_and_si128(_mm_srl_epi32(b, shiftCount), mask);
+	b = _mm_unpacklo_epi8(lowNybbles, highNybbles);
+	__m128i b2 = _mm_unpackhi_epi8(lowNybbles, highNybbles);
+
+	lowNybbles = _mm_and_si128(c, mask);
+	highNybbles = _mm_and_si128(_mm_srl_epi32(c, shiftCount), mask);
+	c = _mm_unpacklo_epi8(lowNybbles, highNybbles);
+	__m128i c2 = _mm_unpackhi_epi8(lowNybbles, highNybbles);
+
+	lowNybbles = _mm_and_si128(d, mask);
+	highNybbles = _mm_and_si128(_mm_srl_epi32(d, shiftCount), mask);
+	d = _mm_unpacklo_epi8(lowNybbles, highNybbles);
+	__m128i d2 = _mm_unpackhi_epi8(lowNybbles, highNybbles);
+
+	::ConvertColumn8(dest, destStride, colNum, a, b, c, d);
+	if(destStride > 16)
+	{
+		::ConvertColumn8(dest + 16, destStride, colNum, a2, b2, c2, d2);
+	}
+}
+
+void CGsDeswizzle::ReadBlockPSMCT32(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	auto src = reinterpret_cast<const __m128i*>(block);
+	for(uint32 column = 0; column < 4; column++)
+	{
+		__m128i a = _mm_load_si128(src + 0);
+		__m128i b = _mm_load_si128(src + 1);
+		__m128i c = _mm_load_si128(src + 2);
+		__m128i d = _mm_load_si128(src + 3);
+
+		//Pixel pairs alternate between the two rows of the column
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 0x00), _mm_unpacklo_epi64(a, b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 0x10), _mm_unpacklo_epi64(c, d));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstStride + 0x00), _mm_unpackhi_epi64(a, b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstStride + 0x10), _mm_unpackhi_epi64(c, d));
+
+		src += 4;
+		dst += dstStride * 2;
+	}
+}
+
+void CGsDeswizzle::ReadBlockPSMCT16(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	auto src = reinterpret_cast<const __m128i*>(block);
+	for(uint32 column = 0; column < 4; column++)
+	{
+		__m128i a = _mm_load_si128(src + 0);
+		__m128i b = _mm_load_si128(src + 1);
+		__m128i c = _mm_load_si128(src + 2);
+		__m128i d = _mm_load_si128(src + 3);
+
+		//Same dword layout as PSMCT32, the left half of a row is made of the low halves of its dwords
+		__m128i row0a = SplitHalves(_mm_unpacklo_epi64(a, b));
+		__m128i row0b = SplitHalves(_mm_unpacklo_epi64(c, d));
+		__m128i row1a = SplitHalves(_mm_unpackhi_epi64(a, b));
+		__m128i row1b = SplitHalves(_mm_unpackhi_epi64(c, d));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 0x00), _mm_unpacklo_epi64(row0a, row0b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 0x10), _mm_unpackhi_epi64(row0a, row0b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstStride + 0x00), _mm_unpacklo_epi64(row1a, row1b));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + dstStride + 0x10), _mm_unpackhi_epi64(row1a, row1b));
+
+		src += 4;
+		dst += dstStride * 2;
+	}
+}
+
+void CGsDeswizzle::SplitColors32(const uint32* colors, uint16* lo, uint16* hi)
+{
+	__m128i a = SplitHalves(_mm_loadu_si128(reinterpret_cast<const __m128i*>(colors + 0)));
+	__m128i b = SplitHalves(_mm_loadu_si128(reinterpret_cast<const __m128i*>(colors + 4)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lo), _mm_unpacklo_epi64(a, b));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(hi), _mm_unpackhi_epi64(a, b));
+}
+
+#elif defined(USE_NEON)
+
+static void ConvertColumn8(uint8x16x4_t data, uint8* dest, const int destStride, int colNum)
+{
+	uint16x8_t row0 = vcombine_u16(vmovn_u32(vreinterpretq_u32_u8(data.val[0])), vmovn_u32(vreinterpretq_u32_u8(data.val[2])));
+	uint16x8_t revr0 = vrev32q_u16(vreinterpretq_u16_u8(data.val[0]));
+	uint16x8_t revr2 = vrev32q_u16(vreinterpretq_u16_u8(data.val[2]));
+	uint16x8_t row1 = vcombine_u16(vmovn_u32(vreinterpretq_u32_u16(revr0)), vmovn_u32(vreinterpretq_u32_u16(revr2)));
+
+	uint16x8_t row2 = vcombine_u16(vmovn_u32(vreinterpretq_u32_u8(data.val[1])), vmovn_u32(vreinterpretq_u32_u8(data.val[3])));
+	uint16x8_t revr1 = vrev32q_u16(vreinterpretq_u16_u8(data.val[1]));
+	uint16x8_t revr3 = vrev32q_u16(vreinterpretq_u16_u8(data.val[3]));
+	uint16x8_t row3 = vcombine_u16(vmovn_u32(vreinterpretq_u32_u16(revr1)), vmovn_u32(vreinterpretq_u32_u16(revr3)));
+
+	if((colNum & 1) == 0)
+	{
+		row2 = vreinterpretq_u16_u32(vrev64q_u32(vreinterpretq_u32_u16(row2)));
+		row3 = vreinterpretq_u16_u32(vrev64q_u32(vreinterpretq_u32_u16(row3)));
+	}
+	else
+	{
+		row0 = vreinterpretq_u16_u32(vrev64q_u32(vreinterpretq_u32_u16(row0)));
+		row1 = vreinterpretq_u16_u32(vrev64q_u32(vreinterpretq_u32_u16(row1)));
+	}
+
+	vst1q_u8(dest, vreinterpretq_u8_u16(row0));
+	vst1q_u8(dest + destStride, vreinterpretq_u8_u16(row1));
+	vst1q_u8(dest + 2 * destStride, vreinterpretq_u8_u16(row2));
+	vst1q_u8(dest + 3 * destStride, vreinterpretq_u8_u16(row3));
+}
+
+void CGsDeswizzle::ConvertColumn8(uint8* dest, int destStride, const uint8* src, int colNum)
+{
+	// This sucks in the entire column and de-interleaves it
+	uint8x16x4_t data = vld4q_u8(src);
+	::ConvertColumn8(data, dest, destStride, colNum);
+}
+
+void CGsDeswizzle::ConvertColumn4(uint8* dest, int destStride, const uint8* src, int colNum)
+{
+	// https://developer.arm.com/architectures/instruction-sets/simd-isas/neon/intrinsics
+
+	uint8x16x4_t data = vld4q_u8(src);
+
+	const auto mask = vdupq_n_u8(0x0F);
+
+	auto high_nybbles = vshrq_n_u8(data.val[0], 4);
+	auto lo_nybbles = vandq_u8(data.val[0], mask);
+
+	uint8x16x4_t col8Data;
+	col8Data.val[0] = lo_nybbles;
+	col8Data.val[1] = high_nybbles;
+
+	high_nybbles = vshrq_n_u8(data.val[1], 4);
+	lo_nybbles = vandq_u8(data.val[1], mask);
+	col8Data.val[2] = lo_nybbles;
+	col8Data.val[3] = high_nybbles;
+	::ConvertColumn8(col8Data, dest, destStride, colNum);
+
+	if(destStride > 16)
+	{
+		high_nybbles = vshrq_n_u8(data.val[2], 4);
+		lo_nybbles = vandq_u8(data.val[2], mask);
+		col8Data.val[0] = lo_nybbles;
+		col8Data.val[1] = high_nybbles;
+		high_nybbles = vshrq_n_u8(data.val[3], 4);
+		lo_nybbles = vandq_u8(data.val[3], mask);
+		col8Data.val[2] = lo_nybbles;
+		col8Data.val[3] = high_nybbles;
+		::ConvertColumn8(col8Data, dest + 16, destStride, colNum);
+	}
+}
+
+void CGsDeswizzle::ReadBlockPSMCT32(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	auto src = reinterpret_cast<const uint32*>(block);
+	for(uint32 column = 0; column < 4; column++)
+	{
+		uint32x4_t a = vld1q_u32(src + 0x0);
+		uint32x4_t b = vld1q_u32(src + 0x4);
+		uint32x4_t c = vld1q_u32(src + 0x8);
+		uint32x4_t d = vld1q_u32(src + 0xC);
+
+		//Pixel pairs alternate between the two rows of the column
+		vst1q_u32(reinterpret_cast<uint32*>(dst + 0x00), vcombine_u32(vget_low_u32(a), vget_low_u32(b)));
+		vst1q_u32(reinterpret_cast<uint32*>(dst + 0x10), vcombine_u32(vget_low_u32(c), vget_low_u32(d)));
+		vst1q_u32(reinterpret_cast<uint32*>(dst + dstStride + 0x00), vcombine_u32(vget_high_u32(a), vget_high_u32(b)));
+		vst1q_u32(reinterpret_cast<uint32*>(dst + dstStride + 0x10), vcombine_u32(vget_high_u32(c), vget_high_u32(d)));
+
+		src += 0x10;
+		dst += dstStride * 2;
+	}
+}
+
+void CGsDeswizzle::ReadBlockPSMCT16(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	auto src = reinterpret_cast<const uint32*>(block);
+	for(uint32 column = 0; column < 4; column++)
+	{
+		uint32x4_t a = vld1q_u32(src + 0x0);
+		uint32x4_t b = vld1q_u32(src + 0x4);
+		uint32x4_t c = vld1q_u32(src + 0x8);
+		uint32x4_t d = vld1q_u32(src + 0xC);
+
+		//Same dword layout as PSMCT32, the left half of a row is made of the low halves of its dwords
+		uint16x8x2_t row0 = vuzpq_u16(
+		    vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(a), vget_low_u32(b))),
+		    vreinterpretq_u16_u32(vcombine_u32(vget_low_u32(c), vget_low_u32(d))));
+		uint16x8x2_t row1 = vuzpq_u16(
+		    vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(a), vget_high_u32(b))),
+		    vreinterpretq_u16_u32(vcombine_u32(vget_high_u32(c), vget_high_u32(d))));
+
+		vst1q_u16(reinterpret_cast<uint16*>(dst + 0x00), row0.val[0]);
+		vst1q_u16(reinterpret_cast<uint16*>(dst + 0x10), row0.val[1]);
+		vst1q_u16(reinterpret_cast<uint16*>(dst + dstStride + 0x00), row1.val[0]);
+		vst1q_u16(reinterpret_cast<uint16*>(dst + dstStride + 0x10), row1.val[1]);
+
+		src += 0x10;
+		dst += dstStride * 2;
+	}
+}
+
+void CGsDeswizzle::SplitColors32(const uint32* colors, uint16* lo, uint16* hi)
+{
+	uint16x8x2_t halves = vuzpq_u16(
+	    vreinterpretq_u16_u32(vld1q_u32(colors + 0)),
+	    vreinterpretq_u16_u32(vld1q_u32(colors + 4)));
+	vst1q_u16(lo, halves.val[0]);
+	vst1q_u16(hi, halves.val[1]);
+}
+
+#else
+
+//Reference implementations, pixel offsets are taken from the indexors' page offset tables.
+//The first block of a page is at the page's start, its offsets are relative to the block.
+
+template <typename Storage>
+static void ReadBlockGeneric(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	typedef typename Storage::Unit Unit;
+	auto pageOffsets = CGsPixelFormats::CPixelIndexor<Storage>::GetPageOffsets();
+	for(uint32 y = 0; y < Storage::BLOCKHEIGHT; y++)
+	{
+		auto dstRow = dst + (y * dstStride);
+		for(uint32 x = 0; x < Storage::BLOCKWIDTH; x++)
+		{
+			auto pixel = *reinterpret_cast<const Unit*>(block + pageOffsets[(y * Storage::PAGEWIDTH) + x]);
+			memcpy(dstRow + (x * sizeof(Unit)), &pixel, sizeof(Unit));
+		}
+	}
+}
+
+void CGsDeswizzle::ConvertColumn8(uint8* dest, int destStride, const uint8* src, int colNum)
+{
+	typedef CGsPixelFormats::STORAGEPSMT8 Storage;
+	auto pageOffsets = CGsPixelFormats::CPixelIndexorPSMT8::GetPageOffsets();
+	for(uint32 y = 0; y < Storage::COLUMNHEIGHT; y++)
+	{
+		uint32 blockY = (colNum * Storage::COLUMNHEIGHT) + y;
+		for(uint32 x = 0; x < Storage::COLUMNWIDTH; x++)
+		{
+			uint32 offset = pageOffsets[(blockY * Storage::PAGEWIDTH) + x] - (colNum * CGsPixelFormats::COLUMNSIZE);
+			dest[(y * destStride) + x] = src[offset];
+		}
+	}
+}
+
+void CGsDeswizzle::ConvertColumn4(uint8* dest, int destStride, const uint8* src, int colNum)
+{
+	typedef CGsPixelFormats::STORAGEPSMT4 Storage;
+	auto pageOffsets = CGsPixelFormats::CPixelIndexorPSMT4::GetPageOffsets();
+	uint32 width = (destStride > 16) ? Storage::COLUMNWIDTH : (Storage::COLUMNWIDTH / 2);
+	for(uint32 y = 0; y < Storage::COLUMNHEIGHT; y++)
+	{
+		uint32 blockY = (colNum * Storage::COLUMNHEIGHT) + y;
+		for(uint32 x = 0; x < width; x++)
+		{
+			//Offsets are in nibbles
+			uint32 offset = pageOffsets[(blockY * Storage::PAGEWIDTH) + x] - (colNum * CGsPixelFormats::COLUMNSIZE * 2);
+			dest[(y * destStride) + x] = (src[offset / 2] >> ((offset & 1) * 4)) & 0x0F;
+		}
+	}
+}
+
+void CGsDeswizzle::ReadBlockPSMCT32(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	ReadBlockGeneric<CGsPixelFormats::STORAGEPSMCT32>(block, dst, dstStride);
+}
+
+void CGsDeswizzle::ReadBlockPSMCT16(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	ReadBlockGeneric<CGsPixelFormats::STORAGEPSMCT16>(block, dst, dstStride);
+}
+
+void CGsDeswizzle::SplitColors32(const uint32* colors, uint16* lo, uint16* hi)
+{
+	for(uint32 i = 0; i < 8; i++)
+	{
+		lo[i] = static_cast<uint16>(colors[i]);
+		hi[i] = static_cast<uint16>(colors[i] >> 16);
+	}
+}
+
+#endif
+
+void CGsDeswizzle::ReadBlockPSMT8(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	//A block is made of 4 columns of 16x4 pixels
+	for(uint32 column = 0; column < 4; column++)
+	{
+		ConvertColumn8(dst, dstStride, block, column);
+		block += CGsPixelFormats::COLUMNSIZE;
+		dst += dstStride * 4;
+	}
+}
+
+void CGsDeswizzle::ReadBlockPSMT4(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	assert(dstStride >= CGsPixelFormats::STORAGEPSMT4::BLOCKWIDTH);
+	//A block is made of 4 columns of 32x4 pixels
+	for(uint32 column = 0; column < 4; column++)
+	{
+		ConvertColumn4(dst, dstStride, block, column);
+		block += CGsPixelFormats::COLUMNSIZE;
+		dst += dstStride * 4;
+	}
+}
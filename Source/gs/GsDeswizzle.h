@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Types.h"
+#include "GsPixelFormats.h"
+
+//Converts swizzled GS memory blocks to linear pixels. Blocks need to be 16 bytes aligned,
+//destination rows don't.
+//There are no block readers for PSMZ16, PSMZ24, PSMT8H, PSMT4HL and PSMT4HH: local to host
+//transfers don't support them and their textures are still converted one pixel at a time.
+class CGsDeswizzle
+{
+public:
+	//Converts one column (16x4 pixels) of a PSMT8 block, 'colNum' is the column's index in its block
+	static void ConvertColumn8(uint8*, int, const uint8*, int);
+
+	//Converts one column (32x4 pixels) of a PSMT4 block to one byte per pixel. If stride is
+	//16 bytes or less, only the left half of the column is converted.
+	static void ConvertColumn4(uint8*, int, const uint8*, int);
+
+	//Whole blocks, destination stride is in bytes
+	static void ReadBlockPSMCT32(const uint8*, uint8*, uint32);
+	static void ReadBlockPSMCT16(const uint8*, uint8*, uint32);
+	static void ReadBlockPSMT8(const uint8*, uint8*, uint32);
+	//Produces one byte per pixel
+	static void ReadBlockPSMT4(const uint8*, uint8*, uint32);
+
+	template <typename Storage>
+	static void ReadBlock(const uint8*, uint8*, uint32);
+
+	//Splits 8 32-bit colors in their low and high halves, as stored in the CLUT buffer
+	static void SplitColors32(const uint32*, uint16*, uint16*);
+};
+
+template <>
+inline void CGsDeswizzle::ReadBlock<CGsPixelFormats::STORAGEPSMCT32>(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	ReadBlockPSMCT32(block, dst, dstStride);
+}
+
+template <>
+inline void CGsDeswizzle::ReadBlock<CGsPixelFormats::STORAGEPSMZ32>(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	ReadBlockPSMCT32(block, dst, dstStride);
+}
+
+template <>
+inline void CGsDeswizzle::ReadBlock<CGsPixelFormats::STORAGEPSMCT16>(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	ReadBlockPSMCT16(block, dst, dstStride);
+}
+
+template <>
+inline void CGsDeswizzle::ReadBlock<CGsPixelFormats::STORAGEPSMCT16S>(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	ReadBlockPSMCT16(block, dst, dstStride);
+}
+
+template <>
+inline void CGsDeswizzle::ReadBlock<CGsPixelFormats::STORAGEPSMT8>(const uint8* block, uint8* dst, uint32 dstStride)
+{
+	ReadBlockPSMT8(block, dst, dstStride);
+}
@@ -0,0 +1,127 @@
+#include <cassert>
+#include <cstring>
+#include "GsImageDataRing.h"
+
+static uint32 AlignPacketSize(uint32 size)
+{
+	return (size + 0xF) & ~0xF;
+}
+
+CGsImageDataRing::CGsImageDataRing(uint32 capacity)
+    : m_storage(capacity)
+    , m_capacity(capacity)
+{
+	assert((capacity & 0xF) == 0);
+}
+
+//Copies a packet in the ring, returns a pointer to the copy or nullptr if the packet doesn't
+//fit. If there isn't enough space left, waits for the consumer if allowed to, fails otherwise.
+uint8* CGsImageDataRing::Push(const void* data, uint32 length, bool canWait)
+{
+	uint32 packetSize = sizeof(HEADER) + AlignPacketSize(length + PACKET_PADDING);
+	uint32 writeOffset = static_cast<uint32>(m_writePosition % m_capacity);
+	uint32 tailSize = m_capacity - writeOffset;
+	uint32 requiredSize = (packetSize > tailSize) ? (tailSize + packetSize) : packetSize;
+	if(requiredSize > m_capacity)
+	{
+		return nullptr;
+	}
+
+	if(GetFreeSize() < requiredSize)
+	{
+		if(!canWait)
+		{
+			return nullptr;
+		}
+		m_stats.stallCount++;
+		std::unique_lock<std::mutex> freeSpaceLock(m_freeSpaceMutex);
+		//Pairs with the fence in Pop: either we see the new read position or the consumer sees the flag
+		m_producerWaiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_freeSpaceCondition.wait(freeSpaceLock, [&]() { return GetFreeSize() >= requiredSize; });
+		m_producerWaiting.store(false, std::memory_order_relaxed);
+	}
+
+	if(packetSize > tailSize)
+	{
+		//Tail is always large enough to hold a header since everything is 16 bytes aligned
+		auto marker = GetHeader(m_writePosition);
+		marker->length = WRAP_MARKER;
+		marker->size = tailSize;
+		m_writePosition += tailSize;
+	}
+
+	auto header = GetHeader(m_writePosition);
+	header->length = length;
+	header->size = packetSize;
+	auto packet = reinterpret_cast<uint8*>(header + 1);
+	memcpy(packet, data, length);
+	m_writePosition += packetSize;
+
+	m_stats.packetCount++;
+	m_stats.byteCount += length;
+
+	return packet;
+}
+
+//Returns the oldest packet that wasn't popped yet. Must only be called when the producer
+//notified that a packet was pushed.
+const uint8* CGsImageDataRing::Front(uint32& length)
+{
+	uint64 readPosition = m_readPosition.load(std::memory_order_relaxed);
+	auto header = GetHeader(readPosition);
+	if(header->length == WRAP_MARKER)
+	{
+		header = GetHeader(readPosition + header->size);
+	}
+	length = header->length;
+	return reinterpret_cast<const uint8*>(header + 1);
+}
+
+void CGsImageDataRing::Pop()
+{
+	uint64 readPosition = m_readPosition.load(std::memory_order_relaxed);
+	auto header = GetHeader(readPosition);
+	if(header->length == WRAP_MARKER)
+	{
+		readPosition += header->size;
+		header = GetHeader(readPosition);
+	}
+	readPosition += header->size;
+	m_readPosition.store(readPosition, std::memory_order_release);
+	//Only wake up the producer if it's waiting for space, see Push
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(m_producerWaiting.load(std::memory_order_relaxed))
+	{
+		//Producer holds the lock until it's waiting on the condition, it can't miss the notification
+		std::lock_guard<std::mutex> freeSpaceLock(m_freeSpaceMutex);
+		m_freeSpaceCondition.notify_one();
+	}
+}
+
+void CGsImageDataRing::CountOverflow()
+{
+	m_stats.overflowCount++;
+}
+
+CGsImageDataRing::STATS CGsImageDataRing::GetStats() const
+{
+	return m_stats;
+}
+
+void CGsImageDataRing::ResetStats()
+{
+	m_stats = STATS();
+}
+
+uint32 CGsImageDataRing::GetFreeSize() const
+{
+	uint64 readPosition = m_readPosition.load(std::memory_order_acquire);
+	assert(m_writePosition >= readPosition);
+	return m_capacity - static_cast<uint32>(m_writePosition - readPosition);
+}
+
+CGsImageDataRing::HEADER* CGsImageDataRing::GetHeader(uint64 position)
+{
+	return reinterpret_cast<HEADER*>(m_storage.data() + (position % m_capacity));
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "Types.h"
+
+//Single producer, single consumer byte ring holding image transfer packets on their way
+//to the GS thread.
+//
+//The producer copies a packet in the ring and then notifies the consumer through the GS
+//mailbox, which makes the packet's contents visible to it. Packets are consumed in the
+//order they were pushed and their storage is given back to the producer when popped.
+//Each packet is preceded by a small header holding its length. Packets never wrap around
+//the end of the ring, a marker is written instead and the packet starts back at the
+//beginning of the storage.
+class CGsImageDataRing
+{
+public:
+	enum
+	{
+		DEFAULT_CAPACITY = 0x400000,
+		//Transfer handlers are allowed to read beyond the actual length of the packet (ie.: PSMCT24)
+		PACKET_PADDING = 0x10,
+	};
+
+	struct STATS
+	{
+		uint32 packetCount = 0;
+		uint64 byteCount = 0;
+		//Number of packets that had to wait for the consumer to free up space
+		uint32 stallCount = 0;
+		//Number of packets that couldn't be stored in the ring
+		uint32 overflowCount = 0;
+	};
+
+	CGsImageDataRing(uint32 = DEFAULT_CAPACITY);
+
+	uint8* Push(const void*, uint32, bool);
+	const uint8* Front(uint32&);
+	void Pop();
+
+	void CountOverflow();
+
+	STATS GetStats() const;
+	void ResetStats();
+
+private:
+	struct HEADER
+	{
+		uint32 length;
+		uint32 size;
+		uint32 reserved[2];
+	};
+	static_assert(sizeof(HEADER) == 0x10, "HEADER must be 16 bytes long.");
+
+	enum : uint32
+	{
+		WRAP_MARKER = ~0U,
+	};
+
+	uint32 GetFreeSize() const;
+	HEADER* GetHeader(uint64);
+
+	std::vector<uint8> m_storage;
+	uint32 m_capacity = 0;
+
+	//Only modified by the producer
+	uint64 m_writePosition = 0;
+	STATS m_stats;
+
+	//Only modified by the consumer
+	std::atomic<uint64> m_readPosition = 0;
+
+	//Wakes up the producer when it waits for the consumer to free up space. The consumer
+	//only takes the lock if the producer flagged that it's waiting.
+	std::atomic<bool> m_producerWaiting = false;
+	std::mutex m_freeSpaceMutex;
+	std::condition_variable m_freeSpaceCondition;
+};
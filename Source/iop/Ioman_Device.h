@@ -34,6 +34,11 @@ namespace Iop
 			{
 				throw std::runtime_error("Mounting not supported.");
 			}
+			//Files of the device can be read on another thread while the emulation goes on
+			virtual bool IsAsyncReadSupported() const
+			{
+				return false;
+			}
 		};
 	}
 }
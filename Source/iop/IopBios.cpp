@@ -310,6 +310,9 @@ uint32& CIopBios::ModuleStartRequestFree() const
 
 void CIopBios::SaveState(Framework::CZipArchiveWriter& archive)
 {
+	//Threads waiting on host reads are woken up before their state (stored in RAM) is written
+	m_ioman->CompleteAsyncReads();
+
 	CStructCollectionStateFile* modulesFile = new CStructCollectionStateFile(STATE_MODULES);
 	{
 		for(const auto& modulePair : m_modules)
@@ -693,6 +696,11 @@ int32 CIopBios::LoadModule(CELF& elf, const char* path)
 		}
 	}
 
+	{
+		uint32 textEnd = iopMod ? (moduleRange.first + iopMod->textSectionSize) : moduleRange.second;
+		m_cpu.m_executor->PrecompileRange(moduleRange.first, textEnd, entryPoint);
+	}
+
 	return loadedModuleId;
 }
 
@@ -1175,6 +1183,10 @@ uint32 CIopBios::TerminateThread(uint32 threadId)
 		}
 		thread->waitSemaphore = 0;
 	}
+	if(thread->status == THREAD_STATUS_WAIT_IO)
+	{
+		m_ioman->CancelAsyncRead(threadId);
+	}
 	thread->status = THREAD_STATUS_DORMANT;
 	UnlinkThread(thread->id);
 	return KERNEL_RESULT_OK;
@@ -1340,6 +1352,7 @@ uint32 CIopBios::ReferThreadStatus(uint32 threadId, uint32 statusPtr, bool inInt
 	case THREAD_STATUS_WAITING_SEMAPHORE:
 	case THREAD_STATUS_WAIT_VBLANK_START:
 	case THREAD_STATUS_WAIT_VBLANK_END:
+	case THREAD_STATUS_WAIT_IO:
 		threadStatus = 0x04;
 		break;
 	case THREAD_STATUS_RUNNING:
@@ -1547,6 +1560,10 @@ int32 CIopBios::ReleaseWaitThread(uint32 threadId, bool inInterrupt)
 		thread->waitSemaphore = 0;
 	}
 	break;
+	case THREAD_STATUS_WAIT_IO:
+		//Read will complete in the background, but the thread won't get its result
+		m_ioman->CancelAsyncRead(threadId);
+		break;
 	default:
 		assert(false);
 		break;
@@ -1800,11 +1817,33 @@ uint64 CIopBios::ClockToMicroSec(uint64 clock)
 void CIopBios::CountTicks(uint32 ticks)
 {
 	CurrentTime() += ticks;
+	m_ioman->ProcessAsyncReads();
 #ifdef _IOP_EMULATE_MODULES
 	m_mcserv->CountTicks(ticks, m_sifMan.get());
 #endif
 }
 
+//Returns a lower bound on the number of ticks before a sleeping thread
+//becomes ready or before a module needs to complete a pending operation
+uint32 CIopBios::GetTicksUntilNextEvent()
+{
+	uint64 result = ~0U;
+	uint64 currentTime = GetCurrentTime();
+	uint32 nextThreadId = ThreadLinkHead();
+	while(nextThreadId != 0)
+	{
+		THREAD* nextThread = m_threads[nextThreadId];
+		nextThreadId = nextThread->nextThreadId;
+		if(currentTime > nextThread->nextActivateTime) return 0;
+		result = std::min<uint64>(result, nextThread->nextActivateTime - currentTime + 1);
+	}
+	result = std::min<uint64>(result, m_ioman->GetTicksUntilNextEvent());
+#ifdef _IOP_EMULATE_MODULES
+	result = std::min<uint64>(result, m_mcserv->GetTicksUntilNextEvent());
+#endif
+	return static_cast<uint32>(result);
+}
+
 void CIopBios::NotifyVBlankStart()
 {
 	for(auto thread : m_threads)
@@ -2770,6 +2809,34 @@ void CIopBios::ReleaseWaitCdSync()
 	}
 }
 
+//Puts the current thread in a wait state till an asynchronous I/O request completes.
+//Returns the id of the waiting thread, or -1 if the current context can't wait.
+int32 CIopBios::WaitIoCompletion()
+{
+	int32 threadId = m_currentThreadId;
+	if(threadId < 0) return -1;
+	uint32 status = m_cpu.m_State.nCOP0[CCOP_SCU::STATUS];
+	if((status & CMIPS::STATUS_EXL) != 0) return -1;
+	//Reschedule won't switch away from the thread if interrupts are disabled
+	if((status & CMIPS::STATUS_IE) != CMIPS::STATUS_IE) return -1;
+	auto thread = GetThread(threadId);
+	if(!thread || (thread->status != THREAD_STATUS_RUNNING)) return -1;
+	thread->status = THREAD_STATUS_WAIT_IO;
+	UnlinkThread(threadId);
+	m_rescheduleNeeded = true;
+	return threadId;
+}
+
+void CIopBios::ReleaseWaitIoCompletion(uint32 threadId, uint32 result)
+{
+	auto thread = GetThread(threadId);
+	if(!thread || (thread->status != THREAD_STATUS_WAIT_IO)) return;
+
+	thread->context.gpr[CMIPS::V0] = result;
+	thread->status = THREAD_STATUS_RUNNING;
+	LinkThread(threadId);
+}
+
 Iop::CSysmem* CIopBios::GetSysmem()
 {
 	return m_sysmem.get();
@@ -3590,6 +3657,9 @@ BiosDebugThreadInfoArray CIopBios::GetThreadsDebugInfo() const
 		case THREAD_STATUS_WAIT_VBLANK_END:
 			threadInfo.stateDescription = "Waiting (Vblank End)";
 			break;
+		case THREAD_STATUS_WAIT_IO:
+			threadInfo.stateDescription = "Waiting (I/O)";
+			break;
 		default:
 			threadInfo.stateDescription = "Unknown";
 			break;
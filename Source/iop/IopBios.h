@@ -115,6 +115,7 @@ public:
 		THREAD_STATUS_WAIT_VBLANK_START = 7,
 		THREAD_STATUS_WAIT_VBLANK_END = 8,
 		THREAD_STATUS_WAIT_CDSYNC = 9,
+		THREAD_STATUS_WAIT_IO = 10,
 	};
 
 	struct THREAD_INFO
@@ -179,6 +180,7 @@ public:
 	void Reschedule();
 
 	void CountTicks(uint32) override;
+	uint32 GetTicksUntilNextEvent() override;
 	uint64 GetCurrentTime() const;
 	uint64 MilliSecToClock(uint32);
 	uint64 MicroSecToClock(uint32);
@@ -272,6 +274,9 @@ public:
 	void WaitCdSync();
 	void ReleaseWaitCdSync();
 
+	int32 WaitIoCompletion();
+	void ReleaseWaitIoCompletion(uint32, uint32);
+
 	int32 RegisterIntrHandler(uint32, uint32, uint32, uint32);
 	int32 ReleaseIntrHandler(uint32);
 
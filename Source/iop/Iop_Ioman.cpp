@@ -1,6 +1,7 @@
 #include <cstring>
 #include <stdexcept>
 #include <cctype>
+#include <chrono>
 
 #include "StdStream.h"
 #include "xml/Utils.h"
@@ -120,6 +121,16 @@ CIoman::CIoman(CIopBios& bios, uint8* ram)
 
 CIoman::~CIoman()
 {
+	DiscardAsyncReads();
+	if(m_ioWorkerThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> workerLock(m_ioWorkerMutex);
+			m_ioWorkerThreadDone = true;
+		}
+		m_ioWorkerCondition.notify_all();
+		m_ioWorkerThread.join();
+	}
 	m_files.clear();
 	m_devices.clear();
 }
@@ -276,7 +287,10 @@ uint32 CIoman::Read(uint32 handle, uint32 size, void* buffer)
 		}
 		else
 		{
+			auto readStart = std::chrono::steady_clock::now();
 			result = static_cast<uint32>(stream->Read(buffer, size));
+			auto readTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - readStart).count();
+			CountRead(GetDeviceName(m_files[handle].path), result, readTime, false);
 		}
 	}
 	catch(const std::exception& except)
@@ -824,6 +838,11 @@ int32 CIoman::ReadVirtual(CMIPS& context)
 	}
 	else
 	{
+		if(BeginAsyncRead(handle, bufferPtr, count))
+		{
+			//Thread will be woken up with the result once the read completes
+			return 0;
+		}
 		return Read(handle, count, m_ram + bufferPtr);
 	}
 }
@@ -911,6 +930,7 @@ int32 CIoman::AllocateFileHandle()
 
 void CIoman::FreeFileHandle(uint32 handle)
 {
+	WaitAsyncRead(handle);
 	assert(m_files.find(handle) != std::end(m_files));
 	m_files.erase(handle);
 }
@@ -927,6 +947,7 @@ uint32 CIoman::GetFileMode(uint32 handle) const
 
 Framework::CStream* CIoman::GetFileStream(uint32 handle)
 {
+	WaitAsyncRead(handle);
 	auto file(m_files.find(handle));
 	if(file == std::end(m_files))
 	{
@@ -937,11 +958,210 @@ Framework::CStream* CIoman::GetFileStream(uint32 handle)
 
 void CIoman::SetFileStream(uint32 handle, Framework::CStream* stream)
 {
+	WaitAsyncRead(handle);
 	m_files.erase(handle);
 	m_files[handle] = {stream};
 }
 
 //IOP Invoke
+std::string CIoman::GetDeviceName(const std::string& path)
+{
+	auto position = path.find(':');
+	if(position == std::string::npos)
+	{
+		return std::string();
+	}
+	return path.substr(0, position);
+}
+
+bool CIoman::IsAsyncReadSupported(int32 handle, uint32 size) const
+{
+	if(size < ASYNC_READ_MIN_SIZE) return false;
+	auto fileIterator = m_files.find(handle);
+	if(fileIterator == std::end(m_files)) return false;
+	if(!fileIterator->second.stream) return false;
+	auto deviceIterator = m_devices.find(GetDeviceName(fileIterator->second.path));
+	if(deviceIterator == std::end(m_devices)) return false;
+	return deviceIterator->second->IsAsyncReadSupported();
+}
+
+//Hands a read over to the I/O worker and puts the calling thread to sleep until it completes.
+//Returns false if the read needs to be done synchronously.
+bool CIoman::BeginAsyncRead(int32 handle, uint32 bufferPtr, uint32 size)
+{
+	if(!IsAsyncReadSupported(handle, size)) return false;
+
+	//Reads on a file are done in order
+	WaitAsyncRead(handle);
+
+	int32 threadId = m_bios.WaitIoCompletion();
+	if(threadId < 0) return false;
+
+	CLog::GetInstance().Print(LOG_NAME, "BeginAsyncRead(handle = %d, size = 0x%X, thread = %d);\r\n", handle, size, threadId);
+
+	const auto& file = m_files[handle];
+	auto request = std::make_shared<ASYNC_READ>();
+	request->handle = handle;
+	request->threadId = threadId;
+	request->bufferPtr = bufferPtr;
+	request->size = size;
+	request->stream = file.stream;
+	request->deviceName = GetDeviceName(file.path);
+	m_asyncReadHandles.insert(handle);
+	m_asyncReadThreads[threadId] = request;
+
+	{
+		std::lock_guard<std::mutex> workerLock(m_ioWorkerMutex);
+		if(!m_ioWorkerThread.joinable())
+		{
+			m_ioWorkerThread = std::thread([this]() { IoWorkerThreadProc(); });
+		}
+		m_ioWorkerRequests.push_back(std::move(request));
+	}
+	m_ioWorkerCondition.notify_one();
+	return true;
+}
+
+void CIoman::WaitAsyncRead(int32 handle)
+{
+	if(m_asyncReadHandles.find(handle) == std::end(m_asyncReadHandles)) return;
+	CompleteAsyncReads();
+}
+
+//Copies the data of reads finished by the worker and wakes up their threads
+void CIoman::ProcessAsyncReads()
+{
+	if(m_asyncReadHandles.empty()) return;
+	if(!m_hasCompletedReads) return;
+
+	AsyncReadQueue completedReads;
+	{
+		std::lock_guard<std::mutex> workerLock(m_ioWorkerMutex);
+		std::swap(completedReads, m_completedReads);
+		m_hasCompletedReads = false;
+	}
+
+	for(const auto& request : completedReads)
+	{
+		auto handleIterator = m_asyncReadHandles.find(request->handle);
+		assert(handleIterator != std::end(m_asyncReadHandles));
+		m_asyncReadHandles.erase(handleIterator);
+		//Thread doesn't expect the data anymore and its buffer might have been reused
+		if(request->cancelled) continue;
+		if(request->result != ~0U)
+		{
+			assert(request->result <= request->size);
+			memcpy(m_ram + request->bufferPtr, request->buffer.data(), request->result);
+			CountRead(request->deviceName, request->result, request->readTime, true);
+		}
+		m_asyncReadThreads.erase(request->threadId);
+		m_bios.ReleaseWaitIoCompletion(request->threadId, request->result);
+	}
+}
+
+void CIoman::CancelAsyncRead(uint32 threadId)
+{
+	auto threadIterator = m_asyncReadThreads.find(threadId);
+	if(threadIterator == std::end(m_asyncReadThreads)) return;
+	CLog::GetInstance().Print(LOG_NAME, "CancelAsyncRead(handle = %d, thread = %d);\r\n", threadIterator->second->handle, threadId);
+	threadIterator->second->cancelled = true;
+	m_asyncReadThreads.erase(threadIterator);
+}
+
+//Waits for all reads in flight and completes them
+void CIoman::CompleteAsyncReads()
+{
+	if(m_asyncReadHandles.empty()) return;
+	{
+		std::unique_lock<std::mutex> workerLock(m_ioWorkerMutex);
+		m_ioWorkerIdleCondition.wait(workerLock, [this]() { return m_ioWorkerRequests.empty(); });
+	}
+	ProcessAsyncReads();
+	assert(m_asyncReadHandles.empty());
+}
+
+//Waits for all reads in flight and drops their results without waking up their threads
+void CIoman::DiscardAsyncReads()
+{
+	if(m_asyncReadHandles.empty()) return;
+	{
+		std::unique_lock<std::mutex> workerLock(m_ioWorkerMutex);
+		m_ioWorkerIdleCondition.wait(workerLock, [this]() { return m_ioWorkerRequests.empty(); });
+		m_completedReads.clear();
+		m_hasCompletedReads = false;
+	}
+	m_asyncReadHandles.clear();
+	m_asyncReadThreads.clear();
+}
+
+uint32 CIoman::GetTicksUntilNextEvent() const
+{
+	//Completion can't be predicted, check on it regularly while reads are in flight
+	return m_asyncReadHandles.empty() ? ~0U : ASYNC_READ_POLL_TICKS;
+}
+
+void CIoman::IoWorkerThreadProc()
+{
+	while(1)
+	{
+		AsyncReadPtr request;
+		{
+			std::unique_lock<std::mutex> workerLock(m_ioWorkerMutex);
+			m_ioWorkerCondition.wait(workerLock, [this]() { return m_ioWorkerThreadDone || !m_ioWorkerRequests.empty(); });
+			if(m_ioWorkerRequests.empty()) break;
+			request = m_ioWorkerRequests.front();
+		}
+
+		auto readStart = std::chrono::steady_clock::now();
+		try
+		{
+			if(request->stream->IsEOF())
+			{
+				request->result = 0;
+			}
+			else
+			{
+				request->buffer.resize(request->size);
+				request->result = static_cast<uint32>(request->stream->Read(request->buffer.data(), request->size));
+			}
+		}
+		catch(const std::exception& except)
+		{
+			CLog::GetInstance().Warn(LOG_NAME, "%s: Error occured while trying to read file : %s\r\n", __FUNCTION__, except.what());
+			request->result = ~0U;
+		}
+		request->readTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - readStart).count();
+
+		{
+			std::lock_guard<std::mutex> workerLock(m_ioWorkerMutex);
+			m_ioWorkerRequests.pop_front();
+			m_completedReads.push_back(std::move(request));
+			m_hasCompletedReads = true;
+		}
+		m_ioWorkerIdleCondition.notify_all();
+	}
+}
+
+void CIoman::CountRead(const std::string& deviceName, uint32 size, uint64 readTime, bool async)
+{
+	auto& stats = m_deviceStats[deviceName];
+	stats.readCount++;
+	if(async) stats.asyncReadCount++;
+	stats.readBytes += size;
+	stats.readTime += readTime;
+	stats.maxReadTime = std::max(stats.maxReadTime, readTime);
+}
+
+const CIoman::DeviceStatsMap& CIoman::GetDeviceStats() const
+{
+	return m_deviceStats;
+}
+
+void CIoman::ResetDeviceStats()
+{
+	m_deviceStats.clear();
+}
+
 void CIoman::Invoke(CMIPS& context, unsigned int functionId)
 {
 	switch(functionId)
@@ -1035,6 +1255,9 @@ void CIoman::SaveUserDevicesState(Framework::CZipArchiveWriter& archive) const
 
 void CIoman::LoadFilesState(Framework::CZipArchiveReader& archive)
 {
+	//Threads waiting on these reads are replaced by the loaded state
+	DiscardAsyncReads();
+
 	std::experimental::erase_if(m_files,
 	                            [](const FileMapType::value_type& filePair) {
 		                            return (filePair.first != FID_STDOUT) && (filePair.first != FID_STDERR);
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
 #include "Iop_Module.h"
 #include "Ioman_Defs.h"
 #include "Ioman_Device.h"
@@ -35,6 +42,17 @@ namespace Iop
 
 		typedef std::shared_ptr<Ioman::CDevice> DevicePtr;
 
+		struct DEVICESTATS
+		{
+			uint32 readCount = 0;
+			uint32 asyncReadCount = 0;
+			uint64 readBytes = 0;
+			//Time spent in host reads, in microseconds
+			uint64 readTime = 0;
+			uint64 maxReadTime = 0;
+		};
+		typedef std::map<std::string, DEVICESTATS> DeviceStatsMap;
+
 		CIoman(CIopBios&, uint8*);
 		virtual ~CIoman();
 
@@ -78,7 +96,43 @@ namespace Iop
 		Framework::CStream* GetFileStream(uint32);
 		void SetFileStream(uint32, Framework::CStream*);
 
+		//Asynchronous reads are issued by ReadVirtual and run on the I/O worker thread,
+		//these are called on the IOP thread to complete them
+		void ProcessAsyncReads();
+		void CompleteAsyncReads();
+		//Called when a thread stops waiting before its read completed, results are dropped
+		void CancelAsyncRead(uint32);
+		uint32 GetTicksUntilNextEvent() const;
+
+		const DeviceStatsMap& GetDeviceStats() const;
+		void ResetDeviceStats();
+
 	private:
+		enum
+		{
+			//Reads smaller than this are done synchronously
+			ASYNC_READ_MIN_SIZE = 0x10000,
+			//How often completion is checked while the IOP is idle and reads are pending
+			ASYNC_READ_POLL_TICKS = 0x1000,
+		};
+
+		struct ASYNC_READ
+		{
+			int32 handle = 0;
+			uint32 threadId = 0;
+			uint32 bufferPtr = 0;
+			uint32 size = 0;
+			Framework::CStream* stream = nullptr;
+			std::string deviceName;
+			std::vector<uint8> buffer;
+			uint32 result = 0;
+			uint64 readTime = 0;
+			//Only accessed on the IOP thread
+			bool cancelled = false;
+		};
+		typedef std::shared_ptr<ASYNC_READ> AsyncReadPtr;
+		typedef std::deque<AsyncReadPtr> AsyncReadQueue;
+
 		struct FileInfo
 		{
 			FileInfo() = default;
@@ -143,6 +197,14 @@ namespace Iop
 		int32 PreOpen(uint32, const char*);
 
 		static Framework::STREAM_SEEK_DIRECTION ConvertWhence(uint32);
+		static std::string GetDeviceName(const std::string&);
+
+		bool IsAsyncReadSupported(int32, uint32) const;
+		bool BeginAsyncRead(int32, uint32, uint32);
+		void WaitAsyncRead(int32);
+		void DiscardAsyncReads();
+		void IoWorkerThreadProc();
+		void CountRead(const std::string&, uint32, uint64, bool);
 
 		void InvokeUserDeviceMethod(CMIPS&, uint32, size_t offset, uint32 arg0 = 0, uint32 arg1 = 0, uint32 arg2 = 0);
 
@@ -163,6 +225,20 @@ namespace Iop
 		uint8* m_ram;
 		uint32 m_nextFileHandle;
 		uint32 m_openThunkPtr = 0;
+
+		DeviceStatsMap m_deviceStats;
+
+		//Handles with a read in flight, only accessed on the IOP thread
+		std::multiset<int32> m_asyncReadHandles;
+		std::map<uint32, AsyncReadPtr> m_asyncReadThreads;
+		AsyncReadQueue m_ioWorkerRequests;
+		AsyncReadQueue m_completedReads;
+		std::atomic<bool> m_hasCompletedReads = false;
+		std::mutex m_ioWorkerMutex;
+		std::condition_variable m_ioWorkerCondition;
+		std::condition_variable m_ioWorkerIdleCondition;
+		bool m_ioWorkerThreadDone = false;
+		std::thread m_ioWorkerThread;
 	};
 
 	typedef std::shared_ptr<CIoman> IomanPtr;
@@ -0,0 +1,623 @@
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include "Iop_McCardCache.h"
+#include "Iop_McDirectoryStorage.h"
+#include "Iop_McImageStorage.h"
+#include "../Log.h"
+
+using namespace Iop;
+
+#define LOG_NAME ("iop_mccardcache")
+
+bool CMcCardCache::NAME_LESS::operator()(const std::string& lhs, const std::string& rhs) const
+{
+#ifdef _WIN32
+	//Host file system is case insensitive
+	return _stricmp(lhs.c_str(), rhs.c_str()) < 0;
+#else
+	return lhs < rhs;
+#endif
+}
+
+CMcCardCache::~CMcCardCache()
+{
+	{
+		std::lock_guard<std::mutex> journalLock(m_journalMutex);
+		m_journalThreadDone = true;
+	}
+	m_journalCondition.notify_all();
+	if(m_journalThread.joinable())
+	{
+		m_journalThread.join();
+	}
+}
+
+const fs::path& CMcCardCache::GetBasePath() const
+{
+	return m_basePath;
+}
+
+void CMcCardCache::SetBasePath(const fs::path& basePath)
+{
+	auto normalBasePath = fs::absolute(basePath).lexically_normal();
+	if(normalBasePath == m_basePath) return;
+	Invalidate();
+	//Failures on the previous card don't concern the new one
+	TakeJournalError();
+	m_basePath = normalBasePath;
+	std::error_code ec;
+	if(fs::is_regular_file(m_basePath, ec))
+	{
+		m_storage = std::make_unique<CMcImageStorage>(m_basePath);
+	}
+	else
+	{
+		m_storage = std::make_unique<CMcDirectoryStorage>(m_basePath);
+	}
+}
+
+//Drops the model, it will be rebuilt from the host's contents on next access
+void CMcCardCache::Invalidate()
+{
+	Flush();
+	if(m_root)
+	{
+		DetachFileData(*m_root);
+		m_root.reset();
+	}
+}
+
+//Waits until all pending modifications are applied on the host
+void CMcCardCache::Flush()
+{
+	std::unique_lock<std::mutex> journalLock(m_journalMutex);
+	m_journalCondition.wait(journalLock, [this]() { return m_journal.empty() && !m_journalBusy; });
+}
+
+//Returns true if applying a modification on the host failed since the last call
+bool CMcCardCache::TakeJournalError()
+{
+	std::lock_guard<std::mutex> journalLock(m_journalMutex);
+	bool journalError = m_journalError;
+	m_journalError = false;
+	return journalError;
+}
+
+const CMcCardCache::NODE* CMcCardCache::FindNode(const fs::path& path)
+{
+	PathComponentArray components;
+	if(!GetPathComponents(path, components)) return nullptr;
+	return FindNode(components, components.size());
+}
+
+CMcCardCache::RESULT CMcCardCache::OpenFile(const fs::path& path, bool create, bool truncate, std::unique_ptr<CFileStream>& file)
+{
+	PathComponentArray components;
+	if(!GetPathComponents(path, components)) return RESULT_NO_ENTRY;
+	auto node = FindNode(components, components.size());
+	if(!node)
+	{
+		if(!create || components.empty()) return RESULT_NO_ENTRY;
+		auto parentNode = FindNode(components, components.size() - 1);
+		if(!parentNode || !parentNode->isDirectory) return RESULT_NO_ENTRY;
+		if(!IsValidName(components.back())) return RESULT_INVALID_NAME;
+		if(!ReserveClusters(GetNewEntryClusterCount(*parentNode))) return RESULT_FULL;
+		node = CreateChildNode(*parentNode, components.back(), false);
+		UpdateEntryCount(*parentNode);
+		truncate = true;
+	}
+	if(node->isDirectory) return RESULT_FAILED;
+	if(truncate)
+	{
+		ReleaseClusters(GetNodeClusterCount(*node));
+		if(!node->fileData)
+		{
+			node->fileData = std::make_shared<FILE_DATA>();
+			node->fileData->node = node;
+		}
+		node->fileData->contents = std::make_shared<std::vector<uint8>>();
+		node->fileData->dirty = false;
+		node->fileData->contentsShared = false;
+		node->size = 0;
+		node->modificationTime = std::time(nullptr);
+		EnqueueWrite(*node);
+	}
+	else if(!LoadFileData(*node))
+	{
+		return RESULT_FAILED;
+	}
+	file = std::make_unique<CFileStream>(*this, node->fileData);
+	return RESULT_OK;
+}
+
+CMcCardCache::RESULT CMcCardCache::MakeDirectory(const fs::path& path)
+{
+	PathComponentArray components;
+	if(!GetPathComponents(path, components)) return RESULT_NO_ENTRY;
+	if(auto node = FindNode(components, components.size()))
+	{
+		return node->isDirectory ? RESULT_OK : RESULT_FAILED;
+	}
+	if(components.empty()) return RESULT_NO_ENTRY;
+	auto parentNode = FindNode(components, components.size() - 1);
+	if(!parentNode || !parentNode->isDirectory) return RESULT_NO_ENTRY;
+	if(!IsValidName(components.back())) return RESULT_INVALID_NAME;
+	//Directory's own cluster holds the '.' and '..' entries
+	if(!ReserveClusters(GetNewEntryClusterCount(*parentNode) + 1)) return RESULT_FULL;
+	auto node = CreateChildNode(*parentNode, components.back(), true);
+	node->entryCount = 2;
+	UpdateEntryCount(*parentNode);
+
+	JOURNAL_ENTRY entry;
+	entry.op = JOURNAL_OP_MAKE_DIRECTORY;
+	entry.path = GetNodePath(*node);
+	EnqueueJournalEntry(std::move(entry));
+	return RESULT_OK;
+}
+
+CMcCardCache::RESULT CMcCardCache::Remove(const fs::path& path)
+{
+	PathComponentArray components;
+	if(!GetPathComponents(path, components)) return RESULT_NO_ENTRY;
+	auto node = FindNode(components, components.size());
+	if(!node) return RESULT_NO_ENTRY;
+	if(!node->parent) return RESULT_FAILED;
+	if(!node->children.empty()) return RESULT_NOT_EMPTY;
+
+	JOURNAL_ENTRY entry;
+	entry.op = JOURNAL_OP_REMOVE;
+	entry.path = GetNodePath(*node);
+
+	auto name = node->name;
+	auto parentNode = node->parent;
+	ReleaseClusters(GetNodeClusterCount(*node));
+	DetachFileData(*node);
+	parentNode->children.erase(name);
+
+	EnqueueJournalEntry(std::move(entry));
+	return RESULT_OK;
+}
+
+CMcCardCache::RESULT CMcCardCache::Rename(const fs::path& srcPath, const fs::path& dstPath)
+{
+	PathComponentArray srcComponents;
+	PathComponentArray dstComponents;
+	if(!GetPathComponents(srcPath, srcComponents)) return RESULT_NO_ENTRY;
+	if(!GetPathComponents(dstPath, dstComponents)) return RESULT_NO_ENTRY;
+
+	auto srcNode = FindNode(srcComponents, srcComponents.size());
+	if(!srcNode) return RESULT_NO_ENTRY;
+	if(!srcNode->parent || dstComponents.empty()) return RESULT_FAILED;
+	auto dstParentNode = FindNode(dstComponents, dstComponents.size() - 1);
+	if(!dstParentNode || !dstParentNode->isDirectory) return RESULT_NO_ENTRY;
+
+	const auto& dstName = dstComponents.back();
+	if(!IsValidName(dstName)) return RESULT_INVALID_NAME;
+	auto dstNodeIterator = dstParentNode->children.find(dstName);
+	bool replacing = (dstNodeIterator != std::end(dstParentNode->children));
+	if(replacing)
+	{
+		auto dstNode = dstNodeIterator->second.get();
+		if(dstNode == srcNode) return RESULT_OK;
+		//Only allow replacing a file by another file
+		if(srcNode->isDirectory || dstNode->isDirectory) return RESULT_FAILED;
+	}
+
+	//Can't move a directory inside itself
+	for(auto ancestorNode = dstParentNode; ancestorNode; ancestorNode = ancestorNode->parent)
+	{
+		if(ancestorNode == srcNode) return RESULT_FAILED;
+	}
+
+	//Moving to another directory needs a new entry there, unless it takes the replaced file's
+	if((dstParentNode != srcNode->parent) && !replacing)
+	{
+		if(!ReserveClusters(GetNewEntryClusterCount(*dstParentNode))) return RESULT_FULL;
+	}
+
+	JOURNAL_ENTRY entry;
+	entry.op = JOURNAL_OP_RENAME;
+	entry.path = GetNodePath(*srcNode);
+
+	if(replacing)
+	{
+		ReleaseClusters(GetNodeClusterCount(*dstNodeIterator->second));
+		DetachFileData(*dstNodeIterator->second);
+		dstParentNode->children.erase(dstNodeIterator);
+	}
+
+	auto srcNodeIterator = srcNode->parent->children.find(srcNode->name);
+	assert(srcNodeIterator != std::end(srcNode->parent->children));
+	auto movedNode = std::move(srcNodeIterator->second);
+	srcNode->parent->children.erase(srcNodeIterator);
+	movedNode->parent = dstParentNode;
+	movedNode->name = dstName;
+	dstParentNode->children.emplace(dstName, std::move(movedNode));
+	UpdateEntryCount(*dstParentNode);
+
+	entry.newPath = GetNodePath(*srcNode);
+	EnqueueJournalEntry(std::move(entry));
+	return RESULT_OK;
+}
+
+bool CMcCardCache::BuildModel()
+{
+	if(m_root) return true;
+	if(!m_storage) return false;
+	try
+	{
+		if(!m_storage->Mount()) return false;
+		m_capacity = m_storage->GetCapacity();
+		m_root = std::make_unique<NODE>();
+		m_root->isDirectory = true;
+		m_root->entryCount = m_capacity.rootEntryCount;
+		IndexDirectory(*m_root);
+		return true;
+	}
+	catch(const std::exception& exception)
+	{
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to index '%s': %s.\r\n", m_basePath.string().c_str(), exception.what());
+		m_root.reset();
+		return false;
+	}
+}
+
+void CMcCardCache::IndexDirectory(NODE& directoryNode)
+{
+	for(const auto& entry : m_storage->ReadDirectory(GetNodePath(directoryNode)))
+	{
+		auto node = CreateChildNode(directoryNode, entry.name, entry.isDirectory);
+		node->size = entry.size;
+		node->modificationTime = entry.modificationTime;
+		node->entryCount = entry.entryCount;
+		if(node->isDirectory)
+		{
+			IndexDirectory(*node);
+		}
+	}
+}
+
+//Makes sure streams opened on files of a subtree don't refer to its nodes anymore
+void CMcCardCache::DetachFileData(NODE& node)
+{
+	if(node.fileData)
+	{
+		node.fileData->node = nullptr;
+	}
+	for(auto& childPair : node.children)
+	{
+		DetachFileData(*childPair.second);
+	}
+}
+
+//Splits a host path in components relative to the card's base path
+bool CMcCardCache::GetPathComponents(const fs::path& path, PathComponentArray& components) const
+{
+	auto relativePath = fs::absolute(path).lexically_normal().lexically_relative(m_basePath);
+	if(relativePath.empty()) return false;
+	for(const auto& element : relativePath)
+	{
+		auto elementString = element.string();
+		if(elementString.empty() || (elementString == ".")) continue;
+		if(elementString == "..") return false;
+		components.push_back(std::move(elementString));
+	}
+	return true;
+}
+
+CMcCardCache::NODE* CMcCardCache::FindNode(const PathComponentArray& components, size_t depth)
+{
+	assert(depth <= components.size());
+	if(!BuildModel()) return nullptr;
+	auto node = m_root.get();
+	for(size_t i = 0; i < depth; i++)
+	{
+		auto childIterator = node->children.find(components[i]);
+		if(childIterator == std::end(node->children)) return nullptr;
+		node = childIterator->second.get();
+	}
+	return node;
+}
+
+CMcCardCache::NODE* CMcCardCache::CreateChildNode(NODE& parentNode, const std::string& name, bool isDirectory)
+{
+	auto node = std::make_unique<NODE>();
+	node->parent = &parentNode;
+	node->name = name;
+	node->isDirectory = isDirectory;
+	node->modificationTime = std::time(nullptr);
+	auto result = node.get();
+	parentNode.children[name] = std::move(node);
+	return result;
+}
+
+std::string CMcCardCache::GetNodePath(const NODE& node) const
+{
+	if(!node.parent) return std::string();
+	if(!node.parent->parent) return node.name;
+	return GetNodePath(*node.parent) + "/" + node.name;
+}
+
+bool CMcCardCache::IsValidName(const std::string& name)
+{
+	return !name.empty() && (name.size() < MAX_NAME_SIZE);
+}
+
+uint32 CMcCardCache::GetFileClusterCount(uint32 size) const
+{
+	if(m_capacity.clusterSize == 0) return 0;
+	return (size + m_capacity.clusterSize - 1) / m_capacity.clusterSize;
+}
+
+uint32 CMcCardCache::GetNodeClusterCount(const NODE& node) const
+{
+	if(m_capacity.clusterSize == 0) return 0;
+	if(!node.isDirectory) return GetFileClusterCount(node.size);
+	return (node.entryCount + m_capacity.entriesPerCluster - 1) / m_capacity.entriesPerCluster;
+}
+
+//Returns the number of clusters a directory needs to grow by to hold a new entry
+uint32 CMcCardCache::GetNewEntryClusterCount(const NODE& directoryNode) const
+{
+	if(m_capacity.clusterSize == 0) return 0;
+	//Slots of deleted entries are reused, the first two are used by '.' and '..'
+	if((directoryNode.children.size() + 2) < directoryNode.entryCount) return 0;
+	return ((directoryNode.entryCount % m_capacity.entriesPerCluster) == 0) ? 1 : 0;
+}
+
+void CMcCardCache::UpdateEntryCount(NODE& directoryNode)
+{
+	directoryNode.entryCount = std::max<uint32>(directoryNode.entryCount, directoryNode.children.size() + 2);
+}
+
+bool CMcCardCache::ReserveClusters(uint32 clusterCount)
+{
+	if(m_capacity.clusterSize == 0) return true;
+	if(clusterCount > m_capacity.freeClusterCount) return false;
+	m_capacity.freeClusterCount -= clusterCount;
+	return true;
+}
+
+void CMcCardCache::ReleaseClusters(uint32 clusterCount)
+{
+	m_capacity.freeClusterCount += clusterCount;
+}
+
+bool CMcCardCache::LoadFileData(NODE& node)
+{
+	assert(!node.isDirectory);
+	if(node.fileData) return true;
+
+	//Storage needs to be in sync with the model before we read from it
+	Flush();
+
+	try
+	{
+		auto contents = std::make_shared<std::vector<uint8>>(m_storage->ReadFile(GetNodePath(node)));
+		node.size = static_cast<uint32>(contents->size());
+		node.fileData = std::make_shared<FILE_DATA>();
+		node.fileData->node = &node;
+		node.fileData->contents = std::move(contents);
+		return true;
+	}
+	catch(const std::exception& exception)
+	{
+		CLog::GetInstance().Warn(LOG_NAME, "Failed to load '%s': %s.\r\n", GetNodePath(node).c_str(), exception.what());
+		return false;
+	}
+}
+
+void CMcCardCache::CommitFileData(FILE_DATA& file)
+{
+	if(!file.dirty) return;
+	file.dirty = false;
+	if(!file.node) return;
+	EnqueueWrite(*file.node);
+}
+
+void CMcCardCache::EnqueueJournalEntry(JOURNAL_ENTRY entry)
+{
+	{
+		std::lock_guard<std::mutex> journalLock(m_journalMutex);
+		m_journal.push_back(std::move(entry));
+		if(!m_journalThread.joinable())
+		{
+			m_journalThread = std::thread([this]() { JournalThreadProc(); });
+		}
+	}
+	m_journalCondition.notify_all();
+}
+
+void CMcCardCache::EnqueueWrite(NODE& node)
+{
+	assert(node.fileData);
+	node.fileData->contentsShared = true;
+	auto path = GetNodePath(node);
+	{
+		//Coalesce with the previous write to the same file if it wasn't started yet
+		std::lock_guard<std::mutex> journalLock(m_journalMutex);
+		if(!m_journal.empty())
+		{
+			auto& lastEntry = m_journal.back();
+			if((lastEntry.op == JOURNAL_OP_WRITE) && (lastEntry.path == path))
+			{
+				lastEntry.contents = node.fileData->contents;
+				return;
+			}
+		}
+	}
+	JOURNAL_ENTRY entry;
+	entry.op = JOURNAL_OP_WRITE;
+	entry.path = std::move(path);
+	entry.contents = node.fileData->contents;
+	EnqueueJournalEntry(std::move(entry));
+}
+
+void CMcCardCache::JournalThreadProc()
+{
+	while(1)
+	{
+		JOURNAL_ENTRY entry;
+		{
+			std::unique_lock<std::mutex> journalLock(m_journalMutex);
+			m_journalCondition.wait(journalLock, [this]() { return !m_journal.empty() || m_journalThreadDone; });
+			//Pending entries are always applied before exiting
+			if(m_journal.empty()) break;
+			entry = std::move(m_journal.front());
+			m_journal.pop_front();
+			m_journalBusy = true;
+		}
+		bool failed = false;
+		try
+		{
+			ApplyJournalEntry(entry);
+		}
+		catch(const std::exception& exception)
+		{
+			CLog::GetInstance().Warn(LOG_NAME, "Failed to update '%s': %s.\r\n", entry.path.c_str(), exception.what());
+			failed = true;
+		}
+		bool journalEmpty = false;
+		{
+			std::lock_guard<std::mutex> journalLock(m_journalMutex);
+			journalEmpty = m_journal.empty();
+		}
+		if(journalEmpty)
+		{
+			//Let the storage write out what it has batched
+			try
+			{
+				m_storage->Flush();
+			}
+			catch(const std::exception& exception)
+			{
+				CLog::GetInstance().Warn(LOG_NAME, "Failed to flush '%s': %s.\r\n", m_basePath.string().c_str(), exception.what());
+				failed = true;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> journalLock(m_journalMutex);
+			m_journalBusy = false;
+			m_journalError |= failed;
+		}
+		m_journalCondition.notify_all();
+	}
+}
+
+void CMcCardCache::ApplyJournalEntry(const JOURNAL_ENTRY& entry)
+{
+	switch(entry.op)
+	{
+	case JOURNAL_OP_WRITE:
+		m_storage->WriteFile(entry.path, *entry.contents);
+		break;
+	case JOURNAL_OP_MAKE_DIRECTORY:
+		m_storage->MakeDirectory(entry.path);
+		break;
+	case JOURNAL_OP_REMOVE:
+		m_storage->Remove(entry.path);
+		break;
+	case JOURNAL_OP_RENAME:
+		m_storage->Rename(entry.path, entry.newPath);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+/////////////////////////////////////////////
+//CFileStream Implementation
+/////////////////////////////////////////////
+
+CMcCardCache::CFileStream::CFileStream(CMcCardCache& cache, std::shared_ptr<FILE_DATA> file)
+    : m_cache(cache)
+    , m_file(std::move(file))
+{
+}
+
+CMcCardCache::CFileStream::~CFileStream()
+{
+	Commit();
+}
+
+void CMcCardCache::CFileStream::Seek(int64 offset, Framework::STREAM_SEEK_DIRECTION origin)
+{
+	int64 base = 0;
+	switch(origin)
+	{
+	case Framework::STREAM_SEEK_SET:
+		base = 0;
+		break;
+	case Framework::STREAM_SEEK_CUR:
+		base = m_position;
+		break;
+	case Framework::STREAM_SEEK_END:
+		base = m_file->contents->size();
+		break;
+	}
+	m_position = std::max<int64>(base + offset, 0);
+}
+
+uint64 CMcCardCache::CFileStream::Tell()
+{
+	return m_position;
+}
+
+uint64 CMcCardCache::CFileStream::Read(void* buffer, uint64 size)
+{
+	const auto& contents = *m_file->contents;
+	if(m_position >= contents.size()) return 0;
+	auto readSize = std::min<uint64>(size, contents.size() - m_position);
+	memcpy(buffer, contents.data() + m_position, readSize);
+	m_position += readSize;
+	return readSize;
+}
+
+uint64 CMcCardCache::CFileStream::Write(const void* buffer, uint64 size)
+{
+	if(size == 0) return 0;
+	//Contents of detached files are never written back
+	auto node = m_file->node;
+	if(node && ((m_position + size) > m_file->contents->size()))
+	{
+		uint32 prevClusterCount = m_cache.GetFileClusterCount(static_cast<uint32>(m_file->contents->size()));
+		uint32 clusterCount = m_cache.GetFileClusterCount(static_cast<uint32>(m_position + size));
+		if(!m_cache.ReserveClusters(clusterCount - prevClusterCount)) return 0;
+	}
+	if(m_file->contentsShared)
+	{
+		m_file->contents = std::make_shared<std::vector<uint8>>(*m_file->contents);
+		m_file->contentsShared = false;
+	}
+	auto& contents = *m_file->contents;
+	if((m_position + size) > contents.size())
+	{
+		contents.resize(m_position + size);
+	}
+	memcpy(contents.data() + m_position, buffer, size);
+	m_position += size;
+	m_file->dirty = true;
+	if(node)
+	{
+		node->size = static_cast<uint32>(contents.size());
+		node->modificationTime = std::time(nullptr);
+	}
+	return size;
+}
+
+bool CMcCardCache::CFileStream::IsEOF()
+{
+	return m_position >= m_file->contents->size();
+}
+
+void CMcCardCache::CFileStream::Commit()
+{
+	m_cache.CommitFileData(*m_file);
+}
+
+CMcCardCache& CMcCardCache::CFileStream::GetCardCache() const
+{
+	return m_cache;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ctime>
+#include "filesystem_def.h"
+#include "Stream.h"
+#include "Iop_McCardStorage.h"
+
+namespace Iop
+{
+	//In-memory model of a memory card.
+	//
+	//The directory tree is indexed once when the card is first accessed and file contents
+	//are loaded when files are opened. After that, lookups, directory listings, reads and
+	//writes don't touch the storage. Modifications are recorded in a journal that a worker
+	//thread replays in order on the storage. Since the guest was already told that those
+	//succeeded, failures on the host are kept until they are reported by a later call.
+	//Names and, if the storage has a limited capacity, free space are checked against the
+	//model beforehand, so that the journal doesn't fail on those.
+	//
+	//The card is a directory tree on the host, unless the base path refers to a memory
+	//card image file.
+	class CMcCardCache
+	{
+	public:
+		struct FILE_DATA;
+
+		struct NAME_LESS
+		{
+			bool operator()(const std::string&, const std::string&) const;
+		};
+
+		struct NODE
+		{
+			typedef std::map<std::string, std::unique_ptr<NODE>, NAME_LESS> ChildMap;
+
+			NODE* parent = nullptr;
+			std::string name;
+			bool isDirectory = false;
+			uint32 size = 0;
+			time_t modificationTime = 0;
+			//Slots used by the directory on the storage, including deleted entries
+			uint32 entryCount = 0;
+			ChildMap children;
+			//Contents of the file, null until the file is opened
+			std::shared_ptr<FILE_DATA> fileData;
+		};
+
+		struct FILE_DATA
+		{
+			//Null if the file was deleted while opened
+			NODE* node = nullptr;
+			std::shared_ptr<std::vector<uint8>> contents;
+			bool dirty = false;
+			//Contents were handed to the journal and need to be copied before being modified
+			bool contentsShared = false;
+		};
+
+		class CFileStream : public Framework::CStream
+		{
+		public:
+			CFileStream(CMcCardCache&, std::shared_ptr<FILE_DATA>);
+			virtual ~CFileStream();
+
+			void Seek(int64, Framework::STREAM_SEEK_DIRECTION) override;
+			uint64 Tell() override;
+			uint64 Read(void*, uint64) override;
+			uint64 Write(const void*, uint64) override;
+			bool IsEOF() override;
+
+			//Schedules the write of modified contents to the host
+			void Commit();
+
+			CMcCardCache& GetCardCache() const;
+
+		private:
+			CMcCardCache& m_cache;
+			std::shared_ptr<FILE_DATA> m_file;
+			uint64 m_position = 0;
+		};
+
+		enum RESULT
+		{
+			RESULT_OK,
+			RESULT_NO_ENTRY,
+			RESULT_NOT_EMPTY,
+			RESULT_FULL,
+			RESULT_INVALID_NAME,
+			RESULT_FAILED,
+		};
+
+		enum
+		{
+			MAX_NAME_SIZE = 0x20,
+		};
+
+		CMcCardCache() = default;
+		CMcCardCache(const CMcCardCache&) = delete;
+		virtual ~CMcCardCache();
+
+		CMcCardCache& operator=(const CMcCardCache&) = delete;
+
+		const fs::path& GetBasePath() const;
+		void SetBasePath(const fs::path&);
+
+		void Invalidate();
+		void Flush();
+		bool TakeJournalError();
+
+		const NODE* FindNode(const fs::path&);
+
+		RESULT OpenFile(const fs::path&, bool, bool, std::unique_ptr<CFileStream>&);
+		RESULT MakeDirectory(const fs::path&);
+		RESULT Remove(const fs::path&);
+		RESULT Rename(const fs::path&, const fs::path&);
+
+	private:
+		enum JOURNAL_OP
+		{
+			JOURNAL_OP_WRITE,
+			JOURNAL_OP_MAKE_DIRECTORY,
+			JOURNAL_OP_REMOVE,
+			JOURNAL_OP_RENAME,
+		};
+
+		struct JOURNAL_ENTRY
+		{
+			JOURNAL_OP op = JOURNAL_OP_WRITE;
+			std::string path;
+			std::string newPath;
+			std::shared_ptr<const std::vector<uint8>> contents;
+		};
+
+		typedef std::vector<std::string> PathComponentArray;
+
+		bool BuildModel();
+		void IndexDirectory(NODE&);
+		void DetachFileData(NODE&);
+
+		bool GetPathComponents(const fs::path&, PathComponentArray&) const;
+		NODE* FindNode(const PathComponentArray&, size_t);
+		NODE* CreateChildNode(NODE&, const std::string&, bool);
+		std::string GetNodePath(const NODE&) const;
+
+		static bool IsValidName(const std::string&);
+		uint32 GetFileClusterCount(uint32) const;
+		uint32 GetNodeClusterCount(const NODE&) const;
+		uint32 GetNewEntryClusterCount(const NODE&) const;
+		void UpdateEntryCount(NODE&);
+		bool ReserveClusters(uint32);
+		void ReleaseClusters(uint32);
+
+		bool LoadFileData(NODE&);
+		void CommitFileData(FILE_DATA&);
+
+		void EnqueueJournalEntry(JOURNAL_ENTRY);
+		void EnqueueWrite(NODE&);
+		void JournalThreadProc();
+		void ApplyJournalEntry(const JOURNAL_ENTRY&);
+
+		fs::path m_basePath;
+		std::unique_ptr<CMcCardStorage> m_storage;
+		std::unique_ptr<NODE> m_root;
+		//Free clusters are tracked by the model, they might not be free on the storage yet
+		CMcCardStorage::CAPACITY m_capacity;
+
+		std::deque<JOURNAL_ENTRY> m_journal;
+		std::mutex m_journalMutex;
+		std::condition_variable m_journalCondition;
+		bool m_journalBusy = false;
+		bool m_journalError = false;
+		bool m_journalThreadDone = false;
+		std::thread m_journalThread;
+	};
+}
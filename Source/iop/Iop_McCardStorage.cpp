@@ -0,0 +1,25 @@
+#include <stdexcept>
+#include "Iop_McCardStorage.h"
+#include "StdStream.h"
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace Iop;
+
+void CMcCardStorage::SyncStream(Framework::CStdStream& stream)
+{
+	stream.Flush();
+	FILE* file = stream;
+#ifdef _WIN32
+	int result = _commit(_fileno(file));
+#else
+	int result = fsync(fileno(file));
+#endif
+	if(result != 0)
+	{
+		throw std::runtime_error("Failed to sync file.");
+	}
+}
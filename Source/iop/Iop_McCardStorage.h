@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ctime>
+#include "Types.h"
+
+namespace Framework
+{
+	class CStdStream;
+}
+
+namespace Iop
+{
+	//Backing store for the contents of a memory card.
+	//
+	//Paths are relative to the root of the card and use '/' as separator, an empty path
+	//refers to the root directory. Failures are reported by throwing exceptions.
+	class CMcCardStorage
+	{
+	public:
+		struct ENTRY
+		{
+			std::string name;
+			bool isDirectory = false;
+			uint32 size = 0;
+			time_t modificationTime = 0;
+			//Slots used by a directory, including deleted entries. Only set if the capacity is limited.
+			uint32 entryCount = 0;
+		};
+
+		//Describes how space is allocated on a storage with a limited capacity. Directories use
+		//a slot per entry, slots of deleted entries are reused before the directory grows.
+		struct CAPACITY
+		{
+			//Zero if the capacity isn't limited
+			uint32 clusterSize = 0;
+			uint32 entriesPerCluster = 0;
+			uint32 freeClusterCount = 0;
+			uint32 rootEntryCount = 0;
+		};
+
+		typedef std::vector<ENTRY> EntryArray;
+		typedef std::vector<uint8> ByteArray;
+
+		virtual ~CMcCardStorage() = default;
+
+		//Returns false if the card is not available
+		virtual bool Mount() = 0;
+
+		//Only valid once the storage is mounted
+		virtual CAPACITY GetCapacity()
+		{
+			return CAPACITY();
+		}
+
+		virtual EntryArray ReadDirectory(const std::string&) = 0;
+		virtual ByteArray ReadFile(const std::string&) = 0;
+
+		virtual void WriteFile(const std::string&, const ByteArray&) = 0;
+		virtual void MakeDirectory(const std::string&) = 0;
+		virtual void Remove(const std::string&) = 0;
+		virtual void Rename(const std::string&, const std::string&) = 0;
+
+		//Called once all pending modifications were handed to the storage
+		virtual void Flush()
+		{
+		}
+
+	protected:
+		//Makes sure data written to the stream reached the host's storage device
+		static void SyncStream(Framework::CStdStream&);
+	};
+}
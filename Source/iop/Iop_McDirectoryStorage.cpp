@@ -0,0 +1,109 @@
+#include <cstring>
+#include "Iop_McDirectoryStorage.h"
+#include "StdStreamUtils.h"
+#include "FilesystemUtils.h"
+#include "../Log.h"
+
+using namespace Iop;
+
+#define LOG_NAME ("iop_mcdirectorystorage")
+
+//Appended to the name of files while they are being written on the host
+#define TEMP_FILE_SUFFIX "~mcwrite"
+
+CMcDirectoryStorage::CMcDirectoryStorage(const fs::path& basePath)
+    : m_basePath(basePath)
+{
+}
+
+bool CMcDirectoryStorage::Mount()
+{
+	std::error_code ec;
+	return fs::is_directory(m_basePath, ec);
+}
+
+CMcCardStorage::EntryArray CMcDirectoryStorage::ReadDirectory(const std::string& path)
+{
+	static const size_t tempFileSuffixLength = strlen(TEMP_FILE_SUFFIX);
+	EntryArray entries;
+	std::error_code ec;
+	for(auto elementIterator = fs::directory_iterator(GetHostPath(path), ec);
+	    !ec && (elementIterator != fs::directory_iterator()); elementIterator.increment(ec))
+	{
+		const auto& elementPath = elementIterator->path();
+		auto name = elementPath.filename().string();
+		if(
+		    (name.size() > tempFileSuffixLength) &&
+		    (name.compare(name.size() - tempFileSuffixLength, tempFileSuffixLength, TEMP_FILE_SUFFIX) == 0))
+		{
+			//Left over by an interrupted write, original file is still intact
+			CLog::GetInstance().Warn(LOG_NAME, "Removing incomplete file '%s'.\r\n", elementPath.string().c_str());
+			std::error_code removeEc;
+			fs::remove(elementPath, removeEc);
+			continue;
+		}
+		try
+		{
+			ENTRY entry;
+			entry.name = std::move(name);
+			entry.isDirectory = fs::is_directory(elementPath);
+			entry.size = entry.isDirectory ? 0 : static_cast<uint32>(fs::file_size(elementPath));
+			entry.modificationTime = Framework::ConvertFsTimeToSystemTime(fs::last_write_time(elementPath));
+			entries.push_back(std::move(entry));
+		}
+		catch(const std::exception& exception)
+		{
+			CLog::GetInstance().Warn(LOG_NAME, "Failed to read '%s': %s.\r\n", elementPath.string().c_str(), exception.what());
+		}
+	}
+	return entries;
+}
+
+CMcCardStorage::ByteArray CMcDirectoryStorage::ReadFile(const std::string& path)
+{
+	auto hostPath = GetHostPath(path);
+	auto stream = Framework::CreateInputStdStream(hostPath.native());
+	ByteArray contents(static_cast<size_t>(fs::file_size(hostPath)));
+	if(!contents.empty())
+	{
+		auto amountRead = stream.Read(contents.data(), contents.size());
+		contents.resize(amountRead);
+	}
+	return contents;
+}
+
+void CMcDirectoryStorage::WriteFile(const std::string& path, const ByteArray& contents)
+{
+	auto hostPath = GetHostPath(path);
+	auto tempPath = hostPath;
+	tempPath += TEMP_FILE_SUFFIX;
+	{
+		auto stream = Framework::CreateOutputStdStream(tempPath.native());
+		if(!contents.empty())
+		{
+			stream.Write(contents.data(), contents.size());
+		}
+		SyncStream(stream);
+	}
+	fs::rename(tempPath, hostPath);
+}
+
+void CMcDirectoryStorage::MakeDirectory(const std::string& path)
+{
+	fs::create_directory(GetHostPath(path));
+}
+
+void CMcDirectoryStorage::Remove(const std::string& path)
+{
+	fs::remove(GetHostPath(path));
+}
+
+void CMcDirectoryStorage::Rename(const std::string& srcPath, const std::string& dstPath)
+{
+	fs::rename(GetHostPath(srcPath), GetHostPath(dstPath));
+}
+
+fs::path CMcDirectoryStorage::GetHostPath(const std::string& path) const
+{
+	return path.empty() ? m_basePath : (m_basePath / path);
+}
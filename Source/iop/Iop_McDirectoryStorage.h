@@ -0,0 +1,34 @@
+#pragma once
+
+#include "filesystem_def.h"
+#include "Iop_McCardStorage.h"
+
+namespace Iop
+{
+	//Memory card stored as a directory tree on the host.
+	//
+	//File contents are written to a temporary file which is synced to the host's storage
+	//device and then renamed over the original, so a crash in the middle of a write leaves
+	//either the previous or the new version of the file intact.
+	class CMcDirectoryStorage : public CMcCardStorage
+	{
+	public:
+		CMcDirectoryStorage(const fs::path&);
+		virtual ~CMcDirectoryStorage() = default;
+
+		bool Mount() override;
+
+		EntryArray ReadDirectory(const std::string&) override;
+		ByteArray ReadFile(const std::string&) override;
+
+		void WriteFile(const std::string&, const ByteArray&) override;
+		void MakeDirectory(const std::string&) override;
+		void Remove(const std::string&) override;
+		void Rename(const std::string&, const std::string&) override;
+
+	private:
+		fs::path GetHostPath(const std::string&) const;
+
+		fs::path m_basePath;
+	};
+}
@@ -0,0 +1,882 @@
+#include <cassert>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include "Iop_McImageStorage.h"
+#include "StdStreamUtils.h"
+#include "../Log.h"
+
+using namespace Iop;
+
+#define LOG_NAME ("iop_mcimagestorage")
+
+#define SUPERBLOCK_MAGIC "Sony PS2 Memory Card Format "
+
+//Times on the card are in Japan Standard Time
+#define CARD_TIME_OFFSET (9 * 60 * 60)
+
+#define FILE_MODE (DF_READ | DF_WRITE | DF_EXECUTE | DF_FILE | DF_CLOSED | DF_0400 | DF_EXISTS)
+#define DIRECTORY_MODE (DF_READ | DF_WRITE | DF_EXECUTE | DF_DIRECTORY | DF_0400 | DF_EXISTS)
+
+namespace
+{
+	struct ECC_TABLES
+	{
+		ECC_TABLES()
+		{
+			static const uint8 columnMasks[7] = {0x55, 0x33, 0x0F, 0x00, 0xAA, 0xCC, 0xF0};
+			for(uint32 value = 0; value < 0x100; value++)
+			{
+				parity[value] = GetParity(value);
+				uint8 columnParity = 0;
+				for(uint32 i = 0; i < 7; i++)
+				{
+					columnParity |= GetParity(value & columnMasks[i]) << i;
+				}
+				columnParities[value] = columnParity;
+			}
+		}
+
+		static uint8 GetParity(uint32 value)
+		{
+			value ^= value >> 4;
+			value ^= value >> 2;
+			value ^= value >> 1;
+			return value & 1;
+		}
+
+		std::array<uint8, 0x100> parity;
+		std::array<uint8, 0x100> columnParities;
+	};
+
+	int64 GetDaysFromCivil(int64 year, uint32 month, uint32 day)
+	{
+		year -= (month <= 2) ? 1 : 0;
+		int64 era = ((year >= 0) ? year : (year - 399)) / 400;
+		uint32 yearOfEra = static_cast<uint32>(year - era * 400);
+		uint32 dayOfYear = (153 * ((month > 2) ? (month - 3) : (month + 9)) + 2) / 5 + day - 1;
+		uint32 dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+		return era * 146097 + static_cast<int64>(dayOfEra) - 719468;
+	}
+
+	void GetCivilFromDays(int64 days, int64& year, uint32& month, uint32& day)
+	{
+		days += 719468;
+		int64 era = ((days >= 0) ? days : (days - 146096)) / 146097;
+		uint32 dayOfEra = static_cast<uint32>(days - era * 146097);
+		uint32 yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+		uint32 dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+		uint32 monthIndex = (5 * dayOfYear + 2) / 153;
+		day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+		month = (monthIndex < 10) ? (monthIndex + 3) : (monthIndex - 9);
+		year = static_cast<int64>(yearOfEra) + era * 400 + ((month <= 2) ? 1 : 0);
+	}
+}
+
+CMcImageStorage::CMcImageStorage(const fs::path& path)
+    : m_path(path)
+{
+}
+
+bool CMcImageStorage::Mount()
+{
+	m_stream.reset();
+	m_clusters.clear();
+	m_fat.clear();
+	m_fatClusters.clear();
+	m_chains.clear();
+	m_badClusters.clear();
+	m_pendingFreeClusters.clear();
+	m_allocHint = 0;
+	m_eccErrorCount = 0;
+
+	m_stream = std::make_unique<Framework::CStdStream>(Framework::CreateUpdateExistingStdStream(m_path.native()));
+
+	m_stream->Seek(0, Framework::STREAM_SEEK_SET);
+	if(m_stream->Read(&m_superblock, sizeof(SUPERBLOCK)) != sizeof(SUPERBLOCK))
+	{
+		throw std::runtime_error("Failed to read superblock.");
+	}
+	if(memcmp(m_superblock.magic, SUPERBLOCK_MAGIC, sizeof(m_superblock.magic)) != 0)
+	{
+		throw std::runtime_error("Image is not a formatted memory card.");
+	}
+
+	const auto& sb = m_superblock;
+	m_clusterSize = sb.pageSize * sb.pagesPerCluster;
+	if(
+	    (sb.pageSize == 0) || ((sb.pageSize % ECC_CHUNK_SIZE) != 0) ||
+	    (m_clusterSize < (2 * DIRENTRY_SIZE)) ||
+	    (static_cast<uint64>(sb.allocOffset) + sb.allocEnd > sb.clusterCount))
+	{
+		throw std::runtime_error("Unsupported memory card geometry.");
+	}
+
+	uint64 pageCount = static_cast<uint64>(sb.clusterCount) * sb.pagesPerCluster;
+	uint32 spareSize = sb.pageSize / 32;
+	auto imageSize = fs::file_size(m_path);
+	if(imageSize == (pageCount * sb.pageSize))
+	{
+		m_rawPageSize = sb.pageSize;
+	}
+	else if(imageSize == (pageCount * (sb.pageSize + spareSize)))
+	{
+		m_rawPageSize = sb.pageSize + spareSize;
+	}
+	else
+	{
+		throw std::runtime_error("Image size doesn't match memory card geometry.");
+	}
+	m_entriesPerCluster = m_clusterSize / DIRENTRY_SIZE;
+
+	LoadFat();
+	LoadBadBlocks();
+
+	CLog::GetInstance().Print(LOG_NAME, "Mounted '%s' (clusters = %d, ecc = %d).\r\n",
+	                          m_path.string().c_str(), sb.clusterCount, (m_rawPageSize != sb.pageSize));
+	return true;
+}
+
+CMcCardStorage::CAPACITY CMcImageStorage::GetCapacity()
+{
+	CAPACITY capacity;
+	capacity.clusterSize = m_clusterSize;
+	capacity.entriesPerCluster = m_entriesPerCluster;
+	//Clusters waiting for a flush will be available by the time they're needed
+	capacity.freeClusterCount = GetAvailableClusterCount(true);
+	capacity.rootEntryCount = GetDirEntry(GetRootLocation()).length;
+	return capacity;
+}
+
+CMcCardStorage::EntryArray CMcImageStorage::ReadDirectory(const std::string& path)
+{
+	auto location = FindEntry(path);
+	const auto& dirEntry = GetDirEntry(location);
+	if(!(dirEntry.mode & DF_DIRECTORY))
+	{
+		throw std::runtime_error("Not a directory.");
+	}
+
+	EntryArray entries;
+	uint32 dirCluster = IsRoot(location) ? m_superblock.rootDirCluster : dirEntry.cluster;
+	uint32 entryCount = dirEntry.length;
+	for(uint32 i = 0; i < entryCount; i++)
+	{
+		DIRENTRY_LOCATION childLocation;
+		childLocation.dirCluster = dirCluster;
+		childLocation.index = i;
+		const auto& childEntry = GetDirEntry(childLocation);
+		if(!(childEntry.mode & DF_EXISTS)) continue;
+
+		ENTRY entry;
+		entry.name = std::string(childEntry.name, strnlen(childEntry.name, sizeof(childEntry.name)));
+		if((entry.name == ".") || (entry.name == "..")) continue;
+		entry.isDirectory = (childEntry.mode & DF_DIRECTORY) != 0;
+		entry.size = entry.isDirectory ? 0 : childEntry.length;
+		entry.entryCount = entry.isDirectory ? childEntry.length : 0;
+		entry.modificationTime = ConvertTime(childEntry.modificationTime);
+		entries.push_back(std::move(entry));
+	}
+	return entries;
+}
+
+CMcCardStorage::ByteArray CMcImageStorage::ReadFile(const std::string& path)
+{
+	const auto& entry = GetDirEntry(FindEntry(path));
+	if(!(entry.mode & DF_FILE))
+	{
+		throw std::runtime_error("Not a file.");
+	}
+
+	ByteArray contents(entry.length);
+	if(contents.empty()) return contents;
+
+	auto chain = GetChain(entry.cluster);
+	if((static_cast<uint64>(chain.size()) * m_clusterSize) < contents.size())
+	{
+		throw std::runtime_error("File is larger than its cluster chain.");
+	}
+	for(uint32 i = 0; i < chain.size(); i++)
+	{
+		uint32 offset = i * m_clusterSize;
+		if(offset >= contents.size()) break;
+		uint32 copySize = std::min<uint32>(m_clusterSize, contents.size() - offset);
+		memcpy(contents.data() + offset, GetCluster(m_superblock.allocOffset + chain[i]), copySize);
+	}
+	return contents;
+}
+
+void CMcImageStorage::WriteFile(const std::string& path, const ByteArray& contents)
+{
+	DIRENTRY_LOCATION location;
+	if(!FindEntry(path, location))
+	{
+		std::string parentPath, name;
+		SplitPath(path, parentPath, name);
+		location = CreateEntry(FindEntry(parentPath), name, FILE_MODE);
+	}
+
+	const auto& entry = GetDirEntry(location);
+	if(!(entry.mode & DF_FILE))
+	{
+		throw std::runtime_error("Not a file.");
+	}
+
+	uint32 clusterCount = static_cast<uint32>((contents.size() + m_clusterSize - 1) / m_clusterSize);
+	uint32 prevFirstCluster = (entry.length != 0) ? entry.cluster : FAT_CHAIN_END;
+	uint32 firstCluster = FAT_CHAIN_END;
+	if((clusterCount != 0) && (GetAvailableClusterCount(false) >= clusterCount))
+	{
+		//Previous clusters are only released once the directory entry refers to the new ones
+		firstCluster = ResizeChain(FAT_CHAIN_END, clusterCount);
+		ResizeChain(prevFirstCluster, 0);
+	}
+	else
+	{
+		firstCluster = ResizeChain(prevFirstCluster, clusterCount);
+	}
+	if(clusterCount != 0)
+	{
+		auto chain = GetChain(firstCluster);
+		for(uint32 i = 0; i < chain.size(); i++)
+		{
+			uint32 offset = i * m_clusterSize;
+			uint32 copySize = std::min<uint32>(m_clusterSize, contents.size() - offset);
+			auto cluster = OverwriteCluster(m_superblock.allocOffset + chain[i], false);
+			memcpy(cluster, contents.data() + offset, copySize);
+		}
+	}
+
+	auto& modifiedEntry = ModifyDirEntry(location);
+	modifiedEntry.cluster = firstCluster;
+	modifiedEntry.length = static_cast<uint32>(contents.size());
+	modifiedEntry.modificationTime = ConvertTime(std::time(nullptr));
+}
+
+void CMcImageStorage::MakeDirectory(const std::string& path)
+{
+	std::string parentPath, name;
+	SplitPath(path, parentPath, name);
+	auto parentLocation = FindEntry(parentPath);
+	uint32 parentCluster = IsRoot(parentLocation) ? m_superblock.rootDirCluster : GetDirEntry(parentLocation).cluster;
+
+	auto location = CreateEntry(parentLocation, name, DIRECTORY_MODE);
+	uint32 cluster = AllocateCluster();
+	auto now = ConvertTime(std::time(nullptr));
+
+	auto dotEntries = reinterpret_cast<DIRENTRY*>(OverwriteCluster(m_superblock.allocOffset + cluster, true));
+	{
+		auto& dotEntry = dotEntries[0];
+		dotEntry.mode = DIRECTORY_MODE;
+		dotEntry.cluster = parentCluster;
+		dotEntry.dirEntry = location.index;
+		dotEntry.creationTime = dotEntry.modificationTime = now;
+		strcpy(dotEntry.name, ".");
+	}
+	{
+		auto& dotDotEntry = dotEntries[1];
+		dotDotEntry.mode = DIRECTORY_MODE;
+		dotDotEntry.creationTime = dotDotEntry.modificationTime = now;
+		strcpy(dotDotEntry.name, "..");
+	}
+
+	auto& entry = ModifyDirEntry(location);
+	entry.cluster = cluster;
+	entry.length = 2;
+}
+
+void CMcImageStorage::Remove(const std::string& path)
+{
+	auto location = FindEntry(path);
+	if(IsRoot(location))
+	{
+		throw std::runtime_error("Can't remove root directory.");
+	}
+	const auto& entry = GetDirEntry(location);
+	if(entry.mode & DF_DIRECTORY)
+	{
+		DIRENTRY_LOCATION childLocation;
+		childLocation.dirCluster = entry.cluster;
+		for(childLocation.index = 2; childLocation.index < entry.length; childLocation.index++)
+		{
+			if(GetDirEntry(childLocation).mode & DF_EXISTS)
+			{
+				throw std::runtime_error("Directory not empty.");
+			}
+		}
+	}
+	FreeEntry(location);
+}
+
+void CMcImageStorage::Rename(const std::string& srcPath, const std::string& dstPath)
+{
+	auto srcLocation = FindEntry(srcPath);
+	if(IsRoot(srcLocation))
+	{
+		throw std::runtime_error("Can't rename root directory.");
+	}
+
+	std::string dstParentPath, dstName;
+	SplitPath(dstPath, dstParentPath, dstName);
+	if(dstName.empty() || (dstName.size() >= sizeof(DIRENTRY::name)))
+	{
+		throw std::runtime_error("Invalid name.");
+	}
+	auto dstParentLocation = FindEntry(dstParentPath);
+
+	DIRENTRY_LOCATION existingLocation;
+	if(FindEntry(dstPath, existingLocation))
+	{
+		if((existingLocation.dirCluster == srcLocation.dirCluster) && (existingLocation.index == srcLocation.index)) return;
+		if((GetDirEntry(existingLocation).mode & DF_DIRECTORY) || (GetDirEntry(srcLocation).mode & DF_DIRECTORY))
+		{
+			throw std::runtime_error("Can only replace a file by another file.");
+		}
+		FreeEntry(existingLocation);
+	}
+
+	uint32 dstDirCluster = IsRoot(dstParentLocation) ? m_superblock.rootDirCluster : GetDirEntry(dstParentLocation).cluster;
+	if(srcLocation.dirCluster == dstDirCluster)
+	{
+		auto& entry = ModifyDirEntry(srcLocation);
+		memset(entry.name, 0, sizeof(entry.name));
+		strncpy(entry.name, dstName.c_str(), sizeof(entry.name) - 1);
+		return;
+	}
+
+	//Moving to another directory
+	auto srcEntry = GetDirEntry(srcLocation);
+	auto dstLocation = CreateEntry(dstParentLocation, dstName, srcEntry.mode);
+	{
+		auto& dstEntry = ModifyDirEntry(dstLocation);
+		memcpy(srcEntry.name, dstEntry.name, sizeof(srcEntry.name));
+		dstEntry = srcEntry;
+	}
+	ModifyDirEntry(srcLocation).mode &= ~DF_EXISTS;
+
+	if(srcEntry.mode & DF_DIRECTORY)
+	{
+		//Update link to parent
+		DIRENTRY_LOCATION dotLocation;
+		dotLocation.dirCluster = srcEntry.cluster;
+		dotLocation.index = 0;
+		auto& dotEntry = ModifyDirEntry(dotLocation);
+		dotEntry.cluster = dstDirCluster;
+		dotEntry.dirEntry = dstLocation.index;
+	}
+}
+
+void CMcImageStorage::Flush()
+{
+	if(!m_stream) return;
+
+	//Write data first and make sure it reached the disk before FAT and directories refer to it
+	for(uint32 pass = 0; pass < 2; pass++)
+	{
+		bool writeMetadata = (pass != 0);
+		ByteArray run;
+		uint32 runStart = 0;
+		uint32 runCount = 0;
+		for(auto& clusterPair : m_clusters)
+		{
+			auto& cluster = clusterPair.second;
+			if(!cluster.dirty || (cluster.isMetadata != writeMetadata)) continue;
+			if((runCount != 0) && (clusterPair.first != (runStart + runCount)))
+			{
+				WriteClusters(runStart, runCount, run.data());
+				run.clear();
+				runCount = 0;
+			}
+			if(runCount == 0)
+			{
+				runStart = clusterPair.first;
+			}
+			run.insert(std::end(run), std::begin(cluster.data), std::end(cluster.data));
+			runCount++;
+			cluster.dirty = false;
+		}
+		if(runCount != 0)
+		{
+			WriteClusters(runStart, runCount, run.data());
+		}
+		SyncStream(*m_stream);
+	}
+
+	m_pendingFreeClusters.clear();
+}
+
+void CMcImageStorage::ComputeEcc(const uint8* data, uint8* ecc)
+{
+	static const ECC_TABLES tables;
+	uint8 columnParity = 0x77;
+	uint8 lineParity0 = 0x7F;
+	uint8 lineParity1 = 0x7F;
+	for(uint32 i = 0; i < ECC_CHUNK_SIZE; i++)
+	{
+		uint8 value = data[i];
+		columnParity ^= tables.columnParities[value];
+		if(tables.parity[value])
+		{
+			lineParity0 ^= ~i;
+			lineParity1 ^= i;
+		}
+	}
+	ecc[0] = columnParity;
+	ecc[1] = lineParity0 & 0x7F;
+	ecc[2] = lineParity1;
+}
+
+time_t CMcImageStorage::ConvertTime(const TIME& cardTime)
+{
+	if((cardTime.month < 1) || (cardTime.month > 12)) return 0;
+	int64 days = GetDaysFromCivil(cardTime.year, cardTime.month, cardTime.day);
+	int64 seconds = (days * 24 * 60 * 60) + (cardTime.hour * 60 * 60) + (cardTime.minute * 60) + cardTime.second;
+	return static_cast<time_t>(seconds - CARD_TIME_OFFSET);
+}
+
+CMcImageStorage::TIME CMcImageStorage::ConvertTime(time_t hostTime)
+{
+	int64 seconds = static_cast<int64>(hostTime) + CARD_TIME_OFFSET;
+	int64 days = ((seconds >= 0) ? seconds : (seconds - 86399)) / 86400;
+	uint32 secondOfDay = static_cast<uint32>(seconds - (days * 86400));
+	int64 year = 0;
+	uint32 month = 0, day = 0;
+	GetCivilFromDays(days, year, month, day);
+
+	TIME cardTime = {};
+	cardTime.second = secondOfDay % 60;
+	cardTime.minute = (secondOfDay / 60) % 60;
+	cardTime.hour = secondOfDay / (60 * 60);
+	cardTime.day = day;
+	cardTime.month = month;
+	cardTime.year = static_cast<uint16>(year);
+	return cardTime;
+}
+
+void CMcImageStorage::SplitPath(const std::string& path, std::string& parentPath, std::string& name)
+{
+	auto separatorPosition = path.rfind('/');
+	if(separatorPosition == std::string::npos)
+	{
+		parentPath.clear();
+		name = path;
+	}
+	else
+	{
+		parentPath = path.substr(0, separatorPosition);
+		name = path.substr(separatorPosition + 1);
+	}
+}
+
+uint8* CMcImageStorage::GetCluster(uint32 clusterIndex)
+{
+	auto clusterIterator = m_clusters.find(clusterIndex);
+	if(clusterIterator != std::end(m_clusters))
+	{
+		return clusterIterator->second.data.data();
+	}
+	if(clusterIndex >= m_superblock.clusterCount)
+	{
+		throw std::runtime_error("Cluster index out of range.");
+	}
+	auto& cluster = m_clusters[clusterIndex];
+	cluster.data.resize(m_clusterSize);
+	ReadClusters(clusterIndex, 1, cluster.data.data());
+	return cluster.data.data();
+}
+
+uint8* CMcImageStorage::ModifyCluster(uint32 clusterIndex, bool isMetadata)
+{
+	auto data = GetCluster(clusterIndex);
+	auto& cluster = m_clusters[clusterIndex];
+	cluster.isMetadata = cluster.dirty ? (cluster.isMetadata || isMetadata) : isMetadata;
+	cluster.dirty = true;
+	return data;
+}
+
+//Returns a zeroed cluster without reading its previous contents from the image
+uint8* CMcImageStorage::OverwriteCluster(uint32 clusterIndex, bool isMetadata)
+{
+	if(clusterIndex >= m_superblock.clusterCount)
+	{
+		throw std::runtime_error("Cluster index out of range.");
+	}
+	auto& cluster = m_clusters[clusterIndex];
+	cluster.data.assign(m_clusterSize, 0);
+	cluster.isMetadata = cluster.dirty ? (cluster.isMetadata || isMetadata) : isMetadata;
+	cluster.dirty = true;
+	return cluster.data.data();
+}
+
+void CMcImageStorage::ReadClusters(uint32 firstCluster, uint32 clusterCount, uint8* clusters)
+{
+	uint32 pageSize = m_superblock.pageSize;
+	uint32 pageCount = clusterCount * m_superblock.pagesPerCluster;
+	m_stream->Seek(static_cast<uint64>(firstCluster) * m_superblock.pagesPerCluster * m_rawPageSize, Framework::STREAM_SEEK_SET);
+	if(m_rawPageSize == pageSize)
+	{
+		if(m_stream->Read(clusters, pageCount * pageSize) != (pageCount * pageSize))
+		{
+			throw std::runtime_error("Failed to read clusters.");
+		}
+		return;
+	}
+
+	ByteArray rawPages(pageCount * m_rawPageSize);
+	if(m_stream->Read(rawPages.data(), rawPages.size()) != rawPages.size())
+	{
+		throw std::runtime_error("Failed to read clusters.");
+	}
+
+	uint32 errorCount = 0;
+	for(uint32 page = 0; page < pageCount; page++)
+	{
+		const uint8* rawPage = rawPages.data() + (page * m_rawPageSize);
+		memcpy(clusters + (page * pageSize), rawPage, pageSize);
+
+		//Erased pages don't have valid ECC
+		bool erased = std::all_of(rawPage, rawPage + m_rawPageSize, [](uint8 value) { return value == 0xFF; });
+		if(erased) continue;
+
+		const uint8* pageEcc = rawPage + pageSize;
+		for(uint32 chunk = 0; chunk < (pageSize / ECC_CHUNK_SIZE); chunk++)
+		{
+			uint8 ecc[ECC_SIZE];
+			ComputeEcc(rawPage + (chunk * ECC_CHUNK_SIZE), ecc);
+			if(memcmp(ecc, pageEcc + (chunk * ECC_SIZE), ECC_SIZE) != 0)
+			{
+				errorCount++;
+			}
+		}
+	}
+	if(errorCount != 0)
+	{
+		m_eccErrorCount += errorCount;
+		CLog::GetInstance().Warn(LOG_NAME, "ECC mismatch in clusters 0x%08X-0x%08X (%d chunks).\r\n",
+		                         firstCluster, firstCluster + clusterCount - 1, errorCount);
+	}
+}
+
+void CMcImageStorage::WriteClusters(uint32 firstCluster, uint32 clusterCount, const uint8* clusters)
+{
+	uint32 pageSize = m_superblock.pageSize;
+	uint32 pageCount = clusterCount * m_superblock.pagesPerCluster;
+	m_stream->Seek(static_cast<uint64>(firstCluster) * m_superblock.pagesPerCluster * m_rawPageSize, Framework::STREAM_SEEK_SET);
+	if(m_rawPageSize == pageSize)
+	{
+		m_stream->Write(clusters, pageCount * pageSize);
+		return;
+	}
+
+	ByteArray rawPages(pageCount * m_rawPageSize, 0);
+	for(uint32 page = 0; page < pageCount; page++)
+	{
+		uint8* rawPage = rawPages.data() + (page * m_rawPageSize);
+		memcpy(rawPage, clusters + (page * pageSize), pageSize);
+		for(uint32 chunk = 0; chunk < (pageSize / ECC_CHUNK_SIZE); chunk++)
+		{
+			ComputeEcc(rawPage + (chunk * ECC_CHUNK_SIZE), rawPage + pageSize + (chunk * ECC_SIZE));
+		}
+	}
+	m_stream->Write(rawPages.data(), rawPages.size());
+}
+
+void CMcImageStorage::LoadFat()
+{
+	uint32 entriesPerCluster = m_clusterSize / sizeof(uint32);
+	uint32 entryCount = m_superblock.allocEnd;
+	uint32 fatClusterCount = (entryCount + entriesPerCluster - 1) / entriesPerCluster;
+	if(fatClusterCount > (IFC_LIST_SIZE * entriesPerCluster))
+	{
+		throw std::runtime_error("FAT is too large.");
+	}
+
+	m_fat.resize(entryCount);
+	m_fatClusters.resize(fatClusterCount);
+	for(uint32 i = 0; i < fatClusterCount; i++)
+	{
+		auto indirectFatCluster = reinterpret_cast<const uint32*>(GetCluster(m_superblock.ifcList[i / entriesPerCluster]));
+		uint32 fatCluster = indirectFatCluster[i % entriesPerCluster];
+		m_fatClusters[i] = fatCluster;
+		auto fat = reinterpret_cast<const uint32*>(GetCluster(fatCluster));
+		uint32 firstEntry = i * entriesPerCluster;
+		uint32 copyCount = std::min<uint32>(entriesPerCluster, entryCount - firstEntry);
+		memcpy(m_fat.data() + firstEntry, fat, copyCount * sizeof(uint32));
+	}
+}
+
+void CMcImageStorage::LoadBadBlocks()
+{
+	m_badClusters.assign(m_fat.size(), false);
+	uint32 clustersPerBlock = std::max<uint32>(m_superblock.pagesPerBlock / m_superblock.pagesPerCluster, 1);
+	uint32 blockCount = m_superblock.clusterCount / clustersPerBlock;
+	for(uint32 badBlock : m_superblock.badBlockList)
+	{
+		//Unused entries are set to ~0
+		if(badBlock >= blockCount) continue;
+		for(uint32 i = 0; i < clustersPerBlock; i++)
+		{
+			uint32 clusterIndex = (badBlock * clustersPerBlock) + i;
+			if(clusterIndex < m_superblock.allocOffset) continue;
+			clusterIndex -= m_superblock.allocOffset;
+			if(clusterIndex >= m_badClusters.size()) continue;
+			m_badClusters[clusterIndex] = true;
+		}
+	}
+}
+
+void CMcImageStorage::SetFatEntry(uint32 clusterIndex, uint32 value)
+{
+	assert(clusterIndex < m_fat.size());
+	uint32 entriesPerCluster = m_clusterSize / sizeof(uint32);
+	m_fat[clusterIndex] = value;
+	auto fat = reinterpret_cast<uint32*>(ModifyCluster(m_fatClusters[clusterIndex / entriesPerCluster], true));
+	fat[clusterIndex % entriesPerCluster] = value;
+	m_chains.clear();
+}
+
+CMcImageStorage::ClusterChain CMcImageStorage::GetChain(uint32 firstCluster)
+{
+	auto chainIterator = m_chains.find(firstCluster);
+	if(chainIterator != std::end(m_chains))
+	{
+		return chainIterator->second;
+	}
+
+	ClusterChain chain;
+	uint32 clusterIndex = firstCluster;
+	while(1)
+	{
+		if((clusterIndex >= m_fat.size()) || (chain.size() >= m_fat.size()))
+		{
+			throw std::runtime_error("Invalid cluster chain.");
+		}
+		chain.push_back(clusterIndex);
+		uint32 entry = m_fat[clusterIndex];
+		if(!(entry & FAT_ENTRY_ALLOCATED))
+		{
+			throw std::runtime_error("Cluster chain goes through a free cluster.");
+		}
+		if(entry == FAT_CHAIN_END) break;
+		clusterIndex = entry & ~FAT_ENTRY_ALLOCATED;
+	}
+	m_chains.emplace(firstCluster, chain);
+	return chain;
+}
+
+bool CMcImageStorage::IsClusterAvailable(uint32 clusterIndex, bool includePendingFree) const
+{
+	if(m_fat[clusterIndex] & FAT_ENTRY_ALLOCATED) return false;
+	if(m_badClusters[clusterIndex]) return false;
+	if(!includePendingFree && (m_pendingFreeClusters.find(clusterIndex) != std::end(m_pendingFreeClusters))) return false;
+	return true;
+}
+
+uint32 CMcImageStorage::GetAvailableClusterCount(bool includePendingFree) const
+{
+	uint32 availableCount = 0;
+	for(uint32 clusterIndex = 0; clusterIndex < m_fat.size(); clusterIndex++)
+	{
+		if(IsClusterAvailable(clusterIndex, includePendingFree)) availableCount++;
+	}
+	return availableCount;
+}
+
+uint32 CMcImageStorage::AllocateCluster()
+{
+	//Clusters freed since the last flush are only used as a last resort
+	uint32 clusterCount = static_cast<uint32>(m_fat.size());
+	for(uint32 pass = 0; pass < 2; pass++)
+	{
+		bool includePendingFree = (pass != 0);
+		for(uint32 i = 0; i < clusterCount; i++)
+		{
+			uint32 clusterIndex = (m_allocHint + i) % clusterCount;
+			if(!IsClusterAvailable(clusterIndex, includePendingFree)) continue;
+			SetFatEntry(clusterIndex, FAT_CHAIN_END);
+			m_pendingFreeClusters.erase(clusterIndex);
+			m_allocHint = clusterIndex + 1;
+			return clusterIndex;
+		}
+	}
+	throw std::runtime_error("Memory card is full.");
+}
+
+void CMcImageStorage::FreeCluster(uint32 clusterIndex)
+{
+	SetFatEntry(clusterIndex, FAT_ENTRY_FREE);
+	m_pendingFreeClusters.insert(clusterIndex);
+}
+
+//Returns the new first cluster of the chain, FAT_CHAIN_END if the chain is empty
+uint32 CMcImageStorage::ResizeChain(uint32 firstCluster, uint32 clusterCount)
+{
+	ClusterChain chain;
+	if(firstCluster != FAT_CHAIN_END)
+	{
+		chain = GetChain(firstCluster);
+	}
+	while(chain.size() > clusterCount)
+	{
+		FreeCluster(chain.back());
+		chain.pop_back();
+	}
+	if(!chain.empty())
+	{
+		SetFatEntry(chain.back(), FAT_CHAIN_END);
+	}
+	while(chain.size() < clusterCount)
+	{
+		uint32 clusterIndex = AllocateCluster();
+		if(!chain.empty())
+		{
+			SetFatEntry(chain.back(), clusterIndex | FAT_ENTRY_ALLOCATED);
+		}
+		chain.push_back(clusterIndex);
+	}
+	return chain.empty() ? FAT_CHAIN_END : chain[0];
+}
+
+//The '.' entry of the root directory describes the root directory itself
+CMcImageStorage::DIRENTRY_LOCATION CMcImageStorage::GetRootLocation() const
+{
+	DIRENTRY_LOCATION location;
+	location.dirCluster = m_superblock.rootDirCluster;
+	location.index = 0;
+	return location;
+}
+
+bool CMcImageStorage::IsRoot(const DIRENTRY_LOCATION& location) const
+{
+	return (location.dirCluster == m_superblock.rootDirCluster) && (location.index == 0);
+}
+
+const CMcImageStorage::DIRENTRY& CMcImageStorage::GetDirEntry(const DIRENTRY_LOCATION& location)
+{
+	auto chain = GetChain(location.dirCluster);
+	uint32 chainIndex = location.index / m_entriesPerCluster;
+	if(chainIndex >= chain.size())
+	{
+		throw std::runtime_error("Directory entry out of range.");
+	}
+	auto cluster = GetCluster(m_superblock.allocOffset + chain[chainIndex]);
+	return *reinterpret_cast<const DIRENTRY*>(cluster + (location.index % m_entriesPerCluster) * DIRENTRY_SIZE);
+}
+
+CMcImageStorage::DIRENTRY& CMcImageStorage::ModifyDirEntry(const DIRENTRY_LOCATION& location)
+{
+	auto chain = GetChain(location.dirCluster);
+	uint32 chainIndex = location.index / m_entriesPerCluster;
+	if(chainIndex >= chain.size())
+	{
+		throw std::runtime_error("Directory entry out of range.");
+	}
+	auto cluster = ModifyCluster(m_superblock.allocOffset + chain[chainIndex], true);
+	return *reinterpret_cast<DIRENTRY*>(cluster + (location.index % m_entriesPerCluster) * DIRENTRY_SIZE);
+}
+
+bool CMcImageStorage::FindEntry(const std::string& path, DIRENTRY_LOCATION& location)
+{
+	location = GetRootLocation();
+	size_t nameStart = 0;
+	while(nameStart < path.size())
+	{
+		auto nameEnd = path.find('/', nameStart);
+		if(nameEnd == std::string::npos) nameEnd = path.size();
+		auto name = path.substr(nameStart, nameEnd - nameStart);
+		nameStart = nameEnd + 1;
+		if(name.empty()) continue;
+		if(name.size() >= sizeof(DIRENTRY::name)) return false;
+
+		const auto& dirEntry = GetDirEntry(location);
+		if(!(dirEntry.mode & DF_DIRECTORY)) return false;
+
+		DIRENTRY_LOCATION childLocation;
+		childLocation.dirCluster = IsRoot(location) ? m_superblock.rootDirCluster : dirEntry.cluster;
+		uint32 entryCount = dirEntry.length;
+		bool found = false;
+		for(childLocation.index = 0; childLocation.index < entryCount; childLocation.index++)
+		{
+			const auto& childEntry = GetDirEntry(childLocation);
+			if(!(childEntry.mode & DF_EXISTS)) continue;
+			if(strncmp(childEntry.name, name.c_str(), sizeof(childEntry.name)) != 0) continue;
+			found = true;
+			break;
+		}
+		if(!found) return false;
+		location = childLocation;
+	}
+	return true;
+}
+
+CMcImageStorage::DIRENTRY_LOCATION CMcImageStorage::FindEntry(const std::string& path)
+{
+	DIRENTRY_LOCATION location;
+	if(!FindEntry(path, location))
+	{
+		throw std::runtime_error("Entry not found.");
+	}
+	return location;
+}
+
+CMcImageStorage::DIRENTRY_LOCATION CMcImageStorage::CreateEntry(const DIRENTRY_LOCATION& parentLocation, const std::string& name, uint16 mode)
+{
+	if(name.empty() || (name.size() >= sizeof(DIRENTRY::name)))
+	{
+		throw std::runtime_error("Invalid name.");
+	}
+
+	const auto& parentEntry = GetDirEntry(parentLocation);
+	if(!(parentEntry.mode & DF_DIRECTORY))
+	{
+		throw std::runtime_error("Not a directory.");
+	}
+
+	DIRENTRY_LOCATION location;
+	location.dirCluster = IsRoot(parentLocation) ? m_superblock.rootDirCluster : parentEntry.cluster;
+	uint32 entryCount = parentEntry.length;
+
+	//Reuse the slot of a deleted entry if possible
+	for(location.index = 2; location.index < entryCount; location.index++)
+	{
+		if(!(GetDirEntry(location).mode & DF_EXISTS)) break;
+	}
+
+	if(location.index == entryCount)
+	{
+		auto chain = GetChain(location.dirCluster);
+		if((entryCount / m_entriesPerCluster) >= chain.size())
+		{
+			uint32 clusterIndex = AllocateCluster();
+			SetFatEntry(chain.back(), clusterIndex | FAT_ENTRY_ALLOCATED);
+			OverwriteCluster(m_superblock.allocOffset + clusterIndex, true);
+		}
+		ModifyDirEntry(parentLocation).length = entryCount + 1;
+	}
+
+	auto now = ConvertTime(std::time(nullptr));
+	auto& entry = ModifyDirEntry(location);
+	memset(&entry, 0, sizeof(DIRENTRY));
+	entry.mode = mode;
+	entry.cluster = FAT_CHAIN_END;
+	entry.creationTime = now;
+	entry.modificationTime = now;
+	strncpy(entry.name, name.c_str(), sizeof(entry.name) - 1);
+	return location;
+}
+
+void CMcImageStorage::FreeEntry(const DIRENTRY_LOCATION& location)
+{
+	const auto& entry = GetDirEntry(location);
+	bool hasClusters = (entry.mode & DF_DIRECTORY) || (entry.length != 0);
+	if(hasClusters && (entry.cluster != FAT_CHAIN_END))
+	{
+		for(auto clusterIndex : GetChain(entry.cluster))
+		{
+			FreeCluster(clusterIndex);
+		}
+	}
+	ModifyDirEntry(location).mode &= ~DF_EXISTS;
+}
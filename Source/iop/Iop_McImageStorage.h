@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+#include "filesystem_def.h"
+#include "StdStream.h"
+#include "Iop_McCardStorage.h"
+
+namespace Iop
+{
+	//Memory card stored as a raw PS2 memory card image, with or without ECC data.
+	//
+	//Clusters are kept in memory once they have been read, and the whole FAT is loaded
+	//when the card is mounted. Modifications are applied to the cached clusters and are
+	//only written back to the image when the storage is flushed. Runs of contiguous clusters
+	//are written at once.
+	//
+	//File contents are written to newly allocated clusters when there is enough room for both
+	//versions, and clusters freed since the last flush aren't reused until it completes. Data
+	//clusters are written and synced before FAT and directory clusters, so a crash before the
+	//latter are written leaves files pointing to their previous contents. When the card is too
+	//full, contents are overwritten in place instead.
+	class CMcImageStorage : public CMcCardStorage
+	{
+	public:
+		CMcImageStorage(const fs::path&);
+		virtual ~CMcImageStorage() = default;
+
+		bool Mount() override;
+		CAPACITY GetCapacity() override;
+
+		EntryArray ReadDirectory(const std::string&) override;
+		ByteArray ReadFile(const std::string&) override;
+
+		void WriteFile(const std::string&, const ByteArray&) override;
+		void MakeDirectory(const std::string&) override;
+		void Remove(const std::string&) override;
+		void Rename(const std::string&, const std::string&) override;
+
+		void Flush() override;
+
+	private:
+		enum
+		{
+			ECC_CHUNK_SIZE = 0x80,
+			ECC_SIZE = 3,
+			IFC_LIST_SIZE = 32,
+			DIRENTRY_SIZE = 0x200,
+		};
+
+		enum : uint32
+		{
+			FAT_ENTRY_ALLOCATED = 0x80000000,
+			FAT_ENTRY_FREE = 0x7FFFFFFF,
+			FAT_CHAIN_END = 0xFFFFFFFF,
+		};
+
+		enum DIRENTRY_MODE
+		{
+			DF_READ = 0x0001,
+			DF_WRITE = 0x0002,
+			DF_EXECUTE = 0x0004,
+			DF_FILE = 0x0010,
+			DF_DIRECTORY = 0x0020,
+			DF_CLOSED = 0x0080,
+			DF_0400 = 0x0400,
+			DF_EXISTS = 0x8000,
+		};
+
+		struct SUPERBLOCK
+		{
+			char magic[28];
+			char version[12];
+			uint16 pageSize;
+			uint16 pagesPerCluster;
+			uint16 pagesPerBlock;
+			uint16 unused0;
+			uint32 clusterCount;
+			uint32 allocOffset;
+			uint32 allocEnd;
+			uint32 rootDirCluster;
+			uint32 backupBlock1;
+			uint32 backupBlock2;
+			uint32 unused1[2];
+			uint32 ifcList[IFC_LIST_SIZE];
+			uint32 badBlockList[32];
+			uint8 cardType;
+			uint8 cardFlags;
+		};
+		static_assert(offsetof(SUPERBLOCK, ifcList) == 0x50, "Invalid SUPERBLOCK layout.");
+
+		struct TIME
+		{
+			uint8 unused;
+			uint8 second;
+			uint8 minute;
+			uint8 hour;
+			uint8 day;
+			uint8 month;
+			uint16 year;
+		};
+		static_assert(sizeof(TIME) == 8, "Size of TIME structure must be 8 bytes.");
+
+		struct DIRENTRY
+		{
+			uint16 mode;
+			uint16 unused0;
+			uint32 length;
+			TIME creationTime;
+			uint32 cluster;
+			uint32 dirEntry;
+			TIME modificationTime;
+			uint32 attributes;
+			uint32 unused1[7];
+			char name[0x20];
+			uint8 unused2[0x1A0];
+		};
+		static_assert(sizeof(DIRENTRY) == DIRENTRY_SIZE, "Size of DIRENTRY structure must be 0x200 bytes.");
+
+		//Entry 'index' in the directory starting at cluster 'dirCluster'
+		struct DIRENTRY_LOCATION
+		{
+			uint32 dirCluster = 0;
+			uint32 index = 0;
+		};
+
+		struct CLUSTER
+		{
+			ByteArray data;
+			bool dirty = false;
+			bool isMetadata = false;
+		};
+
+		typedef std::vector<uint32> ClusterChain;
+
+		static void ComputeEcc(const uint8*, uint8*);
+		static time_t ConvertTime(const TIME&);
+		static TIME ConvertTime(time_t);
+		static void SplitPath(const std::string&, std::string&, std::string&);
+
+		uint8* GetCluster(uint32);
+		uint8* ModifyCluster(uint32, bool);
+		uint8* OverwriteCluster(uint32, bool);
+		void ReadClusters(uint32, uint32, uint8*);
+		void WriteClusters(uint32, uint32, const uint8*);
+
+		void LoadFat();
+		void LoadBadBlocks();
+		void SetFatEntry(uint32, uint32);
+		ClusterChain GetChain(uint32);
+		bool IsClusterAvailable(uint32, bool) const;
+		uint32 GetAvailableClusterCount(bool) const;
+		uint32 AllocateCluster();
+		void FreeCluster(uint32);
+		uint32 ResizeChain(uint32, uint32);
+
+		DIRENTRY_LOCATION GetRootLocation() const;
+		bool IsRoot(const DIRENTRY_LOCATION&) const;
+		const DIRENTRY& GetDirEntry(const DIRENTRY_LOCATION&);
+		DIRENTRY& ModifyDirEntry(const DIRENTRY_LOCATION&);
+		bool FindEntry(const std::string&, DIRENTRY_LOCATION&);
+		DIRENTRY_LOCATION FindEntry(const std::string&);
+		DIRENTRY_LOCATION CreateEntry(const DIRENTRY_LOCATION&, const std::string&, uint16);
+		void FreeEntry(const DIRENTRY_LOCATION&);
+
+		fs::path m_path;
+		std::unique_ptr<Framework::CStdStream> m_stream;
+
+		SUPERBLOCK m_superblock = {};
+		uint32 m_clusterSize = 0;
+		uint32 m_rawPageSize = 0;
+		uint32 m_entriesPerCluster = 0;
+		uint32 m_eccErrorCount = 0;
+
+		std::map<uint32, CLUSTER> m_clusters;
+		std::vector<uint32> m_fat;
+		std::vector<uint32> m_fatClusters;
+		std::map<uint32, ClusterChain> m_chains;
+		//Clusters in blocks listed as bad in the superblock, indexed like the FAT
+		std::vector<bool> m_badClusters;
+		//Clusters freed since the last flush, the image might still refer to them
+		std::set<uint32> m_pendingFreeClusters;
+		uint32 m_allocHint = 0;
+	};
+}
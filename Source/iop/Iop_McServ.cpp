@@ -12,10 +12,8 @@
 #include "Iop_SifCmd.h"
 #include "Iop_SifManPs2.h"
 #include "IopBios.h"
-#include "StdStreamUtils.h"
 #include "StringUtils.h"
 #include "MIPSAssembler.h"
-#include "FilesystemUtils.h"
 
 using namespace Iop;
 
@@ -97,6 +95,13 @@ void CMcServ::CountTicks(uint32 ticks, CSifMan* sifMan)
 	}
 }
 
+uint32 CMcServ::GetTicksUntilNextEvent() const
+{
+	auto moduleData = reinterpret_cast<const MODULEDATA*>(m_ram + m_moduleDataAddr);
+	if(moduleData->pendingCommand == CMD_ID_NONE) return ~0U;
+	return moduleData->pendingCommandDelay;
+}
+
 void CMcServ::Invoke(CMIPS& context, unsigned int functionId)
 {
 	switch(functionId)
@@ -144,7 +149,7 @@ bool CMcServ::Invoke(uint32 method, uint32* args, uint32 argsSize, uint32* ret,
 	case 0x74:
 		Write(args, argsSize, ret, retSize, ram);
 		break;
-	case 0x0A:
+	case CMD_ID_FLUSH:
 	case 0x7A:
 		Flush(args, argsSize, ret, retSize, ram);
 		break;
@@ -345,60 +350,53 @@ void CMcServ::Open(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize, u
 		return;
 	}
 
+	auto& cardCache = GetCardCache(cmd->port);
+
 	if(cmd->flags == 0x40)
 	{
 		//Directory only?
-		uint32 result = -1;
-		try
-		{
-			fs::create_directory(filePath);
-			result = 0;
-		}
-		catch(...)
+		switch(cardCache.MakeDirectory(filePath))
 		{
+		case CMcCardCache::RESULT_OK:
+			ret[0] = 0;
+			break;
+		case CMcCardCache::RESULT_FULL:
+			ret[0] = RET_FULL_DEVICE;
+			break;
+		default:
+			ret[0] = -1;
+			break;
 		}
-		ret[0] = result;
 		return;
 	}
 	else
 	{
-		if(cmd->flags & OPEN_FLAG_CREAT)
-		{
-			if(!fs::exists(filePath))
-			{
-				//Create file if it doesn't exist
-				Framework::CreateOutputStdStream(filePath.native());
-			}
-		}
-
-		if(cmd->flags & OPEN_FLAG_TRUNC)
+		uint32 handle = GenerateHandle();
+		if(handle == -1)
 		{
-			if(fs::exists(filePath))
-			{
-				//Create file (discard contents) if it exists
-				Framework::CreateOutputStdStream(filePath.native());
-			}
+			//Exhausted all file handles
+			ret[0] = RET_NO_ENTRY;
+			return;
 		}
 
-		//At this point, we assume that the file has been created or truncated
-		try
+		//File is created if it doesn't exist and OPEN_FLAG_CREAT is set
+		bool create = (cmd->flags & OPEN_FLAG_CREAT) != 0;
+		bool truncate = (cmd->flags & OPEN_FLAG_TRUNC) != 0;
+		std::unique_ptr<CMcCardCache::CFileStream> file;
+		auto result = cardCache.OpenFile(filePath, create, truncate, file);
+		if(result == CMcCardCache::RESULT_FULL)
 		{
-			auto file = Framework::CreateUpdateExistingStdStream(filePath.native());
-			uint32 handle = GenerateHandle();
-			if(handle == -1)
-			{
-				//Exhausted all file handles
-				throw std::exception();
-			}
-			m_files[handle] = std::move(file);
-			ret[0] = handle;
+			ret[0] = RET_FULL_DEVICE;
+			return;
 		}
-		catch(...)
+		if(result != CMcCardCache::RESULT_OK)
 		{
 			//Not existing file?
 			ret[0] = RET_NO_ENTRY;
 			return;
 		}
+		m_files[handle] = std::move(file);
+		ret[0] = handle;
 	}
 }
 
@@ -416,9 +414,12 @@ void CMcServ::Close(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize,
 		return;
 	}
 
-	file->Clear();
+	//Modified contents are written back to the card when the file is destroyed
+	auto& cardCache = file->GetCardCache();
+	m_files[cmd->handle].reset();
 
-	ret[0] = 0;
+	//Host writes are applied later, report failures of previous ones
+	ret[0] = cardCache.TakeJournalError() ? -1 : 0;
 }
 
 void CMcServ::Seek(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize, uint8* ram)
@@ -506,11 +507,18 @@ void CMcServ::Write(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize,
 	//Write "origin" bytes from "data" field first
 	if(cmd->origin != 0)
 	{
-		file->Write(cmd->data, cmd->origin);
-		result += cmd->origin;
+		result += static_cast<uint32>(file->Write(cmd->data, cmd->origin));
 	}
 
 	result += static_cast<uint32>(file->Write(dst, cmd->size));
+
+	//Writes only fall short if there's not enough space left on the card
+	if(result != (cmd->origin + cmd->size))
+	{
+		ret[0] = RET_FULL_DEVICE;
+		return;
+	}
+
 	ret[0] = result;
 }
 
@@ -528,9 +536,12 @@ void CMcServ::Flush(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize,
 		return;
 	}
 
-	file->Flush();
+	//Games expect their data to be on the card once this returns
+	file->Commit();
+	auto& cardCache = file->GetCardCache();
+	cardCache.Flush();
 
-	ret[0] = 0;
+	ret[0] = cardCache.TakeJournalError() ? -1 : 0;
 }
 
 void CMcServ::ChDir(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize, uint8* ram)
@@ -576,15 +587,12 @@ void CMcServ::ChDir(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize,
 			newCurrentDirectory = m_currentDirectory + SEPARATOR_CHAR + requestedDirectory;
 		}
 
-		auto mcPath = CAppConfig::GetInstance().GetPreferencePath(m_mcPathPreference[cmd->port]);
-		auto hostPath = Iop::PathUtils::MakeHostPath(mcPath, newCurrentDirectory.c_str());
+		auto& cardCache = GetCardCache(cmd->port);
+		auto hostPath = Iop::PathUtils::MakeHostPath(cardCache.GetBasePath(), newCurrentDirectory.c_str());
 
-		if(!Iop::PathUtils::IsInsideBasePath(mcPath, hostPath))
-		{
-			//Some games (EA games) will try to ChDir('..') from the MC's root
-			result = RET_NO_ENTRY;
-		}
-		else if(fs::exists(hostPath) && fs::is_directory(hostPath))
+		//Paths outside of the card (ex.: EA games will try to ChDir('..') from the MC's root) are not found
+		auto node = cardCache.FindNode(hostPath);
+		if(node && node->isDirectory)
 		{
 			m_currentDirectory = newCurrentDirectory;
 			result = 0;
@@ -627,14 +635,15 @@ void CMcServ::GetDir(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize,
 		{
 			m_pathFinder.Reset();
 
-			auto mcPath = CAppConfig::GetInstance().GetPreferencePath(m_mcPathPreference[cmd->port]);
+			auto& cardCache = GetCardCache(cmd->port);
+			auto mcPath = cardCache.GetBasePath();
 			if(cmd->name[0] != SEPARATOR_CHAR)
 			{
 				mcPath = Iop::PathUtils::MakeHostPath(mcPath, m_currentDirectory.c_str());
 			}
-			mcPath = fs::absolute(mcPath);
 
-			if(!fs::exists(mcPath))
+			auto baseNode = cardCache.FindNode(mcPath);
+			if(!baseNode)
 			{
 				//Directory doesn't exist
 				ret[0] = RET_NO_ENTRY;
@@ -643,15 +652,14 @@ void CMcServ::GetDir(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize,
 
 			auto searchPath = Iop::PathUtils::MakeHostPath(mcPath, cmd->name);
 			searchPath.remove_filename();
-			if(!fs::exists(searchPath))
+			if(!cardCache.FindNode(searchPath))
 			{
 				//Specified directory doesn't exist, this is an error
 				ret[0] = RET_NO_ENTRY;
 				return;
 			}
 
-			assert(*mcPath.string().rbegin() != '/');
-			m_pathFinder.Search(mcPath, cmd->name);
+			m_pathFinder.Search(*baseNode, cmd->name);
 		}
 
 		auto entries = (cmd->maxEntries > 0) ? reinterpret_cast<ENTRY*>(&ram[cmd->tableAddress]) : nullptr;
@@ -682,13 +690,10 @@ void CMcServ::SetFileInfo(uint32* args, uint32 argsSize, uint32* ret, uint32 ret
 
 		if(filePath1 != filePath2)
 		{
-			try
+			auto result = GetCardCache(cmd->port).Rename(filePath1, filePath2);
+			if(result != CMcCardCache::RESULT_OK)
 			{
-				fs::rename(filePath1, filePath2);
-			}
-			catch(...)
-			{
-				ret[0] = -1;
+				ret[0] = (result == CMcCardCache::RESULT_FULL) ? RET_FULL_DEVICE : -1;
 				return;
 			}
 		}
@@ -714,28 +719,21 @@ void CMcServ::Delete(uint32* args, uint32 argsSize, uint32* ret, uint32 retSize,
 	try
 	{
 		auto filePath = GetAbsoluteFilePath(cmd->port, cmd->slot, cmd->name);
-		if(fs::exists(filePath))
+		switch(GetCardCache(cmd->port).Remove(filePath))
 		{
-			fs::remove(filePath);
+		case CMcCardCache::RESULT_OK:
 			ret[0] = 0;
-		}
-		else
-		{
+			break;
+		case CMcCardCache::RESULT_NO_ENTRY:
 			ret[0] = RET_NO_ENTRY;
-		}
-	}
-	catch(const fs::filesystem_error& exception)
-	{
-		CLog::GetInstance().Warn(LOG_NAME, "Error while executing Delete: %s.\r\n", exception.what());
-		auto errorCode = exception.code();
-		if(errorCode == std::errc::directory_not_empty)
-		{
+			break;
+		case CMcCardCache::RESULT_NOT_EMPTY:
 			//Musashi Samurai Legends will try to delete a directory when overwriting a save
 			ret[0] = RET_NOT_EMPTY;
-		}
-		else
-		{
+			break;
+		default:
 			ret[0] = -1;
+			break;
 		}
 	}
 	catch(const std::exception& exception)
@@ -752,10 +750,11 @@ void CMcServ::GetEntSpace(uint32* args, uint32 argsSize, uint32* ret, uint32 ret
 	CLog::GetInstance().Print(LOG_NAME, "GetEntSpace(port = %i, slot = %i, flags = %i, name = '%s');\r\n",
 	                          cmd->port, cmd->slot, cmd->flags, cmd->name);
 
-	auto mcPath = CAppConfig::GetInstance().GetPreferencePath(m_mcPathPreference[cmd->port]);
-	auto savePath = Iop::PathUtils::MakeHostPath(mcPath, cmd->name);
+	auto& cardCache = GetCardCache(cmd->port);
+	auto savePath = Iop::PathUtils::MakeHostPath(cardCache.GetBasePath(), cmd->name);
 
-	if(fs::exists(savePath) && fs::is_directory(savePath))
+	auto node = cardCache.FindNode(savePath);
+	if(node && node->isDirectory)
 	{
 		// Arbitrarity number, allows Drakengard to detect MC
 		ret[0] = 0xFE;
@@ -835,6 +834,12 @@ void CMcServ::GetVersionInformation(uint32* args, uint32 argsSize, uint32* ret,
 		knownMemoryCard = false;
 	}
 
+	//Pick up changes made to the memory card directories while we weren't running
+	for(auto& cardCache : m_cardCaches)
+	{
+		cardCache.Invalidate();
+	}
+
 	CLog::GetInstance().Print(LOG_NAME, "Init();\r\n");
 }
 
@@ -896,24 +901,28 @@ uint32 CMcServ::GenerateHandle()
 {
 	for(unsigned int i = 0; i < MAX_FILES; i++)
 	{
-		if(m_files[i].IsEmpty()) return i;
+		if(!m_files[i]) return i;
 	}
 	return -1;
 }
 
-Framework::CStdStream* CMcServ::GetFileFromHandle(uint32 handle)
+CMcCardCache::CFileStream* CMcServ::GetFileFromHandle(uint32 handle)
 {
 	assert(handle < MAX_FILES);
 	if(handle >= MAX_FILES)
 	{
 		return nullptr;
 	}
-	auto& file = m_files[handle];
-	if(file.IsEmpty())
-	{
-		return nullptr;
-	}
-	return &file;
+	return m_files[handle].get();
+}
+
+CMcCardCache& CMcServ::GetCardCache(unsigned int port)
+{
+	assert(port < MAX_PORTS);
+	auto& cardCache = m_cardCaches[port];
+	//Memory card directory might have been changed in the settings
+	cardCache.SetBasePath(CAppConfig::GetInstance().GetPreferencePath(m_mcPathPreference[port]));
+	return cardCache;
 }
 
 fs::path CMcServ::GetAbsoluteFilePath(unsigned int port, unsigned int slot, const char* name) const
@@ -983,10 +992,8 @@ void CMcServ::CPathFinder::Reset()
 	m_index = 0;
 }
 
-void CMcServ::CPathFinder::Search(const fs::path& basePath, const char* filter)
+void CMcServ::CPathFinder::Search(const CMcCardCache::NODE& baseNode, const char* filter)
 {
-	m_basePath = basePath;
-
 	std::string filterPathString = filter;
 	if(filterPathString[0] != '/')
 	{
@@ -1030,7 +1037,7 @@ void CMcServ::CPathFinder::Search(const fs::path& basePath, const char* filter)
 		m_entries.push_back(entry);
 	}
 
-	SearchRecurse(m_basePath);
+	SearchRecurse(baseNode, std::string());
 }
 
 unsigned int CMcServ::CPathFinder::Read(ENTRY* entry, unsigned int size)
@@ -1049,19 +1056,16 @@ unsigned int CMcServ::CPathFinder::Read(ENTRY* entry, unsigned int size)
 	return readCount;
 }
 
-void CMcServ::CPathFinder::SearchRecurse(const fs::path& path)
+void CMcServ::CPathFinder::SearchRecurse(const CMcCardCache::NODE& directoryNode, const std::string& directoryPath)
 {
 	bool found = false;
-	fs::directory_iterator endIterator;
 
-	for(fs::directory_iterator elementIterator(path);
-	    elementIterator != endIterator; elementIterator++)
+	for(const auto& childPair : directoryNode.children)
 	{
-		fs::path relativePath(*elementIterator);
-		std::string relativePathString(relativePath.generic_string());
+		const auto& node = *childPair.second;
 
-		//"Extract" a more appropriate relative path from the memory card point of view
-		relativePathString.erase(0, m_basePath.generic_string().size());
+		//Relative path from the memory card point of view
+		auto relativePathString = directoryPath + "/" + node.name;
 
 		//Attempt to match this against the filter
 		if(std::regex_match(relativePathString, m_filterExp))
@@ -1070,24 +1074,23 @@ void CMcServ::CPathFinder::SearchRecurse(const fs::path& path)
 			ENTRY entry;
 			memset(&entry, 0, sizeof(entry));
 
-			strncpy(reinterpret_cast<char*>(entry.name), relativePath.filename().string().c_str(), 0x1F);
+			strncpy(reinterpret_cast<char*>(entry.name), node.name.c_str(), 0x1F);
 			entry.name[0x1F] = 0;
 
-			if(fs::is_directory(*elementIterator))
+			if(node.isDirectory)
 			{
 				entry.size = 0;
 				entry.attributes = MC_FILE_ATTR_FOLDER;
 			}
 			else
 			{
-				entry.size = static_cast<uint32>(fs::file_size(*elementIterator));
+				entry.size = node.size;
 				entry.attributes = MC_FILE_0400 | MC_FILE_ATTR_EXISTS | MC_FILE_ATTR_CLOSED | MC_FILE_ATTR_FILE | MC_FILE_ATTR_READABLE | MC_FILE_ATTR_WRITEABLE | MC_FILE_ATTR_EXECUTABLE;
 			}
 
 			//Fill in modification date info
 			{
-				auto changeSystemTime = Framework::ConvertFsTimeToSystemTime(fs::last_write_time(*elementIterator));
-				auto localChangeDate = std::localtime(&changeSystemTime);
+				auto localChangeDate = std::localtime(&node.modificationTime);
 
 				entry.modificationTime.second = localChangeDate->tm_sec;
 				entry.modificationTime.minute = localChangeDate->tm_min;
@@ -1097,16 +1100,16 @@ void CMcServ::CPathFinder::SearchRecurse(const fs::path& path)
 				entry.modificationTime.year = localChangeDate->tm_year + 1900;
 			}
 
-			//std::filesystem doesn't provide a way to get creation time, so just make it the same as modification date
+			//Creation time isn't tracked, so just make it the same as modification date
 			entry.creationTime = entry.modificationTime;
 
 			m_entries.push_back(entry);
 			found = true;
 		}
 
-		if(fs::is_directory(*elementIterator) && !found)
+		if(node.isDirectory && !found)
 		{
-			SearchRecurse(*elementIterator);
+			SearchRecurse(node, relativePathString);
 		}
 	}
 }
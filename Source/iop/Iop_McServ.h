@@ -4,9 +4,9 @@
 #include <map>
 #include <regex>
 #include "filesystem_def.h"
-#include "StdStream.h"
 #include "Iop_Module.h"
 #include "Iop_SifMan.h"
+#include "Iop_McCardCache.h"
 
 class CMIPSAssembler;
 class CIopBios;
@@ -28,6 +28,7 @@ namespace Iop
 			CMD_ID_SEEK = 0x04,
 			CMD_ID_READ = 0x05,
 			CMD_ID_WRITE = 0x06,
+			CMD_ID_FLUSH = 0x0A,
 			CMD_ID_CHDIR = 0x0C,
 			CMD_ID_GETDIR = 0x0D,
 			CMD_ID_SETFILEINFO = 0x0E,
@@ -64,6 +65,7 @@ namespace Iop
 		enum RETURN_CODES
 		{
 			RET_OK = 0,
+			RET_FULL_DEVICE = -3,
 			RET_NO_ENTRY = -4,
 			RET_PERMISSION_DENIED = -5,
 			RET_NOT_EMPTY = -6,
@@ -128,6 +130,7 @@ namespace Iop
 		void SaveState(Framework::CZipArchiveWriter&) const override;
 
 		void CountTicks(uint32, CSifMan*);
+		uint32 GetTicksUntilNextEvent() const;
 
 	private:
 		struct MODULEDATA
@@ -167,16 +170,15 @@ namespace Iop
 			virtual ~CPathFinder();
 
 			void Reset();
-			void Search(const fs::path&, const char*);
+			void Search(const CMcCardCache::NODE&, const char*);
 			unsigned int Read(ENTRY*, unsigned int);
 
 		private:
 			typedef std::vector<ENTRY> EntryList;
 
-			void SearchRecurse(const fs::path&);
+			void SearchRecurse(const CMcCardCache::NODE&, const std::string&);
 
 			EntryList m_entries;
-			fs::path m_basePath;
 			std::regex m_filterExp;
 			unsigned int m_index;
 		};
@@ -206,7 +208,8 @@ namespace Iop
 		void FinishReadFast(CMIPS&);
 
 		uint32 GenerateHandle();
-		Framework::CStdStream* GetFileFromHandle(uint32);
+		CMcCardCache::CFileStream* GetFileFromHandle(uint32);
+		CMcCardCache& GetCardCache(unsigned int);
 		fs::path GetAbsoluteFilePath(unsigned int, unsigned int, const char*) const;
 
 		CIopBios& m_bios;
@@ -219,7 +222,9 @@ namespace Iop
 		uint32 m_proceedReadFastAddr = 0;
 		uint32 m_finishReadFastAddr = 0;
 		uint32 m_readFastAddr = 0;
-		Framework::CStdStream m_files[MAX_FILES];
+		//Must outlive opened files, they flush their contents to the card when destroyed
+		CMcCardCache m_cardCaches[MAX_PORTS];
+		std::unique_ptr<CMcCardCache::CFileStream> m_files[MAX_FILES];
 		static const char* m_mcPathPreference[2];
 		std::string m_currentDirectory;
 		CPathFinder m_pathFinder;
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <algorithm>
 #include <cstring>
 #include "Iop_RootCounters.h"
 #include "Iop_Intc.h"
@@ -122,50 +123,12 @@ void CRootCounters::Update(unsigned int ticks)
 		COUNTER& counter = m_counter[i];
 		if(i == 2 && counter.mode.en) continue;
 		//Compute count increment
-		unsigned int clockRatio = 1;
-		if(i == 0 && counter.mode.clc)
-		{
-			clockRatio = m_pixelClocks;
-		}
-		if(((i == 1) || (i == 3)) && counter.mode.clc)
-		{
-			clockRatio = m_hsyncClocks;
-		}
-		if(i == 2 && (counter.mode.div != COUNTER_SCALE_1))
-		{
-			assert(counter.mode.div == COUNTER_SCALE_8);
-			clockRatio = 8;
-		}
-		if(
-		    ((i == 4) || (i == 5)) &&
-		    (counter.mode.div != COUNTER_SCALE_1))
-		{
-			switch(counter.mode.div)
-			{
-			case COUNTER_SCALE_8:
-				clockRatio = 8;
-				break;
-			case COUNTER_SCALE_16:
-				clockRatio = 16;
-				break;
-			case COUNTER_SCALE_256:
-				clockRatio = 256;
-				break;
-			}
-		}
+		unsigned int clockRatio = GetClockRatio(i);
 		unsigned int totalTicks = counter.clockRemain + ticks;
 		unsigned int countAdd = totalTicks / clockRatio;
 		counter.clockRemain = totalTicks % clockRatio;
 		//Update count
-		uint32 counterMax = 0;
-		if(g_counterSizes[i] == 16)
-		{
-			counterMax = counter.mode.tar ? static_cast<uint16>(counter.target) : 0xFFFF;
-		}
-		else
-		{
-			counterMax = counter.mode.tar ? counter.target : 0xFFFFFFFF;
-		}
+		uint32 counterMax = GetCounterMax(i);
 		uint32 counterTemp = counter.count + countAdd;
 		if(counterTemp >= counterMax)
 		{
@@ -186,6 +149,75 @@ void CRootCounters::Update(unsigned int ticks)
 	}
 }
 
+//Returns a lower bound on the number of ticks before a counter can raise an interrupt
+uint32 CRootCounters::GetTicksUntilNextInterrupt() const
+{
+	uint32 result = ~0U;
+	for(unsigned int i = 0; i < MAX_COUNTERS; i++)
+	{
+		const COUNTER& counter = m_counter[i];
+		if(i == 2 && counter.mode.en) continue;
+		if(!(counter.mode.iq1 && counter.mode.iq2)) continue;
+		uint32 counterMax = GetCounterMax(i);
+		if(counter.count >= counterMax) return 0;
+		uint64 ticks = static_cast<uint64>(counterMax - counter.count) * GetClockRatio(i);
+		ticks -= std::min<uint64>(ticks, counter.clockRemain);
+		result = static_cast<uint32>(std::min<uint64>(result, ticks));
+	}
+	return result;
+}
+
+unsigned int CRootCounters::GetClockRatio(unsigned int counterId) const
+{
+	const COUNTER& counter = m_counter[counterId];
+	unsigned int i = counterId;
+	unsigned int clockRatio = 1;
+	if(i == 0 && counter.mode.clc)
+	{
+		clockRatio = m_pixelClocks;
+	}
+	if(((i == 1) || (i == 3)) && counter.mode.clc)
+	{
+		clockRatio = m_hsyncClocks;
+	}
+	if(i == 2 && (counter.mode.div != COUNTER_SCALE_1))
+	{
+		assert(counter.mode.div == COUNTER_SCALE_8);
+		clockRatio = 8;
+	}
+	if(
+	    ((i == 4) || (i == 5)) &&
+	    (counter.mode.div != COUNTER_SCALE_1))
+	{
+		switch(counter.mode.div)
+		{
+		case COUNTER_SCALE_8:
+			clockRatio = 8;
+			break;
+		case COUNTER_SCALE_16:
+			clockRatio = 16;
+			break;
+		case COUNTER_SCALE_256:
+			clockRatio = 256;
+			break;
+		}
+	}
+	return clockRatio;
+}
+
+uint32 CRootCounters::GetCounterMax(unsigned int counterId) const
+{
+	const COUNTER& counter = m_counter[counterId];
+	if(g_counterSizes[counterId] == 16)
+	{
+		return counter.mode.tar ? static_cast<uint16>(counter.target) : 0xFFFF;
+	}
+	else
+	{
+		return counter.mode.tar ? counter.target : 0xFFFFFFFF;
+	}
+}
+
 uint32 CRootCounters::ReadRegister(uint32 address)
 {
 #ifdef _DEBUG
@@ -2,6 +2,7 @@
 #include "Iop_Intc.h"
 #include "Iop_DmacChannel.h"
 #include "Log.h"
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
@@ -321,6 +322,12 @@ void CSpeed::CountTicks(uint32 ticks)
 	}
 }
 
+uint32 CSpeed::GetTicksUntilNextEvent() const
+{
+	if(!m_pendingRx) return ~0U;
+	return std::max<int32>(m_rxDelay, 0);
+}
+
 void CSpeed::LogRead(uint32 address)
 {
 #define LOG_GET(registerId)                                           \
@@ -28,6 +28,7 @@ namespace Iop
 		uint32 ReceiveDma(uint8*, uint32, uint32, uint32);
 
 		void CountTicks(uint32);
+		uint32 GetTicksUntilNextEvent() const;
 
 	private:
 		enum SMAP_BD_TX_CTRLSTAT
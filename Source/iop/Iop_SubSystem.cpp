@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "Iop_SubSystem.h"
 #include "IopBios.h"
 #include "GenericMipsExecutor.h"
@@ -17,10 +18,11 @@ using namespace PS2;
 #define STATE_SCRATCH ("iop_scratch")
 #define STATE_SPURAM ("iop_spuram")
 
-CSubSystem::CSubSystem(bool ps2Mode)
+CSubSystem::CSubSystem(bool ps2Mode, bool fastMem)
     : m_cpu(MEMORYMAP_ENDIAN_LSBF, true)
-    , m_ram(new uint8[IOP_RAM_SIZE])
-    , m_scratchPad(new uint8[IOP_SCRATCH_SIZE])
+    , m_fastMemWindow(fastMem ? CFastMemWindow::Create(IOP_RAM_SIZE + IOP_SCRATCH_SIZE) : nullptr)
+    , m_ram(m_fastMemWindow ? m_fastMemWindow->AllocateBacking(IOP_RAM_SIZE) : new uint8[IOP_RAM_SIZE])
+    , m_scratchPad(m_fastMemWindow ? m_fastMemWindow->AllocateBacking(IOP_SCRATCH_SIZE) : new uint8[IOP_SCRATCH_SIZE])
     , m_spuRam(new uint8[SPU_RAM_SIZE])
     , m_dmac(m_ram, m_intc)
     , m_counters(ps2Mode ? IOP_CLOCK_OVER_FREQ : IOP_CLOCK_BASE_FREQ, m_intc)
@@ -35,6 +37,7 @@ CSubSystem::CSubSystem(bool ps2Mode)
     , m_cpuArch(MIPS_REGSIZE_32)
     , m_copScu(MIPS_REGSIZE_32)
     , m_dmaUpdateTicks(0)
+    , m_spuIrqUpdateTicks(0)
 {
 	if(ps2Mode)
 	{
@@ -74,6 +77,11 @@ CSubSystem::CSubSystem(bool ps2Mode)
 	m_cpu.m_pArch = &m_cpuArch;
 	m_cpu.m_pCOP[0] = &m_copScu;
 	m_cpu.m_pAddrTranslator = &CMIPS::TranslateAddress64;
+	m_cpu.m_timerAddressPredicate =
+	    [](uint32 address) {
+		    return ((address >= CRootCounters::ADDR_BEGIN1) && (address <= CRootCounters::ADDR_END1)) ||
+		           ((address >= CRootCounters::ADDR_BEGIN2) && (address <= CRootCounters::ADDR_END2));
+	    };
 
 	m_dmac.SetReceiveFunction(CDmac::CHANNEL_SPU0, std::bind(&CSpuBase::ReceiveDma, &m_spuCore0, PLACEHOLDER_1, PLACEHOLDER_2, PLACEHOLDER_3, PLACEHOLDER_4));
 	m_dmac.SetReceiveFunction(CDmac::CHANNEL_SPU1, std::bind(&CSpuBase::ReceiveDma, &m_spuCore1, PLACEHOLDER_1, PLACEHOLDER_2, PLACEHOLDER_3, PLACEHOLDER_4));
@@ -87,8 +95,11 @@ CSubSystem::CSubSystem(bool ps2Mode)
 CSubSystem::~CSubSystem()
 {
 	m_bios.reset();
-	delete[] m_ram;
-	delete[] m_scratchPad;
+	if(!m_fastMemWindow)
+	{
+		delete[] m_ram;
+		delete[] m_scratchPad;
+	}
 	delete[] m_spuRam;
 }
 
@@ -162,6 +173,7 @@ void CSubSystem::Reset()
 	m_cpu.m_Functions.RemoveTags();
 
 	m_dmaUpdateTicks = 0;
+	m_isIdle = false;
 }
 
 void CSubSystem::SetupPageTable()
@@ -177,6 +189,19 @@ void CSubSystem::SetupPageTable()
 
 		m_cpu.MapPages(addressBit | PS2::IOP_SCRATCH_ADDR, PS2::IOP_SCRATCH_SIZE, m_scratchPad);
 	}
+
+	if(m_fastMemWindow)
+	{
+		//Upper mirror is handled by masking addresses with the window's size
+		bool mapped = true;
+		for(uint32 i = 0; i < 4; i++)
+		{
+			mapped &= m_fastMemWindow->Map(PS2::IOP_RAM_SIZE * i, m_ram, PS2::IOP_RAM_SIZE);
+		}
+		mapped &= m_fastMemWindow->Map(PS2::IOP_SCRATCH_ADDR, m_scratchPad, PS2::IOP_SCRATCH_SIZE);
+		m_cpu.m_fastMemBase = mapped ? m_fastMemWindow->GetBase() : nullptr;
+		m_cpu.m_fastMemSize = mapped ? (PS2::IOP_RAM_SIZE * 4) : 0;
+	}
 }
 
 uint32 CSubSystem::ReadIoRegister(uint32 address)
@@ -314,13 +339,14 @@ void CSubSystem::CheckPendingInterrupts()
 
 bool CSubSystem::IsCpuIdle()
 {
-	return m_bios->IsIdle();
+	return m_bios->IsIdle() || m_isIdle;
 }
 
+static const int g_dmaUpdateDelay = 10000;
+static const int g_spuIrqCheckDelay = 1000;
+
 void CSubSystem::CountTicks(int ticks)
 {
-	static const int g_dmaUpdateDelay = 10000;
-	static const int g_spuIrqCheckDelay = 1000;
 	m_counters.Update(ticks);
 	m_speed.CountTicks(ticks);
 	m_bios->CountTicks(ticks);
@@ -349,9 +375,27 @@ void CSubSystem::CountTicks(int ticks)
 	}
 }
 
+//Returns a lower bound on the number of ticks before something can happen without
+//the CPU's intervention (interrupt, thread wake up, etc.)
+uint32 CSubSystem::GetTicksUntilNextEvent()
+{
+	uint32 result = m_counters.GetTicksUntilNextInterrupt();
+	result = std::min(result, m_speed.GetTicksUntilNextEvent());
+	result = std::min(result, m_bios->GetTicksUntilNextEvent());
+	result = std::min<uint32>(result, std::max(g_dmaUpdateDelay - m_dmaUpdateTicks, 0));
+	//Pending state can only change through SPU rendering or DMA (which is followed by
+	//a check), no need to wake up periodically unless something is already pending
+	if(m_spuCore0.GetIrqPending() || m_spuCore1.GetIrqPending())
+	{
+		result = std::min<uint32>(result, std::max(g_spuIrqCheckDelay - m_spuIrqUpdateTicks, 0));
+	}
+	return result;
+}
+
 int CSubSystem::ExecuteCpu(int quota)
 {
 	int executed = 0;
+	m_isIdle = false;
 	CheckPendingInterrupts();
 	if(!m_cpu.m_State.nHasException)
 	{
@@ -373,6 +417,12 @@ int CSubSystem::ExecuteCpu(int quota)
 			m_cpu.m_State.nHasException = MIPS_EXCEPTION_NONE;
 		}
 		break;
+		case MIPS_EXCEPTION_IDLE:
+		{
+			m_isIdle = true;
+			m_cpu.m_State.nHasException = MIPS_EXCEPTION_NONE;
+		}
+		break;
 		}
 		assert(m_cpu.m_State.nHasException == MIPS_EXCEPTION_NONE);
 	}
@@ -15,19 +15,21 @@
 #include "Iop_Sio2.h"
 #include "zip/ZipArchiveWriter.h"
 #include "zip/ZipArchiveReader.h"
+#include "../FastMemWindow.h"
 
 namespace Iop
 {
 	class CSubSystem
 	{
 	public:
-		CSubSystem(bool ps2Mode);
+		CSubSystem(bool ps2Mode, bool fastMem = false);
 		virtual ~CSubSystem();
 
 		void Reset();
 		int ExecuteCpu(int);
 		bool IsCpuIdle();
 		void CountTicks(int);
+		uint32 GetTicksUntilNextEvent();
 
 		void NotifyVBlankStart();
 		void NotifyVBlankEnd();
@@ -35,6 +37,9 @@ namespace Iop
 		void SaveState(Framework::CZipArchiveWriter&);
 		void LoadState(Framework::CZipArchiveReader&);
 
+		//Must be declared before memory blocks that are allocated from it
+		std::unique_ptr<CFastMemWindow> m_fastMemWindow;
+
 		uint8* m_ram;
 		uint8* m_scratchPad;
 		uint8* m_spuRam;
@@ -73,5 +78,6 @@ namespace Iop
 
 		int m_dmaUpdateTicks;
 		int m_spuIrqUpdateTicks;
+		bool m_isIdle = false;
 	};
 }
@@ -85,3 +85,9 @@ void CDirectoryDevice::MakeDirectory(const char* devicePath)
 		throw std::runtime_error("Failed to create directory.");
 	}
 }
+
+//Each file has its own host stream
+bool CDirectoryDevice::IsAsyncReadSupported() const
+{
+	return true;
+}
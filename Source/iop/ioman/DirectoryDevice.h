@@ -15,6 +15,7 @@ namespace Iop
 			Framework::CStream* GetFile(uint32, const char*) override;
 			Directory GetDirectory(const char*) override;
 			void MakeDirectory(const char*) override;
+			bool IsAsyncReadSupported() const override;
 
 		protected:
 			virtual fs::path GetBasePath() = 0;
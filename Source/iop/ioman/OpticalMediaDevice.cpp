@@ -46,3 +46,9 @@ Directory COpticalMediaDevice::GetDirectory(const char* devicePath)
 {
 	throw std::runtime_error("Not supported.");
 }
+
+//Block providers serialize accesses to the disc image
+bool COpticalMediaDevice::IsAsyncReadSupported() const
+{
+	return true;
+}
@@ -18,6 +18,7 @@ namespace Iop
 
 			Framework::CStream* GetFile(uint32, const char*) override;
 			Directory GetDirectory(const char*) override;
+			bool IsAsyncReadSupported() const override;
 
 		private:
 			static char FixSlashes(char);
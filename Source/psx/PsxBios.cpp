@@ -200,6 +200,11 @@ void CPsxBios::CountTicks(uint32 ticks)
 {
 }
 
+uint32 CPsxBios::GetTicksUntilNextEvent()
+{
+	return ~0U;
+}
+
 void CPsxBios::AssembleEventChecker()
 {
 	CMIPSAssembler assembler(reinterpret_cast<uint32*>(m_ram + EVENT_CHECKER));
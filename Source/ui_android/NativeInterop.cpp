@@ -23,7 +23,7 @@
 
 CPS2VM* g_virtualMachine = nullptr;
 CPS2VM::ProfileFrameDoneSignal::Connection g_ProfileFrameDoneConnection;
-Framework::CSignal<void(uint32)>::Connection g_OnNewFrameConnection;
+CGSHandler::NewFrameEvent::Connection g_OnNewFrameConnection;
 
 #define PREF_AUDIO_ENABLEOUTPUT ("audio.enableoutput")
 
@@ -174,7 +174,7 @@ extern "C" JNIEXPORT void JNICALL Java_com_virtualapplications_play_NativeIntero
 	{
 		g_virtualMachine->CreateGSHandler(CGSH_OpenGLAndroid::GetFactoryFunction(nativeWindow));
 		g_OnNewFrameConnection = g_virtualMachine->m_ee->m_gs->OnNewFrame.Connect(
-		    std::bind(&CStatsManager::OnNewFrame, &CStatsManager::GetInstance(), std::placeholders::_1));
+		    std::bind(&CStatsManager::OnNewFrame, &CStatsManager::GetInstance(), std::placeholders::_1, std::placeholders::_2));
 	}
 	else
 	{
@@ -7,6 +7,8 @@
 #include "StdStreamUtils.h"
 #include "string_cast.h"
 #include "string_format.h"
+#include "make_unique.h"
+#include "FrameDumpStream.h"
 #include "GsPacketData.h"
 #include "GsPacketListModel.h"
 #include "GsStateUtils.h"
@@ -14,6 +16,7 @@
 
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QOffscreenSurface>
 #include <QApplication>
 
@@ -75,8 +78,26 @@ void QtFramedebugger::LoadFrameDump(std::string path)
 	try
 	{
 		fs::path dumpPath(path);
-		auto inputStream = Framework::CreateInputStdStream(dumpPath.native());
-		m_frameDump.Read(inputStream);
+		if(dumpPath.extension() == ".pfds")
+		{
+			auto inputStream = std::make_unique<Framework::CStdStream>(Framework::CreateInputStdStream(dumpPath.native()));
+			CFrameDumpStreamReader reader(std::move(inputStream));
+			if(reader.GetFrameCount() == 0)
+			{
+				throw std::runtime_error("Frame capture doesn't contain any frame.");
+			}
+			bool frameSelected = false;
+			int lastFrameIndex = static_cast<int>(reader.GetFrameCount() - 1);
+			int frameIndex = QInputDialog::getInt(this, tr("Load Frame Capture"), tr("Frame (0 - %1):").arg(lastFrameIndex),
+			                                      0, 0, lastFrameIndex, 1, &frameSelected);
+			if(!frameSelected) return;
+			reader.ReadFrame(frameIndex, m_frameDump);
+		}
+		else
+		{
+			auto inputStream = Framework::CreateInputStdStream(dumpPath.native());
+			m_frameDump.Read(inputStream);
+		}
 		m_frameDump.IdentifyDrawingKicks();
 	}
 	catch(const std::exception& exception)
@@ -356,7 +377,7 @@ void QtFramedebugger::on_actionLoad_Dump_triggered()
 {
 	QFileDialog dialog(this);
 	dialog.setFileMode(QFileDialog::ExistingFile);
-	dialog.setNameFilter(tr("Play! Frame Dumps (*.dmp.zip);;All files (*.*)"));
+	dialog.setNameFilter(tr("Play! Frame Dumps (*.dmp.zip *.pfds);;All files (*.*)"));
 	if(dialog.exec())
 	{
 		auto filePath = dialog.selectedFiles().first();
@@ -120,6 +120,7 @@ MainWindow::MainWindow(QWidget* parent)
 	connect(debugMenuUi->actionShowDebugger, &QAction::triggered, this, std::bind(&MainWindow::ShowDebugger, this));
 	connect(debugMenuUi->actionShowFrameDebugger, &QAction::triggered, this, std::bind(&MainWindow::ShowFrameDebugger, this));
 	connect(debugMenuUi->actionDumpNextFrame, &QAction::triggered, this, std::bind(&MainWindow::DumpNextFrame, this));
+	connect(debugMenuUi->actionCaptureFrames, &QAction::triggered, this, std::bind(&MainWindow::ToggleFrameCapture, this));
 	connect(debugMenuUi->actionGsDrawEnabled, &QAction::triggered, this, std::bind(&MainWindow::ToggleGsDraw, this));
 #endif
 }
@@ -237,7 +238,7 @@ void MainWindow::SetupGsHandler()
 
 	connect(m_outputwindow, SIGNAL(doubleClick(QMouseEvent*)), this, SLOT(doubleClickEvent(QMouseEvent*)));
 
-	m_OnNewFrameConnection = m_virtualMachine->m_ee->m_gs->OnNewFrame.Connect(std::bind(&CStatsManager::OnNewFrame, &CStatsManager::GetInstance(), std::placeholders::_1));
+	m_OnNewFrameConnection = m_virtualMachine->m_ee->m_gs->OnNewFrame.Connect(std::bind(&CStatsManager::OnNewFrame, &CStatsManager::GetInstance(), std::placeholders::_1, std::placeholders::_2));
 }
 
 void MainWindow::SetupSoundHandler()
@@ -493,11 +494,13 @@ void MainWindow::updateStats()
 {
 	uint32 frames = CStatsManager::GetInstance().GetFrames();
 	uint32 drawCalls = CStatsManager::GetInstance().GetDrawCalls();
+	uint32 primitives = CStatsManager::GetInstance().GetPrimitives();
 	uint32 dcpf = (frames != 0) ? (drawCalls / frames) : 0;
+	uint32 ppf = (frames != 0) ? (primitives / frames) : 0;
 #ifdef PROFILE
 	m_profileStatsLabel->setText(QString::fromStdString(CStatsManager::GetInstance().GetProfilingInfo()));
 #endif
-	m_fpsLabel->setText(QString("%1 f/s, %2 dc/f").arg(frames).arg(dcpf));
+	m_fpsLabel->setText(QString("%1 f/s, %2 dc/f, %3 p/f").arg(frames).arg(dcpf).arg(ppf));
 	CStatsManager::GetInstance().ClearStats();
 }
 
@@ -836,6 +839,38 @@ void MainWindow::DumpNextFrame()
 	    });
 }
 
+void MainWindow::ToggleFrameCapture()
+{
+	if(!debugMenuUi->actionCaptureFrames->isChecked())
+	{
+		m_virtualMachine->EndFrameDumpStream();
+		m_msgLabel->setText(QString("Frame capture stopped."));
+		return;
+	}
+
+	try
+	{
+		auto frameDumpDirectoryPath = GetFrameDumpDirectoryPath();
+		Framework::PathUtils::EnsurePathExists(frameDumpDirectoryPath);
+		for(unsigned int i = 0; i < UINT_MAX; i++)
+		{
+			auto frameCaptureFileName = string_format("framecapture_%08d.pfds", i);
+			auto frameCapturePath = frameDumpDirectoryPath / fs::path(frameCaptureFileName);
+			if(!fs::exists(frameCapturePath))
+			{
+				m_virtualMachine->BeginFrameDumpStream(frameCapturePath);
+				m_msgLabel->setText(QString("Capturing frames to '%1'.").arg(frameCaptureFileName.c_str()));
+				return;
+			}
+		}
+	}
+	catch(...)
+	{
+	}
+	debugMenuUi->actionCaptureFrames->setChecked(false);
+	m_msgLabel->setText(QString("Failed to start frame capture."));
+}
+
 void MainWindow::ToggleGsDraw()
 {
 	auto gs = m_virtualMachine->GetGSHandler();
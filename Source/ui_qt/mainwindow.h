@@ -49,6 +49,7 @@ public:
 	void ShowFrameDebugger();
 	fs::path GetFrameDumpDirectoryPath();
 	void DumpNextFrame();
+	void ToggleFrameCapture();
 	void ToggleGsDraw();
 #endif
 
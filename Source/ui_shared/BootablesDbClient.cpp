@@ -7,7 +7,7 @@
 
 using namespace BootablesDb;
 
-#define DATABASE_VERSION 2
+#define DATABASE_VERSION 3
 
 static const char* g_dbFileName = "bootables.db";
 
@@ -19,9 +19,21 @@ static const char* g_bootablesTableCreateStatement =
     "    title TEXT DEFAULT '',"
     "    coverUrl TEXT DEFAULT '',"
     "    lastBootedTime INTEGER DEFAULT 0,"
-    "    overview TEXT DEFAULT ''"
+    "    overview TEXT DEFAULT '',"
+    "    fileSize INTEGER DEFAULT 0,"
+    "    fileTime INTEGER DEFAULT 0"
     ")";
 
+//Version 3 added the file size and time used to skip unchanged files when scanning
+static const char* g_migrateFromVersion2Statements[] =
+    {
+        "BEGIN TRANSACTION",
+        "ALTER TABLE bootables ADD COLUMN fileSize INTEGER DEFAULT 0",
+        "ALTER TABLE bootables ADD COLUMN fileTime INTEGER DEFAULT 0",
+        "PRAGMA user_version = 3",
+        "COMMIT",
+};
+
 CClient::CClient()
 {
 	m_dbPath = CAppConfig::GetInstance().GetBasePath() / g_dbFileName;
@@ -141,6 +153,15 @@ void CClient::SetOverview(const fs::path& path, const char* overview)
 	statement.StepNoResult();
 }
 
+void CClient::SetFileInfo(const fs::path& path, uint64 fileSize, int64 fileTime)
+{
+	Framework::CSqliteStatement statement(m_db, "UPDATE bootables SET fileSize = ?, fileTime = ? WHERE path = ?");
+	sqlite3_bind_int64(statement, 1, fileSize);
+	sqlite3_bind_int64(statement, 2, fileTime);
+	statement.BindText(3, Framework::PathUtils::GetNativeStringFromPath(path).c_str());
+	statement.StepNoResult();
+}
+
 Bootable CClient::ReadBootable(Framework::CSqliteStatement& statement)
 {
 	Bootable bootable;
@@ -150,12 +171,14 @@ Bootable CClient::ReadBootable(Framework::CSqliteStatement& statement)
 	bootable.coverUrl = reinterpret_cast<const char*>(sqlite3_column_text(statement, 3));
 	bootable.overview = reinterpret_cast<const char*>(sqlite3_column_text(statement, 5));
 	bootable.lastBootedTime = sqlite3_column_int(statement, 4);
+	bootable.fileSize = sqlite3_column_int64(statement, 6);
+	bootable.fileTime = sqlite3_column_int64(statement, 7);
 	return bootable;
 }
 
 void CClient::CheckDbVersion()
 {
-	bool dbExistsAndMatchesVersion =
+	int version =
 	    [&]() {
 		    try
 		    {
@@ -164,17 +187,37 @@ void CClient::CheckDbVersion()
 
 			    Framework::CSqliteStatement statement(db, "PRAGMA user_version");
 			    statement.StepWithResult();
-			    int version = sqlite3_column_int(statement, 0);
-			    return (version == DATABASE_VERSION);
+			    return sqlite3_column_int(statement, 0);
 		    }
 		    catch(...)
 		    {
-			    return false;
+			    return 0;
 		    }
 	    }();
 
-	if(!dbExistsAndMatchesVersion)
+	if(version == DATABASE_VERSION)
 	{
-		fs::remove(m_dbPath);
+		return;
 	}
+
+	//Previous version only lacks columns, keep its contents
+	if(version == 2)
+	{
+		try
+		{
+			auto db = Framework::CSqliteDb(Framework::PathUtils::GetNativeStringFromPath(m_dbPath).c_str(),
+			                               SQLITE_OPEN_READWRITE);
+			for(const auto& migrateStatement : g_migrateFromVersion2Statements)
+			{
+				Framework::CSqliteStatement statement(db, migrateStatement);
+				statement.StepNoResult();
+			}
+			return;
+		}
+		catch(...)
+		{
+		}
+	}
+
+	fs::remove(m_dbPath);
 }
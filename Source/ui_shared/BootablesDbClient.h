@@ -18,6 +18,9 @@ namespace BootablesDb
 		std::string coverUrl;
 		std::string overview;
 		time_t lastBootedTime = 0;
+		//Size and modification time of the file when its disc id was extracted
+		uint64 fileSize = 0;
+		int64 fileTime = 0;
 	};
 
 	class CClient : public CSingleton<CClient>
@@ -46,6 +49,7 @@ namespace BootablesDb
 		void SetCoverUrl(const fs::path&, const char*);
 		void SetLastBootedTime(const fs::path&, time_t);
 		void SetOverview(const fs::path& path, const char* overview);
+		void SetFileInfo(const fs::path&, uint64, int64);
 
 	private:
 		static Bootable ReadBootable(Framework::CSqliteStatement&);
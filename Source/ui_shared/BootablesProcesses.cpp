@@ -1,4 +1,9 @@
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
 #include "AppConfig.h"
 #include "BootablesProcesses.h"
 #include "BootablesDbClient.h"
@@ -8,6 +13,7 @@
 #include "string_format.h"
 #include "StdStreamUtils.h"
 #include "http/HttpClientFactory.h"
+#include "ThreadPool.h"
 
 //Jobs
 // Scan for new games (from input directory)
@@ -17,6 +23,10 @@
 
 //#define SCAN_LOG
 
+//Number of files opened at the same time while scanning. Disc id extraction is mostly
+//waiting on storage (which can be a network share), so this is independent of core count.
+#define SCAN_IO_PARALLELISM 4
+
 static void BootableLog(const char* format, ...)
 {
 #ifdef SCAN_LOG
@@ -50,6 +60,17 @@ bool IsBootableDiscImagePath(const fs::path& filePath)
 	return extensionIterator != std::end(supportedExtensions);
 }
 
+static bool TryGetFileInfo(const fs::path& path, uint64& fileSize, int64& fileTime)
+{
+	std::error_code ec;
+	fileSize = fs::file_size(path, ec);
+	if(ec) return false;
+	auto writeTime = fs::last_write_time(path, ec);
+	if(ec) return false;
+	fileTime = writeTime.time_since_epoch().count();
+	return true;
+}
+
 bool TryRegisterBootable(const fs::path& path)
 {
 	try
@@ -63,6 +84,12 @@ bool TryRegisterBootable(const fs::path& path)
 			return false;
 		}
 		BootablesDb::CClient::GetInstance().RegisterBootable(path, path.filename().string().c_str(), serial.c_str());
+		uint64 fileSize = 0;
+		int64 fileTime = 0;
+		if(!serial.empty() && TryGetFileInfo(path, fileSize, fileTime))
+		{
+			BootablesDb::CClient::GetInstance().SetFileInfo(path, fileSize, fileTime);
+		}
 		return true;
 	}
 	catch(...)
@@ -84,10 +111,23 @@ bool TryUpdateLastBootedTime(const fs::path& path)
 	}
 }
 
-void ScanBootables(const fs::path& parentPath, bool recursive)
+namespace
+{
+	struct SCAN_RESULT
+	{
+		fs::path path;
+		bool registered = false;
+		bool unchanged = false;
+		bool hasFileInfo = false;
+		uint64 fileSize = 0;
+		int64 fileTime = 0;
+		std::string discId;
+		double elapsedMs = 0;
+	};
+}
+
+static void CollectBootableCandidates(const fs::path& parentPath, bool recursive, std::vector<fs::path>& candidates)
 {
-	BootableLog("Entering ScanBootables(path = '%s', recursive = %d);\r\n",
-	            parentPath.string().c_str(), static_cast<int>(recursive));
 	try
 	{
 		std::error_code ec;
@@ -95,28 +135,27 @@ void ScanBootables(const fs::path& parentPath, bool recursive)
 		    pathIterator != fs::directory_iterator(); pathIterator.increment(ec))
 		{
 			auto& path = pathIterator->path();
-			BootableLog("Checking '%s'... ", path.string().c_str());
 			try
 			{
 				if(ec)
 				{
-					BootableLog(" failed to get status: %s.\r\n", ec.message().c_str());
+					BootableLog("Checking '%s'... failed to get status: %s.\r\n", path.string().c_str(), ec.message().c_str());
 					continue;
 				}
 				if(recursive && fs::is_directory(path))
 				{
-					BootableLog("is directory.\r\n");
-					ScanBootables(path, recursive);
+					CollectBootableCandidates(path, recursive, candidates);
 					continue;
 				}
-				BootableLog("registering... ");
-				bool success = TryRegisterBootable(path);
-				BootableLog("result = %d\r\n", static_cast<int>(success));
+				if(IsBootableExecutablePath(path) || IsBootableDiscImagePath(path))
+				{
+					candidates.push_back(path);
+				}
 			}
 			catch(const std::exception& exception)
 			{
 				//Failed to process a path, keep going
-				BootableLog(" exception: %s\r\n", exception.what());
+				BootableLog("Checking '%s'... exception: %s\r\n", path.string().c_str(), exception.what());
 			}
 		}
 	}
@@ -124,6 +163,170 @@ void ScanBootables(const fs::path& parentPath, bool recursive)
 	{
 		BootableLog("Caught an exception while trying to list directory: %s\r\n", exception.what());
 	}
+}
+
+//Runs on a worker thread, must not touch the database
+static SCAN_RESULT ScanBootable(const fs::path& path, const BootablesDb::Bootable* knownBootable)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	SCAN_RESULT result;
+	result.path = path;
+	try
+	{
+		result.hasFileInfo = TryGetFileInfo(path, result.fileSize, result.fileTime);
+		if(
+		    knownBootable && result.hasFileInfo &&
+		    (knownBootable->fileSize == result.fileSize) &&
+		    (knownBootable->fileTime == result.fileTime))
+		{
+			result.registered = true;
+			result.unchanged = true;
+		}
+		else if(IsBootableExecutablePath(path))
+		{
+			result.registered = true;
+		}
+		else
+		{
+			result.registered = DiskUtils::TryGetDiskId(path, &result.discId);
+		}
+	}
+	catch(...)
+	{
+		result.registered = false;
+	}
+	auto endTime = std::chrono::steady_clock::now();
+	result.elapsedMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	return result;
+}
+
+static void ApplyScanResult(const SCAN_RESULT& result, const BootablesDb::Bootable* knownBootable)
+{
+	if(result.unchanged) return;
+	auto& client = BootablesDb::CClient::GetInstance();
+	if(!result.registered)
+	{
+		//Leave existing entries alone, they will be checked again on the next scan
+		return;
+	}
+	if(knownBootable)
+	{
+		if(knownBootable->discId != result.discId)
+		{
+			client.SetDiscId(result.path, result.discId.c_str());
+		}
+	}
+	else
+	{
+		client.RegisterBootable(result.path, result.path.filename().string().c_str(), result.discId.c_str());
+	}
+	if(result.hasFileInfo)
+	{
+		client.SetFileInfo(result.path, result.fileSize, result.fileTime);
+	}
+}
+
+//Directories are walked on the calling thread, files are then checked on a pool of
+//SCAN_IO_PARALLELISM workers. Files already in the database with matching size and
+//modification time are not opened again. Database updates and progress reporting happen
+//on the calling thread, as results come in.
+void ScanBootables(const fs::path& parentPath, bool recursive, const BootableScanProgressCallback& progressCallback)
+{
+	BootableLog("Entering ScanBootables(path = '%s', recursive = %d);\r\n",
+	            parentPath.string().c_str(), static_cast<int>(recursive));
+
+	auto scanStartTime = std::chrono::steady_clock::now();
+
+	std::vector<fs::path> candidates;
+	CollectBootableCandidates(parentPath, recursive, candidates);
+
+	std::map<fs::path, BootablesDb::Bootable> knownBootables;
+	try
+	{
+		for(auto& bootable : BootablesDb::CClient::GetInstance().GetBootables())
+		{
+			knownBootables.emplace(bootable.path, std::move(bootable));
+		}
+	}
+	catch(const std::exception& exception)
+	{
+		BootableLog("Failed to read known bootables: %s\r\n", exception.what());
+	}
+
+	auto findKnownBootable =
+	    [&](const fs::path& path) -> const BootablesDb::Bootable* {
+		    auto bootableIterator = knownBootables.find(path);
+		    return (bootableIterator != std::end(knownBootables)) ? &bootableIterator->second : nullptr;
+	    };
+
+	std::mutex resultsMutex;
+	std::condition_variable resultsCondition;
+	std::deque<SCAN_RESULT> results;
+
+	uint32 unchangedCount = 0;
+	uint32 registeredCount = 0;
+
+	BOOTABLE_SCAN_PROGRESS progress;
+	progress.totalCount = static_cast<uint32>(candidates.size());
+
+	{
+		Framework::CThreadPool threadPool(SCAN_IO_PARALLELISM);
+		for(const auto& candidate : candidates)
+		{
+			const auto* knownBootable = findKnownBootable(candidate);
+			threadPool.Enqueue(
+			    [&, candidate, knownBootable]() {
+				    auto result = ScanBootable(candidate, knownBootable);
+				    std::lock_guard<std::mutex> resultsLock(resultsMutex);
+				    results.push_back(std::move(result));
+				    resultsCondition.notify_one();
+			    });
+		}
+
+		while(progress.processedCount != progress.totalCount)
+		{
+			SCAN_RESULT result;
+			{
+				std::unique_lock<std::mutex> resultsLock(resultsMutex);
+				resultsCondition.wait(resultsLock, [&]() { return !results.empty(); });
+				result = std::move(results.front());
+				results.pop_front();
+			}
+
+			try
+			{
+				ApplyScanResult(result, findKnownBootable(result.path));
+			}
+			catch(const std::exception& exception)
+			{
+				//Failed to register a path, keep going
+				BootableLog("Failed to register '%s': %s\r\n", result.path.string().c_str(), exception.what());
+			}
+
+			BootableLog("Checked '%s'... result = %d, unchanged = %d, time = %0.2fms\r\n",
+			            result.path.string().c_str(), static_cast<int>(result.registered),
+			            static_cast<int>(result.unchanged), result.elapsedMs);
+
+			if(result.unchanged) unchangedCount++;
+			if(result.registered) registeredCount++;
+
+			progress.processedCount++;
+			progress.path = result.path;
+			progress.registered = result.registered;
+			progress.unchanged = result.unchanged;
+			progress.elapsedMs = result.elapsedMs;
+			if(progressCallback)
+			{
+				progressCallback(progress);
+			}
+		}
+	}
+
+	auto scanEndTime = std::chrono::steady_clock::now();
+	BootableLog("Checked %d files (%d registered, %d unchanged) in %0.2fms.\r\n",
+	            progress.totalCount, registeredCount, unchangedCount,
+	            std::chrono::duration<double, std::milli>(scanEndTime - scanStartTime).count());
+
 	BootableLog("Exiting ScanBootables(path = '%s', recursive = %d);\r\n",
 	            parentPath.string().c_str(), static_cast<int>(recursive));
 }
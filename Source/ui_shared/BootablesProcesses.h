@@ -1,13 +1,27 @@
 #pragma once
 
 #include "filesystem_def.h"
+#include "Types.h"
+#include <functional>
 #include <set>
 
+struct BOOTABLE_SCAN_PROGRESS
+{
+	fs::path path;
+	uint32 processedCount = 0;
+	uint32 totalCount = 0;
+	bool registered = false;
+	bool unchanged = false;
+	double elapsedMs = 0;
+};
+
+typedef std::function<void(const BOOTABLE_SCAN_PROGRESS&)> BootableScanProgressCallback;
+
 bool IsBootableExecutablePath(const fs::path&);
 bool IsBootableDiscImagePath(const fs::path&);
 bool TryRegisterBootable(const fs::path&);
 bool TryUpdateLastBootedTime(const fs::path&);
-void ScanBootables(const fs::path&, bool = true);
+void ScanBootables(const fs::path&, bool = true, const BootableScanProgressCallback& = BootableScanProgressCallback());
 std::set<fs::path> GetActiveBootableDirectories();
 void PurgeInexistingFiles();
 void FetchGameTitles();
@@ -3,11 +3,12 @@
 #include "string_format.h"
 #include "PS2VM.h"
 
-void CStatsManager::OnNewFrame(uint32 drawCalls)
+void CStatsManager::OnNewFrame(uint32 drawCalls, uint32 primitives)
 {
 	std::lock_guard<std::mutex> statsLock(m_statsMutex);
 	m_frames++;
 	m_drawCalls += drawCalls;
+	m_primitives += primitives;
 }
 
 uint32 CStatsManager::GetFrames()
@@ -22,6 +23,12 @@ uint32 CStatsManager::GetDrawCalls()
 	return m_drawCalls;
 }
 
+uint32 CStatsManager::GetPrimitives()
+{
+	std::lock_guard<std::mutex> statsLock(m_statsMutex);
+	return m_primitives;
+}
+
 #ifdef PROFILE
 
 std::string CStatsManager::GetProfilingInfo()
@@ -69,6 +76,35 @@ std::string CStatsManager::GetProfilingInfo()
 
 		result += string_format("EE Usage:  %6.2f%%\r\n", (1.f - eeIdleRatio) * 100.f);
 		result += string_format("IOP Usage: %6.2f%%\r\n", (1.f - iopIdleRatio) * 100.f);
+
+		if(m_frames != 0)
+		{
+			result += string_format("Slices:    %6d/frame (%d skipped idle)\r\n",
+			                        m_cpuUtilisation.sliceCount / m_frames, m_cpuUtilisation.idleSkipCount / m_frames);
+			result += string_format("SIF:       %6d packets/frame (%d bytes), %d DMAs/frame (%d bytes)\r\n",
+			                        m_cpuUtilisation.sifPacketCount / m_frames, m_cpuUtilisation.sifPacketBytes / m_frames,
+			                        m_cpuUtilisation.sifDmaCount / m_frames, m_cpuUtilisation.sifDmaBytes / m_frames);
+			result += string_format("GS Image:  %6d packets/frame (%d bytes), %d stalls, %d overflows\r\n",
+			                        m_cpuUtilisation.gsImagePacketCount / m_frames, m_cpuUtilisation.gsImageBytes / m_frames,
+			                        m_cpuUtilisation.gsImageStallCount, m_cpuUtilisation.gsImageOverflowCount);
+			result += string_format("GS Writes: %6d/frame, %d submits/frame (threshold %d), %d stalls\r\n",
+			                        m_cpuUtilisation.gsWriteCount / m_frames, m_cpuUtilisation.gsSubmitCount / m_frames,
+			                        m_cpuUtilisation.gsSubmitThreshold, m_cpuUtilisation.gsWriteStallCount);
+			result += string_format("GS Thread: %6.2fms idle/frame, %.2fms waited on/frame\r\n",
+			                        static_cast<float>(m_cpuUtilisation.gsIdleTime) / static_cast<float>(m_frames * 1000),
+			                        static_cast<float>(m_cpuUtilisation.gsWaitTime) / static_cast<float>(m_frames * 1000));
+			for(const auto& devicePair : m_cpuUtilisation.iomanDevices)
+			{
+				const auto& deviceInfo = devicePair.second;
+				if(deviceInfo.readCount == 0) continue;
+				float avgReadTime = static_cast<float>(deviceInfo.readTime) / static_cast<float>(deviceInfo.readCount * 1000);
+				float maxReadTime = static_cast<float>(deviceInfo.maxReadTime) / 1000.f;
+				result += string_format("IO %-7s %6d reads/frame (%d bytes, %d async), %.2fms avg, %.2fms max\r\n",
+				                        devicePair.first.c_str(), deviceInfo.readCount / m_frames,
+				                        static_cast<int32>(deviceInfo.readBytes / m_frames), deviceInfo.asyncReadCount / m_frames,
+				                        avgReadTime, maxReadTime);
+			}
+		}
 	}
 
 	return result;
@@ -81,6 +117,7 @@ void CStatsManager::ClearStats()
 	std::lock_guard<std::mutex> statsLock(m_statsMutex);
 	m_frames = 0;
 	m_drawCalls = 0;
+	m_primitives = 0;
 #ifdef PROFILE
 	for(auto& zonePair : m_profilerZones)
 	{
@@ -112,6 +149,32 @@ void CStatsManager::OnProfileFrameDone(CPS2VM* virtualMachine, const CProfiler::
 	m_cpuUtilisation.eeIdleTicks += cpuUtilisation.eeIdleTicks;
 	m_cpuUtilisation.iopTotalTicks += cpuUtilisation.iopTotalTicks;
 	m_cpuUtilisation.iopIdleTicks += cpuUtilisation.iopIdleTicks;
+	m_cpuUtilisation.sliceCount += cpuUtilisation.sliceCount;
+	m_cpuUtilisation.idleSkipCount += cpuUtilisation.idleSkipCount;
+	m_cpuUtilisation.sifPacketCount += cpuUtilisation.sifPacketCount;
+	m_cpuUtilisation.sifPacketBytes += cpuUtilisation.sifPacketBytes;
+	m_cpuUtilisation.sifDmaCount += cpuUtilisation.sifDmaCount;
+	m_cpuUtilisation.sifDmaBytes += cpuUtilisation.sifDmaBytes;
+	m_cpuUtilisation.gsImagePacketCount += cpuUtilisation.gsImagePacketCount;
+	m_cpuUtilisation.gsImageBytes += cpuUtilisation.gsImageBytes;
+	m_cpuUtilisation.gsImageStallCount += cpuUtilisation.gsImageStallCount;
+	m_cpuUtilisation.gsImageOverflowCount += cpuUtilisation.gsImageOverflowCount;
+	m_cpuUtilisation.gsWriteCount += cpuUtilisation.gsWriteCount;
+	m_cpuUtilisation.gsSubmitCount += cpuUtilisation.gsSubmitCount;
+	m_cpuUtilisation.gsSubmitThreshold = cpuUtilisation.gsSubmitThreshold;
+	m_cpuUtilisation.gsWriteStallCount += cpuUtilisation.gsWriteStallCount;
+	m_cpuUtilisation.gsIdleTime += cpuUtilisation.gsIdleTime;
+	m_cpuUtilisation.gsWaitTime += cpuUtilisation.gsWaitTime;
+	for(const auto& devicePair : cpuUtilisation.iomanDevices)
+	{
+		const auto& deviceInfo = devicePair.second;
+		auto& totalDeviceInfo = m_cpuUtilisation.iomanDevices[devicePair.first];
+		totalDeviceInfo.readCount += deviceInfo.readCount;
+		totalDeviceInfo.asyncReadCount += deviceInfo.asyncReadCount;
+		totalDeviceInfo.readBytes += deviceInfo.readBytes;
+		totalDeviceInfo.readTime += deviceInfo.readTime;
+		totalDeviceInfo.maxReadTime = std::max(totalDeviceInfo.maxReadTime, deviceInfo.maxReadTime);
+	}
 }
 
 #endif
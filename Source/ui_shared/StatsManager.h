@@ -10,10 +10,11 @@
 class CStatsManager : public CSingleton<CStatsManager>
 {
 public:
-	void OnNewFrame(uint32);
+	void OnNewFrame(uint32, uint32);
 
 	uint32 GetFrames();
 	uint32 GetDrawCalls();
+	uint32 GetPrimitives();
 #ifdef PROFILE
 	std::string GetProfilingInfo();
 #endif
@@ -29,6 +30,7 @@ private:
 
 	uint32 m_frames = 0;
 	uint32 m_drawCalls = 0;
+	uint32 m_primitives = 0;
 
 #ifdef PROFILE
 	struct ZONEINFO
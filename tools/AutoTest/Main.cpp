@@ -1,4 +1,8 @@
+#include <atomic>
+#include <chrono>
 #include "PS2VM.h"
+#include "PS2VM_Preferences.h"
+#include "AppConfig.h"
 #include "filesystem_def.h"
 #include "StdStream.h"
 #include "StdStreamUtils.h"
@@ -72,16 +76,46 @@ std::vector<std::string> ReadLines(Framework::CStream& inputStream)
 	return lines;
 }
 
-TESTRESULT GetTestResult(const fs::path& testFilePath)
+enum TEST_MODE
+{
+	TEST_MODE_DEFAULT,
+	TEST_MODE_IOPTHREAD,
+	TEST_MODE_MIXED,
+};
+
+struct TEST_EXECUTION_STATS
+{
+	double elapsedMs = 0;
+	uint32 compiledBlockCount = 0;
+	uint32 interpretedBlockCount = 0;
+};
+
+typedef std::chrono::steady_clock TestClockType;
+
+fs::path GetResultFilePath(const fs::path& testFilePath, TEST_MODE testMode)
+{
+	auto resultFilePath = testFilePath;
+	switch(testMode)
+	{
+	case TEST_MODE_IOPTHREAD:
+		resultFilePath.replace_extension(".iopthread.result");
+		break;
+	case TEST_MODE_MIXED:
+		resultFilePath.replace_extension(".mixed.result");
+		break;
+	default:
+		resultFilePath.replace_extension(".result");
+		break;
+	}
+	return resultFilePath;
+}
+
+TESTRESULT CompareTestOutputs(const fs::path& resultFilePath, const fs::path& expectedFilePath)
 {
 	TESTRESULT result;
 	result.succeeded = false;
 	try
 	{
-		auto resultFilePath = testFilePath;
-		resultFilePath.replace_extension(".result");
-		auto expectedFilePath = testFilePath;
-		expectedFilePath.replace_extension(".expected");
 		auto resultStream = Framework::CreateInputStdStream(resultFilePath.string());
 		auto expectedStream = Framework::CreateInputStdStream(expectedFilePath.string());
 
@@ -110,21 +144,59 @@ TESTRESULT GetTestResult(const fs::path& testFilePath)
 	return result;
 }
 
-void ExecuteEeTest(const fs::path& testFilePath, const std::string& gsHandlerName)
+TESTRESULT GetTestResult(const fs::path& testFilePath)
 {
-	auto resultFilePath = testFilePath;
-	resultFilePath.replace_extension(".result");
+	auto expectedFilePath = testFilePath;
+	expectedFilePath.replace_extension(".expected");
+	return CompareTestOutputs(GetResultFilePath(testFilePath, TEST_MODE_DEFAULT), expectedFilePath);
+}
+
+//Output produced in a different execution mode must match the default mode's output
+TESTRESULT GetModeCheckResult(const fs::path& testFilePath, TEST_MODE testMode)
+{
+	return CompareTestOutputs(GetResultFilePath(testFilePath, testMode), GetResultFilePath(testFilePath, TEST_MODE_DEFAULT));
+}
+
+void SetupTestMode(CPS2VM& virtualMachine, TEST_MODE testMode)
+{
+	virtualMachine.SetIopThreadMode(false, 0);
+	virtualMachine.SetExecutionModes(false, false);
+	switch(testMode)
+	{
+	case TEST_MODE_IOPTHREAD:
+		virtualMachine.SetIopThreadMode(true, CAppConfig::GetInstance().GetPreferenceInteger(PREF_PS2_IOP_THREAD_WINDOW));
+		break;
+	case TEST_MODE_MIXED:
+		virtualMachine.SetExecutionModes(true, true);
+		break;
+	default:
+		break;
+	}
+}
+
+double GetElapsedMs(TestClockType::time_point startTime, TestClockType::time_point endTime)
+{
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+	return static_cast<double>(elapsed.count()) / 1000.0;
+}
+
+TEST_EXECUTION_STATS ExecuteEeTest(const fs::path& testFilePath, const std::string& gsHandlerName, TEST_MODE testMode)
+{
+	auto resultFilePath = GetResultFilePath(testFilePath, testMode);
 	auto resultStream = new Framework::CStdStream(resultFilePath.string().c_str(), "wb");
 
-	bool executionOver = false;
+	std::atomic<bool> executionOver = false;
+	TestClockType::time_point endTime;
 
 	//Setup virtual machine
 	CPS2VM virtualMachine;
 	virtualMachine.Initialize();
 	virtualMachine.Reset();
 	virtualMachine.CreateGSHandler(GetGsHandlerFactoryFunction(gsHandlerName));
+	SetupTestMode(virtualMachine, testMode);
 	auto connection = virtualMachine.m_ee->m_os->OnRequestExit.Connect(
-	    [&executionOver]() {
+	    [&executionOver, &endTime]() {
+		    endTime = TestClockType::now();
 		    executionOver = true;
 	    });
 	virtualMachine.m_ee->m_os->BootFromFile(testFilePath);
@@ -132,6 +204,7 @@ void ExecuteEeTest(const fs::path& testFilePath, const std::string& gsHandlerNam
 		auto iopOs = dynamic_cast<CIopBios*>(virtualMachine.m_iop->m_bios.get());
 		iopOs->GetIoman()->SetFileStream(Iop::CIoman::FID_STDOUT, resultStream);
 	}
+	auto startTime = TestClockType::now();
 	virtualMachine.Resume();
 
 	while(!executionOver)
@@ -140,11 +213,18 @@ void ExecuteEeTest(const fs::path& testFilePath, const std::string& gsHandlerNam
 	}
 
 	virtualMachine.Pause();
+
+	TEST_EXECUTION_STATS stats;
+	stats.elapsedMs = GetElapsedMs(startTime, endTime);
+	stats.compiledBlockCount = virtualMachine.m_ee->m_EE.m_executor->GetCompiledBlockCount();
+	stats.interpretedBlockCount = virtualMachine.m_ee->m_EE.m_executor->GetInterpretedBlockCount();
+
 	virtualMachine.DestroyGSHandler();
 	virtualMachine.Destroy();
+	return stats;
 }
 
-void ExecuteIopTest(const fs::path& testFilePath)
+TEST_EXECUTION_STATS ExecuteIopTest(const fs::path& testFilePath, TEST_MODE testMode)
 {
 	//Read in the module data
 	std::vector<uint8> moduleData;
@@ -155,30 +235,33 @@ void ExecuteIopTest(const fs::path& testFilePath)
 		moduleStream.Read(moduleData.data(), length);
 	}
 
-	auto resultFilePath = testFilePath;
-	resultFilePath.replace_extension(".result");
+	auto resultFilePath = GetResultFilePath(testFilePath, testMode);
 	auto resultStream = new Framework::CStdStream(resultFilePath.string().c_str(), "wb");
 
-	bool executionOver = false;
+	std::atomic<bool> executionOver = false;
+	TestClockType::time_point endTime;
 	CIopBios::ModuleStartedEvent::Connection connection;
 	//Setup virtual machine
 	CPS2VM virtualMachine;
 	virtualMachine.Initialize();
 	virtualMachine.Reset();
 	virtualMachine.CreateGSHandler(CGSH_Null::GetFactoryFunction());
+	SetupTestMode(virtualMachine, testMode);
 	{
 		auto iopOs = dynamic_cast<CIopBios*>(virtualMachine.m_iop->m_bios.get());
 		int32 rootModuleId = iopOs->LoadModuleFromHost(moduleData.data());
 		connection = iopOs->OnModuleStarted.Connect(
-		    [&executionOver, rootModuleId](uint32 moduleId) {
+		    [&executionOver, &endTime, rootModuleId](uint32 moduleId) {
 			    if(rootModuleId == moduleId)
 			    {
+				    endTime = TestClockType::now();
 				    executionOver = true;
 			    }
 		    });
 		iopOs->StartModule(rootModuleId, "", nullptr, 0);
 		iopOs->GetIoman()->SetFileStream(Iop::CIoman::FID_STDOUT, resultStream);
 	}
+	auto startTime = TestClockType::now();
 	virtualMachine.Resume();
 
 	while(!executionOver)
@@ -187,10 +270,43 @@ void ExecuteIopTest(const fs::path& testFilePath)
 	}
 
 	virtualMachine.Pause();
+
+	TEST_EXECUTION_STATS stats;
+	stats.elapsedMs = GetElapsedMs(startTime, endTime);
+	stats.compiledBlockCount = virtualMachine.m_iop->m_cpu.m_executor->GetCompiledBlockCount();
+	stats.interpretedBlockCount = virtualMachine.m_iop->m_cpu.m_executor->GetInterpretedBlockCount();
+
 	virtualMachine.Destroy();
+	return stats;
+}
+
+void ReportIopThreadCheck(const fs::path& testPath, const TestReportWriterPtr& testReportWriter)
+{
+	auto result = GetModeCheckResult(testPath, TEST_MODE_IOPTHREAD);
+	printf("Checking '%s' with IOP thread: %s.\r\n", testPath.string().c_str(), result.succeeded ? "SUCCEEDED" : "FAILED");
+	if(testReportWriter)
+	{
+		testReportWriter->ReportTestEntry(testPath.string() + " (IOP thread)", result);
+	}
+}
+
+//Compares output against the JIT run and reports how both execution modes performed
+void ReportMixedCheck(const fs::path& testPath, const TestReportWriterPtr& testReportWriter,
+                            const TEST_EXECUTION_STATS& jitStats, const TEST_EXECUTION_STATS& mixedStats)
+{
+	auto result = GetModeCheckResult(testPath, TEST_MODE_MIXED);
+	uint32 totalBlockCount = mixedStats.compiledBlockCount + mixedStats.interpretedBlockCount;
+	double interpretedRatio = (totalBlockCount != 0) ? (static_cast<double>(mixedStats.interpretedBlockCount) * 100.0 / static_cast<double>(totalBlockCount)) : 0;
+	printf("Checking '%s' with mixed execution: %s (JIT: %0.1fms, mixed: %0.1fms, %0.1f%% of %d blocks interpreted).\r\n",
+	       testPath.string().c_str(), result.succeeded ? "SUCCEEDED" : "FAILED",
+	       jitStats.elapsedMs, mixedStats.elapsedMs, interpretedRatio, totalBlockCount);
+	if(testReportWriter)
+	{
+		testReportWriter->ReportTestEntry(testPath.string() + " (Mixed)", result);
+	}
 }
 
-void ScanAndExecuteTests(const fs::path& testDirPath, const TestReportWriterPtr& testReportWriter, const std::string& gsHandlerName)
+void ScanAndExecuteTests(const fs::path& testDirPath, const TestReportWriterPtr& testReportWriter, const std::string& gsHandlerName, bool iopThreadCheck, bool mixedCheck)
 {
 	fs::directory_iterator endIterator;
 	for(auto testPathIterator = fs::directory_iterator(testDirPath);
@@ -199,30 +315,50 @@ void ScanAndExecuteTests(const fs::path& testDirPath, const TestReportWriterPtr&
 		auto testPath = testPathIterator->path();
 		if(fs::is_directory(testPath))
 		{
-			ScanAndExecuteTests(testPath, testReportWriter, gsHandlerName);
+			ScanAndExecuteTests(testPath, testReportWriter, gsHandlerName, iopThreadCheck, mixedCheck);
 			continue;
 		}
 		if(testPath.extension() == ".elf")
 		{
 			printf("Testing '%s': ", testPath.string().c_str());
-			ExecuteEeTest(testPath, gsHandlerName);
+			auto stats = ExecuteEeTest(testPath, gsHandlerName, TEST_MODE_DEFAULT);
 			auto result = GetTestResult(testPath);
 			printf("%s.\r\n", result.succeeded ? "SUCCEEDED" : "FAILED");
 			if(testReportWriter)
 			{
 				testReportWriter->ReportTestEntry(testPath.string(), result);
 			}
+			if(iopThreadCheck)
+			{
+				ExecuteEeTest(testPath, gsHandlerName, TEST_MODE_IOPTHREAD);
+				ReportIopThreadCheck(testPath, testReportWriter);
+			}
+			if(mixedCheck)
+			{
+				auto mixedStats = ExecuteEeTest(testPath, gsHandlerName, TEST_MODE_MIXED);
+				ReportMixedCheck(testPath, testReportWriter, stats, mixedStats);
+			}
 		}
 		else if(testPath.extension() == ".irx")
 		{
 			printf("Testing '%s': ", testPath.string().c_str());
-			ExecuteIopTest(testPath);
+			auto stats = ExecuteIopTest(testPath, TEST_MODE_DEFAULT);
 			auto result = GetTestResult(testPath);
 			printf("%s.\r\n", result.succeeded ? "SUCCEEDED" : "FAILED");
 			if(testReportWriter)
 			{
 				testReportWriter->ReportTestEntry(testPath.string(), result);
 			}
+			if(iopThreadCheck)
+			{
+				ExecuteIopTest(testPath, TEST_MODE_IOPTHREAD);
+				ReportIopThreadCheck(testPath, testReportWriter);
+			}
+			if(mixedCheck)
+			{
+				auto mixedStats = ExecuteIopTest(testPath, TEST_MODE_MIXED);
+				ReportMixedCheck(testPath, testReportWriter, stats, mixedStats);
+			}
 		}
 	}
 }
@@ -251,6 +387,8 @@ int main(int argc, const char** argv)
 		printf("\t --junitreport <path>\t Writes JUnit format report at <path>.\r\n");
 		printf("\t --gshandler <%s>\tSelects which GS handler to instantiate (default is '%s').\r\n",
 		       validGsHandlerNamesString.c_str(), DEFAULT_GS_HANDLER_NAME);
+		printf("\t --iopthreadcheck\t Runs every test a second time with the IOP on its own thread and compares outputs.\r\n");
+		printf("\t --mixedcheck\t\t Runs every test a second time with EE and IOP blocks interpreted when possible, compares outputs and execution times.\r\n");
 		return -1;
 	}
 
@@ -258,6 +396,8 @@ int main(int argc, const char** argv)
 	fs::path autoTestRoot;
 	fs::path reportPath;
 	std::string gsHandlerName = DEFAULT_GS_HANDLER_NAME;
+	bool iopThreadCheck = false;
+	bool mixedCheck = false;
 	assert(g_validGsHandlersNames.find(gsHandlerName) != std::end(g_validGsHandlersNames));
 
 	for(int i = 1; i < argc; i++)
@@ -288,6 +428,14 @@ int main(int argc, const char** argv)
 			}
 			i++;
 		}
+		else if(!strcmp(argv[i], "--iopthreadcheck"))
+		{
+			iopThreadCheck = true;
+		}
+		else if(!strcmp(argv[i], "--mixedcheck"))
+		{
+			mixedCheck = true;
+		}
 		else
 		{
 			autoTestRoot = argv[i];
@@ -303,7 +451,7 @@ int main(int argc, const char** argv)
 
 	try
 	{
-		ScanAndExecuteTests(autoTestRoot, testReportWriter, gsHandlerName);
+		ScanAndExecuteTests(autoTestRoot, testReportWriter, gsHandlerName, iopThreadCheck, mixedCheck);
 	}
 	catch(const std::exception& exception)
 	{
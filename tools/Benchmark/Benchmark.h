@@ -0,0 +1,26 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+class CBenchmark
+{
+public:
+	virtual ~CBenchmark() = default;
+	virtual void Execute() = 0;
+
+protected:
+	typedef std::chrono::steady_clock ClockType;
+
+	static double GetElapsedMs(ClockType::time_point startTime)
+	{
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(ClockType::now() - startTime);
+		return static_cast<double>(elapsed.count()) / 1000.0;
+	}
+
+	static void Report(const char* name, double elapsedMs, double operationCount)
+	{
+		double rate = (elapsedMs != 0) ? (operationCount / (elapsedMs * 1000.0)) : 0;
+		printf("%-40s %10.2fms %10.2fM ops/s\n", name, elapsedMs, rate);
+	}
+};
@@ -0,0 +1,190 @@
+#include "GifPacketBenchmark.h"
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include "Ps2Const.h"
+#include "FrameDump.h"
+#include "MIPS.h"
+#include "ee/DMAC.h"
+#include "ee/GIF.h"
+#include "gs/GSH_Null.h"
+
+enum
+{
+	PASS_COUNT = 64,
+	STREAM_PACKET_COUNT = 0x800,
+	STRIP_VERTEX_COUNT = 64,
+	SPRITE_COUNT = 32,
+};
+
+class CPacketStreamWriter
+{
+public:
+	CPacketStreamWriter(std::vector<uint8>& stream)
+	    : m_stream(stream)
+	{
+	}
+
+	void WriteTag(uint32 loops, bool eop, bool pre, uint32 prim, uint32 cmd, const std::vector<uint8>& regs)
+	{
+		uint64 tag = loops & 0x7FFF;
+		tag |= static_cast<uint64>(eop ? 1 : 0) << 15;
+		tag |= static_cast<uint64>(pre ? 1 : 0) << 46;
+		tag |= static_cast<uint64>(prim & 0x7FF) << 47;
+		tag |= static_cast<uint64>(cmd & 0x03) << 58;
+		tag |= static_cast<uint64>(regs.size() & 0x0F) << 60;
+		uint64 regList = 0;
+		for(uint32 i = 0; i < regs.size(); i++)
+		{
+			regList |= static_cast<uint64>(regs[i]) << (i * 4);
+		}
+		Write64(tag);
+		Write64(regList);
+	}
+
+	void Write32(uint32 v0, uint32 v1, uint32 v2, uint32 v3)
+	{
+		uint32 values[4] = {v0, v1, v2, v3};
+		Write(values, sizeof(values));
+	}
+
+	void Write64(uint64 value)
+	{
+		Write(&value, sizeof(value));
+	}
+
+	void Align()
+	{
+		while(m_stream.size() & 0x0F)
+		{
+			m_stream.push_back(0);
+		}
+	}
+
+private:
+	void Write(const void* data, size_t size)
+	{
+		auto bytes = reinterpret_cast<const uint8*>(data);
+		m_stream.insert(m_stream.end(), bytes, bytes + size);
+	}
+
+	std::vector<uint8>& m_stream;
+};
+
+//Textured, gouraud shaded triangle strips, each preceded by a small A+D state block
+CGifPacketBenchmark::PacketStream CGifPacketBenchmark::CreateVertexStream()
+{
+	PacketStream stream;
+	CPacketStreamWriter writer(stream);
+	for(uint32 packet = 0; packet < STREAM_PACKET_COUNT; packet++)
+	{
+		writer.WriteTag(1, false, false, 0, 0, {0x0E, 0x0E});
+		writer.Write64(0x0000000000000044);
+		writer.Write64(GS_REG_ALPHA_1);
+		writer.Write64(0x0000000000070000);
+		writer.Write64(GS_REG_TEST_1);
+
+		//PRIM: triangle strip, gouraud, textured
+		writer.WriteTag(STRIP_VERTEX_COUNT, (packet + 1) == STREAM_PACKET_COUNT, true, 0x1C, 0, {0x02, 0x01, 0x05});
+		for(uint32 vertex = 0; vertex < STRIP_VERTEX_COUNT; vertex++)
+		{
+			writer.Write32(0x3F000000 + vertex, 0x3E800000 + vertex, 0x3F800000, 0);
+			writer.Write32(vertex & 0xFF, 0x80, 0x40, 0x80);
+			writer.Write32(0x8000 + (vertex << 4), 0x8000 + ((vertex & 1) << 8), 0x1000, ((vertex < 2) ? 0x8000 : 0));
+		}
+	}
+	return stream;
+}
+
+//Render state changes issued as long lists of A+D writes
+CGifPacketBenchmark::PacketStream CGifPacketBenchmark::CreateStateStream()
+{
+	static const uint8 stateRegisters[] =
+	    {
+	        GS_REG_TEX1_1,
+	        GS_REG_ALPHA_1,
+	        GS_REG_TEST_1,
+	        GS_REG_SCISSOR_1,
+	        GS_REG_FBA_1,
+	        GS_REG_PABE,
+	        GS_REG_TEXA,
+	        GS_REG_COLCLAMP,
+	    };
+
+	PacketStream stream;
+	CPacketStreamWriter writer(stream);
+	for(uint32 packet = 0; packet < STREAM_PACKET_COUNT; packet++)
+	{
+		writer.WriteTag(32, (packet + 1) == STREAM_PACKET_COUNT, false, 0, 0, {0x0E});
+		for(uint32 i = 0; i < 32; i++)
+		{
+			writer.Write64(i);
+			writer.Write64(stateRegisters[i % (sizeof(stateRegisters) / sizeof(stateRegisters[0]))]);
+		}
+	}
+	return stream;
+}
+
+//Sprites sent in REGLIST mode
+CGifPacketBenchmark::PacketStream CGifPacketBenchmark::CreateRegListStream()
+{
+	PacketStream stream;
+	CPacketStreamWriter writer(stream);
+	for(uint32 packet = 0; packet < STREAM_PACKET_COUNT; packet++)
+	{
+		//PRIM: sprite, textured, UV
+		writer.WriteTag(SPRITE_COUNT, (packet + 1) == STREAM_PACKET_COUNT, true, 0x156, 1,
+		                {GS_REG_RGBAQ, GS_REG_UV, GS_REG_XYZ2, GS_REG_UV, GS_REG_XYZ2, 0x0F});
+		for(uint32 sprite = 0; sprite < SPRITE_COUNT; sprite++)
+		{
+			writer.Write64(0x3F80000080808080);
+			writer.Write64(0x00000000);
+			writer.Write64(0x0000100080008000 + (sprite << 4));
+			writer.Write64(0x0100010001000100);
+			writer.Write64(0x0000100081008100 + (sprite << 4));
+			writer.Write64(0);
+		}
+		writer.Align();
+	}
+	return stream;
+}
+
+void CGifPacketBenchmark::ProcessStream(const char* name, const PacketStream& stream)
+{
+	std::vector<uint8> ram(PS2::EE_RAM_SIZE);
+	std::vector<uint8> spr(PS2::EE_SPR_SIZE);
+	std::vector<uint8> vuMem0(PS2::VUMEM0SIZE);
+	assert(stream.size() <= ram.size());
+	memcpy(ram.data(), stream.data(), stream.size());
+
+	CMIPS ee(MEMORYMAP_ENDIAN_LSBF);
+	CDMAC dmac(ram.data(), spr.data(), vuMem0.data(), ee);
+	CGSHandler* gs = new CGSH_Null();
+	gs->Initialize();
+	CGIF gif(gs, dmac, ram.data(), spr.data());
+
+	auto streamSize = static_cast<uint32>(stream.size());
+	auto startTime = ClockType::now();
+	for(uint32 pass = 0; pass < PASS_COUNT; pass++)
+	{
+		uint32 processed = gif.ProcessMultiplePackets(ram.data(), PS2::EE_RAM_SIZE, 0, streamSize, CGsPacketMetadata(3));
+		assert(processed == streamSize);
+		gs->Finish();
+	}
+	auto elapsedMs = GetElapsedMs(startTime);
+
+	gs->Release();
+	delete gs;
+
+	//Reported rate is in millions of qwords per second
+	Report(name, elapsedMs, static_cast<double>(streamSize / 0x10) * PASS_COUNT);
+}
+
+void CGifPacketBenchmark::Execute()
+{
+	printf("GIF packet processing:\n");
+
+	ProcessStream("  PACKED triangle strips (ST, RGBAQ, XYZ2)", CreateVertexStream());
+	ProcessStream("  PACKED A+D", CreateStateStream());
+	ProcessStream("  REGLIST sprites", CreateRegListStream());
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+#include "Benchmark.h"
+#include "Types.h"
+
+class CGifPacketBenchmark : public CBenchmark
+{
+public:
+	void Execute() override;
+
+private:
+	typedef std::vector<uint8> PacketStream;
+
+	static PacketStream CreateVertexStream();
+	static PacketStream CreateStateStream();
+	static PacketStream CreateRegListStream();
+
+	static void ProcessStream(const char*, const PacketStream&);
+};
@@ -0,0 +1,164 @@
+#include "IsoFileReadBenchmark.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "string_format.h"
+#include "StdStream.h"
+#include "ISO9660/BlockProvider.h"
+#include "ISO9660/File.h"
+
+enum
+{
+	IMAGE_BLOCKCOUNT = 0x8000,
+	RAW_BLOCKSIZE = 0x930,
+	RAW_BLOCKHEADER_SIZE = 0x18,
+};
+
+//Copy of ISO9660::CFile's read path as it was before ReadBlocks was introduced: every
+//sector goes through the single block buffer and is then copied to the destination
+class CLegacyFile : public Framework::CStream
+{
+public:
+	CLegacyFile(ISO9660::CBlockProvider* blockProvider, uint64 start, uint64 size)
+	    : m_blockProvider(blockProvider)
+	    , m_start(start)
+	    , m_end(start + size)
+	{
+		m_blockPosition = static_cast<uint32>(m_start / ISO9660::CBlockProvider::BLOCKSIZE);
+		m_blockProvider->ReadBlock(m_blockPosition, m_block);
+	}
+
+	void Seek(int64, Framework::STREAM_SEEK_DIRECTION) override
+	{
+		assert(false);
+	}
+
+	uint64 Tell() override
+	{
+		return m_position;
+	}
+
+	uint64 Read(void* data, uint64 length) override
+	{
+		if(length == 0) return 0;
+
+		uint64 remainFileSize = m_end - (m_start + m_position);
+		if(remainFileSize == 0) m_isEof = true;
+		length = std::min<uint64>(length, remainFileSize);
+
+		uint64 total = length;
+		while(length != 0)
+		{
+			SyncBlock();
+			uint64 blockPosition = (m_start + m_position) % ISO9660::CBlockProvider::BLOCKSIZE;
+			uint64 blockRemain = ISO9660::CBlockProvider::BLOCKSIZE - blockPosition;
+			uint64 toRead = std::min<uint64>(length, blockRemain);
+
+			memcpy(data, m_block + blockPosition, static_cast<uint32>(toRead));
+
+			m_position += toRead;
+			length -= toRead;
+			data = reinterpret_cast<uint8*>(data) + toRead;
+		}
+
+		return total;
+	}
+
+	uint64 Write(const void*, uint64) override
+	{
+		return -1;
+	}
+
+	bool IsEOF() override
+	{
+		return m_isEof;
+	}
+
+private:
+	void SyncBlock()
+	{
+		uint32 position = static_cast<uint32>((m_start + m_position) / ISO9660::CBlockProvider::BLOCKSIZE);
+		if(position == m_blockPosition) return;
+
+		m_blockProvider->ReadBlock(position, m_block);
+		m_blockPosition = position;
+	}
+
+	ISO9660::CBlockProvider* m_blockProvider = nullptr;
+	uint64 m_start = 0;
+	uint64 m_end = 0;
+	uint64 m_position = 0;
+	uint32 m_blockPosition = 0;
+	bool m_isEof = false;
+	uint8 m_block[ISO9660::CBlockProvider::BLOCKSIZE];
+};
+
+//Returns nullptr if the temporary file couldn't be created
+static std::shared_ptr<Framework::CStream> CreateImageStream(uint32 rawBlockSize)
+{
+	auto file = tmpfile();
+	if(!file) return std::shared_ptr<Framework::CStream>();
+	auto stream = std::make_shared<Framework::CStdStream>(file);
+	std::vector<uint8> block(rawBlockSize);
+	for(uint32 i = 0; i < IMAGE_BLOCKCOUNT; i++)
+	{
+		memset(block.data(), static_cast<uint8>(i), rawBlockSize);
+		stream->Write(block.data(), rawBlockSize);
+	}
+	return stream;
+}
+
+template <typename FileType>
+void CIsoFileReadBenchmark::ReadFile(const char* name, ISO9660::CBlockProvider& provider, uint32 chunkSize)
+{
+	static const uint64 fileStart = 0x123;
+	static const uint64 fileSize = (static_cast<uint64>(IMAGE_BLOCKCOUNT - 1) * ISO9660::CBlockProvider::BLOCKSIZE) - fileStart;
+
+	FileType file(&provider, fileStart, fileSize);
+	std::vector<uint8> buffer(chunkSize);
+	uint64 total = 0;
+	auto startTime = ClockType::now();
+	while(!file.IsEOF())
+	{
+		uint64 amountRead = file.Read(buffer.data(), chunkSize);
+		if(amountRead == 0) break;
+		total += amountRead;
+	}
+	auto elapsedMs = GetElapsedMs(startTime);
+	if(total != fileSize)
+	{
+		printf("  read %llu bytes, expected %llu\n", static_cast<unsigned long long>(total), static_cast<unsigned long long>(fileSize));
+	}
+	auto reportName = string_format("  %s (%dKB reads)", name, chunkSize / 1024);
+	//Reported rate is in MB/s
+	Report(reportName.c_str(), elapsedMs, static_cast<double>(total));
+}
+
+void CIsoFileReadBenchmark::Execute()
+{
+	printf("ISO9660 file reads:\n");
+
+	auto image2048 = CreateImageStream(ISO9660::CBlockProvider::BLOCKSIZE);
+	auto imageXa = CreateImageStream(RAW_BLOCKSIZE);
+	if(!image2048 || !imageXa)
+	{
+		printf("  failed to create temporary image files, skipping\n");
+		return;
+	}
+
+	ISO9660::CBlockProvider2048 provider2048(image2048);
+	ISO9660::CBlockProviderCDROMXA providerXa(imageXa);
+
+	static const uint32 chunkSizes[] = {0x800, 0x10000, 0x100000};
+	for(auto chunkSize : chunkSizes)
+	{
+		ReadFile<CLegacyFile>("2048 previous CFile", provider2048, chunkSize);
+		ReadFile<ISO9660::CFile>("2048 CFile", provider2048, chunkSize);
+		ReadFile<CLegacyFile>("CDROM XA previous CFile", providerXa, chunkSize);
+		ReadFile<ISO9660::CFile>("CDROM XA CFile", providerXa, chunkSize);
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Benchmark.h"
+#include "Types.h"
+
+namespace ISO9660
+{
+	class CBlockProvider;
+}
+
+class CIsoFileReadBenchmark : public CBenchmark
+{
+public:
+	void Execute() override;
+
+private:
+	template <typename FileType>
+	static void ReadFile(const char*, ISO9660::CBlockProvider&, uint32);
+};
@@ -0,0 +1,26 @@
+#include <functional>
+#include "MemoryMapBenchmark.h"
+#include "IsoFileReadBenchmark.h"
+#include "GifPacketBenchmark.h"
+
+typedef std::function<CBenchmark*()> BenchmarkFactoryFunction;
+
+// clang-format off
+static const BenchmarkFactoryFunction s_factories[] =
+{
+	[]() { return new CMemoryMapBenchmark(); },
+	[]() { return new CIsoFileReadBenchmark(); },
+	[]() { return new CGifPacketBenchmark(); },
+};
+// clang-format on
+
+int main(int argc, const char** argv)
+{
+	for(const auto& factory : s_factories)
+	{
+		auto benchmark = factory();
+		benchmark->Execute();
+		delete benchmark;
+	}
+	return 0;
+}
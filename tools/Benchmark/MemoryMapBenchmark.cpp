@@ -0,0 +1,168 @@
+#include "MemoryMapBenchmark.h"
+#include <string>
+#include <vector>
+#include "MemoryMap.h"
+
+//Layout similar to the EE's: RAM, scratchpad, hardware registers, VU memory and BIOS
+enum
+{
+	ITERATION_COUNT = 0x1000000,
+	RAM_SIZE = 0x02000000,
+	SPR_SIZE = 0x4000,
+	VUMEM_SIZE = 0x4000,
+	BIOS_SIZE = 0x400000,
+};
+
+class CBenchmarkMemoryMap : public CMemoryMap_LSBF
+{
+public:
+	//Same lookup as the one used before the page index was introduced
+	const MEMORYMAPELEMENT* GetReadMapLinear(uint32 address) const
+	{
+		for(const auto& mapElement : m_readMap)
+		{
+			if(address <= mapElement.nEnd)
+			{
+				if(!(address >= mapElement.nStart)) return nullptr;
+				return &mapElement;
+			}
+		}
+		return nullptr;
+	}
+};
+
+static uint32 s_registerValue = 0;
+
+static uint32 DirectRegisterHandler(void* context, uint32 address, uint32 value)
+{
+	auto registerValue = reinterpret_cast<uint32*>(context);
+	(*registerValue) += value;
+	return (*registerValue);
+}
+
+void CMemoryMapBenchmark::Execute()
+{
+	std::vector<uint8> ram(RAM_SIZE);
+	std::vector<uint8> spr(SPR_SIZE);
+	std::vector<uint8> vuMem(VUMEM_SIZE);
+	std::vector<uint8> bios(BIOS_SIZE);
+
+	auto functionHandler = [](uint32 address, uint32 value) {
+		s_registerValue += value;
+		return s_registerValue;
+	};
+
+	//Regions are inserted in ascending order, the linear lookup relies on this
+	CBenchmarkMemoryMap memoryMap;
+	memoryMap.InsertReadMap(0x00000000, RAM_SIZE - 1, ram.data(), 0x00);
+	memoryMap.InsertReadMap(0x10000000, 0x10FFFFFF, functionHandler, 0x01);
+	memoryMap.InsertReadMap(0x11004000, 0x11004000 + VUMEM_SIZE - 1, vuMem.data(), 0x02);
+	memoryMap.InsertReadMap(0x12000000, 0x12FFFFFF, &DirectRegisterHandler, &s_registerValue, 0x03);
+	memoryMap.InsertReadMap(0x1FC00000, 0x1FC00000 + BIOS_SIZE - 1, bios.data(), 0x04);
+	memoryMap.InsertReadMap(0x70000000, 0x70000000 + SPR_SIZE - 1, spr.data(), 0x05);
+
+	memoryMap.InsertWriteMap(0x00000000, RAM_SIZE - 1, ram.data(), 0x00);
+	memoryMap.InsertWriteMap(0x10000000, 0x10FFFFFF, functionHandler, 0x01);
+	memoryMap.InsertWriteMap(0x12000000, 0x12FFFFFF, &DirectRegisterHandler, &s_registerValue, 0x03);
+	memoryMap.InsertWriteMap(0x70000000, 0x70000000 + SPR_SIZE - 1, spr.data(), 0x05);
+
+	//Make sure every measured access actually hits the region it's supposed to measure
+	const auto hitsRegion =
+	    [](const CMemoryMap::MEMORYMAPELEMENT* element, uint32 address, uint32 mask) {
+		    return (element != nullptr) && (element->nStart <= address) && ((address + mask) <= element->nEnd);
+	    };
+
+	printf("Memory map:\n");
+
+	struct REGION
+	{
+		const char* name;
+		uint32 address;
+		uint32 mask;
+		bool writable;
+	};
+
+	// clang-format off
+	static const REGION regions[] =
+	{
+		{"  memory (ram)", 0x00000000, RAM_SIZE - 4, true},
+		{"  memory (bios)", 0x1FC00000, BIOS_SIZE - 4, false},
+		{"  std::function handler", 0x10000000, 0xFFFC, true},
+		{"  direct handler", 0x12000000, 0xFFFC, true},
+	};
+	// clang-format on
+
+	for(const auto& region : regions)
+	{
+		if(!hitsRegion(memoryMap.GetReadMap(region.address), region.address, region.mask))
+		{
+			printf("%s: read lookup misses, not measured\n", region.name);
+			continue;
+		}
+		uint32 result = 0;
+		{
+			auto startTime = ClockType::now();
+			for(uint32 i = 0; i < ITERATION_COUNT; i++)
+			{
+				uint32 address = region.address + ((i * 4) & region.mask);
+				result += memoryMap.GetWord(address);
+			}
+			auto elapsedMs = GetElapsedMs(startTime);
+			std::string name = std::string(region.name) + " read";
+			Report(name.c_str(), elapsedMs, ITERATION_COUNT);
+		}
+		if(region.writable && !hitsRegion(memoryMap.GetWriteMap(region.address), region.address, region.mask))
+		{
+			printf("%s: write lookup misses, not measured\n", region.name);
+		}
+		else if(region.writable)
+		{
+			auto startTime = ClockType::now();
+			for(uint32 i = 0; i < ITERATION_COUNT; i++)
+			{
+				uint32 address = region.address + ((i * 4) & region.mask);
+				memoryMap.SetWord(address, i);
+			}
+			auto elapsedMs = GetElapsedMs(startTime);
+			std::string name = std::string(region.name) + " write";
+			Report(name.c_str(), elapsedMs, ITERATION_COUNT);
+		}
+		//Prevent the compiler from removing the reads
+		if(result == 0xFFFFFFFF) printf("%d\n", result);
+	}
+
+	printf("Memory map lookup:\n");
+
+	//Addresses are spread over all regions, including unmapped ones
+	std::vector<uint32> addresses(0x10000);
+	for(uint32 i = 0; i < addresses.size(); i++)
+	{
+		addresses[i] = (i * 0x9E3779B1) & 0x7FFFFFFC;
+		if((i % 2) == 0) addresses[i] &= 0x1FFFFFFF;
+	}
+
+	uint32 indexedFound = 0;
+	{
+		auto startTime = ClockType::now();
+		for(uint32 i = 0; i < ITERATION_COUNT; i++)
+		{
+			indexedFound += (memoryMap.GetReadMap(addresses[i & 0xFFFF]) != nullptr) ? 1 : 0;
+		}
+		Report("  indexed lookup", GetElapsedMs(startTime), ITERATION_COUNT);
+	}
+
+	uint32 linearFound = 0;
+	{
+		auto startTime = ClockType::now();
+		for(uint32 i = 0; i < ITERATION_COUNT; i++)
+		{
+			linearFound += (memoryMap.GetReadMapLinear(addresses[i & 0xFFFF]) != nullptr) ? 1 : 0;
+		}
+		Report("  linear lookup", GetElapsedMs(startTime), ITERATION_COUNT);
+	}
+
+	if(indexedFound != linearFound)
+	{
+		printf("  mismatch between indexed (%d) and linear (%d) lookups, results are invalid\n", indexedFound, linearFound);
+	}
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Benchmark.h"
+
+class CMemoryMapBenchmark : public CBenchmark
+{
+public:
+	void Execute() override;
+};
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "InputScript.h"
+#include "ControllerInfo.h"
+#include "PH_Generic.h"
+#include "string_format.h"
+
+static uint32 GetButtonFromName(const std::string& name)
+{
+	for(uint32 i = 0; i < PS2::CControllerInfo::MAX_BUTTONS; i++)
+	{
+		if(!strcmp(PS2::CControllerInfo::m_buttonName[i], name.c_str()))
+		{
+			return i;
+		}
+	}
+	throw std::runtime_error(string_format("Unknown button '%s'.", name.c_str()));
+}
+
+CInputScript::CInputScript(const fs::path& path)
+{
+	std::ifstream input(path);
+	if(!input)
+	{
+		throw std::runtime_error(string_format("Failed to open input script '%s'.", path.string().c_str()));
+	}
+
+	std::string line;
+	uint32 lineIndex = 0;
+	while(std::getline(input, line))
+	{
+		lineIndex++;
+		std::istringstream lineStream(line);
+		std::string firstToken;
+		if(!(lineStream >> firstToken)) continue;
+		if(firstToken[0] == '#') continue;
+
+		EVENT event;
+		std::string buttonName;
+		event.frame = std::stoul(firstToken);
+		if(!(lineStream >> buttonName >> event.value))
+		{
+			throw std::runtime_error(string_format("Invalid input script line %d.", lineIndex));
+		}
+		event.button = GetButtonFromName(buttonName);
+		m_events.push_back(event);
+	}
+
+	std::stable_sort(m_events.begin(), m_events.end(),
+	                 [](const EVENT& event1, const EVENT& event2) { return event1.frame < event2.frame; });
+}
+
+void CInputScript::Apply(uint32 frame, CPH_Generic& padHandler)
+{
+	for(; m_nextEvent < m_events.size(); m_nextEvent++)
+	{
+		const auto& event = m_events[m_nextEvent];
+		if(event.frame > frame) break;
+		if(PS2::CControllerInfo::IsAxis(static_cast<PS2::CControllerInfo::BUTTON>(event.button)))
+		{
+			padHandler.SetAxisState(event.button, event.value);
+		}
+		else
+		{
+			padHandler.SetButtonState(event.button, event.value != 0);
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include "filesystem_def.h"
+#include "Types.h"
+
+class CPH_Generic;
+
+//Timed controller input for benchmark runs.
+//
+//Each line of the script has the form "<frame> <button> <value>", where frame is
+//the emulated frame (vblank) at which the change is applied, button is one of the
+//names in CControllerInfo::m_buttonName and value is 0/1 for buttons or -1.0 to 1.0
+//for analog axes. Empty lines and lines starting with '#' are ignored.
+
+class CInputScript
+{
+public:
+	CInputScript() = default;
+	CInputScript(const fs::path&);
+
+	void Apply(uint32, CPH_Generic&);
+
+private:
+	struct EVENT
+	{
+		uint32 frame = 0;
+		uint32 button = 0;
+		float value = 0;
+	};
+	typedef std::vector<EVENT> EventArray;
+
+	EventArray m_events;
+	size_t m_nextEvent = 0;
+};
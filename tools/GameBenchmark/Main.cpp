@@ -0,0 +1,381 @@
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include "PS2VM.h"
+#include "PS2VM_Preferences.h"
+#include "AppConfig.h"
+#include "PH_Generic.h"
+#include "StdStreamUtils.h"
+#include "filesystem_def.h"
+#include "string_format.h"
+#include "gs/GSH_Null.h"
+#include "InputScript.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define DEFAULT_FRAME_COUNT 600
+#define DEFAULT_WARMUP_FRAME_COUNT 300
+#define DEFAULT_TIMEOUT_SECONDS 1800
+
+//Keeps track of emulated frames. Pad handlers are updated once per vblank on the emulation
+//thread, which makes them a convenient frame clock that also feeds the input script.
+class CBenchmarkPadHandler : public CPH_Generic
+{
+public:
+	typedef std::chrono::steady_clock ClockType;
+
+	CBenchmarkPadHandler(CInputScript inputScript, uint32 warmupFrames, uint32 measuredFrames)
+	    : m_inputScript(std::move(inputScript))
+	    , m_warmupFrames(warmupFrames)
+	    , m_endFrame(warmupFrames + measuredFrames)
+	{
+	}
+
+	void Update(uint8* ram) override
+	{
+		m_inputScript.Apply(m_frame, *this);
+		CPH_Generic::Update(ram);
+
+		m_frame++;
+		if(m_frame == m_warmupFrames)
+		{
+			m_measureStartTime = ClockType::now();
+			m_measuring = true;
+		}
+		else if(m_frame == m_endFrame)
+		{
+			std::unique_lock<std::mutex> doneLock(m_doneMutex);
+			m_measureEndTime = ClockType::now();
+			m_measuring = false;
+			m_done = true;
+			m_doneCondition.notify_all();
+		}
+	}
+
+	bool IsMeasuring() const
+	{
+		return m_measuring;
+	}
+
+	//Returns false if the requested amount of frames wasn't reached in time
+	bool WaitForCompletion(std::chrono::seconds timeout)
+	{
+		std::unique_lock<std::mutex> doneLock(m_doneMutex);
+		return m_doneCondition.wait_for(doneLock, timeout, [this]() { return m_done; });
+	}
+
+	double GetMeasuredTimeMs() const
+	{
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(m_measureEndTime - m_measureStartTime);
+		return static_cast<double>(elapsed.count()) / 1000.0;
+	}
+
+private:
+	CInputScript m_inputScript;
+	uint32 m_warmupFrames = 0;
+	uint32 m_endFrame = 0;
+	uint32 m_frame = 0;
+	std::atomic<bool> m_measuring = false;
+	ClockType::time_point m_measureStartTime;
+	ClockType::time_point m_measureEndTime;
+
+	std::mutex m_doneMutex;
+	std::condition_variable m_doneCondition;
+	bool m_done = false;
+};
+
+//Restores the preferences changed for the benchmark, even if it fails
+class CPreferenceGuard
+{
+public:
+	CPreferenceGuard()
+	    : m_limitFrameRate(CAppConfig::GetInstance().GetPreferenceBoolean(PREF_PS2_LIMIT_FRAMERATE))
+	    , m_cdrom0Path(CAppConfig::GetInstance().GetPreferencePath(PREF_PS2_CDROM0_PATH))
+	{
+	}
+
+	CPreferenceGuard(const CPreferenceGuard&) = delete;
+	CPreferenceGuard& operator=(const CPreferenceGuard&) = delete;
+
+	~CPreferenceGuard()
+	{
+		CAppConfig::GetInstance().SetPreferenceBoolean(PREF_PS2_LIMIT_FRAMERATE, m_limitFrameRate);
+		CAppConfig::GetInstance().SetPreferencePath(PREF_PS2_CDROM0_PATH, m_cdrom0Path);
+	}
+
+private:
+	bool m_limitFrameRate = false;
+	fs::path m_cdrom0Path;
+};
+
+struct BENCHMARK_REPORT
+{
+	std::string title;
+	std::string sourcePath;
+	uint32 warmupFrames = 0;
+	uint32 measuredFrames = 0;
+	double elapsedMs = 0;
+	std::map<std::string, uint64> zoneTimes;
+	std::map<std::string, uint32> compiledBlocks;
+	uint64 peakMemoryBytes = 0;
+};
+
+static uint64 GetPeakMemoryUsage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage = {};
+	if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return static_cast<uint64>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static std::string EscapeJsonString(const std::string& value)
+{
+	std::string result;
+	for(auto character : value)
+	{
+		switch(character)
+		{
+		case '\\':
+			result += "\\\\";
+			break;
+		case '"':
+			result += "\\\"";
+			break;
+		default:
+			if(static_cast<uint8>(character) < 0x20)
+			{
+				result += string_format("\\u%04x", character);
+			}
+			else
+			{
+				result += character;
+			}
+			break;
+		}
+	}
+	return result;
+}
+
+static std::string FormatReport(const BENCHMARK_REPORT& report)
+{
+	double elapsedSeconds = report.elapsedMs / 1000.0;
+	double fps = (elapsedSeconds != 0) ? (static_cast<double>(report.measuredFrames) / elapsedSeconds) : 0;
+
+	std::string result;
+	result += "{\n";
+	result += string_format("\t\"title\": \"%s\",\n", EscapeJsonString(report.title).c_str());
+	result += string_format("\t\"source\": \"%s\",\n", EscapeJsonString(report.sourcePath).c_str());
+	result += string_format("\t\"warmupFrames\": %d,\n", report.warmupFrames);
+	result += string_format("\t\"frames\": %d,\n", report.measuredFrames);
+	result += string_format("\t\"elapsedMs\": %0.3f,\n", report.elapsedMs);
+	result += string_format("\t\"fps\": %0.3f,\n", fps);
+	result += "\t\"zonesMs\": {";
+	for(auto zoneIterator = report.zoneTimes.begin(); zoneIterator != report.zoneTimes.end(); zoneIterator++)
+	{
+		result += (zoneIterator == report.zoneTimes.begin()) ? "\n" : ",\n";
+		result += string_format("\t\t\"%s\": %0.3f", EscapeJsonString(zoneIterator->first).c_str(), static_cast<double>(zoneIterator->second) / 1000000.0);
+	}
+	result += report.zoneTimes.empty() ? "},\n" : "\n\t},\n";
+	result += "\t\"compiledBlocks\": {";
+	for(auto blockIterator = report.compiledBlocks.begin(); blockIterator != report.compiledBlocks.end(); blockIterator++)
+	{
+		result += (blockIterator == report.compiledBlocks.begin()) ? "\n" : ",\n";
+		result += string_format("\t\t\"%s\": %d", blockIterator->first.c_str(), blockIterator->second);
+	}
+	result += "\n\t},\n";
+	result += string_format("\t\"peakMemoryBytes\": %llu\n", static_cast<unsigned long long>(report.peakMemoryBytes));
+	result += "}\n";
+	return result;
+}
+
+static uint32 ParseCount(const char* option, const char* value)
+{
+	char* end = nullptr;
+	errno = 0;
+	unsigned long result = isdigit(static_cast<unsigned char>(value[0])) ? strtoul(value, &end, 10) : 0;
+	if((end == nullptr) || (*end != 0) || (errno == ERANGE) || (result > UINT32_MAX))
+	{
+		throw std::runtime_error(string_format("Invalid value '%s' for option '%s'.", value, option));
+	}
+	return static_cast<uint32>(result);
+}
+
+static BENCHMARK_REPORT RunBenchmark(const fs::path& bootPath, const fs::path& inputScriptPath, uint32 warmupFrames, uint32 measuredFrames, uint32 timeoutSeconds)
+{
+	if(bootPath.empty())
+	{
+		throw std::runtime_error("No disc image or ELF path specified.");
+	}
+	if(!fs::exists(bootPath))
+	{
+		throw std::runtime_error(string_format("Boot path '%s' doesn't exist.", bootPath.string().c_str()));
+	}
+
+	BENCHMARK_REPORT report;
+	report.sourcePath = bootPath.string();
+	report.warmupFrames = warmupFrames;
+	report.measuredFrames = measuredFrames;
+
+	CInputScript inputScript;
+	if(!inputScriptPath.empty())
+	{
+		inputScript = CInputScript(inputScriptPath);
+	}
+
+	bool bootElf = (bootPath.extension() == ".elf") || (bootPath.extension() == ".ELF");
+	CPreferenceGuard preferenceGuard;
+
+	CPS2VM virtualMachine;
+	virtualMachine.Initialize();
+	CAppConfig::GetInstance().SetPreferenceBoolean(PREF_PS2_LIMIT_FRAMERATE, false);
+	if(!bootElf)
+	{
+		CAppConfig::GetInstance().SetPreferencePath(PREF_PS2_CDROM0_PATH, bootPath);
+	}
+	virtualMachine.Reset();
+	virtualMachine.CreateGSHandler(CGSH_Null::GetFactoryFunction());
+	virtualMachine.ReloadFrameRateLimit();
+	virtualMachine.CreatePadHandler(
+	    [&]() { return new CBenchmarkPadHandler(std::move(inputScript), warmupFrames, measuredFrames); });
+	auto padHandler = static_cast<CBenchmarkPadHandler*>(virtualMachine.GetPadHandler());
+
+	std::mutex zoneTimesMutex;
+	auto profileConnection = virtualMachine.ProfileFrameDone.Connect(
+	    [&](const CProfiler::ZoneArray& zones) {
+		    if(!padHandler->IsMeasuring()) return;
+		    std::lock_guard<std::mutex> zoneTimesLock(zoneTimesMutex);
+		    for(const auto& zone : zones)
+		    {
+			    report.zoneTimes[zone.name] += zone.totalTime;
+		    }
+	    });
+
+	if(bootElf)
+	{
+		virtualMachine.m_ee->m_os->BootFromFile(bootPath);
+	}
+	else
+	{
+		virtualMachine.m_ee->m_os->BootFromCDROM();
+	}
+	report.title = virtualMachine.m_ee->m_os->GetExecutableName();
+
+	virtualMachine.Resume();
+	bool completed = padHandler->WaitForCompletion(std::chrono::seconds(timeoutSeconds));
+	virtualMachine.Pause();
+
+	if(!completed)
+	{
+		virtualMachine.Destroy();
+		throw std::runtime_error(string_format("Benchmark didn't complete within %d seconds.", timeoutSeconds));
+	}
+
+	report.elapsedMs = padHandler->GetMeasuredTimeMs();
+	report.compiledBlocks["ee"] = virtualMachine.m_ee->m_EE.m_executor->GetCompiledBlockCount();
+	report.compiledBlocks["vu0"] = virtualMachine.m_ee->m_VU0.m_executor->GetCompiledBlockCount();
+	report.compiledBlocks["vu1"] = virtualMachine.m_ee->m_VU1.m_executor->GetCompiledBlockCount();
+	report.compiledBlocks["iop"] = virtualMachine.m_iop->m_cpu.m_executor->GetCompiledBlockCount();
+	report.peakMemoryBytes = GetPeakMemoryUsage();
+
+	virtualMachine.Destroy();
+
+	return report;
+}
+
+int main(int argc, const char** argv)
+{
+	if(argc < 2)
+	{
+		printf("Usage: GameBenchmark [options] <disc image or ELF path>\r\n");
+		printf("Options: \r\n");
+		printf("\t --frames <count>\t Number of emulated frames to measure (default is %d).\r\n", DEFAULT_FRAME_COUNT);
+		printf("\t --warmup <count>\t Number of emulated frames to run before measuring (default is %d).\r\n", DEFAULT_WARMUP_FRAME_COUNT);
+		printf("\t --input <path>\t\t Controller input script to play back.\r\n");
+		printf("\t --timeout <seconds>\t Fails if frames aren't done after this amount of time (default is %d).\r\n", DEFAULT_TIMEOUT_SECONDS);
+		printf("\t --report <path>\t Writes JSON report at <path> instead of standard output.\r\n");
+		return -1;
+	}
+
+	try
+	{
+		fs::path bootPath;
+		fs::path inputScriptPath;
+		fs::path reportPath;
+		uint32 measuredFrames = DEFAULT_FRAME_COUNT;
+		uint32 warmupFrames = DEFAULT_WARMUP_FRAME_COUNT;
+		uint32 timeoutSeconds = DEFAULT_TIMEOUT_SECONDS;
+		for(int i = 1; i < argc; i++)
+		{
+			if(!strcmp(argv[i], "--frames") && ((i + 1) < argc))
+			{
+				measuredFrames = std::max<uint32>(ParseCount(argv[i], argv[i + 1]), 1);
+				i++;
+			}
+			else if(!strcmp(argv[i], "--warmup") && ((i + 1) < argc))
+			{
+				//Measurement needs a start point, at least one frame is needed
+				warmupFrames = std::max<uint32>(ParseCount(argv[i], argv[i + 1]), 1);
+				i++;
+			}
+			else if(!strcmp(argv[i], "--timeout") && ((i + 1) < argc))
+			{
+				timeoutSeconds = std::max<uint32>(ParseCount(argv[i], argv[i + 1]), 1);
+				i++;
+			}
+			else if(!strcmp(argv[i], "--input") && ((i + 1) < argc))
+			{
+				inputScriptPath = fs::path(argv[i + 1]);
+				i++;
+			}
+			else if(!strcmp(argv[i], "--report") && ((i + 1) < argc))
+			{
+				reportPath = fs::path(argv[i + 1]);
+				i++;
+			}
+			else
+			{
+				bootPath = argv[i];
+			}
+		}
+
+		auto report = RunBenchmark(bootPath, inputScriptPath, warmupFrames, measuredFrames, timeoutSeconds);
+		auto reportString = FormatReport(report);
+		if(reportPath.empty())
+		{
+			printf("%s", reportString.c_str());
+		}
+		else
+		{
+			auto reportStream = Framework::CreateOutputStdStream(reportPath.native());
+			reportStream.Write(reportString.data(), reportString.size());
+		}
+	}
+	catch(const std::exception& exception)
+	{
+		printf("Error: %s\r\n", exception.what());
+		return -1;
+	}
+	return 0;
+}
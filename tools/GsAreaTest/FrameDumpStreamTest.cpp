@@ -0,0 +1,251 @@
+#include <cstring>
+#include <zlib.h>
+#include "FrameDumpStreamTest.h"
+#include "FrameDumpStream.h"
+#include "StdStreamUtils.h"
+
+static fs::path GetStreamPath()
+{
+	return fs::absolute("./framedumpstream.pfds");
+}
+
+static fs::path GetModifiedStreamPath()
+{
+	return fs::absolute("./framedumpstream_modified.pfds");
+}
+
+void CFrameDumpStreamTest::Execute()
+{
+	CheckRoundTrip();
+	CheckTruncatedStream();
+	CheckTruncatedRecords();
+	fs::remove(GetStreamPath());
+	fs::remove(GetModifiedStreamPath());
+}
+
+//Writes 3 frames (the last one without a VSync) and returns the packets that were added in each of them
+CFrameDumpStreamTest::FrameArray CFrameDumpStreamTest::WriteStream(const fs::path& path)
+{
+	std::vector<uint8> gsRam(CGSHandler::RAMSIZE, 0x55);
+	std::vector<uint64> gsRegisters(CGSHandler::REGISTER_MAX, 0x1234);
+
+	//Big enough to be stored in its own chunk and referenced by the second frame
+	CGsPacket::ImageDataArray largeImage(0x1000);
+	for(uint32 i = 0; i < largeImage.size(); i++)
+	{
+		largeImage[i] = static_cast<uint8>(i * 7);
+	}
+	CGsPacket::ImageDataArray smallImage(0x20, 0xAA);
+
+	FrameArray frames(3);
+	auto addRegisterPacket =
+	    [](CFrameDumpStreamWriter& writer, CFrameDump::PacketArray& frame, uint32 count, uint32 pathIndex) {
+		    CGsPacket packet;
+		    packet.metadata.pathIndex = pathIndex;
+		    for(uint32 i = 0; i < count; i++)
+		    {
+			    packet.registerWrites.push_back(CGSHandler::RegisterWrite(static_cast<uint8>(i), (static_cast<uint64>(count) << 32) | i));
+		    }
+		    writer.AddRegisterPacket(packet.registerWrites.data(), count, &packet.metadata);
+		    frame.push_back(std::move(packet));
+	    };
+	auto addImagePacket =
+	    [](CFrameDumpStreamWriter& writer, CFrameDump::PacketArray& frame, const CGsPacket::ImageDataArray& imageData) {
+		    CGsPacket packet;
+		    packet.imageData = imageData;
+		    writer.AddImagePacket(imageData.data(), static_cast<uint32>(imageData.size()));
+		    frame.push_back(std::move(packet));
+	    };
+
+	CFrameDumpStreamWriter writer(std::make_unique<Framework::CStdStream>(Framework::CreateOutputStdStream(path.native())), 2);
+
+	TEST_VERIFY(writer.AddVSync());
+	writer.AddKeyFrame(gsRam.data(), gsRegisters.data(), 0x03);
+	addRegisterPacket(writer, frames[0], 0x10, 1);
+	addImagePacket(writer, frames[0], smallImage);
+	addImagePacket(writer, frames[0], largeImage);
+
+	TEST_VERIFY(!writer.AddVSync());
+	addRegisterPacket(writer, frames[1], 0x20, 2);
+	addImagePacket(writer, frames[1], largeImage);
+
+	TEST_VERIFY(writer.AddVSync());
+	writer.AddKeyFrame(gsRam.data(), gsRegisters.data(), 0x03);
+	addRegisterPacket(writer, frames[2], 0x30, 3);
+
+	writer.Finish();
+
+	auto stats = writer.GetStats();
+	TEST_VERIFY(stats.keyFrameCount == 2);
+	TEST_VERIFY(stats.dedupedImageBytes == largeImage.size());
+
+	return frames;
+}
+
+void CFrameDumpStreamTest::CheckFrame(const CFrameDump::PacketArray& expectedPackets, const CFrameDump::PacketArray& packets)
+{
+	TEST_VERIFY(packets.size() == expectedPackets.size());
+	for(uint32 i = 0; i < packets.size(); i++)
+	{
+		const auto& packet = packets[i];
+		const auto& expectedPacket = expectedPackets[i];
+		TEST_VERIFY(packet.registerWrites == expectedPacket.registerWrites);
+		TEST_VERIFY(packet.imageData == expectedPacket.imageData);
+		if(!expectedPacket.registerWrites.empty())
+		{
+			TEST_VERIFY(packet.metadata.pathIndex == expectedPacket.metadata.pathIndex);
+		}
+	}
+}
+
+//Writes a stream made of a single packet chunk containing 'records'
+void CFrameDumpStreamTest::WriteMalformedStream(const fs::path& path, const ByteArray& records)
+{
+	uLongf compressedSize = compressBound(static_cast<uLong>(records.size()));
+	ByteArray compressedRecords(compressedSize);
+	int result = compress2(compressedRecords.data(), &compressedSize, records.data(), static_cast<uLong>(records.size()), Z_BEST_SPEED);
+	TEST_VERIFY(result == Z_OK);
+
+	FrameDumpStream::FILEHEADER header = {};
+	header.magic = FrameDumpStream::FILE_MAGIC;
+	header.version = FrameDumpStream::FILE_VERSION;
+	header.keyFrameInterval = 1;
+	header.metadataSize = sizeof(CGsPacketMetadata);
+
+	FrameDumpStream::CHUNKHEADER chunkHeader = {};
+	chunkHeader.type = FrameDumpStream::CHUNK_TYPE_PACKETS;
+	chunkHeader.id = 0;
+	chunkHeader.compressedSize = static_cast<uint32>(compressedSize);
+	chunkHeader.uncompressedSize = static_cast<uint32>(records.size());
+
+	auto stream = Framework::CreateOutputStdStream(path.native());
+	stream.Write(&header, sizeof(header));
+	stream.Write(&chunkHeader, sizeof(chunkHeader));
+	stream.Write(compressedRecords.data(), compressedSize);
+}
+
+bool CFrameDumpStreamTest::ReadFails(const fs::path& path)
+{
+	try
+	{
+		CFrameDumpStreamReader reader(std::make_unique<Framework::CStdStream>(Framework::CreateInputStdStream(path.native())));
+		TEST_VERIFY(reader.GetFrameCount() == 1);
+		CFrameDump::PacketArray packets;
+		reader.ReadFramePackets(0, packets);
+	}
+	catch(const std::exception&)
+	{
+		return true;
+	}
+	return false;
+}
+
+void CFrameDumpStreamTest::CheckRoundTrip()
+{
+	auto expectedFrames = WriteStream(GetStreamPath());
+
+	CFrameDumpStreamReader reader(std::make_unique<Framework::CStdStream>(Framework::CreateInputStdStream(GetStreamPath().native())));
+	TEST_VERIFY(reader.GetFrameCount() == expectedFrames.size());
+	TEST_VERIFY(reader.GetKeyFrameForFrame(1) == 0);
+	TEST_VERIFY(reader.GetKeyFrameForFrame(2) == 2);
+	for(uint32 frameIndex = 0; frameIndex < expectedFrames.size(); frameIndex++)
+	{
+		CFrameDump::PacketArray packets;
+		reader.ReadFramePackets(frameIndex, packets);
+		CheckFrame(expectedFrames[frameIndex], packets);
+	}
+
+	CFrameDump frameDump;
+	reader.ReadFrame(1, frameDump);
+	TEST_VERIFY(frameDump.GetPackets().size() == (expectedFrames[0].size() + expectedFrames[1].size()));
+	TEST_VERIFY(frameDump.GetInitialGsRam()[0] == 0x55);
+}
+
+void CFrameDumpStreamTest::CheckTruncatedStream()
+{
+	auto expectedFrames = WriteStream(GetStreamPath());
+
+	//Cut the stream in the middle of the last packet chunk, right before the index
+	ByteArray streamData(static_cast<size_t>(fs::file_size(GetStreamPath())));
+	{
+		auto stream = Framework::CreateInputStdStream(GetStreamPath().native());
+		stream.Read(streamData.data(), streamData.size());
+	}
+	FrameDumpStream::FOOTER footer = {};
+	memcpy(&footer, streamData.data() + streamData.size() - sizeof(footer), sizeof(footer));
+	TEST_VERIFY(footer.magic == FrameDumpStream::FOOTER_MAGIC);
+	{
+		auto stream = Framework::CreateOutputStdStream(GetModifiedStreamPath().native());
+		stream.Write(streamData.data(), footer.indexOffset - 4);
+	}
+
+	//Index is rebuilt from the complete chunks, frames before the cut are still there
+	CFrameDumpStreamReader reader(std::make_unique<Framework::CStdStream>(Framework::CreateInputStdStream(GetModifiedStreamPath().native())));
+	TEST_VERIFY(reader.GetFrameCount() == (expectedFrames.size() - 1));
+	for(uint32 frameIndex = 0; frameIndex < reader.GetFrameCount(); frameIndex++)
+	{
+		CFrameDump::PacketArray packets;
+		reader.ReadFramePackets(frameIndex, packets);
+		CheckFrame(expectedFrames[frameIndex], packets);
+	}
+}
+
+void CFrameDumpStreamTest::CheckTruncatedRecords()
+{
+	auto appendData =
+	    [](ByteArray& output, const void* data, size_t size) {
+		    auto bytes = reinterpret_cast<const uint8*>(data);
+		    output.insert(output.end(), bytes, bytes + size);
+	    };
+
+	//Register record claiming more writes than there are
+	{
+		ByteArray records;
+		uint32 recordHeader[2] = {FrameDumpStream::RECORD_TYPE_REGISTERS, 0x100};
+		CGsPacketMetadata metadata;
+		CGSHandler::RegisterWrite registerWrite(GS_REG_PRIM, 0);
+		appendData(records, recordHeader, sizeof(recordHeader));
+		appendData(records, &metadata, sizeof(metadata));
+		appendData(records, &registerWrite, sizeof(registerWrite));
+		WriteMalformedStream(GetModifiedStreamPath(), records);
+		TEST_VERIFY(ReadFails(GetModifiedStreamPath()));
+	}
+
+	//Register record cut in its metadata
+	{
+		ByteArray records;
+		uint32 recordHeader[2] = {FrameDumpStream::RECORD_TYPE_REGISTERS, 0};
+		appendData(records, recordHeader, sizeof(recordHeader));
+		records.push_back(0);
+		WriteMalformedStream(GetModifiedStreamPath(), records);
+		TEST_VERIFY(ReadFails(GetModifiedStreamPath()));
+	}
+
+	//Image record bigger than the chunk
+	{
+		ByteArray records;
+		uint32 recordHeader[2] = {FrameDumpStream::RECORD_TYPE_IMAGE, 0xFFFFFFF0};
+		appendData(records, recordHeader, sizeof(recordHeader));
+		records.resize(records.size() + 0x10);
+		WriteMalformedStream(GetModifiedStreamPath(), records);
+		TEST_VERIFY(ReadFails(GetModifiedStreamPath()));
+	}
+
+	//Record header cut in half
+	{
+		ByteArray records;
+		uint32 recordType = FrameDumpStream::RECORD_TYPE_VSYNC;
+		appendData(records, &recordType, sizeof(recordType));
+		WriteMalformedStream(GetModifiedStreamPath(), records);
+		TEST_VERIFY(ReadFails(GetModifiedStreamPath()));
+	}
+
+	//Well formed records are still accepted
+	{
+		ByteArray records;
+		uint32 recordHeader[2] = {FrameDumpStream::RECORD_TYPE_VSYNC, 0};
+		appendData(records, recordHeader, sizeof(recordHeader));
+		WriteMalformedStream(GetModifiedStreamPath(), records);
+		TEST_VERIFY(!ReadFails(GetModifiedStreamPath()));
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Test.h"
+#include "FrameDump.h"
+#include "filesystem_def.h"
+
+//Checks that frames written to a frame dump stream are read back as they were, and that
+//truncated or corrupted streams are rejected instead of being read out of bounds
+class CFrameDumpStreamTest : public CTest
+{
+public:
+	void Execute() override;
+
+private:
+	typedef std::vector<CFrameDump::PacketArray> FrameArray;
+	typedef std::vector<uint8> ByteArray;
+
+	static FrameArray WriteStream(const fs::path&);
+	static void CheckFrame(const CFrameDump::PacketArray&, const CFrameDump::PacketArray&);
+	static void WriteMalformedStream(const fs::path&, const ByteArray&);
+	static bool ReadFails(const fs::path&);
+
+	static void CheckRoundTrip();
+	static void CheckTruncatedStream();
+	static void CheckTruncatedRecords();
+};
@@ -0,0 +1,205 @@
+#include "GifPacketTest.h"
+#include <random>
+#include "Ps2Const.h"
+#include "MIPS.h"
+#include "ee/DMAC.h"
+#include "ee/GIF.h"
+#include "gs/GSH_Null.h"
+
+enum
+{
+	RANDOM_STREAM_COUNT = 16,
+	RANDOM_PACKET_COUNT = 0x100,
+};
+
+//Records register writes as the GS thread receives them
+class CGSH_Recorder : public CGSH_Null
+{
+public:
+	typedef std::vector<std::pair<uint8, uint64>> RegisterWriteArray;
+
+	RegisterWriteArray m_writes;
+
+protected:
+	void WriteRegisterImpl(uint8 registerId, uint64 value) override
+	{
+		m_writes.emplace_back(registerId, value);
+		CGSH_Null::WriteRegisterImpl(registerId, value);
+	}
+};
+
+static void WriteTag(std::vector<uint8>& stream, uint32 loops, bool eop, bool pre, uint32 prim, uint32 cmd, const std::vector<uint8>& regs)
+{
+	uint64 tag[2] = {};
+	tag[0] = loops & 0x7FFF;
+	tag[0] |= static_cast<uint64>(eop ? 1 : 0) << 15;
+	tag[0] |= static_cast<uint64>(pre ? 1 : 0) << 46;
+	tag[0] |= static_cast<uint64>(prim & 0x7FF) << 47;
+	tag[0] |= static_cast<uint64>(cmd & 0x03) << 58;
+	tag[0] |= static_cast<uint64>(regs.size() & 0x0F) << 60;
+	for(uint32 i = 0; i < regs.size(); i++)
+	{
+		tag[1] |= static_cast<uint64>(regs[i]) << (i * 4);
+	}
+	auto bytes = reinterpret_cast<const uint8*>(tag);
+	stream.insert(stream.end(), bytes, bytes + sizeof(tag));
+}
+
+static void Write64(std::vector<uint8>& stream, uint64 value)
+{
+	auto bytes = reinterpret_cast<const uint8*>(&value);
+	stream.insert(stream.end(), bytes, bytes + sizeof(value));
+}
+
+//Random mix of PACKED and REGLIST packets, with vertex only loops, A+D and NOP fields
+CGifPacketTest::PacketStream CGifPacketTest::CreateRandomStream(uint32 seed)
+{
+	//Registers without side effects outside of the GS's register file
+	static const uint8 adRegisters[] =
+	    {
+	        GS_REG_PRIM,
+	        GS_REG_RGBAQ,
+	        GS_REG_XYZ2,
+	        GS_REG_TEX1_1,
+	        GS_REG_ALPHA_1,
+	        GS_REG_TEST_1,
+	        GS_REG_SCISSOR_1,
+	        GS_REG_PABE,
+	        GS_REG_FOGCOL,
+	    };
+	static const uint8 packedDescs[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0D, 0x0E, 0x0F};
+	static const uint8 vertexDescs[] = {0x01, 0x02, 0x03, 0x04, 0x05};
+	static const uint8 regListDescs[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x08, 0x09, 0x0A, 0x0D, 0x0F};
+
+	std::mt19937 random(seed);
+	auto pick = [&](const uint8* values, uint32 count) { return values[random() % count]; };
+
+	PacketStream stream;
+	for(uint32 packet = 0; packet < RANDOM_PACKET_COUNT; packet++)
+	{
+		bool eop = (packet + 1) == RANDOM_PACKET_COUNT;
+		uint32 loops = 1 + (random() % 24);
+		uint32 regCount = 1 + (random() % 16);
+		bool pre = (random() & 1) != 0;
+		uint32 prim = random() & 0x7FF;
+		uint32 kind = random() % 3;
+
+		std::vector<uint8> regs(regCount);
+		if(kind == 2)
+		{
+			for(auto& reg : regs)
+			{
+				reg = pick(regListDescs, sizeof(regListDescs));
+			}
+			WriteTag(stream, loops, eop, pre, prim, 1, regs);
+			for(uint32 i = 0; i < (loops * regCount); i++)
+			{
+				Write64(stream, (static_cast<uint64>(random()) << 32) | random());
+			}
+			if(stream.size() & 0x0F)
+			{
+				Write64(stream, 0);
+			}
+			continue;
+		}
+
+		bool vertexOnly = (kind == 0);
+		for(auto& reg : regs)
+		{
+			reg = vertexOnly ? pick(vertexDescs, sizeof(vertexDescs)) : pick(packedDescs, sizeof(packedDescs));
+		}
+		WriteTag(stream, loops, eop, pre, prim, 0, regs);
+		for(uint32 i = 0; i < (loops * regCount); i++)
+		{
+			uint8 reg = regs[i % regCount];
+			uint32 values[4] = {random(), random(), random(), random()};
+			if(reg == 0x0E)
+			{
+				Write64(stream, (static_cast<uint64>(values[0]) << 32) | values[1]);
+				Write64(stream, pick(adRegisters, sizeof(adRegisters)));
+			}
+			else
+			{
+				Write64(stream, (static_cast<uint64>(values[1]) << 32) | values[0]);
+				Write64(stream, (static_cast<uint64>(values[3]) << 32) | values[2]);
+			}
+		}
+	}
+	return stream;
+}
+
+//A+D loops writing SIGNAL, each one stalls the GIF until the previous one is acknowledged
+CGifPacketTest::PacketStream CGifPacketTest::CreateSignalStream()
+{
+	PacketStream stream;
+	WriteTag(stream, 8, true, false, 0, 0, {0x0E, 0x0E});
+	for(uint32 loop = 0; loop < 8; loop++)
+	{
+		Write64(stream, 0x44 + loop);
+		Write64(stream, GS_REG_ALPHA_1);
+		Write64(stream, loop);
+		Write64(stream, ((loop % 3) == 1) ? GS_REG_SIGNAL : GS_REG_TEST_1);
+	}
+	return stream;
+}
+
+//Feeds the stream to the GIF in chunks of the specified size and returns the writes received by the GS.
+//The GIF checks CSR to know if a SIGNAL is pending, streams using SIGNAL need the GS to be in sync after each chunk.
+CGifPacketTest::RegisterWriteArray CGifPacketTest::ProcessStream(const PacketStream& stream, uint32 chunkSize, bool syncChunks)
+{
+	std::vector<uint8> ram(PS2::EE_RAM_SIZE);
+	std::vector<uint8> spr(PS2::EE_SPR_SIZE);
+	std::vector<uint8> vuMem0(PS2::VUMEM0SIZE);
+	TEST_VERIFY(stream.size() <= ram.size());
+	memcpy(ram.data(), stream.data(), stream.size());
+
+	CMIPS ee(MEMORYMAP_ENDIAN_LSBF);
+	CDMAC dmac(ram.data(), spr.data(), vuMem0.data(), ee);
+	auto recorder = new CGSH_Recorder();
+	CGSHandler* gs = recorder;
+	gs->Initialize();
+	CGIF gif(gs, dmac, ram.data(), spr.data());
+
+	auto streamSize = static_cast<uint32>(stream.size());
+	uint32 address = 0;
+	while(address < streamSize)
+	{
+		uint32 end = std::min<uint32>(address + chunkSize, streamSize);
+		uint32 processed = gif.ProcessMultiplePackets(ram.data(), PS2::EE_RAM_SIZE, address, end, CGsPacketMetadata(3));
+		address += processed;
+		if(syncChunks)
+		{
+			gs->Finish();
+		}
+		if(address != end)
+		{
+			//Stalled on SIGNAL, acknowledge it once the GS has seen it
+			gs->Finish();
+			TEST_VERIFY((gs->ReadPrivRegister(CGSHandler::GS_CSR) & CGSHandler::CSR_SIGNAL_EVENT) != 0);
+			gs->WritePrivRegister(CGSHandler::GS_CSR, CGSHandler::CSR_SIGNAL_EVENT);
+		}
+	}
+	gs->Finish();
+
+	auto writes = std::move(recorder->m_writes);
+	gs->Release();
+	delete gs;
+	return writes;
+}
+
+void CGifPacketTest::CheckStream(const PacketStream& stream, bool hasSignal)
+{
+	auto batchedWrites = ProcessStream(stream, static_cast<uint32>(stream.size()), hasSignal);
+	auto qwordWrites = ProcessStream(stream, 0x10, hasSignal);
+	TEST_VERIFY(!batchedWrites.empty());
+	TEST_VERIFY(batchedWrites == qwordWrites);
+}
+
+void CGifPacketTest::Execute()
+{
+	for(uint32 i = 0; i < RANDOM_STREAM_COUNT; i++)
+	{
+		CheckStream(CreateRandomStream(i), false);
+	}
+	CheckStream(CreateSignalStream(), true);
+}
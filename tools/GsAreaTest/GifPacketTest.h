@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+#include "Test.h"
+#include "Types.h"
+
+//Checks that GIF packets produce the same register writes whether they are received
+//at once (loops decoded in batches) or one qword at a time (loops decoded field by field)
+class CGifPacketTest : public CTest
+{
+public:
+	void Execute() override;
+
+private:
+	typedef std::vector<uint8> PacketStream;
+	typedef std::vector<std::pair<uint8, uint64>> RegisterWriteArray;
+
+	static PacketStream CreateRandomStream(uint32);
+	static PacketStream CreateSignalStream();
+
+	static RegisterWriteArray ProcessStream(const PacketStream&, uint32, bool);
+	static void CheckStream(const PacketStream&, bool);
+};
@@ -0,0 +1,171 @@
+#include <cstring>
+#include <vector>
+#include "GsDeswizzleTest.h"
+#include "gs/GSHandler.h"
+#include "gs/GsDeswizzle.h"
+#include "gs/GsPixelFormats.h"
+
+//Buffers are checked over a few pages, with a width that isn't a power of two
+static const uint32 g_bufferWidth = 3;
+static const uint32 g_bufferPointers[] =
+    {
+        0,
+        CGsPixelFormats::PAGESIZE * 5,
+        CGSHandler::RAMSIZE - CGsPixelFormats::PAGESIZE,
+};
+
+void CGsDeswizzleTest::Execute()
+{
+	std::vector<uint8> ram(CGSHandler::RAMSIZE);
+	uint32 seed = 0x1234567;
+	for(auto& value : ram)
+	{
+		seed = (seed * 1103515245) + 12345;
+		value = static_cast<uint8>(seed >> 16);
+	}
+
+	for(auto bufferPointer : g_bufferPointers)
+	{
+		CheckReadBlock<CGsPixelFormats::STORAGEPSMCT32>(ram.data(), bufferPointer, g_bufferWidth);
+		CheckReadBlock<CGsPixelFormats::STORAGEPSMZ32>(ram.data(), bufferPointer, g_bufferWidth);
+		CheckReadBlock<CGsPixelFormats::STORAGEPSMCT16>(ram.data(), bufferPointer, g_bufferWidth);
+		CheckReadBlock<CGsPixelFormats::STORAGEPSMCT16S>(ram.data(), bufferPointer, g_bufferWidth);
+		CheckReadBlock<CGsPixelFormats::STORAGEPSMT8>(ram.data(), bufferPointer, g_bufferWidth);
+		CheckReadBlockPSMT4(ram.data(), bufferPointer, g_bufferWidth);
+	}
+
+	CheckConvertColumn4Half(ram.data());
+	CheckSplitColors32();
+}
+
+template <typename Storage>
+void CGsDeswizzleTest::CheckReadBlock(uint8* ram, uint32 bufferPointer, uint32 bufferWidth)
+{
+	typedef typename Storage::Unit Unit;
+	CGsPixelFormats::CPixelIndexor<Storage> indexor(ram, bufferPointer, bufferWidth);
+
+	//Destination has some padding on each row to catch overruns
+	static const uint32 dstWidth = Storage::BLOCKWIDTH + 4;
+	Unit blockPixels[Storage::BLOCKHEIGHT + 1][dstWidth];
+
+	uint32 bufferPixelWidth = bufferWidth * 64;
+	for(uint32 blockY = 0; blockY < (Storage::PAGEHEIGHT * 2); blockY += Storage::BLOCKHEIGHT)
+	{
+		for(uint32 blockX = 0; blockX < bufferPixelWidth; blockX += Storage::BLOCKWIDTH)
+		{
+			memset(blockPixels, 0xCC, sizeof(blockPixels));
+
+			uint32 columnX = blockX;
+			uint32 columnY = blockY;
+			auto block = ram + indexor.GetColumnAddress(columnX, columnY);
+			CGsDeswizzle::ReadBlock<Storage>(block, reinterpret_cast<uint8*>(blockPixels), sizeof(blockPixels[0]));
+
+			for(uint32 y = 0; y < Storage::BLOCKHEIGHT; y++)
+			{
+				for(uint32 x = 0; x < Storage::BLOCKWIDTH; x++)
+				{
+					TEST_VERIFY(blockPixels[y][x] == indexor.GetPixel(blockX + x, blockY + y));
+				}
+				for(uint32 x = Storage::BLOCKWIDTH; x < dstWidth; x++)
+				{
+					TEST_VERIFY(blockPixels[y][x] == static_cast<Unit>(0xCCCCCCCC));
+				}
+			}
+			for(uint32 x = 0; x < dstWidth; x++)
+			{
+				TEST_VERIFY(blockPixels[Storage::BLOCKHEIGHT][x] == static_cast<Unit>(0xCCCCCCCC));
+			}
+		}
+	}
+}
+
+void CGsDeswizzleTest::CheckReadBlockPSMT4(uint8* ram, uint32 bufferPointer, uint32 bufferWidth)
+{
+	typedef CGsPixelFormats::STORAGEPSMT4 Storage;
+	CGsPixelFormats::CPixelIndexorPSMT4 indexor(ram, bufferPointer, bufferWidth);
+
+	//Kernel expands to one byte per pixel
+	static const uint32 dstWidth = Storage::BLOCKWIDTH + 4;
+	uint8 blockPixels[Storage::BLOCKHEIGHT + 1][dstWidth];
+
+	uint32 bufferPixelWidth = bufferWidth * 64;
+	for(uint32 blockY = 0; blockY < (Storage::PAGEHEIGHT * 2); blockY += Storage::BLOCKHEIGHT)
+	{
+		for(uint32 blockX = 0; blockX < bufferPixelWidth; blockX += Storage::BLOCKWIDTH)
+		{
+			memset(blockPixels, 0xCC, sizeof(blockPixels));
+
+			uint32 columnX = blockX;
+			uint32 columnY = blockY;
+			auto block = ram + indexor.GetColumnAddress(columnX, columnY);
+			CGsDeswizzle::ReadBlockPSMT4(block, reinterpret_cast<uint8*>(blockPixels), sizeof(blockPixels[0]));
+
+			for(uint32 y = 0; y < Storage::BLOCKHEIGHT; y++)
+			{
+				for(uint32 x = 0; x < Storage::BLOCKWIDTH; x++)
+				{
+					TEST_VERIFY(blockPixels[y][x] == indexor.GetPixel(blockX + x, blockY + y));
+				}
+				for(uint32 x = Storage::BLOCKWIDTH; x < dstWidth; x++)
+				{
+					TEST_VERIFY(blockPixels[y][x] == 0xCC);
+				}
+			}
+			for(uint32 x = 0; x < dstWidth; x++)
+			{
+				TEST_VERIFY(blockPixels[Storage::BLOCKHEIGHT][x] == 0xCC);
+			}
+		}
+	}
+}
+
+void CGsDeswizzleTest::CheckConvertColumn4Half(uint8* ram)
+{
+	//Narrow textures only get the left half of each column
+	typedef CGsPixelFormats::STORAGEPSMT4 Storage;
+	CGsPixelFormats::CPixelIndexorPSMT4 indexor(ram, 0, 1);
+
+	static const uint32 dstWidth = Storage::COLUMNWIDTH / 2;
+	uint8 columnPixels[Storage::COLUMNHEIGHT + 1][dstWidth];
+
+	for(uint32 colNum = 0; colNum < 4; colNum++)
+	{
+		memset(columnPixels, 0xCC, sizeof(columnPixels));
+
+		uint32 columnX = 0;
+		uint32 columnY = colNum * Storage::COLUMNHEIGHT;
+		auto column = ram + indexor.GetColumnAddress(columnX, columnY);
+		CGsDeswizzle::ConvertColumn4(reinterpret_cast<uint8*>(columnPixels), sizeof(columnPixels[0]), column, colNum);
+
+		for(uint32 y = 0; y < Storage::COLUMNHEIGHT; y++)
+		{
+			for(uint32 x = 0; x < dstWidth; x++)
+			{
+				TEST_VERIFY(columnPixels[y][x] == indexor.GetPixel(x, (colNum * Storage::COLUMNHEIGHT) + y));
+			}
+		}
+		for(uint32 x = 0; x < dstWidth; x++)
+		{
+			TEST_VERIFY(columnPixels[Storage::COLUMNHEIGHT][x] == 0xCC);
+		}
+	}
+}
+
+void CGsDeswizzleTest::CheckSplitColors32()
+{
+	uint32 colors[8];
+	for(uint32 i = 0; i < 8; i++)
+	{
+		colors[i] = 0x80000000 | (i << 20) | (0x7FFF - i);
+	}
+
+	uint16 colorsLo[8] = {};
+	uint16 colorsHi[8] = {};
+	CGsDeswizzle::SplitColors32(colors, colorsLo, colorsHi);
+
+	for(uint32 i = 0; i < 8; i++)
+	{
+		TEST_VERIFY(colorsLo[i] == static_cast<uint16>(colors[i]));
+		TEST_VERIFY(colorsHi[i] == static_cast<uint16>(colors[i] >> 16));
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Test.h"
+#include "Types.h"
+
+//Checks that the block and column kernels of CGsDeswizzle produce the same pixels
+//as the reference indexors
+class CGsDeswizzleTest : public CTest
+{
+public:
+	void Execute() override;
+
+private:
+	template <typename Storage>
+	static void CheckReadBlock(uint8*, uint32, uint32);
+
+	static void CheckReadBlockPSMT4(uint8*, uint32, uint32);
+	static void CheckConvertColumn4Half(uint8*);
+	static void CheckSplitColors32();
+};
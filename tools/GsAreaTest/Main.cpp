@@ -1,5 +1,8 @@
 #include <functional>
+#include "FrameDumpStreamTest.h"
+#include "GifPacketTest.h"
 #include "GsCachedAreaTest.h"
+#include "GsDeswizzleTest.h"
 #include "GsTransferInvalidationTest.h"
 
 typedef std::function<CTest*()> TestFactoryFunction;
@@ -8,7 +11,10 @@ typedef std::function<CTest*()> TestFactoryFunction;
 static const TestFactoryFunction s_factories[] =
 {
 	[]() { return new CGsCachedAreaTest(); },
-	[]() { return new CGsTransferInvalidationTest(); }
+	[]() { return new CGsTransferInvalidationTest(); },
+	[]() { return new CGifPacketTest(); },
+	[]() { return new CGsDeswizzleTest(); },
+	[]() { return new CFrameDumpStreamTest(); },
 };
 // clang-format on
 
@@ -8,12 +8,9 @@
 #include "PathUtils.h"
 #include "StdStreamUtils.h"
 #include "GameTestSheet.h"
-
-#define CHECK(condition)        \
-	if(!(condition))            \
-	{                           \
-		throw std::exception(); \
-	}
+#include "McCardCacheTest.h"
+#include "McImageStorageTest.h"
+#include "TestUtils.h"
 
 void PrepareTestEnvironment(const CGameTestSheet::EnvironmentActionArray& environment)
 {
@@ -97,6 +94,9 @@ void ExecuteTest(const CGameTestSheet::TEST& test)
 
 int main(int argc, const char** argv)
 {
+	ExecuteMcCardCacheTests();
+	ExecuteMcImageStorageTests();
+
 	auto testsPath = fs::path("./tests/");
 
 	fs::directory_iterator endDirectoryIterator;
@@ -0,0 +1,223 @@
+#include <string.h>
+#include "McCardCacheTest.h"
+#include "TestUtils.h"
+#include "iop/IopBios.h"
+#include "iop/Iop_McCardCache.h"
+#include "iop/Iop_McServ.h"
+#include "iop/Iop_SubSystem.h"
+#include "AppConfig.h"
+#include "StdStreamUtils.h"
+
+typedef std::vector<uint8> ByteArray;
+
+static fs::path GetCardPath()
+{
+	return fs::absolute("./mccardcache");
+}
+
+static void PrepareCard()
+{
+	auto cardPath = GetCardPath();
+	fs::remove_all(cardPath);
+	fs::create_directories(cardPath);
+}
+
+static ByteArray MakeContents(const char* text)
+{
+	return ByteArray(text, text + strlen(text));
+}
+
+static ByteArray ReadHostFile(const fs::path& path)
+{
+	auto stream = Framework::CreateInputStdStream(path.native());
+	ByteArray contents(static_cast<size_t>(fs::file_size(path)));
+	if(!contents.empty())
+	{
+		stream.Read(contents.data(), contents.size());
+	}
+	return contents;
+}
+
+static void WriteCacheFile(Iop::CMcCardCache& cache, const fs::path& path, const ByteArray& contents)
+{
+	std::unique_ptr<Iop::CMcCardCache::CFileStream> file;
+	CHECK(cache.OpenFile(path, true, true, file) == Iop::CMcCardCache::RESULT_OK);
+	file->Write(contents.data(), contents.size());
+}
+
+static void TestWriteBack()
+{
+	PrepareCard();
+	auto cardPath = GetCardPath();
+	Iop::CMcCardCache cache;
+	cache.SetBasePath(cardPath);
+
+	auto contents = MakeContents("0123456789");
+	WriteCacheFile(cache, cardPath / "SAVE", contents);
+	cache.Flush();
+
+	CHECK(ReadHostFile(cardPath / "SAVE") == contents);
+	CHECK(!cache.TakeJournalError());
+}
+
+static void TestCoalescedWrites()
+{
+	PrepareCard();
+	auto cardPath = GetCardPath();
+	Iop::CMcCardCache cache;
+	cache.SetBasePath(cardPath);
+
+	{
+		std::unique_ptr<Iop::CMcCardCache::CFileStream> file;
+		CHECK(cache.OpenFile(cardPath / "SAVE", true, true, file) == Iop::CMcCardCache::RESULT_OK);
+		file->Write("ab", 2);
+		file->Commit();
+		//Contents handed to the journal must not be modified by this
+		file->Write("cd", 2);
+	}
+	cache.Flush();
+
+	CHECK(ReadHostFile(cardPath / "SAVE") == MakeContents("abcd"));
+}
+
+static void TestJournalOrder()
+{
+	PrepareCard();
+	auto cardPath = GetCardPath();
+	Iop::CMcCardCache cache;
+	cache.SetBasePath(cardPath);
+
+	auto contents = MakeContents("journal");
+	CHECK(cache.MakeDirectory(cardPath / "DIR") == Iop::CMcCardCache::RESULT_OK);
+	WriteCacheFile(cache, cardPath / "DIR" / "A", contents);
+	CHECK(cache.Rename(cardPath / "DIR" / "A", cardPath / "DIR" / "B") == Iop::CMcCardCache::RESULT_OK);
+	CHECK(cache.Remove(cardPath / "DIR") == Iop::CMcCardCache::RESULT_NOT_EMPTY);
+	cache.Flush();
+
+	CHECK(!fs::exists(cardPath / "DIR" / "A"));
+	CHECK(ReadHostFile(cardPath / "DIR" / "B") == contents);
+
+	CHECK(cache.Remove(cardPath / "DIR" / "B") == Iop::CMcCardCache::RESULT_OK);
+	CHECK(cache.Remove(cardPath / "DIR") == Iop::CMcCardCache::RESULT_OK);
+	cache.Flush();
+
+	CHECK(!fs::exists(cardPath / "DIR"));
+	CHECK(!cache.TakeJournalError());
+}
+
+static void TestReload()
+{
+	PrepareCard();
+	auto cardPath = GetCardPath();
+	Iop::CMcCardCache cache;
+	cache.SetBasePath(cardPath);
+
+	auto contents = MakeContents("reload");
+	CHECK(cache.MakeDirectory(cardPath / "DIR") == Iop::CMcCardCache::RESULT_OK);
+	WriteCacheFile(cache, cardPath / "DIR" / "SAVE", contents);
+
+	//Model is rebuilt from what was written on the host
+	cache.Invalidate();
+
+	auto node = cache.FindNode(cardPath / "DIR" / "SAVE");
+	CHECK(node && !node->isDirectory && (node->size == contents.size()));
+
+	std::unique_ptr<Iop::CMcCardCache::CFileStream> file;
+	CHECK(cache.OpenFile(cardPath / "DIR" / "SAVE", false, false, file) == Iop::CMcCardCache::RESULT_OK);
+	ByteArray readContents(contents.size());
+	CHECK(file->Read(readContents.data(), readContents.size()) == contents.size());
+	CHECK(readContents == contents);
+}
+
+static void TestJournalError()
+{
+	PrepareCard();
+	auto cardPath = GetCardPath();
+	Iop::CMcCardCache cache;
+	cache.SetBasePath(cardPath);
+
+	CHECK(cache.MakeDirectory(cardPath / "DIR") == Iop::CMcCardCache::RESULT_OK);
+	cache.Flush();
+
+	//Directory disappears from the host, the cache still thinks it exists
+	fs::remove_all(cardPath / "DIR");
+	WriteCacheFile(cache, cardPath / "DIR" / "SAVE", MakeContents("lost"));
+	cache.Flush();
+
+	//Failure is reported once
+	CHECK(cache.TakeJournalError());
+	CHECK(!cache.TakeJournalError());
+}
+
+static void TestMcServFlushReportsError()
+{
+	PrepareCard();
+	auto cardPath = GetCardPath();
+
+	auto mcPathPreference = Iop::CMcServ::GetMcPathPreference(0);
+	CAppConfig::GetInstance().RegisterPreferencePath(mcPathPreference, "");
+	CAppConfig::GetInstance().SetPreferencePath(mcPathPreference, cardPath);
+
+	Iop::CSubSystem subSystem(true);
+	subSystem.Reset();
+	auto bios = static_cast<CIopBios*>(subSystem.m_bios.get());
+	bios->Reset(std::shared_ptr<Iop::CSifMan>());
+	auto mcServ = bios->GetMcServ();
+
+	uint32 handle = 0;
+	{
+		Iop::CMcServ::CMD cmd;
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.flags = Iop::CMcServ::OPEN_FLAG_RDWR | Iop::CMcServ::OPEN_FLAG_CREAT;
+		strncpy(cmd.name, "/SAVE", sizeof(cmd.name));
+		mcServ->Invoke(Iop::CMcServ::CMD_ID_OPEN, reinterpret_cast<uint32*>(&cmd), sizeof(cmd), &handle, sizeof(uint32), nullptr);
+		CHECK(static_cast<int32>(handle) >= 0);
+	}
+
+	{
+		auto contents = MakeContents("data");
+		uint32 result = 0;
+
+		Iop::CMcServ::FILECMD cmd;
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.handle = handle;
+		cmd.size = static_cast<uint32>(contents.size());
+		cmd.bufferAddress = 0;
+		mcServ->Invoke(Iop::CMcServ::CMD_ID_WRITE, reinterpret_cast<uint32*>(&cmd), sizeof(cmd), &result, sizeof(uint32), contents.data());
+		CHECK(result == contents.size());
+	}
+
+	//Card disappears from the host before the write is applied
+	fs::remove_all(cardPath);
+
+	{
+		uint32 result = 0;
+
+		Iop::CMcServ::FILECMD cmd;
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.handle = handle;
+		mcServ->Invoke(Iop::CMcServ::CMD_ID_FLUSH, reinterpret_cast<uint32*>(&cmd), sizeof(cmd), &result, sizeof(uint32), nullptr);
+		CHECK(static_cast<int32>(result) < 0);
+	}
+
+	{
+		uint32 result = 0;
+
+		Iop::CMcServ::FILECMD cmd;
+		memset(&cmd, 0, sizeof(cmd));
+		cmd.handle = handle;
+		mcServ->Invoke(Iop::CMcServ::CMD_ID_CLOSE, reinterpret_cast<uint32*>(&cmd), sizeof(cmd), &result, sizeof(uint32), nullptr);
+		CHECK(result == 0);
+	}
+}
+
+void ExecuteMcCardCacheTests()
+{
+	TestWriteBack();
+	TestCoalescedWrites();
+	TestJournalOrder();
+	TestReload();
+	TestJournalError();
+	TestMcServFlushReportsError();
+	fs::remove_all(GetCardPath());
+}
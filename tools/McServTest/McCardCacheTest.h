@@ -0,0 +1,5 @@
+#pragma once
+
+//Checks that modifications made through the memory card cache reach the host in order,
+//and that failures happening on the journal thread are reported afterwards
+void ExecuteMcCardCacheTests();
@@ -0,0 +1,247 @@
+#include <string.h>
+#include <algorithm>
+#include "McImageStorageTest.h"
+#include "TestUtils.h"
+#include "iop/Iop_McCardCache.h"
+#include "iop/Iop_McImageStorage.h"
+#include "StdStreamUtils.h"
+
+typedef std::vector<uint8> ByteArray;
+
+//Small card without ECC, 2 directory entries per cluster
+#define PAGE_SIZE (0x200)
+#define PAGES_PER_CLUSTER (2)
+#define PAGES_PER_BLOCK (16)
+#define CLUSTER_SIZE (PAGE_SIZE * PAGES_PER_CLUSTER)
+#define CLUSTERS_PER_BLOCK (PAGES_PER_BLOCK / PAGES_PER_CLUSTER)
+#define CLUSTER_COUNT (0x80)
+#define IFC_CLUSTER (8)
+#define FAT_CLUSTER (9)
+#define ALLOC_OFFSET (10)
+#define ALLOC_END (CLUSTER_COUNT - ALLOC_OFFSET - CLUSTERS_PER_BLOCK)
+#define BAD_BLOCK (2)
+//Root directory uses the first allocatable cluster
+#define FREE_CLUSTER_COUNT (ALLOC_END - 1 - CLUSTERS_PER_BLOCK)
+
+#define DIRENTRY_SIZE (0x200)
+#define FAT_ENTRY_FREE (0x7FFFFFFF)
+#define FAT_CHAIN_END (0xFFFFFFFF)
+
+static fs::path GetImagePath()
+{
+	return fs::absolute("./mcimage.ps2");
+}
+
+static void Write16(ByteArray& image, uint32 offset, uint16 value)
+{
+	memcpy(image.data() + offset, &value, sizeof(uint16));
+}
+
+static void Write32(ByteArray& image, uint32 offset, uint32 value)
+{
+	memcpy(image.data() + offset, &value, sizeof(uint32));
+}
+
+static void WriteDirEntry(ByteArray& image, uint32 offset, uint16 mode, uint32 length, const char* name)
+{
+	memset(image.data() + offset, 0, DIRENTRY_SIZE);
+	Write16(image, offset + 0x00, mode);
+	Write32(image, offset + 0x04, length);
+	strcpy(reinterpret_cast<char*>(image.data() + offset + 0x40), name);
+}
+
+static void FormatImage()
+{
+	ByteArray image(CLUSTER_COUNT * CLUSTER_SIZE, 0xFF);
+
+	memset(image.data(), 0, CLUSTER_SIZE);
+	memcpy(image.data(), "Sony PS2 Memory Card Format 1.2.0.0", 35);
+	Write16(image, 0x28, PAGE_SIZE);
+	Write16(image, 0x2A, PAGES_PER_CLUSTER);
+	Write16(image, 0x2C, PAGES_PER_BLOCK);
+	Write32(image, 0x30, CLUSTER_COUNT);
+	Write32(image, 0x34, ALLOC_OFFSET);
+	Write32(image, 0x38, ALLOC_END);
+	Write32(image, 0x3C, 0);
+	Write32(image, 0x50, IFC_CLUSTER);
+	for(uint32 i = 0; i < 32; i++)
+	{
+		Write32(image, 0xD0 + (i * 4), (i == 0) ? BAD_BLOCK : ~0U);
+	}
+
+	memset(image.data() + (IFC_CLUSTER * CLUSTER_SIZE), 0, CLUSTER_SIZE);
+	Write32(image, IFC_CLUSTER * CLUSTER_SIZE, FAT_CLUSTER);
+
+	for(uint32 i = 0; i < (CLUSTER_SIZE / 4); i++)
+	{
+		Write32(image, (FAT_CLUSTER * CLUSTER_SIZE) + (i * 4), (i == 0) ? FAT_CHAIN_END : FAT_ENTRY_FREE);
+	}
+
+	uint32 rootOffset = ALLOC_OFFSET * CLUSTER_SIZE;
+	WriteDirEntry(image, rootOffset, 0x8427, 2, ".");
+	WriteDirEntry(image, rootOffset + DIRENTRY_SIZE, 0xA426, 0, "..");
+
+	auto stream = Framework::CreateOutputStdStream(GetImagePath().native());
+	stream.Write(image.data(), image.size());
+}
+
+static ByteArray ReadImage()
+{
+	auto stream = Framework::CreateInputStdStream(GetImagePath().native());
+	ByteArray image(static_cast<size_t>(fs::file_size(GetImagePath())));
+	stream.Read(image.data(), image.size());
+	return image;
+}
+
+static ByteArray MakeContents(uint32 size, uint8 seed)
+{
+	ByteArray contents(size);
+	for(uint32 i = 0; i < size; i++)
+	{
+		contents[i] = static_cast<uint8>((i * 7) + seed);
+	}
+	return contents;
+}
+
+static Iop::CMcCardCache::RESULT WriteCacheFile(Iop::CMcCardCache& cache, const fs::path& path, const ByteArray& contents)
+{
+	std::unique_ptr<Iop::CMcCardCache::CFileStream> file;
+	auto result = cache.OpenFile(path, true, true, file);
+	if(result != Iop::CMcCardCache::RESULT_OK) return result;
+	if(file->Write(contents.data(), contents.size()) != contents.size()) return Iop::CMcCardCache::RESULT_FULL;
+	return Iop::CMcCardCache::RESULT_OK;
+}
+
+static ByteArray ReadCacheFile(Iop::CMcCardCache& cache, const fs::path& path)
+{
+	std::unique_ptr<Iop::CMcCardCache::CFileStream> file;
+	CHECK(cache.OpenFile(path, false, false, file) == Iop::CMcCardCache::RESULT_OK);
+	file->Seek(0, Framework::STREAM_SEEK_END);
+	ByteArray contents(static_cast<size_t>(file->Tell()));
+	file->Seek(0, Framework::STREAM_SEEK_SET);
+	CHECK(file->Read(contents.data(), contents.size()) == contents.size());
+	return contents;
+}
+
+static void TestRoundTrip()
+{
+	FormatImage();
+	auto imagePath = GetImagePath();
+	auto saveContents = MakeContents(3000, 1);
+	auto iconContents = MakeContents(CLUSTER_SIZE, 2);
+
+	{
+		Iop::CMcCardCache cache;
+		cache.SetBasePath(imagePath);
+		CHECK(cache.MakeDirectory(imagePath / "BESLES-00000") == Iop::CMcCardCache::RESULT_OK);
+		CHECK(WriteCacheFile(cache, imagePath / "BESLES-00000" / "SAVE", MakeContents(5000, 3)) == Iop::CMcCardCache::RESULT_OK);
+		CHECK(WriteCacheFile(cache, imagePath / "BESLES-00000" / "icon.sys", iconContents) == Iop::CMcCardCache::RESULT_OK);
+		//Overwrite with smaller contents
+		CHECK(WriteCacheFile(cache, imagePath / "BESLES-00000" / "SAVE", saveContents) == Iop::CMcCardCache::RESULT_OK);
+
+		//Model is rebuilt from the image
+		cache.Invalidate();
+		CHECK(ReadCacheFile(cache, imagePath / "BESLES-00000" / "SAVE") == saveContents);
+		CHECK(cache.Rename(imagePath / "BESLES-00000" / "icon.sys", imagePath / "ICON") == Iop::CMcCardCache::RESULT_OK);
+		cache.Flush();
+		CHECK(!cache.TakeJournalError());
+	}
+
+	{
+		Iop::CMcImageStorage storage(imagePath);
+		CHECK(storage.Mount());
+		CHECK(storage.ReadFile("BESLES-00000/SAVE") == saveContents);
+		CHECK(storage.ReadFile("ICON") == iconContents);
+		CHECK(storage.ReadDirectory("BESLES-00000").size() == 1);
+	}
+}
+
+static void TestCopyOnWrite()
+{
+	FormatImage();
+	auto imagePath = GetImagePath();
+	auto prevContents = MakeContents(CLUSTER_SIZE, 4);
+	auto contents = MakeContents(CLUSTER_SIZE, 5);
+
+	{
+		Iop::CMcImageStorage storage(imagePath);
+		CHECK(storage.Mount());
+		storage.WriteFile("SAVE", prevContents);
+		storage.Flush();
+		storage.WriteFile("SAVE", contents);
+		//Must not reuse the clusters freed above
+		storage.WriteFile("OTHER", MakeContents(CLUSTER_SIZE, 6));
+		storage.Flush();
+		CHECK(storage.ReadFile("SAVE") == contents);
+	}
+
+	//Previous contents are left intact, the image only stops referring to them
+	auto image = ReadImage();
+	CHECK(std::search(image.begin(), image.end(), prevContents.begin(), prevContents.end()) != image.end());
+}
+
+static void TestFull()
+{
+	FormatImage();
+	auto imagePath = GetImagePath();
+
+	Iop::CMcCardCache cache;
+	cache.SetBasePath(imagePath);
+
+	//Root directory needs a new cluster for the first entry
+	uint32 maxSize = (FREE_CLUSTER_COUNT - 1) * CLUSTER_SIZE;
+	{
+		std::unique_ptr<Iop::CMcCardCache::CFileStream> file;
+		CHECK(cache.OpenFile(imagePath / "BIG", true, true, file) == Iop::CMcCardCache::RESULT_OK);
+		auto contents = MakeContents(maxSize + 1, 7);
+		CHECK(file->Write(contents.data(), contents.size()) == 0);
+		CHECK(file->Write(contents.data(), maxSize) == maxSize);
+	}
+
+	CHECK(cache.MakeDirectory(imagePath / "DIR") == Iop::CMcCardCache::RESULT_FULL);
+	CHECK(cache.FindNode(imagePath / "DIR") == nullptr);
+	//Entry fits in the root directory's last cluster, but not its contents
+	CHECK(WriteCacheFile(cache, imagePath / "SMALL", MakeContents(1, 8)) == Iop::CMcCardCache::RESULT_FULL);
+
+	cache.Flush();
+	CHECK(!cache.TakeJournalError());
+
+	CHECK(cache.Remove(imagePath / "BIG") == Iop::CMcCardCache::RESULT_OK);
+	CHECK(WriteCacheFile(cache, imagePath / "SMALL", MakeContents(1, 8)) == Iop::CMcCardCache::RESULT_OK);
+	CHECK(cache.MakeDirectory(imagePath / "DIR") == Iop::CMcCardCache::RESULT_OK);
+	cache.Flush();
+	CHECK(!cache.TakeJournalError());
+
+	//Nothing was written to the bad block
+	auto image = ReadImage();
+	auto badBlockBegin = image.begin() + (BAD_BLOCK * CLUSTERS_PER_BLOCK * CLUSTER_SIZE);
+	auto badBlockEnd = badBlockBegin + (CLUSTERS_PER_BLOCK * CLUSTER_SIZE);
+	CHECK(std::all_of(badBlockBegin, badBlockEnd, [](uint8 value) { return value == 0xFF; }));
+}
+
+static void TestInvalidName()
+{
+	FormatImage();
+	auto imagePath = GetImagePath();
+
+	Iop::CMcCardCache cache;
+	cache.SetBasePath(imagePath);
+
+	std::string longName(Iop::CMcCardCache::MAX_NAME_SIZE, 'A');
+	std::string name(Iop::CMcCardCache::MAX_NAME_SIZE - 1, 'A');
+	CHECK(WriteCacheFile(cache, imagePath / longName, MakeContents(1, 9)) == Iop::CMcCardCache::RESULT_INVALID_NAME);
+	CHECK(cache.MakeDirectory(imagePath / longName) == Iop::CMcCardCache::RESULT_INVALID_NAME);
+	CHECK(cache.MakeDirectory(imagePath / name) == Iop::CMcCardCache::RESULT_OK);
+	CHECK(cache.Rename(imagePath / name, imagePath / longName) == Iop::CMcCardCache::RESULT_INVALID_NAME);
+	cache.Flush();
+	CHECK(!cache.TakeJournalError());
+}
+
+void ExecuteMcImageStorageTests()
+{
+	TestRoundTrip();
+	TestCopyOnWrite();
+	TestFull();
+	TestInvalidName();
+	fs::remove(GetImagePath());
+}
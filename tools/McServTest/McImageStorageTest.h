@@ -0,0 +1,5 @@
+#pragma once
+
+//Checks that contents written to a memory card image through the memory card cache
+//can be read back, and that the card's free space and bad blocks are respected
+void ExecuteMcImageStorageTests();
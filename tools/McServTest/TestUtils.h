@@ -0,0 +1,9 @@
+#pragma once
+
+#include <exception>
+
+#define CHECK(condition)        \
+	if(!(condition))            \
+	{                           \
+		throw std::exception(); \
+	}
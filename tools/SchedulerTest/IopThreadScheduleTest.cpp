@@ -0,0 +1,203 @@
+#include "IopThreadScheduleTest.h"
+#include "iop/IopBios.h"
+#include "iop/Iop_SubSystem.h"
+
+void CIopThreadScheduleTest::Execute()
+{
+	CheckReadyOrder();
+	CheckManyThreads();
+	CheckRotation();
+	CheckPriorityChange();
+	CheckDelayedThreads();
+}
+
+void CIopThreadScheduleTest::CheckReadyOrder()
+{
+	Iop::CSubSystem subSystem(true);
+	auto bios = PrepareBios(subSystem);
+
+	uint32 thread0 = StartThread(bios, 20);
+	uint32 thread1 = StartThread(bios, 10);
+	uint32 thread2 = StartThread(bios, 20);
+	uint32 thread3 = StartThread(bios, 10);
+	uint32 thread4 = StartThread(bios, 30);
+
+	//Threads are ordered by priority, then by the order they were linked in
+	ThreadIdArray expectedOrder = {thread1, thread3, thread0, thread2, thread4};
+	TEST_VERIFY(GetLinkedThreads(bios, thread1) == expectedOrder);
+	TEST_VERIFY(RunReadyThreads(bios) == expectedOrder);
+}
+
+void CIopThreadScheduleTest::CheckManyThreads()
+{
+	static const uint32 threadCount = 100;
+
+	Iop::CSubSystem subSystem(true);
+	auto bios = PrepareBios(subSystem);
+
+	ThreadIdArray threadIds;
+	for(uint32 i = 0; i < threadCount; i++)
+	{
+		threadIds.push_back(StartThread(bios, ((i * 37) % 126) + 1));
+	}
+
+	auto readyOrder = RunReadyThreads(bios);
+	TEST_VERIFY(readyOrder.size() == threadCount);
+	for(uint32 i = 1; i < threadCount; i++)
+	{
+		auto prevThread = bios->GetThread(readyOrder[i - 1]);
+		auto thread = bios->GetThread(readyOrder[i]);
+		TEST_VERIFY(prevThread->priority <= thread->priority);
+		if(prevThread->priority == thread->priority)
+		{
+			//Threads were created and started in increasing id order
+			TEST_VERIFY(prevThread->id < thread->id);
+		}
+	}
+}
+
+void CIopThreadScheduleTest::CheckRotation()
+{
+	Iop::CSubSystem subSystem(true);
+	auto bios = PrepareBios(subSystem);
+
+	uint32 thread0 = StartThread(bios, 10);
+	uint32 thread1 = StartThread(bios, 10);
+	uint32 thread2 = StartThread(bios, 10);
+	uint32 thread3 = StartThread(bios, 20);
+
+	bios->Reschedule();
+	TEST_VERIFY(bios->GetCurrentThreadIdRaw() == thread0);
+
+	//First thread of that priority goes after the other threads of the same priority
+	bios->RotateThreadReadyQueue(10);
+	TEST_VERIFY(GetLinkedThreads(bios, thread1) == ThreadIdArray({thread1, thread2, thread0, thread3}));
+	bios->Reschedule();
+	TEST_VERIFY(bios->GetCurrentThreadIdRaw() == thread1);
+
+	//Priority 0 rotates the current thread's priority
+	bios->RotateThreadReadyQueue(0);
+	TEST_VERIFY(GetLinkedThreads(bios, thread2) == ThreadIdArray({thread2, thread0, thread1, thread3}));
+	bios->Reschedule();
+	TEST_VERIFY(bios->GetCurrentThreadIdRaw() == thread2);
+
+	//Rotating a priority with a single thread or no threads doesn't change anything
+	bios->RotateThreadReadyQueue(20);
+	bios->RotateThreadReadyQueue(50);
+	TEST_VERIFY(GetLinkedThreads(bios, thread2) == ThreadIdArray({thread2, thread0, thread1, thread3}));
+
+	TEST_VERIFY(RunReadyThreads(bios) == ThreadIdArray({thread2, thread0, thread1, thread3}));
+}
+
+void CIopThreadScheduleTest::CheckPriorityChange()
+{
+	Iop::CSubSystem subSystem(true);
+	auto bios = PrepareBios(subSystem);
+
+	uint32 thread0 = StartThread(bios, 10);
+	uint32 thread1 = StartThread(bios, 20);
+	uint32 thread2 = StartThread(bios, 20);
+
+	//Thread is moved after the threads of its new priority
+	bios->ChangeThreadPriority(thread0, 20);
+	TEST_VERIFY(GetLinkedThreads(bios, thread1) == ThreadIdArray({thread1, thread2, thread0}));
+
+	bios->ChangeThreadPriority(thread2, 5);
+	TEST_VERIFY(GetLinkedThreads(bios, thread2) == ThreadIdArray({thread2, thread1, thread0}));
+
+	TEST_VERIFY(RunReadyThreads(bios) == ThreadIdArray({thread2, thread1, thread0}));
+}
+
+void CIopThreadScheduleTest::CheckDelayedThreads()
+{
+	static const uint32 delayTime = 1000;
+
+	Iop::CSubSystem subSystem(true);
+	auto bios = PrepareBios(subSystem);
+
+	uint32 thread0 = StartThread(bios, 10);
+	uint32 thread1 = StartThread(bios, 20);
+	TEST_VERIFY(bios->GetTicksUntilNextEvent() == 0);
+
+	bios->Reschedule();
+	TEST_VERIFY(bios->GetCurrentThreadIdRaw() == thread0);
+
+	//Delayed thread stays linked, but other threads run before it
+	bios->DelayThread(delayTime);
+	TEST_VERIFY(GetLinkedThreads(bios, thread0) == ThreadIdArray({thread0, thread1}));
+	bios->Reschedule();
+	TEST_VERIFY(bios->GetCurrentThreadIdRaw() == thread1);
+	TEST_VERIFY(bios->GetTicksUntilNextEvent() == 0);
+
+	//Only the delayed thread is left, nothing happens until it's ready
+	bios->SleepThread();
+	bios->Reschedule();
+	TEST_VERIFY(bios->GetCurrentThreadIdRaw() == -1);
+
+	uint32 delayTicks = static_cast<uint32>(bios->MicroSecToClock(delayTime));
+	uint32 ticksUntilReady = bios->GetTicksUntilNextEvent();
+	TEST_VERIFY(ticksUntilReady != 0);
+	TEST_VERIFY(ticksUntilReady <= (delayTicks + 1));
+
+	//Other events might come before the thread is ready
+	uint32 elapsedTicks = 0;
+	while(uint32 ticks = bios->GetTicksUntilNextEvent())
+	{
+		bios->CountTicks(ticks);
+		elapsedTicks += ticks;
+		TEST_VERIFY(elapsedTicks <= (delayTicks + 1));
+	}
+	TEST_VERIFY(RunReadyThreads(bios) == ThreadIdArray({thread0}));
+}
+
+//Resets the BIOS and puts its own threads to sleep, leaving an empty thread list
+CIopBios* CIopThreadScheduleTest::PrepareBios(Iop::CSubSystem& subSystem)
+{
+	subSystem.Reset();
+	auto bios = static_cast<CIopBios*>(subSystem.m_bios.get());
+	bios->Reset(std::shared_ptr<Iop::CSifMan>());
+	RunReadyThreads(bios);
+	return bios;
+}
+
+uint32 CIopThreadScheduleTest::StartThread(CIopBios* bios, uint32 priority)
+{
+	static const uint32 threadProc = 0x10000;
+	static const uint32 stackSize = 0x400;
+
+	uint32 threadId = bios->CreateThread(threadProc, priority, stackSize, 0, 0);
+	TEST_VERIFY(static_cast<int32>(threadId) > 0);
+	TEST_VERIFY(bios->StartThread(threadId, 0) == 0);
+	return threadId;
+}
+
+//Walks the guest's thread list from the specified thread
+CIopThreadScheduleTest::ThreadIdArray CIopThreadScheduleTest::GetLinkedThreads(CIopBios* bios, uint32 threadId)
+{
+	//Guards against cycles, BIOS can't have more threads than this
+	static const uint32 maxThreadCount = 128;
+
+	ThreadIdArray result;
+	while(threadId != 0)
+	{
+		result.push_back(threadId);
+		TEST_VERIFY(result.size() <= maxThreadCount);
+		threadId = bios->GetThread(threadId)->nextThreadId;
+	}
+	return result;
+}
+
+//Runs threads that are ready and puts them to sleep, returning them in the order they ran in
+CIopThreadScheduleTest::ThreadIdArray CIopThreadScheduleTest::RunReadyThreads(CIopBios* bios)
+{
+	ThreadIdArray result;
+	while(1)
+	{
+		bios->Reschedule();
+		int32 threadId = bios->GetCurrentThreadIdRaw();
+		if(threadId == -1) break;
+		result.push_back(threadId);
+		bios->SleepThread();
+	}
+	return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include "Test.h"
+#include "Types.h"
+
+class CIopBios;
+
+namespace Iop
+{
+	class CSubSystem;
+}
+
+class CIopThreadScheduleTest : public CTest
+{
+public:
+	void Execute() override;
+
+private:
+	typedef std::vector<uint32> ThreadIdArray;
+
+	void CheckReadyOrder();
+	void CheckManyThreads();
+	void CheckRotation();
+	void CheckPriorityChange();
+	void CheckDelayedThreads();
+
+	static CIopBios* PrepareBios(Iop::CSubSystem&);
+	static uint32 StartThread(CIopBios*, uint32);
+	static ThreadIdArray GetLinkedThreads(CIopBios*, uint32);
+	static ThreadIdArray RunReadyThreads(CIopBios*);
+};
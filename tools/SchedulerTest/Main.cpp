@@ -0,0 +1,24 @@
+#include <functional>
+#include "IopThreadScheduleTest.h"
+#include "SliceTicksTest.h"
+
+typedef std::function<CTest*()> TestFactoryFunction;
+
+// clang-format off
+static const TestFactoryFunction s_factories[] =
+{
+	[]() { return new CSliceTicksTest(); },
+	[]() { return new CIopThreadScheduleTest(); },
+};
+// clang-format on
+
+int main(int argc, const char** argv)
+{
+	for(const auto& factory : s_factories)
+	{
+		auto test = factory();
+		test->Execute();
+		delete test;
+	}
+	return 0;
+}
@@ -0,0 +1,126 @@
+#include "SliceTicksTest.h"
+#include "PS2VM.h"
+
+void CSliceTicksTest::Execute()
+{
+	CheckBusy();
+	CheckIdle();
+	CheckDmaStalled();
+	CheckVuRunning();
+	CheckIopThreadIdleLoop();
+	CheckIopThreadMode();
+}
+
+void CSliceTicksTest::CheckBusy()
+{
+	//Busy CPUs run for a busy slice
+	{
+		CPS2VM::SLICE_STATE state;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == CPS2VM::MAX_BUSY_SLICE_TICKS);
+	}
+
+	//Unless an event comes before
+	{
+		CPS2VM::SLICE_STATE state;
+		state.nextEventTicks = 1000;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == 1000);
+	}
+
+	//Slices are aligned on IOP ticks and are never empty
+	{
+		CPS2VM::SLICE_STATE state;
+		state.nextEventTicks = 1003;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == 1000);
+		state.nextEventTicks = 0;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == CPS2VM::IOP_TICK_RATIO);
+	}
+}
+
+void CSliceTicksTest::CheckIdle()
+{
+	//Idle CPUs skip to the earliest of their wake up times (IOP ticks are converted to EE ticks)
+	{
+		CPS2VM::SLICE_STATE state;
+		state.cpusIdle = true;
+		state.eeWakeUpTicks = 100000;
+		state.iopWakeUpTicks = 10000;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == 10000 * CPS2VM::IOP_TICK_RATIO);
+		state.eeWakeUpTicks = 50000;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == 50000);
+	}
+
+	//Or to the next event
+	{
+		CPS2VM::SLICE_STATE state;
+		state.cpusIdle = true;
+		state.nextEventTicks = 20000;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == 20000);
+	}
+
+	//Idle slices have a maximum length
+	{
+		CPS2VM::SLICE_STATE state;
+		state.cpusIdle = true;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == CPS2VM::MAX_IDLE_SLICE_TICKS);
+	}
+
+	//Idle slices are never shorter than busy slices, unless an event comes before
+	{
+		CPS2VM::SLICE_STATE state;
+		state.cpusIdle = true;
+		state.eeWakeUpTicks = 100;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == CPS2VM::MAX_BUSY_SLICE_TICKS);
+		state.nextEventTicks = 200;
+		TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == 200);
+	}
+}
+
+void CSliceTicksTest::CheckDmaStalled()
+{
+	//EE reports it can wake up right away while a DMA transfer can be resumed
+	CPS2VM::SLICE_STATE state;
+	state.cpusIdle = true;
+	state.eeWakeUpTicks = 0;
+	state.iopWakeUpTicks = 10000;
+	TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == CPS2VM::MAX_BUSY_SLICE_TICKS);
+}
+
+void CSliceTicksTest::CheckVuRunning()
+{
+	//EE reports it can wake up right away while a VU is running
+	CPS2VM::SLICE_STATE state;
+	state.cpusIdle = true;
+	state.eeWakeUpTicks = 0;
+	state.nextEventTicks = 100000;
+	TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == CPS2VM::MAX_BUSY_SLICE_TICKS);
+}
+
+void CSliceTicksTest::CheckIopThreadIdleLoop()
+{
+	//IOP reports it can wake up right away while a thread is ready, even if it's
+	//the running thread that was caught in an idle loop
+	CPS2VM::SLICE_STATE state;
+	state.cpusIdle = true;
+	state.eeWakeUpTicks = 100000;
+	state.iopWakeUpTicks = 0;
+	TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == CPS2VM::MAX_BUSY_SLICE_TICKS);
+}
+
+void CSliceTicksTest::CheckIopThreadMode()
+{
+	//IOP thread windows are used as busy slices, they shouldn't be shortened by idle CPUs
+	static const uint32 windowTicks = 800;
+
+	CPS2VM::SLICE_STATE state;
+	state.busySliceTicks = windowTicks;
+	TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == windowTicks);
+
+	state.cpusIdle = true;
+	state.eeWakeUpTicks = 0;
+	state.iopWakeUpTicks = 0;
+	TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == windowTicks);
+
+	state.eeWakeUpTicks = 100000;
+	state.iopWakeUpTicks = 10000;
+	TEST_VERIFY(CPS2VM::ComputeSliceTicks(state) == 10000 * CPS2VM::IOP_TICK_RATIO);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Test.h"
+
+class CSliceTicksTest : public CTest
+{
+public:
+	void Execute() override;
+
+private:
+	void CheckBusy();
+	void CheckIdle();
+	void CheckDmaStalled();
+	void CheckVuRunning();
+	void CheckIopThreadIdleLoop();
+	void CheckIopThreadMode();
+};